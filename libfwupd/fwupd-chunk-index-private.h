@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2021 Richard Hughes <richard@hughsie.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1+
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * FwupdChunkIndexFetchFunc:
+ * @offset: the offset into the new file
+ * @length: the number of bytes required
+ * @user_data: user data
+ * @error: a #GError
+ *
+ * Gets a range of the new file, typically using a HTTP range request.
+ *
+ * Returns: (transfer full): exactly @length bytes, or %NULL for error
+ **/
+typedef GBytes	*(*FwupdChunkIndexFetchFunc)			(gsize		 offset,
+								 gsize		 length,
+								 gpointer	 user_data,
+								 GError		**error);
+
+GArray		*fwupd_chunk_index_split			(GBytes		*blob);
+gchar		*fwupd_chunk_index_build			(GBytes		*blob);
+GBytes		*fwupd_chunk_index_rebuild			(GBytes		*index,
+								 GBytes		*blob_old,
+								 FwupdChunkIndexFetchFunc fetch_func,
+								 gpointer	 user_data,
+								 GError		**error)
+								 G_GNUC_WARN_UNUSED_RESULT;
+
+G_END_DECLS
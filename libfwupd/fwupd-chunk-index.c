@@ -0,0 +1,350 @@
+/*
+ * Copyright (C) 2021 Richard Hughes <richard@hughsie.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1+
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "fwupd-chunk-index-private.h"
+#include "fwupd-error.h"
+
+/*
+ * A chunk index describes a file as a list of content-defined chunks so that
+ * a client holding an older copy only has to download the chunks that have
+ * changed. The chunk boundaries are found using a gear rolling hash, and so an
+ * insertion or deletion only changes the chunks either side of the edit.
+ *
+ * The index is a text file with a header line, then the size and SHA256 of
+ * the entire file, then the size and SHA256 of each chunk in order, e.g.
+ *
+ *   # fwupd-chunk-index 1
+ *   98765 0c39bd…
+ *   40123 2f8ab2…
+ *   58642 a0b1c3…
+ *
+ * The file itself has to be uncompressed, or compressed in a way that resets
+ * the compressor regularly, e.g. `gzip --rsyncable`.
+ */
+
+#define FWUPD_CHUNK_INDEX_HEADER	"# fwupd-chunk-index 1"
+#define FWUPD_CHUNK_INDEX_SIZE_MIN	0x2000
+#define FWUPD_CHUNK_INDEX_SIZE_MAX	0x20000
+#define FWUPD_CHUNK_INDEX_HASH_MASK	0x7fff		/* ~32kB average */
+
+/* give up and download everything when more than 3/4 has changed */
+#define FWUPD_CHUNK_INDEX_FETCH_MAX_PCT	75
+
+typedef struct {
+	gsize		 offset;
+	gsize		 size;
+	gchar		*checksum;
+} FwupdChunkIndexItem;
+
+typedef struct {
+	gsize		 offset;
+	gsize		 size;
+} FwupdChunkIndexRange;
+
+static void
+fwupd_chunk_index_item_free (FwupdChunkIndexItem *item)
+{
+	g_free (item->checksum);
+	g_free (item);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(FwupdChunkIndexItem, fwupd_chunk_index_item_free)
+
+/* a fixed pseudo-random table, which has to match the one used on the server */
+static const guint32 *
+fwupd_chunk_index_get_gear (void)
+{
+	static guint32 gear[256] = { 0x0 };
+	static gsize gear_init = 0;
+	if (g_once_init_enter (&gear_init)) {
+		guint32 val = 0x2545f491;
+		for (guint i = 0; i < G_N_ELEMENTS(gear); i++) {
+			val ^= val << 13;
+			val ^= val >> 17;
+			val ^= val << 5;
+			gear[i] = val;
+		}
+		g_once_init_leave (&gear_init, 1);
+	}
+	return gear;
+}
+
+/**
+ * fwupd_chunk_index_split:
+ * @blob: a #GBytes
+ *
+ * Splits the data into content-defined chunks.
+ *
+ * Returns: (transfer container) (element-type gsize): the size of each chunk
+ **/
+GArray *
+fwupd_chunk_index_split (GBytes *blob)
+{
+	const guint32 *gear = fwupd_chunk_index_get_gear ();
+	gsize bufsz = 0;
+	gsize start = 0;
+	guint32 hash = 0;
+	const guint8 *buf = g_bytes_get_data (blob, &bufsz);
+	GArray *sizes = g_array_new (FALSE, FALSE, sizeof(gsize));
+
+	for (gsize i = 0; i < bufsz; i++) {
+		gsize size = i + 1 - start;
+		hash = (hash << 1) + gear[buf[i]];
+		if (size < FWUPD_CHUNK_INDEX_SIZE_MIN)
+			continue;
+		if ((hash & FWUPD_CHUNK_INDEX_HASH_MASK) == 0 ||
+		    size >= FWUPD_CHUNK_INDEX_SIZE_MAX) {
+			g_array_append_val (sizes, size);
+			start = i + 1;
+			hash = 0;
+		}
+	}
+	if (start < bufsz) {
+		gsize size = bufsz - start;
+		g_array_append_val (sizes, size);
+	}
+	return sizes;
+}
+
+/**
+ * fwupd_chunk_index_build:
+ * @blob: a #GBytes
+ *
+ * Builds the chunk index for the data, which would typically be published
+ * next to the file on the server.
+ *
+ * Returns: (transfer full): the chunk index
+ **/
+gchar *
+fwupd_chunk_index_build (GBytes *blob)
+{
+	gsize bufsz = 0;
+	gsize offset = 0;
+	const guint8 *buf = g_bytes_get_data (blob, &bufsz);
+	g_autofree gchar *checksum = NULL;
+	g_autoptr(GArray) sizes = fwupd_chunk_index_split (blob);
+	g_autoptr(GString) str = g_string_new (FWUPD_CHUNK_INDEX_HEADER "\n");
+
+	checksum = g_compute_checksum_for_data (G_CHECKSUM_SHA256, buf, bufsz);
+	g_string_append_printf (str, "%" G_GSIZE_FORMAT " %s\n", bufsz, checksum);
+	for (guint i = 0; i < sizes->len; i++) {
+		gsize size = g_array_index (sizes, gsize, i);
+		g_autofree gchar *checksum_chunk = NULL;
+		checksum_chunk = g_compute_checksum_for_data (G_CHECKSUM_SHA256,
+							      buf + offset, size);
+		g_string_append_printf (str, "%" G_GSIZE_FORMAT " %s\n",
+					size, checksum_chunk);
+		offset += size;
+	}
+	return g_string_free (g_steal_pointer (&str), FALSE);
+}
+
+static FwupdChunkIndexItem *
+fwupd_chunk_index_parse_line (const gchar *line, GError **error)
+{
+	guint64 size = 0;
+	g_auto(GStrv) split = g_strsplit (line, " ", -1);
+	g_autoptr(FwupdChunkIndexItem) item = g_new0 (FwupdChunkIndexItem, 1);
+
+	if (g_strv_length (split) != 2 || strlen (split[1]) != 64) {
+		g_set_error (error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_INVALID_FILE,
+			     "invalid chunk index line: %s", line);
+		return NULL;
+	}
+	if (!g_ascii_string_to_unsigned (split[0], 10, 1, G_MAXSIZE, &size, error))
+		return NULL;
+	item->size = size;
+	item->checksum = g_strdup (split[1]);
+	return g_steal_pointer (&item);
+}
+
+/* the first item is the entire file */
+static GPtrArray *
+fwupd_chunk_index_parse (GBytes *index, GError **error)
+{
+	gsize offset = 0;
+	g_autofree gchar *str = g_strndup (g_bytes_get_data (index, NULL),
+					   g_bytes_get_size (index));
+	g_auto(GStrv) lines = g_strsplit (str, "\n", -1);
+	g_autoptr(GPtrArray) items = NULL;
+
+	if (g_strcmp0 (lines[0], FWUPD_CHUNK_INDEX_HEADER) != 0) {
+		g_set_error_literal (error,
+				     FWUPD_ERROR,
+				     FWUPD_ERROR_INVALID_FILE,
+				     "chunk index header invalid");
+		return NULL;
+	}
+	items = g_ptr_array_new_with_free_func ((GDestroyNotify) fwupd_chunk_index_item_free);
+	for (guint i = 1; lines[i] != NULL; i++) {
+		FwupdChunkIndexItem *item;
+		if (lines[i][0] == '\0')
+			continue;
+		item = fwupd_chunk_index_parse_line (lines[i], error);
+		if (item == NULL)
+			return NULL;
+		g_ptr_array_add (items, item);
+		if (items->len == 1)
+			continue;
+		if (item->size > FWUPD_CHUNK_INDEX_SIZE_MAX) {
+			g_set_error (error,
+				     FWUPD_ERROR,
+				     FWUPD_ERROR_INVALID_FILE,
+				     "chunk size 0x%x too large",
+				     (guint) item->size);
+			return NULL;
+		}
+		item->offset = offset;
+		offset += item->size;
+	}
+	if (items->len < 2) {
+		g_set_error_literal (error,
+				     FWUPD_ERROR,
+				     FWUPD_ERROR_INVALID_FILE,
+				     "chunk index has no chunks");
+		return NULL;
+	}
+	if (offset != ((FwupdChunkIndexItem *) g_ptr_array_index (items, 0))->size) {
+		g_set_error (error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_INVALID_FILE,
+			     "chunk sizes add up to 0x%x, expected 0x%x",
+			     (guint) offset,
+			     (guint) ((FwupdChunkIndexItem *) g_ptr_array_index (items, 0))->size);
+		return NULL;
+	}
+	return g_steal_pointer (&items);
+}
+
+/**
+ * fwupd_chunk_index_rebuild:
+ * @index: the chunk index of the new file
+ * @blob_old: the old file
+ * @fetch_func: (scope call): a #FwupdChunkIndexFetchFunc
+ * @user_data: user data to pass to @fetch_func
+ * @error: the #GError, or %NULL
+ *
+ * Rebuilds the new file using the chunks that are the same as in @blob_old,
+ * and using @fetch_func for each contiguous run of chunks that are not.
+ *
+ * The result is only returned if the SHA256 matches the one in @index.
+ *
+ * Returns: (transfer full): the new file, or %NULL for error
+ **/
+GBytes *
+fwupd_chunk_index_rebuild (GBytes *index,
+			   GBytes *blob_old,
+			   FwupdChunkIndexFetchFunc fetch_func,
+			   gpointer user_data,
+			   GError **error)
+{
+	FwupdChunkIndexItem *item_file;
+	gsize bufsz_old = 0;
+	gsize fetch_sz = 0;
+	gsize offset_old = 0;
+	const guint8 *buf_old = g_bytes_get_data (blob_old, &bufsz_old);
+	g_autofree gchar *checksum = NULL;
+	g_autofree guint8 *buf = NULL;
+	g_autoptr(GArray) ranges = g_array_new (FALSE, FALSE, sizeof(FwupdChunkIndexRange));
+	g_autoptr(GArray) sizes_old = NULL;
+	g_autoptr(GHashTable) chunks_old = NULL;
+	g_autoptr(GPtrArray) items = NULL;
+
+	g_return_val_if_fail (index != NULL, NULL);
+	g_return_val_if_fail (blob_old != NULL, NULL);
+	g_return_val_if_fail (fetch_func != NULL, NULL);
+	g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+	items = fwupd_chunk_index_parse (index, error);
+	if (items == NULL)
+		return NULL;
+	item_file = g_ptr_array_index (items, 0);
+
+	/* the offset of each chunk in the old file */
+	chunks_old = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	sizes_old = fwupd_chunk_index_split (blob_old);
+	for (guint i = 0; i < sizes_old->len; i++) {
+		gsize size = g_array_index (sizes_old, gsize, i);
+		gchar *checksum_old = g_compute_checksum_for_data (G_CHECKSUM_SHA256,
+								   buf_old + offset_old,
+								   size);
+		g_hash_table_insert (chunks_old, checksum_old, GSIZE_TO_POINTER (offset_old));
+		offset_old += size;
+	}
+
+	/* copy what we can, and merge the rest into ranges */
+	buf = g_malloc0 (item_file->size);
+	for (guint i = 1; i < items->len; i++) {
+		FwupdChunkIndexItem *item = g_ptr_array_index (items, i);
+		FwupdChunkIndexRange range = { item->offset, item->size };
+		gpointer value = NULL;
+		if (g_hash_table_lookup_extended (chunks_old, item->checksum, NULL, &value)) {
+			gsize offset = GPOINTER_TO_SIZE (value);
+			if (offset + item->size <= bufsz_old) {
+				memcpy (buf + item->offset, buf_old + offset, item->size);
+				continue;
+			}
+		}
+		fetch_sz += item->size;
+		if (ranges->len > 0) {
+			FwupdChunkIndexRange *range_last;
+			range_last = &g_array_index (ranges, FwupdChunkIndexRange, ranges->len - 1);
+			if (range_last->offset + range_last->size == item->offset) {
+				range_last->size += item->size;
+				continue;
+			}
+		}
+		g_array_append_val (ranges, range);
+	}
+	if (fetch_sz * 100 > item_file->size * FWUPD_CHUNK_INDEX_FETCH_MAX_PCT) {
+		g_set_error (error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_NOT_SUPPORTED,
+			     "0x%x of 0x%x bytes changed, not worth it",
+			     (guint) fetch_sz, (guint) item_file->size);
+		return NULL;
+	}
+	g_debug ("fetching 0x%x of 0x%x bytes in %u ranges",
+		 (guint) fetch_sz, (guint) item_file->size, ranges->len);
+
+	/* get the changed chunks */
+	for (guint i = 0; i < ranges->len; i++) {
+		FwupdChunkIndexRange *range = &g_array_index (ranges, FwupdChunkIndexRange, i);
+		g_autoptr(GBytes) blob = NULL;
+		blob = fetch_func (range->offset, range->size, user_data, error);
+		if (blob == NULL)
+			return NULL;
+		if (g_bytes_get_size (blob) != range->size) {
+			g_set_error (error,
+				     FWUPD_ERROR,
+				     FWUPD_ERROR_INVALID_FILE,
+				     "range @0x%x was 0x%x bytes, expected 0x%x",
+				     (guint) range->offset,
+				     (guint) g_bytes_get_size (blob),
+				     (guint) range->size);
+			return NULL;
+		}
+		memcpy (buf + range->offset, g_bytes_get_data (blob, NULL), range->size);
+	}
+
+	/* check it is what we expected */
+	checksum = g_compute_checksum_for_data (G_CHECKSUM_SHA256, buf, item_file->size);
+	if (g_strcmp0 (checksum, item_file->checksum) != 0) {
+		g_set_error (error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_INVALID_FILE,
+			     "rebuilt checksum %s did not match %s",
+			     checksum, item_file->checksum);
+		return NULL;
+	}
+	return g_bytes_new_take (g_steal_pointer (&buf), item_file->size);
+}
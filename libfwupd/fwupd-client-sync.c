@@ -154,6 +154,59 @@ fwupd_client_get_devices (FwupdClient *self, GCancellable *cancellable, GError *
 	return g_steal_pointer (&helper->array);
 }
 
+static void
+fwupd_client_get_devices_with_releases_cb (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+	FwupdClientHelper *helper = (FwupdClientHelper *) user_data;
+	helper->array = fwupd_client_get_devices_with_releases_finish (FWUPD_CLIENT (source),
+								       res, &helper->error);
+	g_main_loop_quit (helper->loop);
+}
+
+/**
+ * fwupd_client_get_devices_with_releases:
+ * @self: A #FwupdClient
+ * @kind: A #FwupdReleaseKind, e.g. %FWUPD_RELEASE_KIND_UPGRADES
+ * @cancellable: the #GCancellable, or %NULL
+ * @error: the #GError, or %NULL
+ *
+ * Gets all the devices registered with the daemon, each with the releases of
+ * the requested kind added using fwupd_device_add_release().
+ *
+ * Returns: (element-type FwupdDevice) (transfer container): results
+ *
+ * Since: 1.6.0
+ **/
+GPtrArray *
+fwupd_client_get_devices_with_releases (FwupdClient *self,
+					FwupdReleaseKind kind,
+					GCancellable *cancellable,
+					GError **error)
+{
+	g_autoptr(FwupdClientHelper) helper = NULL;
+
+	g_return_val_if_fail (FWUPD_IS_CLIENT (self), NULL);
+	g_return_val_if_fail (kind < FWUPD_RELEASE_KIND_LAST, NULL);
+	g_return_val_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable), NULL);
+	g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+	/* connect */
+	if (!fwupd_client_connect (self, cancellable, error))
+		return NULL;
+
+	/* call async version and run loop until complete */
+	helper = fwupd_client_helper_new (self);
+	fwupd_client_get_devices_with_releases_async (self, kind, cancellable,
+						      fwupd_client_get_devices_with_releases_cb,
+						      helper);
+	g_main_loop_run (helper->loop);
+	if (helper->array == NULL) {
+		g_propagate_error (error, g_steal_pointer (&helper->error));
+		return NULL;
+	}
+	return g_steal_pointer (&helper->array);
+}
+
 static void
 fwupd_client_get_plugins_cb (GObject *source, GAsyncResult *res, gpointer user_data)
 {
@@ -1487,6 +1540,54 @@ fwupd_client_modify_remote (FwupdClient *self,
 	return TRUE;
 }
 
+static void
+fwupd_client_get_metrics_cb (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+	FwupdClientHelper *helper = (FwupdClientHelper *) user_data;
+	helper->hash = fwupd_client_get_metrics_finish (FWUPD_CLIENT (source), res, &helper->error);
+	g_main_loop_quit (helper->loop);
+}
+
+/**
+ * fwupd_client_get_metrics:
+ * @self: A #FwupdClient
+ * @cancellable: the #GCancellable, or %NULL
+ * @error: the #GError, or %NULL
+ *
+ * Gets the counters and latency histograms recorded by the daemon.
+ *
+ * Returns: (transfer container) (element-type utf8 utf8): metrics
+ *
+ * Since: 1.6.0
+ **/
+GHashTable *
+fwupd_client_get_metrics (FwupdClient *self,
+			  GCancellable *cancellable,
+			  GError **error)
+{
+	g_autoptr(FwupdClientHelper) helper = NULL;
+
+	g_return_val_if_fail (FWUPD_IS_CLIENT (self), NULL);
+	g_return_val_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable), NULL);
+	g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+	/* connect */
+	if (!fwupd_client_connect (self, cancellable, error))
+		return NULL;
+
+	/* call async version and run loop until complete */
+	helper = fwupd_client_helper_new (self);
+	fwupd_client_get_metrics_async (self, cancellable,
+					fwupd_client_get_metrics_cb,
+					helper);
+	g_main_loop_run (helper->loop);
+	if (helper->hash == NULL) {
+		g_propagate_error (error, g_steal_pointer (&helper->error));
+		return NULL;
+	}
+	return g_steal_pointer (&helper->hash);
+}
+
 static void
 fwupd_client_get_report_metadata_cb (GObject *source, GAsyncResult *res, gpointer user_data)
 {
@@ -168,6 +168,15 @@ GHashTable	*fwupd_client_get_report_metadata	(FwupdClient	*self,
 							 GCancellable	*cancellable,
 							 GError		**error)
 							 G_GNUC_WARN_UNUSED_RESULT;
+GHashTable	*fwupd_client_get_metrics		(FwupdClient	*self,
+							 GCancellable	*cancellable,
+							 GError		**error)
+							 G_GNUC_WARN_UNUSED_RESULT;
+GPtrArray	*fwupd_client_get_devices_with_releases	(FwupdClient	*self,
+							 FwupdReleaseKind kind,
+							 GCancellable	*cancellable,
+							 GError		**error)
+							 G_GNUC_WARN_UNUSED_RESULT;
 GPtrArray	*fwupd_client_get_remotes		(FwupdClient	*self,
 							 GCancellable	*cancellable,
 							 GError		**error)
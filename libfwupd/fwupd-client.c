@@ -15,12 +15,14 @@
 #ifdef HAVE_GIO_UNIX
 #include <gio/gunixfdlist.h>
 #endif
+#include <jcat.h>
 
 #include <fcntl.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include "fwupd-chunk-index-private.h"
 #include "fwupd-client-private.h"
 #include "fwupd-client-sync.h"
 #include "fwupd-common-private.h"
@@ -45,6 +47,12 @@ typedef GObject		*(*FwupdClientObjectNewFunc)	(void);
  */
 
 static void fwupd_client_finalize	 (GObject *object);
+static void fwupd_client_download_metadata_async (FwupdClient *self,
+						  FwupdRemote *remote,
+						  GBytes *signature,
+						  GCancellable *cancellable,
+						  GAsyncReadyCallback callback,
+						  gpointer callback_data);
 
 typedef struct {
 	GMainContext			*main_ctx;
@@ -74,6 +82,8 @@ typedef struct {
 	CURL				*curl;
 	curl_mime			*mime;
 	struct curl_slist		*headers;
+	gchar				*filename_old;	/* for delta downloads */
+	gchar				*checksum;	/* for delta downloads */
 } FwupdCurlHelper;
 #endif
 
@@ -121,6 +131,8 @@ fwupd_client_curl_helper_free (FwupdCurlHelper *helper)
 		curl_slist_free_all (helper->headers);
 	if (helper->urls != NULL)
 		g_ptr_array_unref (helper->urls);
+	g_free (helper->filename_old);
+	g_free (helper->checksum);
 	g_free (helper);
 }
 
@@ -930,6 +942,86 @@ fwupd_client_get_report_metadata_finish (FwupdClient *self, GAsyncResult *res, G
 	return g_task_propagate_pointer (G_TASK(res), error);
 }
 
+static void
+fwupd_client_get_metrics_cb (GObject *source,
+			     GAsyncResult *res,
+			     gpointer user_data)
+{
+	g_autoptr(GTask) task = G_TASK (user_data);
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GVariant) val = NULL;
+
+	val = g_dbus_proxy_call_finish (G_DBUS_PROXY (source), res, &error);
+	if (val == NULL) {
+		fwupd_client_fixup_dbus_error (error);
+		g_task_return_error (task, g_steal_pointer (&error));
+		return;
+	}
+
+	/* success */
+	g_task_return_pointer (task,
+			       fwupd_report_metadata_hash_from_variant (val),
+			       (GDestroyNotify) g_hash_table_unref);
+}
+
+/**
+ * fwupd_client_get_metrics_async:
+ * @self: A #FwupdClient
+ * @cancellable: the #GCancellable, or %NULL
+ * @callback: the function to run on completion
+ * @callback_data: the data to pass to @callback
+ *
+ * Gets the counters and latency histograms recorded by the daemon.
+ *
+ * You must have called fwupd_client_connect_async() on @self before using
+ * this method.
+ *
+ * Since: 1.6.0
+ **/
+void
+fwupd_client_get_metrics_async (FwupdClient *self,
+				GCancellable *cancellable,
+				GAsyncReadyCallback callback,
+				gpointer callback_data)
+{
+	FwupdClientPrivate *priv = GET_PRIVATE (self);
+	g_autoptr(GTask) task = NULL;
+
+	g_return_if_fail (FWUPD_IS_CLIENT (self));
+	g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+	g_return_if_fail (priv->proxy != NULL);
+
+	/* call into daemon */
+	task = g_task_new (self, cancellable, callback, callback_data);
+	g_dbus_proxy_call (priv->proxy, "GetMetrics",
+			   NULL,
+			   G_DBUS_CALL_FLAGS_NONE,
+			   -1, cancellable,
+			   fwupd_client_get_metrics_cb,
+			   g_steal_pointer (&task));
+}
+
+/**
+ * fwupd_client_get_metrics_finish:
+ * @self: A #FwupdClient
+ * @res: the #GAsyncResult
+ * @error: the #GError, or %NULL
+ *
+ * Gets the result of fwupd_client_get_metrics_async().
+ *
+ * Returns: (transfer container) (element-type utf8 utf8): metrics
+ *
+ * Since: 1.6.0
+ **/
+GHashTable *
+fwupd_client_get_metrics_finish (FwupdClient *self, GAsyncResult *res, GError **error)
+{
+	g_return_val_if_fail (FWUPD_IS_CLIENT (self), NULL);
+	g_return_val_if_fail (g_task_is_valid (res, self), NULL);
+	g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+	return g_task_propagate_pointer (G_TASK(res), error);
+}
+
 static void
 fwupd_client_get_devices_cb (GObject *source,
 			     GAsyncResult *res,
@@ -1007,6 +1099,93 @@ fwupd_client_get_devices_finish (FwupdClient *self, GAsyncResult *res, GError **
 	return g_task_propagate_pointer (G_TASK(res), error);
 }
 
+static void
+fwupd_client_get_devices_with_releases_cb (GObject *source,
+					   GAsyncResult *res,
+					   gpointer user_data)
+{
+	g_autoptr(GTask) task = G_TASK (user_data);
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GVariant) val = NULL;
+
+	val = g_dbus_proxy_call_finish (G_DBUS_PROXY (source), res, &error);
+	if (val == NULL) {
+		fwupd_client_fixup_dbus_error (error);
+		g_task_return_error (task, g_steal_pointer (&error));
+		return;
+	}
+
+	/* success */
+	g_task_return_pointer (task,
+			       fwupd_device_array_from_variant (val),
+			       (GDestroyNotify) g_ptr_array_unref);
+}
+
+/**
+ * fwupd_client_get_devices_with_releases_async:
+ * @self: A #FwupdClient
+ * @kind: A #FwupdReleaseKind, e.g. %FWUPD_RELEASE_KIND_UPGRADES
+ * @cancellable: the #GCancellable, or %NULL
+ * @callback: the function to run on completion
+ * @callback_data: the data to pass to @callback
+ *
+ * Gets all the devices registered with the daemon, each with the releases of
+ * the requested kind added. This is much faster than calling
+ * fwupd_client_get_upgrades_async() for each device.
+ *
+ * You must have called fwupd_client_connect_async() on @self before using
+ * this method.
+ *
+ * Since: 1.6.0
+ **/
+void
+fwupd_client_get_devices_with_releases_async (FwupdClient *self,
+					      FwupdReleaseKind kind,
+					      GCancellable *cancellable,
+					      GAsyncReadyCallback callback,
+					      gpointer callback_data)
+{
+	FwupdClientPrivate *priv = GET_PRIVATE (self);
+	g_autoptr(GTask) task = NULL;
+
+	g_return_if_fail (FWUPD_IS_CLIENT (self));
+	g_return_if_fail (kind < FWUPD_RELEASE_KIND_LAST);
+	g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+	g_return_if_fail (priv->proxy != NULL);
+
+	/* call into daemon */
+	task = g_task_new (self, cancellable, callback, callback_data);
+	g_dbus_proxy_call (priv->proxy, "GetDevicesWithReleases",
+			   g_variant_new ("(u)", (guint32) kind),
+			   G_DBUS_CALL_FLAGS_NONE,
+			   -1, cancellable,
+			   fwupd_client_get_devices_with_releases_cb,
+			   g_steal_pointer (&task));
+}
+
+/**
+ * fwupd_client_get_devices_with_releases_finish:
+ * @self: A #FwupdClient
+ * @res: the #GAsyncResult
+ * @error: the #GError, or %NULL
+ *
+ * Gets the result of fwupd_client_get_devices_with_releases_async().
+ *
+ * Returns: (element-type FwupdDevice) (transfer container): results
+ *
+ * Since: 1.6.0
+ **/
+GPtrArray *
+fwupd_client_get_devices_with_releases_finish (FwupdClient *self,
+					       GAsyncResult *res,
+					       GError **error)
+{
+	g_return_val_if_fail (FWUPD_IS_CLIENT (self), NULL);
+	g_return_val_if_fail (g_task_is_valid (res, self), NULL);
+	g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+	return g_task_propagate_pointer (G_TASK(res), error);
+}
+
 static void
 fwupd_client_get_plugins_cb (GObject *source,
 			     GAsyncResult *res,
@@ -3291,13 +3470,13 @@ fwupd_client_refresh_remote_signature_cb (GObject *source,
 		return;
 	}
 
-	/* download metadata */
-	fwupd_client_download_bytes_async (self,
-					   fwupd_remote_get_metadata_uri (data->remote),
-					   FWUPD_CLIENT_DOWNLOAD_FLAG_NONE,
-					   cancellable,
-					   fwupd_client_refresh_remote_metadata_cb,
-					   g_steal_pointer (&task));
+	/* download metadata, only getting the changed parts if possible */
+	fwupd_client_download_metadata_async (self,
+					      data->remote,
+					      data->signature,
+					      cancellable,
+					      fwupd_client_refresh_remote_metadata_cb,
+					      g_steal_pointer (&task));
 }
 
 /**
@@ -4472,6 +4651,156 @@ fwupd_client_download_bytes_thread_cb (GTask *task,
 			       g_steal_pointer (&blob),
 			       (GDestroyNotify) g_bytes_unref);
 }
+
+/* @range is in the form `start-end` or %NULL to get the entire file */
+static GBytes *
+fwupd_client_download_http_range (FwupdClient *self,
+				  CURL *curl,
+				  const gchar *url,
+				  const gchar *range,
+				  GError **error)
+{
+	glong status_code = 0;
+	glong status_code_expected = range != NULL ? 206 : 200;
+	g_autoptr(GBytes) blob = NULL;
+
+	curl_easy_setopt (curl, CURLOPT_RANGE, range);
+	blob = fwupd_client_download_http (self, curl, url, error);
+	curl_easy_setopt (curl, CURLOPT_RANGE, NULL);
+	if (blob == NULL)
+		return NULL;
+	curl_easy_getinfo (curl, CURLINFO_RESPONSE_CODE, &status_code);
+	if (status_code != status_code_expected) {
+		g_set_error (error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_NOT_SUPPORTED,
+			     "failed to download %s: status-code was %ld",
+			     url, status_code);
+		return NULL;
+	}
+	return g_steal_pointer (&blob);
+}
+
+typedef struct {
+	FwupdClient	*self;
+	CURL		*curl;
+	const gchar	*url;
+} FwupdClientDownloadRangeHelper;
+
+static GBytes *
+fwupd_client_download_range_cb (gsize offset, gsize length, gpointer user_data, GError **error)
+{
+	FwupdClientDownloadRangeHelper *helper = (FwupdClientDownloadRangeHelper *) user_data;
+	g_autofree gchar *range = NULL;
+	range = g_strdup_printf ("%" G_GSIZE_FORMAT "-%" G_GSIZE_FORMAT,
+				 offset, offset + length - 1);
+	return fwupd_client_download_http_range (helper->self,
+						 helper->curl,
+						 helper->url,
+						 range,
+						 error);
+}
+
+/* rebuild the file from the old copy and the changed chunks */
+static GBytes *
+fwupd_client_download_delta (FwupdClient *self,
+			     FwupdCurlHelper *helper,
+			     const gchar *url,
+			     GError **error)
+{
+	gsize bufsz_old = 0;
+	gchar *buf_old = NULL;
+	FwupdClientDownloadRangeHelper range_helper = {
+		.self = self,
+		.curl = helper->curl,
+		.url = url,
+	};
+	g_autofree gchar *checksum = NULL;
+	g_autofree gchar *url_index = g_strdup_printf ("%s.chunks", url);
+	g_autoptr(GBytes) blob = NULL;
+	g_autoptr(GBytes) blob_old = NULL;
+	g_autoptr(GBytes) index = NULL;
+
+	if (!g_file_get_contents (helper->filename_old, &buf_old, &bufsz_old, error))
+		return NULL;
+	blob_old = g_bytes_new_take (buf_old, bufsz_old);
+	g_debug ("downloading %s", url_index);
+	index = fwupd_client_download_http_range (self, helper->curl, url_index, NULL, error);
+	if (index == NULL)
+		return NULL;
+	blob = fwupd_chunk_index_rebuild (index, blob_old,
+					  fwupd_client_download_range_cb,
+					  &range_helper,
+					  error);
+	if (blob == NULL)
+		return NULL;
+
+	/* the index is not signed, so check against the signed checksum */
+	checksum = g_compute_checksum_for_bytes (G_CHECKSUM_SHA256, blob);
+	if (g_strcmp0 (checksum, helper->checksum) != 0) {
+		g_set_error (error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_INVALID_FILE,
+			     "rebuilt checksum %s did not match signed %s",
+			     checksum, helper->checksum);
+		return NULL;
+	}
+	return g_steal_pointer (&blob);
+}
+
+static void
+fwupd_client_download_metadata_thread_cb (GTask *task,
+					  gpointer source_object,
+					  gpointer task_data,
+					  GCancellable *cancellable)
+{
+	FwupdClient *self = FWUPD_CLIENT (source_object);
+	FwupdCurlHelper *helper = g_task_get_task_data (task);
+	const gchar *url = g_ptr_array_index (helper->urls, 0);
+	g_autoptr(GBytes) blob = NULL;
+	g_autoptr(GError) error_local = NULL;
+
+	blob = fwupd_client_download_delta (self, helper, url, &error_local);
+	if (blob == NULL) {
+		g_debug ("failed to download changes, falling back: %s",
+			 error_local->message);
+		fwupd_client_set_percentage (self, 0);
+		fwupd_client_set_status (self, FWUPD_STATUS_IDLE);
+		fwupd_client_download_bytes_thread_cb (task, source_object,
+						       task_data, cancellable);
+		return;
+	}
+	g_task_return_pointer (task,
+			       g_steal_pointer (&blob),
+			       (GDestroyNotify) g_bytes_unref);
+}
+
+/* gets the signed SHA256 of the metadata, or %NULL if unavailable */
+static gchar *
+fwupd_client_get_signature_checksum (FwupdRemote *remote, GBytes *signature)
+{
+	JcatBlob *jcat_blob;
+	g_autofree gchar *basename = NULL;
+	g_autoptr(GInputStream) istr = NULL;
+	g_autoptr(GPtrArray) jcat_blobs = NULL;
+	g_autoptr(JcatFile) jcat_file = jcat_file_new ();
+	g_autoptr(JcatItem) jcat_item = NULL;
+
+	if (fwupd_remote_get_keyring_kind (remote) != FWUPD_KEYRING_KIND_JCAT)
+		return NULL;
+	istr = g_memory_input_stream_new_from_bytes (signature);
+	if (!jcat_file_import_stream (jcat_file, istr, JCAT_IMPORT_FLAG_NONE, NULL, NULL))
+		return NULL;
+	basename = g_path_get_basename (fwupd_remote_get_metadata_uri (remote));
+	jcat_item = jcat_file_get_item_by_id (jcat_file, basename, NULL);
+	if (jcat_item == NULL)
+		return NULL;
+	jcat_blobs = jcat_item_get_blobs_by_kind (jcat_item, JCAT_BLOB_KIND_SHA256);
+	if (jcat_blobs->len == 0)
+		return NULL;
+	jcat_blob = g_ptr_array_index (jcat_blobs, 0);
+	return jcat_blob_get_data_as_string (jcat_blob);
+}
 #endif
 
 /* private */
@@ -4563,6 +4892,55 @@ fwupd_client_download_bytes_async (FwupdClient *self,
 					    callback, callback_data);
 }
 
+/* like fwupd_client_download_bytes_async() for the remote metadata, but only
+ * downloading the chunks that changed from the cached copy when possible */
+static void
+fwupd_client_download_metadata_async (FwupdClient *self,
+				      FwupdRemote *remote,
+				      GBytes *signature,
+				      GCancellable *cancellable,
+				      GAsyncReadyCallback callback,
+				      gpointer callback_data)
+{
+	const gchar *url = fwupd_remote_get_metadata_uri (remote);
+#ifdef HAVE_LIBCURL
+	const gchar *filename_old = fwupd_remote_get_filename_cache (remote);
+	g_autofree gchar *checksum = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(FwupdCurlHelper) helper = NULL;
+	g_autoptr(GTask) task = NULL;
+
+	/* we need an old copy, and a signed checksum to compare the result to */
+	checksum = fwupd_client_get_signature_checksum (remote, signature);
+	if (checksum == NULL ||
+	    filename_old == NULL ||
+	    !g_file_test (filename_old, G_FILE_TEST_EXISTS) ||
+	    !fwupd_client_is_url_http (url)) {
+		fwupd_client_download_bytes_async (self, url,
+						   FWUPD_CLIENT_DOWNLOAD_FLAG_NONE,
+						   cancellable, callback, callback_data);
+		return;
+	}
+
+	task = g_task_new (self, cancellable, callback, callback_data);
+	helper = fwupd_client_curl_new (self, &error);
+	if (helper == NULL) {
+		g_task_return_error (task, g_steal_pointer (&error));
+		return;
+	}
+	helper->urls = g_ptr_array_new_with_free_func (g_free);
+	g_ptr_array_add (helper->urls, g_strdup (url));
+	helper->filename_old = g_strdup (filename_old);
+	helper->checksum = g_steal_pointer (&checksum);
+	g_task_set_task_data (task, g_steal_pointer (&helper), (GDestroyNotify) fwupd_client_curl_helper_free);
+	g_task_run_in_thread (task, fwupd_client_download_metadata_thread_cb);
+#else
+	fwupd_client_download_bytes_async (self, url,
+					   FWUPD_CLIENT_DOWNLOAD_FLAG_NONE,
+					   cancellable, callback, callback_data);
+#endif
+}
+
 /**
  * fwupd_client_download_bytes_finish:
  * @self: A #FwupdClient
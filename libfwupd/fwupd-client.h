@@ -323,6 +323,23 @@ GHashTable	*fwupd_client_get_report_metadata_finish(FwupdClient	*self,
 							 GAsyncResult	*res,
 							 GError		**error)
 							 G_GNUC_WARN_UNUSED_RESULT;
+void		 fwupd_client_get_metrics_async		(FwupdClient	*self,
+							 GCancellable	*cancellable,
+							 GAsyncReadyCallback callback,
+							 gpointer	 callback_data);
+GHashTable	*fwupd_client_get_metrics_finish	(FwupdClient	*self,
+							 GAsyncResult	*res,
+							 GError		**error)
+							 G_GNUC_WARN_UNUSED_RESULT;
+void		 fwupd_client_get_devices_with_releases_async (FwupdClient *self,
+							 FwupdReleaseKind kind,
+							 GCancellable	*cancellable,
+							 GAsyncReadyCallback callback,
+							 gpointer	 callback_data);
+GPtrArray	*fwupd_client_get_devices_with_releases_finish (FwupdClient *self,
+							 GAsyncResult	*res,
+							 GError		**error)
+							 G_GNUC_WARN_UNUSED_RESULT;
 
 FwupdStatus	 fwupd_client_get_status		(FwupdClient	*self);
 gboolean	 fwupd_client_get_tainted		(FwupdClient	*self);
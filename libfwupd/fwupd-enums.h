@@ -222,6 +222,22 @@ typedef enum {
 	FWUPD_RELEASE_URGENCY_LAST
 } FwupdReleaseUrgency;
 
+/**
+ * FwupdReleaseKind:
+ * @FWUPD_RELEASE_KIND_ALL:			All releases
+ * @FWUPD_RELEASE_KIND_UPGRADES:		Only releases that can be used to upgrade
+ * @FWUPD_RELEASE_KIND_DOWNGRADES:		Only releases that can be used to downgrade
+ *
+ * The kind of releases to return for each device.
+ **/
+typedef enum {
+	FWUPD_RELEASE_KIND_ALL,					/* Since: 1.6.0 */
+	FWUPD_RELEASE_KIND_UPGRADES,				/* Since: 1.6.0 */
+	FWUPD_RELEASE_KIND_DOWNGRADES,				/* Since: 1.6.0 */
+	/*< private >*/
+	FWUPD_RELEASE_KIND_LAST
+} FwupdReleaseKind;
+
 /**
  * FwupdPluginFlags:
  * @FWUPD_PLUGIN_FLAG_NONE:			No flags set
@@ -267,6 +283,7 @@ typedef guint64 FwupdPluginFlags;
  * @FWUPD_INSTALL_FLAG_IGNORE_VID_PID:		Ignore firmware vendor and project checks
  * @FWUPD_INSTALL_FLAG_IGNORE_POWER:		Ignore requirement of external power source
  * @FWUPD_INSTALL_FLAG_NO_SEARCH:		Do not use heuristics when parsing the image
+ * @FWUPD_INSTALL_FLAG_LAZY_PARSE:		Only parse child images when they are accessed
  *
  * Flags to set when performing the firmware update or install.
  **/
@@ -282,6 +299,7 @@ typedef enum {
 	FWUPD_INSTALL_FLAG_IGNORE_VID_PID	= 1 << 7,	/* Since: 1.5.0 */
 	FWUPD_INSTALL_FLAG_IGNORE_POWER		= 1 << 8,	/* Since: 1.5.0 */
 	FWUPD_INSTALL_FLAG_NO_SEARCH		= 1 << 9,	/* Since: 1.5.0 */
+	FWUPD_INSTALL_FLAG_LAZY_PARSE		= 1 << 10,	/* Since: 1.6.0 */
 	/*< private >*/
 	FWUPD_INSTALL_FLAG_LAST
 } FwupdInstallFlags;
@@ -12,6 +12,7 @@
 #include <fnmatch.h>
 #endif
 
+#include "fwupd-chunk-index-private.h"
 #include "fwupd-client.h"
 #include "fwupd-client-sync.h"
 #include "fwupd-common.h"
@@ -666,6 +667,90 @@ fwupd_common_guid_func (void)
 	g_assert_false (fwupd_guid_from_string ("0112233-4455-6677-8899-aabbccddeeff", NULL, 0, NULL));
 }
 
+typedef struct {
+	GBytes		*blob;
+	gsize		 fetched;
+} FwupdChunkIndexHelper;
+
+/* stands in for the server responding to HTTP range requests */
+static GBytes *
+fwupd_chunk_index_fetch_cb (gsize offset, gsize length, gpointer user_data, GError **error)
+{
+	FwupdChunkIndexHelper *helper = (FwupdChunkIndexHelper *) user_data;
+	helper->fetched += length;
+	return g_bytes_new_from_bytes (helper->blob, offset, length);
+}
+
+static void
+fwupd_chunk_index_func (void)
+{
+	gsize bufsz = 0x200000;
+	g_autofree gchar *index_str = NULL;
+	g_autofree guint8 *buf = g_malloc (bufsz + 0x100);
+	g_autoptr(GBytes) blob1 = NULL;
+	g_autoptr(GBytes) blob2 = NULL;
+	g_autoptr(GBytes) blob3 = NULL;
+	g_autoptr(GBytes) blob_bad = NULL;
+	g_autoptr(GBytes) blob_zero = NULL;
+	g_autoptr(GBytes) index = NULL;
+	g_autoptr(GBytes) index_bad = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GRand) rand = g_rand_new_with_seed (0x1234);
+	FwupdChunkIndexHelper helper = { NULL, 0 };
+
+	/* old version */
+	for (gsize i = 0; i < bufsz; i++)
+		buf[i] = g_rand_int_range (rand, 0x00, 0x100);
+	blob1 = g_bytes_new (buf, bufsz);
+
+	/* new version has an insertion and a single changed byte */
+	memmove (buf + 0x30100, buf + 0x30000, bufsz - 0x30000);
+	memset (buf + 0x30000, 'X', 0x100);
+	buf[0x60000] ^= 0xff;
+	blob2 = g_bytes_new (buf, bufsz + 0x100);
+	index_str = fwupd_chunk_index_build (blob2);
+	index = g_bytes_new (index_str, strlen (index_str));
+
+	/* only the changed chunks are fetched */
+	helper.blob = blob2;
+	blob3 = fwupd_chunk_index_rebuild (index, blob1,
+					   fwupd_chunk_index_fetch_cb, &helper,
+					   &error);
+	g_assert_no_error (error);
+	g_assert_nonnull (blob3);
+	g_assert_true (g_bytes_equal (blob2, blob3));
+	g_assert_cmpuint (helper.fetched, >, 0);
+	g_assert_cmpuint (helper.fetched, <, bufsz / 4);
+
+	/* everything changed, so not worth it */
+	blob_bad = g_bytes_new_static ("hello world", 11);
+	g_clear_pointer (&blob3, g_bytes_unref);
+	blob3 = fwupd_chunk_index_rebuild (index, blob_bad,
+					   fwupd_chunk_index_fetch_cb, &helper,
+					   &error);
+	g_assert_error (error, FWUPD_ERROR, FWUPD_ERROR_NOT_SUPPORTED);
+	g_assert_null (blob3);
+	g_clear_error (&error);
+
+	/* the server returns the wrong data */
+	blob_zero = g_bytes_new_take (g_malloc0 (bufsz + 0x100), bufsz + 0x100);
+	helper.blob = blob_zero;
+	blob3 = fwupd_chunk_index_rebuild (index, blob1,
+					   fwupd_chunk_index_fetch_cb, &helper,
+					   &error);
+	g_assert_error (error, FWUPD_ERROR, FWUPD_ERROR_INVALID_FILE);
+	g_assert_null (blob3);
+	g_clear_error (&error);
+
+	/* invalid index */
+	index_bad = g_bytes_new_static ("# fwupd-chunk-index 1\n123 abc\n", 30);
+	blob3 = fwupd_chunk_index_rebuild (index_bad, blob1,
+					   fwupd_chunk_index_fetch_cb, &helper,
+					   &error);
+	g_assert_error (error, FWUPD_ERROR, FWUPD_ERROR_INVALID_FILE);
+	g_assert_null (blob3);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -686,6 +771,7 @@ main (int argc, char **argv)
 	g_test_add_func ("/fwupd/remote{base-uri}", fwupd_remote_baseuri_func);
 	g_test_add_func ("/fwupd/remote{no-path}", fwupd_remote_nopath_func);
 	g_test_add_func ("/fwupd/remote{local}", fwupd_remote_local_func);
+	g_test_add_func ("/fwupd/chunk-index", fwupd_chunk_index_func);
 	if (fwupd_has_system_bus ()) {
 		g_test_add_func ("/fwupd/client{remotes}", fwupd_client_remotes_func);
 		g_test_add_func ("/fwupd/client{devices}", fwupd_client_devices_func);
@@ -13,6 +13,7 @@
 
 #include "fu-cabinet.h"
 #include "fu-common.h"
+#include "fu-jcat-cache-private.h"
 
 #include "fwupd-enums.h"
 #include "fwupd-error.h"
@@ -220,18 +221,16 @@ fu_cabinet_parse_release (FuCabinet *self, XbNode *release, GError **error)
 	item = jcat_file_get_item_by_id (self->jcat_file, basename, NULL);
 	if (item != NULL) {
 		g_autoptr(GError) error_local = NULL;
-		g_autoptr(GPtrArray) results = NULL;
-		results = jcat_context_verify_item (self->jcat_context,
-						    blob, item,
-						    JCAT_VERIFY_FLAG_REQUIRE_CHECKSUM |
-						    JCAT_VERIFY_FLAG_REQUIRE_SIGNATURE,
-						    &error_local);
-		if (results == NULL) {
+		if (!fu_jcat_cache_verify_item (self->jcat_context,
+						blob, item,
+						JCAT_VERIFY_FLAG_REQUIRE_CHECKSUM |
+						JCAT_VERIFY_FLAG_REQUIRE_SIGNATURE,
+						NULL, NULL,
+						&error_local)) {
 			g_debug ("failed to verify payload %s: %s",
 				 basename, error_local->message);
 		} else {
-			g_debug ("verified payload %s: %u",
-				 basename, results->len);
+			g_debug ("verified payload %s", basename);
 			release_flags |= FWUPD_RELEASE_FLAG_TRUSTED_PAYLOAD;
 		}
 
@@ -410,19 +409,17 @@ fu_cabinet_build_silo_metainfo (FuCabinet *self, GCabFile *cabfile, GError **err
 		g_debug ("failed to verify %s: no JcatItem", fn);
 	} else {
 		g_autoptr(GError) error_local = NULL;
-		g_autoptr(GPtrArray) results = NULL;
-		results = jcat_context_verify_item (self->jcat_context,
-						    gcab_file_get_bytes (cabfile),
-						    item,
-						    JCAT_VERIFY_FLAG_REQUIRE_CHECKSUM |
-						    JCAT_VERIFY_FLAG_REQUIRE_SIGNATURE,
-						    &error_local);
-		if (results == NULL) {
+		if (!fu_jcat_cache_verify_item (self->jcat_context,
+						gcab_file_get_bytes (cabfile),
+						item,
+						JCAT_VERIFY_FLAG_REQUIRE_CHECKSUM |
+						JCAT_VERIFY_FLAG_REQUIRE_SIGNATURE,
+						NULL, NULL,
+						&error_local)) {
 			g_debug ("failed to verify %s: %s",
 				 fn, error_local->message);
 		} else {
-			g_debug ("verified metadata %s: %u",
-				 fn, results->len);
+			g_debug ("verified metadata %s", fn);
 			release_flags |= FWUPD_RELEASE_FLAG_TRUSTED_METADATA;
 		}
 	}
@@ -34,3 +34,12 @@ gchar		*fu_device_get_guids_as_str		(FuDevice	*self);
 GPtrArray	*fu_device_get_possible_plugins		(FuDevice	*self);
 void		 fu_device_add_possible_plugin		(FuDevice	*self,
 							 const gchar	*plugin);
+void		 fu_device_add_metric_counter		(FuDevice	*self,
+							 const gchar	*name,
+							 guint64	 value);
+void		 fu_device_add_metric_duration		(FuDevice	*self,
+							 const gchar	*name,
+							 gint64		 start);
+void		 fu_device_add_metric_duration_by_id	(FuDevice	*self,
+							 const gchar	*name,
+							 gint64		 start);
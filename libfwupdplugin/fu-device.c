@@ -15,7 +15,10 @@
 #include "fu-common.h"
 #include "fu-common-version.h"
 #include "fu-device-private.h"
+#include "fu-metrics.h"
 #include "fu-mutex.h"
+#include "fu-poll-scheduler-private.h"
+#include "fu-retry-policy-private.h"
 
 #include "fwupd-common.h"
 #include "fwupd-device-private.h"
@@ -53,7 +56,6 @@ typedef struct {
 	guint				 battery_level;
 	gint				 order;
 	guint				 priority;
-	guint				 poll_id;
 	gboolean			 done_probe;
 	gboolean			 done_setup;
 	gboolean			 device_id_valid;
@@ -186,6 +188,8 @@ fu_device_internal_flag_to_string (FuDeviceInternalFlags flag)
 		return "retry-open";
 	if (flag == FU_DEVICE_INTERNAL_FLAG_REPLUG_MATCH_GUID)
 		return "replug-match-guid";
+	if (flag == FU_DEVICE_INTERNAL_FLAG_POLL_RELAXED)
+		return "poll-relaxed";
 	return NULL;
 }
 
@@ -218,6 +222,8 @@ fu_device_internal_flag_from_string (const gchar *flag)
 		return FU_DEVICE_INTERNAL_FLAG_ENSURE_SEMVER;
 	if (g_strcmp0 (flag, "retry-open") == 0)
 		return FU_DEVICE_INTERNAL_FLAG_RETRY_OPEN;
+	if (g_strcmp0 (flag, "poll-relaxed") == 0)
+		return FU_DEVICE_INTERNAL_FLAG_POLL_RELAXED;
 	return FU_DEVICE_INTERNAL_FLAG_UNKNOWN;
 }
 
@@ -369,6 +375,71 @@ fu_device_retry_set_delay (FuDevice *self, guint delay)
 	priv->retry_delay = delay;
 }
 
+static gchar *
+fu_device_get_metric_id (FuDevice *self, const gchar *name)
+{
+	return g_strdup_printf ("device.%s.%s", G_OBJECT_TYPE_NAME (self), name);
+}
+
+/* private */
+void
+fu_device_add_metric_duration (FuDevice *self, const gchar *name, gint64 start)
+{
+	g_autofree gchar *id = fu_device_get_metric_id (self, name);
+	fu_metrics_add_duration (id, g_get_monotonic_time () - start);
+}
+
+/* private; for values that depend on the specific device rather than the
+ * driver, e.g. the firmware running on it */
+void
+fu_device_add_metric_duration_by_id (FuDevice *self, const gchar *name, gint64 start)
+{
+	const gchar *device_id = fu_device_get_id (self);
+	g_autofree gchar *id = NULL;
+
+	if (device_id == NULL) {
+		fu_device_add_metric_duration (self, name, start);
+		return;
+	}
+	id = g_strdup_printf ("device.%s.%s.%s",
+			      G_OBJECT_TYPE_NAME (self), device_id, name);
+	fu_metrics_add_duration (id, g_get_monotonic_time () - start);
+}
+
+/* private */
+void
+fu_device_add_metric_counter (FuDevice *self, const gchar *name, guint64 value)
+{
+	g_autofree gchar *id = fu_device_get_metric_id (self, name);
+	fu_metrics_add_counter (id, value);
+}
+
+/* runs the recovery function registered for the error, if any */
+static gboolean
+fu_device_retry_recover (FuDevice *self,
+			 const GError *error_local,
+			 gpointer user_data,
+			 GError **error)
+{
+	FuDevicePrivate *priv = GET_PRIVATE (self);
+	for (guint j = 0; j < priv->retry_recs->len; j++) {
+		FuDeviceRetryRecovery *rec = g_ptr_array_index (priv->retry_recs, j);
+		if (g_error_matches (error_local, rec->domain, rec->code)) {
+			if (rec->recovery_func != NULL) {
+				if (!rec->recovery_func (self, user_data, error))
+					return FALSE;
+			} else {
+				g_set_error (error,
+					     G_IO_ERROR,
+					     G_IO_ERROR_FAILED,
+					     "device recovery not possible");
+				return FALSE;
+			}
+		}
+	}
+	return TRUE;
+}
+
 /**
  * fu_device_retry_full:
  * @self: A #FuDevice
@@ -424,6 +495,9 @@ fu_device_retry_full (FuDevice *self,
 			return FALSE;
 		}
 
+		/* record each failed try */
+		fu_device_add_metric_counter (self, "retry", 1);
+
 		/* too many retries */
 		if (i >= count - 1) {
 			g_propagate_prefixed_error (error,
@@ -441,21 +515,8 @@ fu_device_retry_full (FuDevice *self,
 		}
 
 		/* find the condition that matches */
-		for (guint j = 0; j < priv->retry_recs->len; j++) {
-			FuDeviceRetryRecovery *rec = g_ptr_array_index (priv->retry_recs, j);
-			if (g_error_matches (error_local, rec->domain, rec->code)) {
-				if (rec->recovery_func != NULL) {
-					if (!rec->recovery_func (self, user_data, error))
-						return FALSE;
-				} else {
-					g_set_error (error,
-						     G_IO_ERROR,
-						     G_IO_ERROR_FAILED,
-						     "device recovery not possible");
-					return FALSE;
-				}
-			}
-		}
+		if (!fu_device_retry_recover (self, error_local, user_data, error))
+			return FALSE;
 	}
 
 	/* success */
@@ -494,6 +555,154 @@ fu_device_retry (FuDevice *self,
 				     user_data, error);
 }
 
+/* the key used to remember the settle time of this kind of device */
+static gchar *
+fu_device_get_retry_model (FuDevice *self)
+{
+	const gchar *guid = fu_device_get_guid_default (self);
+	if (guid == NULL)
+		return g_strdup (G_OBJECT_TYPE_NAME (self));
+	return g_strdup_printf ("%s-%s", G_OBJECT_TYPE_NAME (self), guid);
+}
+
+/* waits, returning early if the device says it is ready */
+static void
+fu_device_retry_wait (FuDevice *self,
+		      FuRetryPolicy *policy,
+		      guint delay,
+		      FuDeviceRetryFunc ready_func,
+		      gpointer user_data)
+{
+	guint interval = fu_retry_policy_get_ready_interval (policy);
+
+	if (ready_func == NULL) {
+		g_usleep (delay * 1000);
+		return;
+	}
+	while (delay > 0) {
+		guint slice = MIN(delay, interval);
+		g_autoptr(GError) error_local = NULL;
+		g_usleep (slice * 1000);
+		delay -= slice;
+		if (ready_func (self, user_data, &error_local))
+			return;
+		if (error_local != NULL)
+			g_debug ("not ready: %s", error_local->message);
+	}
+}
+
+/**
+ * fu_device_retry_with_policy:
+ * @self: A #FuDevice
+ * @policy: A #FuRetryPolicy
+ * @func: (scope async): A function to execute
+ * @ready_func: (scope async) (nullable): A function to check if the device is ready
+ * @user_data: (nullable): a helper to pass to @func and @ready_func
+ * @error: A #GError
+ *
+ * Calls a specific function until it succeeds or the time budget of @policy
+ * is used, optionally handling the error with a reset action.
+ *
+ * The delay between tries grows exponentially, and if @ready_func is set it is
+ * polled during each delay so that @func can be retried as soon as the device
+ * is ready. If @policy has an ID then the time the device took to settle is
+ * remembered, and used as the first delay for the same model next time if
+ * the first try fails.
+ *
+ * If fu_device_retry_add_recovery() has not been used then all errors are
+ * considered non-fatal until the budget is used.
+ *
+ * Since: 1.6.0
+ **/
+gboolean
+fu_device_retry_with_policy (FuDevice *self,
+			     FuRetryPolicy *policy,
+			     FuDeviceRetryFunc func,
+			     FuDeviceRetryFunc ready_func,
+			     gpointer user_data,
+			     GError **error)
+{
+	FuDevicePrivate *priv = GET_PRIVATE (self);
+	gint64 start = g_get_monotonic_time ();
+	guint budget;
+	guint delay = 0;
+	guint elapsed;
+	guint settle;
+	g_autofree gchar *model = NULL;
+
+	g_return_val_if_fail (FU_IS_DEVICE (self), FALSE);
+	g_return_val_if_fail (FU_IS_RETRY_POLICY (policy), FALSE);
+	g_return_val_if_fail (func != NULL, FALSE);
+	g_return_val_if_fail (error != NULL, FALSE);
+
+	budget = fu_retry_policy_get_budget (policy);
+	model = fu_device_get_retry_model (self);
+	settle = fu_retry_policy_get_settle (policy, model);
+
+	for (guint i = 1; ; i++) {
+		g_autoptr(GError) error_local =	NULL;
+
+		/* run function, if success return success */
+		if (func (self, user_data, &error_local))
+			break;
+
+		/* sanity check */
+		if (error_local == NULL) {
+			g_set_error (error,
+				     G_IO_ERROR,
+				     G_IO_ERROR_FAILED,
+				     "exec failed but no error set!");
+			return FALSE;
+		}
+
+		/* record each failed try */
+		fu_device_add_metric_counter (self, "retry", 1);
+
+		/* out of time */
+		elapsed = (g_get_monotonic_time () - start) / 1000;
+		if (elapsed >= budget) {
+			g_propagate_prefixed_error (error,
+						    g_steal_pointer (&error_local),
+						    "failed after %ums and %u tries: ",
+						    elapsed, i);
+			return FALSE;
+		}
+
+		/* show recoverable error on the console */
+		if (priv->retry_recs->len == 0) {
+			g_debug ("failed on try %u after %ums: %s",
+				 i, elapsed, error_local->message);
+		} else if (!fu_device_retry_recover (self, error_local, user_data, error)) {
+			return FALSE;
+		}
+
+		/* if the device was not ready straight away then start a little
+		 * short of the learned time so it can also get shorter */
+		if (i == 1 && settle > 0) {
+			guint settle_wait = (settle * 3) / 4;
+			g_debug ("waiting %ums for %s to settle", settle_wait, model);
+			fu_device_retry_wait (self, policy,
+					      MIN(settle_wait, budget - elapsed),
+					      ready_func, user_data);
+			continue;
+		}
+
+		/* back off, but never past the end of the budget */
+		delay = fu_retry_policy_get_next_delay (policy, delay);
+		fu_device_retry_wait (self, policy,
+				      MIN(delay, budget - elapsed),
+				      ready_func, user_data);
+	}
+
+	/* remember how long this model took */
+	fu_device_add_metric_duration (self, "retry-settle", start);
+	elapsed = (g_get_monotonic_time () - start) / 1000;
+	fu_retry_policy_add_settle (policy, model, elapsed);
+
+	/* success */
+	return TRUE;
+}
+
 /**
  * fu_device_poll:
  * @self: A #FuDevice
@@ -521,20 +730,6 @@ fu_device_poll (FuDevice *self, GError **error)
 	return TRUE;
 }
 
-static gboolean
-fu_device_poll_cb (gpointer user_data)
-{
-	FuDevice *self = FU_DEVICE (user_data);
-	FuDevicePrivate *priv = GET_PRIVATE (self);
-	g_autoptr(GError) error_local = NULL;
-	if (!fu_device_poll (self, &error_local)) {
-		g_warning ("disabling polling: %s", error_local->message);
-		priv->poll_id = 0;
-		return G_SOURCE_REMOVE;
-	}
-	return G_SOURCE_CONTINUE;
-}
-
 /**
  * fu_device_set_poll_interval:
  * @self: a #FuPlugin
@@ -544,28 +739,19 @@ fu_device_poll_cb (gpointer user_data)
  * returns %FALSE then a warning is printed to the console and the poll is
  * disabled until the next call to fu_device_set_poll_interval().
  *
+ * Polls of all devices are coalesced onto shared wakeups, so the interval is
+ * the nominal period rather than an exact one. Devices with
+ * %FU_DEVICE_INTERNAL_FLAG_POLL_RELAXED are polled less often when they do not
+ * change or when no client is connected, which should not be used when the
+ * poll drains notifications from the hardware.
+ *
  * Since: 1.1.2
  **/
 void
 fu_device_set_poll_interval (FuDevice *self, guint interval)
 {
-	FuDevicePrivate *priv = GET_PRIVATE (self);
-
 	g_return_if_fail (FU_IS_DEVICE (self));
-
-	if (priv->poll_id != 0) {
-		g_source_remove (priv->poll_id);
-		priv->poll_id = 0;
-	}
-	if (interval == 0)
-		return;
-	if (interval % 1000 == 0) {
-		priv->poll_id = g_timeout_add_seconds (interval / 1000,
-						       fu_device_poll_cb,
-						       self);
-	} else {
-		priv->poll_id = g_timeout_add (interval, fu_device_poll_cb, self);
-	}
+	fu_poll_scheduler_add (self, interval);
 }
 
 /**
@@ -2731,6 +2917,8 @@ fu_device_write_firmware (FuDevice *self,
 			  GError **error)
 {
 	FuDeviceClass *klass = FU_DEVICE_GET_CLASS (self);
+	gboolean ret;
+	gint64 start;
 	g_autoptr(FuFirmware) firmware = NULL;
 	g_autofree gchar *str = NULL;
 
@@ -2746,7 +2934,8 @@ fu_device_write_firmware (FuDevice *self,
 		return FALSE;
 	}
 
-	/* prepare (e.g. decompress) firmware */
+	/* prepare (e.g. decompress) firmware, only parsing the child images
+	 * that the device actually uses if FWUPD_INSTALL_FLAG_LAZY_PARSE */
 	firmware = fu_device_prepare_firmware (self, fw, flags, error);
 	if (firmware == NULL)
 		return FALSE;
@@ -2754,7 +2943,13 @@ fu_device_write_firmware (FuDevice *self,
 	g_debug ("installing onto %s:\n%s", fu_device_get_id (self), str);
 
 	/* call vfunc */
-	return klass->write_firmware (self, firmware, flags, error);
+	start = g_get_monotonic_time ();
+	ret = klass->write_firmware (self, firmware, flags, error);
+	fu_device_add_metric_duration (self, "write-firmware", start);
+	if (!ret)
+		return FALSE;
+	fu_device_add_metric_counter (self, "write-firmware-bytes", g_bytes_get_size (fw));
+	return TRUE;
 }
 
 /**
@@ -2866,8 +3061,13 @@ fu_device_read_firmware (FuDevice *self, GError **error)
 	}
 
 	/* call vfunc */
-	if (klass->read_firmware != NULL)
-		return klass->read_firmware (self, error);
+	if (klass->read_firmware != NULL) {
+		FuFirmware *firmware;
+		gint64 start = g_get_monotonic_time ();
+		firmware = klass->read_firmware (self, error);
+		fu_device_add_metric_duration (self, "read-firmware", start);
+		return firmware;
+	}
 
 	/* use the default FuFirmware when only ->dump_firmware is provided */
 	fw = fu_device_dump_firmware (self, error);
@@ -2926,6 +3126,8 @@ gboolean
 fu_device_detach (FuDevice *self, GError **error)
 {
 	FuDeviceClass *klass = FU_DEVICE_GET_CLASS (self);
+	gboolean ret;
+	gint64 start;
 
 	g_return_val_if_fail (FU_IS_DEVICE (self), FALSE);
 	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
@@ -2935,7 +3137,10 @@ fu_device_detach (FuDevice *self, GError **error)
 		return TRUE;
 
 	/* call vfunc */
-	return klass->detach (self, error);
+	start = g_get_monotonic_time ();
+	ret = klass->detach (self, error);
+	fu_device_add_metric_duration (self, "detach", start);
+	return ret;
 }
 
 /**
@@ -2953,6 +3158,8 @@ gboolean
 fu_device_attach (FuDevice *self, GError **error)
 {
 	FuDeviceClass *klass = FU_DEVICE_GET_CLASS (self);
+	gboolean ret;
+	gint64 start;
 
 	g_return_val_if_fail (FU_IS_DEVICE (self), FALSE);
 	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
@@ -2962,7 +3169,10 @@ fu_device_attach (FuDevice *self, GError **error)
 		return TRUE;
 
 	/* call vfunc */
-	return klass->attach (self, error);
+	start = g_get_monotonic_time ();
+	ret = klass->attach (self, error);
+	fu_device_add_metric_duration (self, "attach", start);
+	return ret;
 }
 
 /**
@@ -2980,6 +3190,8 @@ gboolean
 fu_device_reload (FuDevice *self, GError **error)
 {
 	FuDeviceClass *klass = FU_DEVICE_GET_CLASS (self);
+	gboolean ret;
+	gint64 start;
 
 	g_return_val_if_fail (FU_IS_DEVICE (self), FALSE);
 	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
@@ -2989,7 +3201,10 @@ fu_device_reload (FuDevice *self, GError **error)
 		return TRUE;
 
 	/* call vfunc */
-	return klass->reload (self, error);
+	start = g_get_monotonic_time ();
+	ret = klass->reload (self, error);
+	fu_device_add_metric_duration (self, "reload", start);
+	return ret;
 }
 
 /**
@@ -3098,6 +3313,7 @@ fu_device_open (FuDevice *self, GError **error)
 
 	/* subclassed */
 	if (klass->open != NULL) {
+		gint64 start = g_get_monotonic_time ();
 		if (fu_device_has_internal_flag (self, FU_DEVICE_INTERNAL_FLAG_RETRY_OPEN)) {
 			if (!fu_device_retry_full (self, fu_device_open_cb,
 						   FU_DEVICE_RETRY_OPEN_COUNT,
@@ -3108,6 +3324,7 @@ fu_device_open (FuDevice *self, GError **error)
 			if (!klass->open (self, error))
 				return FALSE;
 		}
+		fu_device_add_metric_duration (self, "open", start);
 	}
 
 	/* setup */
@@ -3164,7 +3381,11 @@ fu_device_close (FuDevice *self, GError **error)
 
 	/* subclassed */
 	if (klass->close != NULL) {
-		if (!klass->close (self, error))
+		gboolean ret;
+		gint64 start = g_get_monotonic_time ();
+		ret = klass->close (self, error);
+		fu_device_add_metric_duration (self, "close", start);
+		if (!ret)
 			return FALSE;
 	}
 
@@ -3200,7 +3421,11 @@ fu_device_probe (FuDevice *self, GError **error)
 
 	/* subclassed */
 	if (klass->probe != NULL) {
-		if (!klass->probe (self, error))
+		gboolean ret;
+		gint64 start = g_get_monotonic_time ();
+		ret = klass->probe (self, error);
+		fu_device_add_metric_duration (self, "probe", start);
+		if (!ret)
 			return FALSE;
 	}
 	priv->done_probe = TRUE;
@@ -3301,7 +3526,11 @@ fu_device_setup (FuDevice *self, GError **error)
 
 	/* subclassed */
 	if (klass->setup != NULL) {
-		if (!klass->setup (self, error))
+		gboolean ret;
+		gint64 start = g_get_monotonic_time ();
+		ret = klass->setup (self, error);
+		fu_device_add_metric_duration (self, "setup", start);
+		if (!ret)
 			return FALSE;
 	}
 
@@ -3342,7 +3571,11 @@ fu_device_activate (FuDevice *self, GError **error)
 
 	/* subclassed */
 	if (klass->activate != NULL) {
-		if (!klass->activate (self, error))
+		gboolean ret;
+		gint64 start = g_get_monotonic_time ();
+		ret = klass->activate (self, error);
+		fu_device_add_metric_duration (self, "activate", start);
+		if (!ret)
 			return FALSE;
 	}
 
@@ -3699,8 +3932,7 @@ fu_device_finalize (GObject *object)
 		g_object_remove_weak_pointer (G_OBJECT (priv->proxy), (gpointer *) &priv->proxy);
 	if (priv->quirks != NULL)
 		g_object_unref (priv->quirks);
-	if (priv->poll_id != 0)
-		g_source_remove (priv->poll_id);
+	fu_poll_scheduler_remove (self);
 	if (priv->metadata != NULL)
 		g_hash_table_unref (priv->metadata);
 	g_ptr_array_unref (priv->parent_guids);
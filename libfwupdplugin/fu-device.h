@@ -12,6 +12,7 @@
 #include "fu-firmware.h"
 #include "fu-quirks.h"
 #include "fu-common-version.h"
+#include "fu-retry-policy.h"
 
 #define FU_TYPE_DEVICE (fu_device_get_type ())
 G_DECLARE_DERIVABLE_TYPE (FuDevice, fu_device, FU, DEVICE, FwupdDevice)
@@ -208,6 +209,7 @@ FuDevice	*fu_device_new				(void);
  * @FU_DEVICE_INTERNAL_FLAG_MD_SET_ICON:		Set the device icon from the metadata if available
  * @FU_DEVICE_INTERNAL_FLAG_RETRY_OPEN:			Retry the device open up to 5 times if it fails
  * @FU_DEVICE_INTERNAL_FLAG_REPLUG_MATCH_GUID:		Match GUIDs on device replug where the physical and logical IDs will be different
+ * @FU_DEVICE_INTERNAL_FLAG_POLL_RELAXED:		The poll has no side effects, so can be done less often when idle or with no clients
  *
  * The device internal flags.
  **/
@@ -222,6 +224,7 @@ typedef enum {
 	FU_DEVICE_INTERNAL_FLAG_MD_SET_ICON		= (1llu << 6),	/* Since: 1.5.5 */
 	FU_DEVICE_INTERNAL_FLAG_RETRY_OPEN		= (1llu << 7),	/* Since: 1.5.5 */
 	FU_DEVICE_INTERNAL_FLAG_REPLUG_MATCH_GUID	= (1llu << 8),	/* Since: 1.5.8 */
+	FU_DEVICE_INTERNAL_FLAG_POLL_RELAXED		= (1llu << 9),	/* Since: 1.6.0 */
 	/*< private >*/
 	FU_DEVICE_INTERNAL_FLAG_UNKNOWN			= G_MAXUINT64,
 } FuDeviceInternalFlags;
@@ -424,6 +427,13 @@ gboolean	 fu_device_retry_full			(FuDevice	*self,
 							 gpointer	 user_data,
 							 GError		**error)
 							 G_GNUC_WARN_UNUSED_RESULT;
+gboolean	 fu_device_retry_with_policy		(FuDevice	*self,
+							 FuRetryPolicy	*policy,
+							 FuDeviceRetryFunc func,
+							 FuDeviceRetryFunc ready_func,
+							 gpointer	 user_data,
+							 GError		**error)
+							 G_GNUC_WARN_UNUSED_RESULT;
 gboolean	 fu_device_bind_driver			(FuDevice	*self,
 							 const gchar	*subsystem,
 							 const gchar	*driver,
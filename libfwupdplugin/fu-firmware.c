@@ -34,6 +34,9 @@ typedef struct {
 	guint64				 offset;
 	gsize				 size;
 	GPtrArray			*chunks;	/* nullable, element-type FuChunk */
+	GBytes				*lazy_fw;	/* nullable, parsed on demand */
+	FwupdInstallFlags		 lazy_flags;
+	GError				*lazy_error;	/* nullable, from the deferred parse */
 } FuFirmwarePrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE (FuFirmware, fu_firmware, G_TYPE_OBJECT)
@@ -475,6 +478,8 @@ fu_firmware_get_bytes (FuFirmware *self, GError **error)
 {
 	FuFirmwarePrivate *priv = GET_PRIVATE (self);
 	g_return_val_if_fail (FU_IS_FIRMWARE (self), NULL);
+	if (!fu_firmware_ensure_parsed (self, error))
+		return NULL;
 	if (priv->bytes == NULL) {
 		g_set_error_literal (error,
 				     FWUPD_ERROR,
@@ -613,6 +618,10 @@ fu_firmware_get_checksum (FuFirmware *self,
 	g_return_val_if_fail (FU_IS_FIRMWARE (self), NULL);
 	g_return_val_if_fail (error == NULL || *error == NULL, NULL);
 
+	/* not yet parsed */
+	if (!fu_firmware_ensure_parsed (self, error))
+		return NULL;
+
 	/* subclassed */
 	if (klass->get_checksum != NULL)
 		return klass->get_checksum (self, csum_kind, error);
@@ -731,6 +740,98 @@ fu_firmware_parse (FuFirmware *self, GBytes *fw, FwupdInstallFlags flags, GError
 	return fu_firmware_parse_full (self, fw, 0x0, 0x0, flags, error);
 }
 
+/**
+ * fu_firmware_parse_lazy:
+ * @self: A #FuFirmware
+ * @fw: A #GBytes
+ * @flags: some #FwupdInstallFlags, e.g. %FWUPD_INSTALL_FLAG_LAZY_PARSE
+ * @error: A #GError, or %NULL
+ *
+ * Parses a child image. If %FWUPD_INSTALL_FLAG_LAZY_PARSE is set then @fw is
+ * only recorded, and the image is parsed the first time it is returned from
+ * functions like fu_firmware_get_images() or fu_firmware_get_image_by_id().
+ *
+ * This is useful for container formats where the caller typically only needs
+ * one image and parsing the others is expensive, e.g. requires decompression.
+ *
+ * Returns: %TRUE for success
+ *
+ * Since: 1.6.0
+ **/
+gboolean
+fu_firmware_parse_lazy (FuFirmware *self, GBytes *fw, FwupdInstallFlags flags, GError **error)
+{
+	FuFirmwarePrivate *priv = GET_PRIVATE (self);
+
+	g_return_val_if_fail (FU_IS_FIRMWARE (self), FALSE);
+	g_return_val_if_fail (fw != NULL, FALSE);
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+	/* parse now */
+	if ((flags & FWUPD_INSTALL_FLAG_LAZY_PARSE) == 0)
+		return fu_firmware_parse (self, fw, flags, error);
+
+	/* sanity check */
+	if (g_bytes_get_size (fw) == 0) {
+		g_set_error_literal (error,
+				     FWUPD_ERROR,
+				     FWUPD_ERROR_NOT_SUPPORTED,
+				     "invalid firmware as zero sized");
+		return FALSE;
+	}
+
+	/* just record the offset and size */
+	if (priv->lazy_fw != NULL)
+		g_bytes_unref (priv->lazy_fw);
+	priv->lazy_fw = g_bytes_ref (fw);
+	priv->lazy_flags = flags;
+	if (priv->size == 0)
+		priv->size = g_bytes_get_size (fw);
+	return TRUE;
+}
+
+/**
+ * fu_firmware_ensure_parsed:
+ * @self: A #FuFirmware
+ * @error: A #GError, or %NULL
+ *
+ * Parses the image if it was deferred using fu_firmware_parse_lazy().
+ *
+ * If parsing fails the error is remembered and returned again each time the
+ * image is used, so that invalid firmware can never be written.
+ *
+ * Returns: %TRUE for success
+ *
+ * Since: 1.6.0
+ **/
+gboolean
+fu_firmware_ensure_parsed (FuFirmware *self, GError **error)
+{
+	FuFirmwarePrivate *priv = GET_PRIVATE (self);
+	g_autoptr(GBytes) fw = NULL;
+
+	g_return_val_if_fail (FU_IS_FIRMWARE (self), FALSE);
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+	/* already failed */
+	if (priv->lazy_error != NULL) {
+		g_propagate_error (error, g_error_copy (priv->lazy_error));
+		return FALSE;
+	}
+
+	/* nothing to do */
+	if (priv->lazy_fw == NULL)
+		return TRUE;
+
+	/* only try once */
+	fw = g_steal_pointer (&priv->lazy_fw);
+	if (!fu_firmware_parse (self, fw, priv->lazy_flags, &priv->lazy_error)) {
+		g_propagate_error (error, g_error_copy (priv->lazy_error));
+		return FALSE;
+	}
+	return TRUE;
+}
+
 /**
  * fu_firmware_build:
  * @self: A #FuFirmware
@@ -1028,6 +1129,10 @@ fu_firmware_write (FuFirmware *self, GError **error)
 	g_return_val_if_fail (FU_IS_FIRMWARE (self), NULL);
 	g_return_val_if_fail (error == NULL || *error == NULL, NULL);
 
+	/* not yet parsed */
+	if (!fu_firmware_ensure_parsed (self, error))
+		return NULL;
+
 	/* subclassed */
 	if (klass->write != NULL)
 		return klass->write (self, error);
@@ -1280,6 +1385,11 @@ fu_firmware_remove_image_by_id (FuFirmware *self, const gchar *id, GError **erro
  *
  * Returns all the images in the firmware.
  *
+ * Images deferred using fu_firmware_parse_lazy() are parsed, and any image that
+ * failed to parse is still returned, but returns the parse error when it is
+ * written or the payload is requested. Use fu_firmware_get_images_full() to get
+ * the error directly.
+ *
  * Returns: (transfer container) (element-type FuFirmware): images
  *
  * Since: 1.3.1
@@ -1295,6 +1405,46 @@ fu_firmware_get_images (FuFirmware *self)
 	imgs = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
 	for (guint i = 0; i < priv->images->len; i++) {
 		FuFirmware *img = g_ptr_array_index (priv->images, i);
+		g_autoptr(GError) error_local = NULL;
+		if (!fu_firmware_ensure_parsed (img, &error_local)) {
+			g_debug ("failed to parse image %s: %s",
+				 fu_firmware_get_id (img),
+				 error_local->message);
+		}
+		g_ptr_array_add (imgs, g_object_ref (img));
+	}
+	return g_steal_pointer (&imgs);
+}
+
+/**
+ * fu_firmware_get_images_full:
+ * @self: a #FuFirmware
+ * @error: A #GError, or %NULL
+ *
+ * Returns all the images in the firmware, parsing any that were deferred using
+ * fu_firmware_parse_lazy().
+ *
+ * Returns: (transfer container) (element-type FuFirmware): images, or %NULL
+ * if any image failed to parse
+ *
+ * Since: 1.6.0
+ **/
+GPtrArray *
+fu_firmware_get_images_full (FuFirmware *self, GError **error)
+{
+	FuFirmwarePrivate *priv = GET_PRIVATE (self);
+	g_autoptr(GPtrArray) imgs = NULL;
+
+	g_return_val_if_fail (FU_IS_FIRMWARE (self), NULL);
+	g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+	imgs = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+	for (guint i = 0; i < priv->images->len; i++) {
+		FuFirmware *img = g_ptr_array_index (priv->images, i);
+		if (!fu_firmware_ensure_parsed (img, error)) {
+			g_prefix_error (error, "failed to parse image 0x%x: ", i);
+			return NULL;
+		}
 		g_ptr_array_add (imgs, g_object_ref (img));
 	}
 	return g_steal_pointer (&imgs);
@@ -1322,8 +1472,17 @@ fu_firmware_get_image_by_id (FuFirmware *self, const gchar *id, GError **error)
 
 	for (guint i = 0; i < priv->images->len; i++) {
 		FuFirmware *img = g_ptr_array_index (priv->images, i);
-		if (g_strcmp0 (fu_firmware_get_id (img), id) == 0)
+
+		/* the ID might only be known after parsing */
+		if (fu_firmware_get_id (img) == NULL) {
+			if (!fu_firmware_ensure_parsed (img, error))
+				return NULL;
+		}
+		if (g_strcmp0 (fu_firmware_get_id (img), id) == 0) {
+			if (!fu_firmware_ensure_parsed (img, error))
+				return NULL;
 			return g_object_ref (img);
+		}
 	}
 	g_set_error (error,
 		     FWUPD_ERROR,
@@ -1375,8 +1534,11 @@ fu_firmware_get_image_by_idx (FuFirmware *self, guint64 idx, GError **error)
 
 	for (guint i = 0; i < priv->images->len; i++) {
 		FuFirmware *img = g_ptr_array_index (priv->images, i);
-		if (fu_firmware_get_idx (img) == idx)
+		if (fu_firmware_get_idx (img) == idx) {
+			if (!fu_firmware_ensure_parsed (img, error))
+				return NULL;
 			return g_object_ref (img);
+		}
 	}
 	g_set_error (error,
 		     FWUPD_ERROR,
@@ -1510,6 +1672,8 @@ fu_firmware_export (FuFirmware *self,
 					     NULL);
 	}
 	fu_xmlb_builder_insert_kx (bn, "alignment", priv->alignment);
+	if (priv->lazy_fw != NULL)
+		fu_xmlb_builder_insert_kb (bn, "lazy", TRUE);
 
 	/* chunks */
 	if (priv->chunks != NULL && priv->chunks->len > 0) {
@@ -1609,6 +1773,10 @@ fu_firmware_finalize (GObject *object)
 		g_bytes_unref (priv->bytes);
 	if (priv->chunks != NULL)
 		g_ptr_array_unref (priv->chunks);
+	if (priv->lazy_fw != NULL)
+		g_bytes_unref (priv->lazy_fw);
+	if (priv->lazy_error != NULL)
+		g_error_free (priv->lazy_error);
 	g_ptr_array_unref (priv->images);
 	G_OBJECT_CLASS (fu_firmware_parent_class)->finalize (object);
 }
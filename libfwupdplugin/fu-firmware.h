@@ -191,6 +191,14 @@ gboolean	 fu_firmware_parse			(FuFirmware	*self,
 							 FwupdInstallFlags flags,
 							 GError		**error)
 							 G_GNUC_WARN_UNUSED_RESULT;
+gboolean	 fu_firmware_parse_lazy			(FuFirmware	*self,
+							 GBytes		*fw,
+							 FwupdInstallFlags flags,
+							 GError		**error)
+							 G_GNUC_WARN_UNUSED_RESULT;
+gboolean	 fu_firmware_ensure_parsed		(FuFirmware	*self,
+							 GError		**error)
+							 G_GNUC_WARN_UNUSED_RESULT;
 gboolean	 fu_firmware_parse_file			(FuFirmware	*self,
 							 GFile		*file,
 							 FwupdInstallFlags flags,
@@ -231,6 +239,8 @@ gboolean	 fu_firmware_remove_image_by_id		(FuFirmware	*self,
 							 const gchar	*id,
 							 GError		**error);
 GPtrArray	*fu_firmware_get_images			(FuFirmware	*self);
+GPtrArray	*fu_firmware_get_images_full		(FuFirmware	*self,
+							 GError		**error);
 FuFirmware	*fu_firmware_get_image_by_id		(FuFirmware	*self,
 							 const gchar	*id,
 							 GError		**error);
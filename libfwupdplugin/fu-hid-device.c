@@ -8,7 +8,9 @@
 
 #include "config.h"
 
+#include "fu-device-private.h"
 #include "fu-hid-device.h"
+#include "fu-io-trace.h"
 
 #define FU_HID_REPORT_GET				0x01
 #define FU_HID_REPORT_SET				0x09
@@ -18,6 +20,7 @@
 #define FU_HID_REPORT_TYPE_FEATURE			0x03
 
 #define FU_HID_DEVICE_RETRIES				10
+#define FU_HID_DEVICE_EP_IN_SIZE_DEFAULT		64 /* bytes */
 
 /**
  * SECTION:fu-hid-device
@@ -33,6 +36,8 @@ typedef struct
 	FuUsbDevice		*usb_device;
 	guint8			 interface;
 	gboolean		 interface_autodetect;
+	guint8			 ep_in;
+	guint16			 ep_in_sz;
 	FuHidDeviceFlags	 flags;
 } FuHidDevicePrivate;
 
@@ -90,6 +95,10 @@ fu_hid_device_open (FuDevice *device, GError **error)
 	if (!FU_DEVICE_CLASS (fu_hid_device_parent_class)->open (device, error))
 		return FALSE;
 
+	/* replaying a trace, so there is no device */
+	if (fu_io_trace_get_mode () == FU_IO_TRACE_MODE_REPLAY)
+		return TRUE;
+
 	/* auto-detect */
 	if (priv->interface_autodetect) {
 		g_autoptr(GPtrArray) ifaces = NULL;
@@ -114,6 +123,26 @@ fu_hid_device_open (FuDevice *device, GError **error)
 		g_debug ("autodetected HID interface of 0x%02x", priv->interface);
 	}
 
+	/* find the interrupt IN endpoint used for input reports */
+	if (priv->ep_in == 0x0) {
+		g_autoptr(GPtrArray) ifaces = g_usb_device_get_interfaces (usb_device, NULL);
+		for (guint i = 0; ifaces != NULL && i < ifaces->len; i++) {
+			GUsbInterface *iface = g_ptr_array_index (ifaces, i);
+			g_autoptr(GPtrArray) endpoints = NULL;
+			if (g_usb_interface_get_number (iface) != priv->interface)
+				continue;
+			endpoints = g_usb_interface_get_endpoints (iface);
+			for (guint j = 0; endpoints != NULL && j < endpoints->len; j++) {
+				GUsbEndpoint *ep = g_ptr_array_index (endpoints, j);
+				if (g_usb_endpoint_get_direction (ep) != G_USB_DEVICE_DIRECTION_DEVICE_TO_HOST)
+					continue;
+				priv->ep_in = g_usb_endpoint_get_address (ep);
+				priv->ep_in_sz = g_usb_endpoint_get_maximum_packet_size (ep);
+				break;
+			}
+		}
+	}
+
 	/* claim */
 	if ((priv->flags & FU_HID_DEVICE_FLAG_NO_KERNEL_UNBIND) == 0)
 		flags |= G_USB_DEVICE_CLAIM_INTERFACE_BIND_KERNEL_DRIVER;
@@ -139,6 +168,10 @@ fu_hid_device_close (FuDevice *device, GError **error)
 #endif
 
 #ifdef HAVE_GUSB
+	/* replaying a trace, so there is no device */
+	if (fu_io_trace_get_mode () == FU_IO_TRACE_MODE_REPLAY)
+		return FU_DEVICE_CLASS (fu_hid_device_parent_class)->close (device, error);
+
 	/* release */
 	if ((priv->flags & FU_HID_DEVICE_FLAG_NO_KERNEL_REBIND) == 0)
 		flags |= G_USB_DEVICE_CLAIM_INTERFACE_BIND_KERNEL_DRIVER;
@@ -235,7 +268,6 @@ fu_hid_device_set_report_internal (FuHidDevice *self,
 {
 #ifdef HAVE_GUSB
 	FuHidDevicePrivate *priv = GET_PRIVATE (self);
-	GUsbDevice *usb_device;
 	gsize actual_len = 0;
 	guint16 wvalue = (FU_HID_REPORT_TYPE_OUTPUT << 8) | helper->value;
 
@@ -250,17 +282,16 @@ fu_hid_device_set_report_internal (FuHidDevice *self,
 		fu_common_dump_raw (G_LOG_DOMAIN, title,
 				    helper->buf, helper->bufsz);
 	}
-	usb_device = fu_usb_device_get_dev (FU_USB_DEVICE (self));
-	if (!g_usb_device_control_transfer (usb_device,
-					    G_USB_DEVICE_DIRECTION_HOST_TO_DEVICE,
-					    G_USB_DEVICE_REQUEST_TYPE_CLASS,
-					    G_USB_DEVICE_RECIPIENT_INTERFACE,
-					    FU_HID_REPORT_SET,
-					    wvalue, priv->interface,
-					    helper->buf, helper->bufsz,
-					    &actual_len,
-					    helper->timeout,
-					    NULL, error)) {
+	if (!fu_usb_device_control_transfer (FU_USB_DEVICE (self),
+					     G_USB_DEVICE_DIRECTION_HOST_TO_DEVICE,
+					     G_USB_DEVICE_REQUEST_TYPE_CLASS,
+					     G_USB_DEVICE_RECIPIENT_INTERFACE,
+					     FU_HID_REPORT_SET,
+					     wvalue, priv->interface,
+					     helper->buf, helper->bufsz,
+					     &actual_len,
+					     helper->timeout,
+					     NULL, error)) {
 		g_prefix_error (error, "failed to SetReport: ");
 		return FALSE;
 	}
@@ -270,6 +301,7 @@ fu_hid_device_set_report_internal (FuHidDevice *self,
 			     actual_len, helper->bufsz);
 		return FALSE;
 	}
+	fu_device_add_metric_counter (FU_DEVICE (self), "write-bytes", actual_len);
 #endif
 	return TRUE;
 }
@@ -342,7 +374,6 @@ fu_hid_device_get_report_internal (FuHidDevice *self,
 {
 #ifdef HAVE_GUSB
 	FuHidDevicePrivate *priv = GET_PRIVATE (self);
-	GUsbDevice *usb_device;
 	gsize actual_len = 0;
 	guint16 wvalue = (FU_HID_REPORT_TYPE_INPUT << 8) | helper->value;
 
@@ -357,17 +388,16 @@ fu_hid_device_get_report_internal (FuHidDevice *self,
 		fu_common_dump_raw (G_LOG_DOMAIN, title,
 				    helper->buf, actual_len);
 	}
-	usb_device = fu_usb_device_get_dev (FU_USB_DEVICE (self));
-	if (!g_usb_device_control_transfer (usb_device,
-					    G_USB_DEVICE_DIRECTION_DEVICE_TO_HOST,
-					    G_USB_DEVICE_REQUEST_TYPE_CLASS,
-					    G_USB_DEVICE_RECIPIENT_INTERFACE,
-					    FU_HID_REPORT_GET,
-					    wvalue, priv->interface,
-					    helper->buf, helper->bufsz,
-					    &actual_len, /* actual length */
-					    helper->timeout,
-					    NULL, error)) {
+	if (!fu_usb_device_control_transfer (FU_USB_DEVICE (self),
+					     G_USB_DEVICE_DIRECTION_DEVICE_TO_HOST,
+					     G_USB_DEVICE_REQUEST_TYPE_CLASS,
+					     G_USB_DEVICE_RECIPIENT_INTERFACE,
+					     FU_HID_REPORT_GET,
+					     wvalue, priv->interface,
+					     helper->buf, helper->bufsz,
+					     &actual_len, /* actual length */
+					     helper->timeout,
+					     NULL, error)) {
 		g_prefix_error (error, "failed to GetReport: ");
 		return FALSE;
 	}
@@ -383,6 +413,7 @@ fu_hid_device_get_report_internal (FuHidDevice *self,
 			     actual_len, helper->bufsz);
 		return FALSE;
 	}
+	fu_device_add_metric_counter (FU_DEVICE (self), "read-bytes", actual_len);
 #endif
 	return TRUE;
 }
@@ -448,6 +479,216 @@ fu_hid_device_get_report (FuHidDevice *self,
 	return fu_hid_device_get_report_internal (self, &helper, error);
 }
 
+/**
+ * fu_hid_device_set_interrupt_endpoint:
+ * @self: A #FuHidDevice
+ * @ep: An endpoint address, e.g. 0x81
+ * @ep_sz: The maximum packet size, or 0 for the default
+ *
+ * Sets the interrupt IN endpoint used to read input reports.
+ *
+ * In most cases the endpoint is auto-detected when the device is opened, but
+ * this function can be used where the endpoint descriptor is invalid.
+ *
+ * Since: 1.6.0
+ **/
+void
+fu_hid_device_set_interrupt_endpoint (FuHidDevice *self, guint8 ep, guint16 ep_sz)
+{
+	FuHidDevicePrivate *priv = GET_PRIVATE (self);
+	g_return_if_fail (FU_HID_DEVICE (self));
+	priv->ep_in = ep;
+	priv->ep_in_sz = ep_sz;
+}
+
+/**
+ * fu_hid_device_read_interrupt:
+ * @self: A #FuHidDevice
+ * @buf: a mutable buffer to read an input report into
+ * @bufsz: Size of @buf
+ * @actual_length: (out) (optional): the number of bytes read
+ * @timeout: timeout in ms
+ * @error: a #GError or %NULL
+ *
+ * Reads one input report from the interrupt IN endpoint, returning as soon
+ * as the device sends it rather than polling with GetReport.
+ *
+ * Returns: %TRUE for success
+ *
+ * Since: 1.6.0
+ **/
+gboolean
+fu_hid_device_read_interrupt (FuHidDevice *self,
+			      guint8 *buf,
+			      gsize bufsz,
+			      gsize *actual_length,
+			      guint timeout,
+			      GError **error)
+{
+	FuHidDevicePrivate *priv = GET_PRIVATE (self);
+	gsize actual_length_tmp = 0;
+
+	g_return_val_if_fail (FU_HID_DEVICE (self), FALSE);
+	g_return_val_if_fail (buf != NULL, FALSE);
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+	if (priv->ep_in == 0x0) {
+		g_set_error_literal (error,
+				     FWUPD_ERROR,
+				     FWUPD_ERROR_NOT_SUPPORTED,
+				     "no interrupt IN endpoint");
+		return FALSE;
+	}
+	if (!fu_usb_device_interrupt_transfer (FU_USB_DEVICE (self), priv->ep_in,
+					       buf, bufsz, &actual_length_tmp,
+					       timeout, NULL, error)) {
+		g_prefix_error (error, "failed to read input report: ");
+		return FALSE;
+	}
+	if (g_getenv ("FU_HID_DEVICE_VERBOSE") != NULL) {
+		g_autofree gchar *title = NULL;
+		title = g_strdup_printf ("HID::Interrupt [ep=0x%02x]", priv->ep_in);
+		fu_common_dump_raw (G_LOG_DOMAIN, title, buf, actual_length_tmp);
+	}
+	fu_device_add_metric_counter (FU_DEVICE (self), "read-bytes", actual_length_tmp);
+	if (actual_length != NULL)
+		*actual_length = actual_length_tmp;
+	return TRUE;
+}
+
+static gboolean
+fu_hid_device_match_report_id (FuHidDevice *self,
+			       GByteArray *request,
+			       GByteArray *response,
+			       gpointer user_data)
+{
+	return response->len > 0 && response->data[0] == request->data[0];
+}
+
+/**
+ * fu_hid_device_transfer_reports:
+ * @self: A #FuHidDevice
+ * @requests: (element-type GByteArray): output reports, each starting with the report ID
+ * @max_outstanding: the number of requests that can be sent before the oldest is answered
+ * @timeout: timeout in ms for each response
+ * @flags: #FuHidDeviceFlags e.g. %FU_HID_DEVICE_FLAG_IS_FEATURE
+ * @match_func: (scope call) (nullable): a function to match responses to requests
+ * @user_data: (nullable): user data for @match_func
+ * @error: a #GError or %NULL
+ *
+ * Sends each request with SetReport, keeping up to @max_outstanding requests
+ * unanswered, and reads the responses from the interrupt IN endpoint.
+ *
+ * Each response is given to the oldest unanswered request that @match_func
+ * accepts, so devices that use a sequence number can answer out of order. By
+ * default responses are matched using the report ID, and input reports that
+ * do not match any request are ignored.
+ *
+ * The time taken for each response is recorded as a device metric.
+ *
+ * Returns: (transfer container) (element-type GByteArray): responses in the same order as @requests, or %NULL
+ *
+ * Since: 1.6.0
+ **/
+GPtrArray *
+fu_hid_device_transfer_reports (FuHidDevice *self,
+				GPtrArray *requests,
+				guint max_outstanding,
+				guint timeout,
+				FuHidDeviceFlags flags,
+				FuHidDeviceMatchFunc match_func,
+				gpointer user_data,
+				GError **error)
+{
+	FuHidDevicePrivate *priv = GET_PRIVATE (self);
+	guint done = 0;
+	guint idx_next = 0;
+	gsize bufsz;
+	g_autofree gint64 *starts = NULL;
+	g_autofree guint8 *buf = NULL;
+	g_autoptr(GArray) pending = g_array_new (FALSE, FALSE, sizeof(guint));
+	g_autoptr(GPtrArray) responses = NULL;
+
+	g_return_val_if_fail (FU_HID_DEVICE (self), NULL);
+	g_return_val_if_fail (requests != NULL, NULL);
+	g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+	if (match_func == NULL)
+		match_func = fu_hid_device_match_report_id;
+	max_outstanding = MAX(max_outstanding, 1);
+	bufsz = priv->ep_in_sz > 0 ? priv->ep_in_sz : FU_HID_DEVICE_EP_IN_SIZE_DEFAULT;
+	buf = g_malloc0 (bufsz);
+	starts = g_new0 (gint64, requests->len);
+	responses = g_ptr_array_new_with_free_func ((GDestroyNotify) g_byte_array_unref);
+	g_ptr_array_set_size (responses, requests->len);
+
+	while (done < requests->len) {
+		gsize actual_length = 0;
+		gboolean matched = FALSE;
+		g_autoptr(GByteArray) response = NULL;
+
+		/* write as many requests as the protocol allows */
+		while (idx_next < requests->len && pending->len < max_outstanding) {
+			GByteArray *request = g_ptr_array_index (requests, idx_next);
+			if (request->len == 0) {
+				g_set_error (error,
+					     G_IO_ERROR,
+					     G_IO_ERROR_INVALID_DATA,
+					     "request %u has no report ID",
+					     idx_next);
+				return NULL;
+			}
+			starts[idx_next] = g_get_monotonic_time ();
+			if (!fu_hid_device_set_report (self, request->data[0],
+						       request->data, request->len,
+						       timeout, flags, error)) {
+				g_prefix_error (error, "failed to send request %u: ", idx_next);
+				return NULL;
+			}
+			g_array_append_val (pending, idx_next);
+			idx_next++;
+		}
+
+		/* the oldest request has not been answered in time */
+		if (g_get_monotonic_time () - starts[g_array_index (pending, guint, 0)] >
+		    (gint64) timeout * 1000) {
+			g_set_error (error,
+				     G_IO_ERROR,
+				     G_IO_ERROR_TIMED_OUT,
+				     "no response to request %u",
+				     g_array_index (pending, guint, 0));
+			return NULL;
+		}
+
+		/* get the next input report */
+		if (!fu_hid_device_read_interrupt (self, buf, bufsz, &actual_length,
+						   timeout, error)) {
+			g_prefix_error (error, "no response to request %u: ",
+					g_array_index (pending, guint, 0));
+			return NULL;
+		}
+		response = g_byte_array_sized_new (actual_length);
+		g_byte_array_append (response, buf, actual_length);
+		for (guint i = 0; i < pending->len; i++) {
+			guint idx = g_array_index (pending, guint, i);
+			GByteArray *request = g_ptr_array_index (requests, idx);
+			if (!match_func (self, request, response, user_data))
+				continue;
+			fu_device_add_metric_duration_by_id (FU_DEVICE (self), "report-latency", starts[idx]);
+			g_ptr_array_index (responses, idx) = g_steal_pointer (&response);
+			g_array_remove_index (pending, i);
+			matched = TRUE;
+			done++;
+			break;
+		}
+		if (!matched)
+			g_debug ("ignoring unexpected input report 0x%02x", buf[0]);
+	}
+
+	/* success */
+	return g_steal_pointer (&responses);
+}
+
 static void
 fu_hid_device_init (FuHidDevice *self)
 {
@@ -41,6 +41,22 @@ typedef enum {
 	FU_HID_DEVICE_FLAG_LAST
 } FuHidDeviceFlags;
 
+/**
+ * FuHidDeviceMatchFunc:
+ * @self: A #FuHidDevice
+ * @request: the output report that was sent
+ * @response: the input report that was received
+ * @user_data: user data
+ *
+ * Checks if an input report is the response to a request.
+ *
+ * Returns: %TRUE if @response answers @request
+ **/
+typedef gboolean (*FuHidDeviceMatchFunc)		(FuHidDevice	*self,
+							 GByteArray	*request,
+							 GByteArray	*response,
+							 gpointer	 user_data);
+
 FuHidDevice	*fu_hid_device_new			(GUsbDevice	*usb_device);
 void		 fu_hid_device_add_flag			(FuHidDevice	*self,
 							 FuHidDeviceFlags flag);
@@ -63,3 +79,22 @@ gboolean	 fu_hid_device_get_report		(FuHidDevice	*self,
 							 FuHidDeviceFlags flags,
 							 GError		**error)
 							 G_GNUC_WARN_UNUSED_RESULT;
+void		 fu_hid_device_set_interrupt_endpoint	(FuHidDevice	*self,
+							 guint8		 ep,
+							 guint16	 ep_sz);
+gboolean	 fu_hid_device_read_interrupt		(FuHidDevice	*self,
+							 guint8		*buf,
+							 gsize		 bufsz,
+							 gsize		*actual_length,
+							 guint		 timeout,
+							 GError		**error)
+							 G_GNUC_WARN_UNUSED_RESULT;
+GPtrArray	*fu_hid_device_transfer_reports		(FuHidDevice	*self,
+							 GPtrArray	*requests,
+							 guint		 max_outstanding,
+							 guint		 timeout,
+							 FuHidDeviceFlags flags,
+							 FuHidDeviceMatchFunc match_func,
+							 gpointer	 user_data,
+							 GError		**error)
+							 G_GNUC_WARN_UNUSED_RESULT;
@@ -0,0 +1,16 @@
+/*
+ * Copyright (C) 2021 Richard Hughes <richard@hughsie.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1+
+ */
+
+#pragma once
+
+#include "fu-hwids.h"
+
+gboolean	 fu_hwids_setup_from_keyfile	(FuHwids	*self,
+						 GKeyFile	*kf,
+						 GError		**error)
+						 G_GNUC_WARN_UNUSED_RESULT;
+void		 fu_hwids_to_keyfile		(FuHwids	*self,
+						 GKeyFile	*kf);
@@ -13,7 +13,7 @@
 #include <string.h>
 
 #include "fu-common.h"
-#include "fu-hwids.h"
+#include "fu-hwids-private.h"
 #include "fwupd-common.h"
 #include "fwupd-error.h"
 
@@ -361,6 +361,31 @@ fu_hwids_convert_integer_cb (FuSmbios *smbios,
 	return g_strdup_printf ("%x", tmp);
 }
 
+static void
+fu_hwids_add_value (FuHwids *self, const gchar *key, const gchar *value)
+{
+	g_autofree gchar *value_safe = NULL;
+
+	g_hash_table_insert (self->hash_dmi_hw, g_strdup (key), g_strdup (value));
+
+	/* make suitable for display */
+	value_safe = g_str_to_ascii (value, "C");
+	g_strdelimit (value_safe, "\n\r", '\0');
+	g_strchomp (value_safe);
+	g_hash_table_insert (self->hash_dmi_display,
+			     g_strdup (key),
+			     g_steal_pointer (&value_safe));
+}
+
+static void
+fu_hwids_add_guid (FuHwids *self, const gchar *guid)
+{
+	g_hash_table_insert (self->hash_guid,
+			     g_strdup (guid),
+			     GUINT_TO_POINTER (1));
+	g_ptr_array_add (self->array_guids, g_strdup (guid));
+}
+
 /**
  * fu_hwids_setup:
  * @self: A #FuHwids
@@ -415,7 +440,6 @@ fu_hwids_setup (FuHwids *self, FuSmbios *smbios, GError **error)
 	for (guint i = 0; map[i].key != NULL; i++) {
 		const gchar *contents_hdr = NULL;
 		g_autofree gchar *contents = NULL;
-		g_autofree gchar *contents_safe = NULL;
 		g_autoptr(GError) error_local = NULL;
 
 		/* get the data from a SMBIOS table unless an override exists */
@@ -444,17 +468,7 @@ fu_hwids_setup (FuHwids *self, FuSmbios *smbios, GError **error)
 		while (contents_hdr[0] == '0' &&
 		       map[i].func != fu_hwids_convert_padded_integer_cb)
 			contents_hdr++;
-		g_hash_table_insert (self->hash_dmi_hw,
-				     g_strdup (map[i].key),
-				     g_strdup (contents_hdr));
-
-		/* make suitable for display */
-		contents_safe = g_str_to_ascii (contents_hdr, "C");
-		g_strdelimit (contents_safe, "\n\r", '\0');
-		g_strchomp (contents_safe);
-		g_hash_table_insert (self->hash_dmi_display,
-				     g_strdup (map[i].key),
-				     g_steal_pointer (&contents_safe));
+		fu_hwids_add_value (self, map[i].key, contents_hdr);
 	}
 
 	/* add GUIDs */
@@ -470,15 +484,88 @@ fu_hwids_setup (FuHwids *self, FuSmbios *smbios, GError **error)
 			g_debug ("%s is not available, %s", key, error_local->message);
 			continue;
 		}
-		g_hash_table_insert (self->hash_guid,
-				     g_strdup (guid),
-				     GUINT_TO_POINTER (1));
-		g_ptr_array_add (self->array_guids, g_steal_pointer (&guid));
+		fu_hwids_add_guid (self, guid);
 	}
 
 	return TRUE;
 }
 
+/**
+ * fu_hwids_setup_from_keyfile:
+ * @self: A #FuHwids
+ * @kf: A #GKeyFile
+ * @error: A #GError or %NULL
+ *
+ * Loads the DMI values and the hardware GUIDs previously saved using
+ * fu_hwids_to_keyfile(), which avoids recalculating all the GUIDs.
+ *
+ * Returns: %TRUE for success
+ *
+ * Since: 1.6.0
+ **/
+gboolean
+fu_hwids_setup_from_keyfile (FuHwids *self, GKeyFile *kf, GError **error)
+{
+	g_auto(GStrv) guids = NULL;
+	g_auto(GStrv) keys = NULL;
+	g_autoptr(GPtrArray) values = g_ptr_array_new_with_free_func (g_free);
+
+	g_return_val_if_fail (FU_IS_HWIDS (self), FALSE);
+	g_return_val_if_fail (kf != NULL, FALSE);
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+	/* the GUIDs are required, even if there are no DMI values */
+	guids = g_key_file_get_string_list (kf, "HwIds", "Guids", NULL, error);
+	if (guids == NULL)
+		return FALSE;
+	if (g_key_file_has_group (kf, "Smbios")) {
+		keys = g_key_file_get_keys (kf, "Smbios", NULL, error);
+		if (keys == NULL)
+			return FALSE;
+	}
+	for (guint i = 0; keys != NULL && keys[i] != NULL; i++) {
+		gchar *value = g_key_file_get_string (kf, "Smbios", keys[i], error);
+		if (value == NULL)
+			return FALSE;
+		g_ptr_array_add (values, value);
+	}
+
+	/* only modify the object when everything was read */
+	for (guint i = 0; i < values->len; i++)
+		fu_hwids_add_value (self, keys[i], g_ptr_array_index (values, i));
+	for (guint i = 0; guids[i] != NULL; i++)
+		fu_hwids_add_guid (self, guids[i]);
+	return TRUE;
+}
+
+/**
+ * fu_hwids_to_keyfile:
+ * @self: A #FuHwids
+ * @kf: A #GKeyFile
+ *
+ * Saves the DMI values and the hardware GUIDs so that they can be loaded
+ * using fu_hwids_setup_from_keyfile().
+ *
+ * Since: 1.6.0
+ **/
+void
+fu_hwids_to_keyfile (FuHwids *self, GKeyFile *kf)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+
+	g_return_if_fail (FU_IS_HWIDS (self));
+	g_return_if_fail (kf != NULL);
+
+	g_key_file_remove_group (kf, "Smbios", NULL);
+	g_hash_table_iter_init (&iter, self->hash_dmi_hw);
+	while (g_hash_table_iter_next (&iter, &key, &value))
+		g_key_file_set_string (kf, "Smbios", key, value);
+	g_key_file_set_string_list (kf, "HwIds", "Guids",
+				    (const gchar * const *) self->array_guids->pdata,
+				    self->array_guids->len);
+}
+
 static void
 fu_hwids_finalize (GObject *object)
 {
@@ -0,0 +1,738 @@
+/*
+ * Copyright (C) 2021 Richard Hughes <richard@hughsie.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1+
+ */
+
+#define G_LOG_DOMAIN				"FuIoTrace"
+
+#include <config.h>
+
+#include <string.h>
+
+#include "fwupd-error.h"
+
+#include "fu-device-private.h"
+#include "fu-common.h"
+#include "fu-io-trace.h"
+#include "fu-usb-device.h"
+
+/**
+ * SECTION:fu-io-trace
+ * @short_description: record and replay low level device I/O
+ *
+ * When recording, every USB transfer, HID report, ioctl and pread or pwrite
+ * made using #FuUsbDevice, #FuHidDevice and #FuUdevDevice is saved to a trace
+ * file with the time taken. When replaying, the device is not used at all and
+ * each transaction is answered from the trace, optionally waiting for the
+ * recorded duration so that update loops can be benchmarked without hardware.
+ *
+ * The trace is a binary file starting with `FWIOTRC1`, followed by records
+ * that each start with a tag byte. All integers are little endian, strings
+ * are prefixed with a 16 bit length and data with a 32 bit length.
+ *
+ * A transaction is tagged `T` and has the kind, the 64 bit request, the 64 bit
+ * offset from the start and 32 bit duration in microseconds, the 32 bit actual
+ * length, the data sent and received and then a byte set to 1 if followed by
+ * the error domain, 32 bit code and message.
+ *
+ * Devices added by a backend are also saved, tagged `D`, with the number of
+ * fields followed by the GType name, backend ID, physical ID, logical ID,
+ * instance IDs, GUIDs and possible plugins, where `-` is unset and lists are
+ * comma separated, so that a replay backend can create the same devices
+ * without the hardware being present. Only #FuUdevDevice devices can be
+ * created this way, as plugins use the #GUsbDevice of a #FuUsbDevice directly;
+ * USB transfers are recorded for profiling but cannot be replayed.
+ *
+ * All functions are threadsafe, although replay requires that the
+ * transactions happen in the same order as they were recorded.
+ */
+
+#define FU_IO_TRACE_MAGIC		"FWIOTRC1"
+#define FU_IO_TRACE_TAG_TRANSACTION	'T'
+#define FU_IO_TRACE_TAG_DEVICE		'D'
+
+typedef struct {
+	gchar		*kind;
+	guint64		 request;
+	guint64		 duration;
+	gsize		 actual_length;
+	GBytes		*buf_in;
+	GBytes		*buf_out;
+	GError		*error;
+	gchar		**device;
+} FuIoTraceItem;
+
+static GMutex		 trace_mutex;
+static FuIoTraceMode	 trace_mode = FU_IO_TRACE_MODE_NONE;
+static GOutputStream	*trace_ostream = NULL;
+static gint64		 trace_start = 0;
+static GPtrArray	*trace_items = NULL;	/* of FuIoTraceItem */
+static guint		 trace_idx = 0;
+static gdouble		 trace_speed = 0.f;
+static GPtrArray	*trace_devices = NULL;	/* of FuIoTraceItem, not owned */
+
+#define FU_IO_TRACE_DEVICE_FIELDS	8
+
+static void
+fu_io_trace_item_free (FuIoTraceItem *item)
+{
+	g_free (item->kind);
+	if (item->buf_in != NULL)
+		g_bytes_unref (item->buf_in);
+	if (item->buf_out != NULL)
+		g_bytes_unref (item->buf_out);
+	if (item->error != NULL)
+		g_error_free (item->error);
+	g_strfreev (item->device);
+	g_free (item);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(FuIoTraceItem, fu_io_trace_item_free)
+
+static void
+fu_io_trace_append_data (GByteArray *buf, const guint8 *data, gsize datasz)
+{
+	if (data == NULL)
+		datasz = 0;
+	fu_byte_array_append_uint32 (buf, MIN(datasz, G_MAXUINT32), G_LITTLE_ENDIAN);
+	if (datasz > 0)
+		g_byte_array_append (buf, data, MIN(datasz, G_MAXUINT32));
+}
+
+static void
+fu_io_trace_append_str (GByteArray *buf, const gchar *value)
+{
+	gsize valuesz;
+
+	if (value == NULL)
+		value = "-";
+	valuesz = MIN(strlen (value), G_MAXUINT16);
+	fu_byte_array_append_uint16 (buf, valuesz, G_LITTLE_ENDIAN);
+	g_byte_array_append (buf, (const guint8 *) value, valuesz);
+}
+
+static void
+fu_io_trace_append_strv (GByteArray *buf, GPtrArray *array)
+{
+	g_autoptr(GString) str = g_string_new (NULL);
+
+	for (guint i = 0; array != NULL && i < array->len; i++) {
+		const gchar *tmp = g_ptr_array_index (array, i);
+		if (str->len > 0)
+			g_string_append_c (str, ',');
+		g_string_append (str, tmp);
+	}
+	fu_io_trace_append_str (buf, str->len > 0 ? str->str : NULL);
+}
+
+static gboolean
+fu_io_trace_parse_data (const guint8 *buf, gsize bufsz, gsize *offset,
+			GBytes **bytes, GError **error)
+{
+	guint32 datasz = 0;
+	g_autofree guint8 *data = NULL;
+
+	if (!fu_common_read_uint32_safe (buf, bufsz, *offset, &datasz,
+					 G_LITTLE_ENDIAN, error))
+		return FALSE;
+	*offset += sizeof(datasz);
+	if (datasz == 0)
+		return TRUE;
+	data = g_malloc (datasz);
+	if (!fu_memcpy_safe (data, datasz, 0x0,		/* dst */
+			     buf, bufsz, *offset,	/* src */
+			     datasz, error))
+		return FALSE;
+	*offset += datasz;
+	*bytes = g_bytes_new_take (g_steal_pointer (&data), datasz);
+	return TRUE;
+}
+
+static gchar *
+fu_io_trace_parse_str (const guint8 *buf, gsize bufsz, gsize *offset, GError **error)
+{
+	guint16 valuesz = 0;
+	g_autofree gchar *value = NULL;
+
+	if (!fu_common_read_uint16_safe (buf, bufsz, *offset, &valuesz,
+					 G_LITTLE_ENDIAN, error))
+		return NULL;
+	*offset += sizeof(valuesz);
+	value = g_malloc0 (valuesz + 1);
+	if (!fu_memcpy_safe ((guint8 *) value, valuesz, 0x0,	/* dst */
+			     buf, bufsz, *offset,		/* src */
+			     valuesz, error))
+		return NULL;
+	*offset += valuesz;
+	return g_steal_pointer (&value);
+}
+
+static void
+fu_io_trace_write (GByteArray *buf, const gchar *what)
+{
+	g_autoptr(GError) error_local = NULL;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&trace_mutex);
+
+	if (trace_ostream == NULL)
+		return;
+	if (!g_output_stream_write_all (trace_ostream, buf->data, buf->len,
+					NULL, NULL, &error_local))
+		g_warning ("failed to record %s: %s", what, error_local->message);
+}
+
+/**
+ * fu_io_trace_get_mode:
+ *
+ * Gets the current I/O trace mode.
+ *
+ * Returns: a #FuIoTraceMode, e.g. %FU_IO_TRACE_MODE_REPLAY
+ *
+ * Since: 1.6.0
+ **/
+FuIoTraceMode
+fu_io_trace_get_mode (void)
+{
+	return g_atomic_int_get (&trace_mode);
+}
+
+/**
+ * fu_io_trace_record_start:
+ * @filename: a trace file to create
+ * @error: A #GError, or %NULL
+ *
+ * Starts recording all device transactions to a file.
+ *
+ * Returns: %TRUE for success
+ *
+ * Since: 1.6.0
+ **/
+gboolean
+fu_io_trace_record_start (const gchar *filename, GError **error)
+{
+	g_autoptr(GFile) file = NULL;
+	g_autoptr(GFileOutputStream) ostream = NULL;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&trace_mutex);
+
+	g_return_val_if_fail (filename != NULL, FALSE);
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+	if (trace_mode != FU_IO_TRACE_MODE_NONE) {
+		g_set_error_literal (error,
+				     FWUPD_ERROR,
+				     FWUPD_ERROR_INTERNAL,
+				     "I/O trace already in progress");
+		return FALSE;
+	}
+	file = g_file_new_for_path (filename);
+	ostream = g_file_replace (file, NULL, FALSE, G_FILE_CREATE_NONE, NULL, error);
+	if (ostream == NULL)
+		return FALSE;
+	if (!g_output_stream_write_all (G_OUTPUT_STREAM (ostream),
+					FU_IO_TRACE_MAGIC,
+					strlen (FU_IO_TRACE_MAGIC),
+					NULL, NULL, error))
+		return FALSE;
+	trace_ostream = G_OUTPUT_STREAM (g_steal_pointer (&ostream));
+	trace_start = g_get_monotonic_time ();
+	g_atomic_int_set (&trace_mode, FU_IO_TRACE_MODE_RECORD);
+	return TRUE;
+}
+
+static FuIoTraceItem *
+fu_io_trace_item_parse (const guint8 *buf, gsize bufsz, gsize *offset, GError **error)
+{
+	guint8 has_error = 0;
+	guint32 duration = 0;
+	guint32 actual_length = 0;
+	g_autoptr(FuIoTraceItem) item = g_new0 (FuIoTraceItem, 1);
+
+	item->kind = fu_io_trace_parse_str (buf, bufsz, offset, error);
+	if (item->kind == NULL)
+		return NULL;
+	if (!fu_common_read_uint64_safe (buf, bufsz, *offset, &item->request,
+					 G_LITTLE_ENDIAN, error))
+		return NULL;
+	*offset += sizeof(guint64);
+
+	/* the offset from the start is only for reading the trace */
+	*offset += sizeof(guint64);
+	if (!fu_common_read_uint32_safe (buf, bufsz, *offset, &duration,
+					 G_LITTLE_ENDIAN, error))
+		return NULL;
+	*offset += sizeof(duration);
+	item->duration = duration;
+	if (!fu_common_read_uint32_safe (buf, bufsz, *offset, &actual_length,
+					 G_LITTLE_ENDIAN, error))
+		return NULL;
+	*offset += sizeof(actual_length);
+	item->actual_length = actual_length;
+	if (!fu_io_trace_parse_data (buf, bufsz, offset, &item->buf_in, error))
+		return NULL;
+	if (!fu_io_trace_parse_data (buf, bufsz, offset, &item->buf_out, error))
+		return NULL;
+	if (!fu_common_read_uint8_safe (buf, bufsz, *offset, &has_error, error))
+		return NULL;
+	*offset += sizeof(has_error);
+	if (has_error) {
+		guint32 code = 0;
+		g_autofree gchar *domain = NULL;
+		g_autofree gchar *message = NULL;
+		domain = fu_io_trace_parse_str (buf, bufsz, offset, error);
+		if (domain == NULL)
+			return NULL;
+		if (!fu_common_read_uint32_safe (buf, bufsz, *offset, &code,
+						 G_LITTLE_ENDIAN, error))
+			return NULL;
+		*offset += sizeof(code);
+		message = fu_io_trace_parse_str (buf, bufsz, offset, error);
+		if (message == NULL)
+			return NULL;
+		item->error = g_error_new_literal (g_quark_from_string (domain),
+						   (gint) code, message);
+	}
+	return g_steal_pointer (&item);
+}
+
+static FuIoTraceItem *
+fu_io_trace_item_parse_device (const guint8 *buf, gsize bufsz, gsize *offset, GError **error)
+{
+	guint8 fieldcnt = 0;
+	g_autoptr(FuIoTraceItem) item = g_new0 (FuIoTraceItem, 1);
+
+	if (!fu_common_read_uint8_safe (buf, bufsz, *offset, &fieldcnt, error))
+		return NULL;
+	*offset += sizeof(fieldcnt);
+	if (fieldcnt + 1 < FU_IO_TRACE_DEVICE_FIELDS) {
+		g_set_error (error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_INVALID_FILE,
+			     "invalid trace device with %u fields",
+			     fieldcnt);
+		return NULL;
+	}
+	item->kind = g_strdup ("device");
+	item->device = g_new0 (gchar *, fieldcnt + 2);
+	item->device[0] = g_strdup (item->kind);
+	for (guint i = 0; i < fieldcnt; i++) {
+		item->device[i + 1] = fu_io_trace_parse_str (buf, bufsz, offset, error);
+		if (item->device[i + 1] == NULL)
+			return NULL;
+	}
+	return g_steal_pointer (&item);
+}
+
+/**
+ * fu_io_trace_replay_start:
+ * @filename: a trace file created with fu_io_trace_record_start()
+ * @speed: the replay speed, e.g. 1.0 for real time or 0.0 for no delays
+ * @error: A #GError, or %NULL
+ *
+ * Starts answering all device transactions from a trace, without using the
+ * hardware at all.
+ *
+ * Returns: %TRUE for success
+ *
+ * Since: 1.6.0
+ **/
+gboolean
+fu_io_trace_replay_start (const gchar *filename, gdouble speed, GError **error)
+{
+	gsize datasz = 0;
+	gsize offset = strlen (FU_IO_TRACE_MAGIC);
+	g_autofree gchar *data = NULL;
+	g_autoptr(GPtrArray) items = NULL;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&trace_mutex);
+
+	g_return_val_if_fail (filename != NULL, FALSE);
+	g_return_val_if_fail (speed >= 0.f, FALSE);
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+	if (trace_mode != FU_IO_TRACE_MODE_NONE) {
+		g_set_error_literal (error,
+				     FWUPD_ERROR,
+				     FWUPD_ERROR_INTERNAL,
+				     "I/O trace already in progress");
+		return FALSE;
+	}
+	if (!g_file_get_contents (filename, &data, &datasz, error))
+		return FALSE;
+	if (datasz < offset || memcmp (data, FU_IO_TRACE_MAGIC, offset) != 0) {
+		g_set_error (error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_INVALID_FILE,
+			     "%s is not an I/O trace", filename);
+		return FALSE;
+	}
+	items = g_ptr_array_new_with_free_func ((GDestroyNotify) fu_io_trace_item_free);
+	while (offset < datasz) {
+		const guint8 *buf = (const guint8 *) data;
+		guint8 tag = buf[offset++];
+		FuIoTraceItem *item;
+		if (tag == FU_IO_TRACE_TAG_TRANSACTION) {
+			item = fu_io_trace_item_parse (buf, datasz, &offset, error);
+		} else if (tag == FU_IO_TRACE_TAG_DEVICE) {
+			item = fu_io_trace_item_parse_device (buf, datasz, &offset, error);
+		} else {
+			g_set_error (error,
+				     FWUPD_ERROR,
+				     FWUPD_ERROR_INVALID_FILE,
+				     "invalid trace record tag 0x%02x",
+				     tag);
+			return FALSE;
+		}
+		if (item == NULL) {
+			g_prefix_error (error, "invalid trace record %u: ", items->len);
+			return FALSE;
+		}
+		g_ptr_array_add (items, item);
+	}
+	g_debug ("replaying %u transactions from %s", items->len, filename);
+	trace_items = g_steal_pointer (&items);
+	trace_devices = g_ptr_array_new ();
+	trace_idx = 0;
+	trace_speed = speed;
+	g_atomic_int_set (&trace_mode, FU_IO_TRACE_MODE_REPLAY);
+	return TRUE;
+}
+
+/**
+ * fu_io_trace_stop:
+ * @error: A #GError, or %NULL
+ *
+ * Stops recording or replaying device transactions.
+ *
+ * Returns: %TRUE for success
+ *
+ * Since: 1.6.0
+ **/
+gboolean
+fu_io_trace_stop (GError **error)
+{
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&trace_mutex);
+
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+	g_atomic_int_set (&trace_mode, FU_IO_TRACE_MODE_NONE);
+	if (trace_items != NULL) {
+		if (trace_idx != trace_items->len) {
+			g_debug ("only replayed %u of %u transactions",
+				 trace_idx, trace_items->len);
+		}
+		g_clear_pointer (&trace_items, g_ptr_array_unref);
+	}
+	if (trace_devices != NULL) {
+		if (trace_devices->len > 0)
+			g_debug ("%u devices were never added", trace_devices->len);
+		g_clear_pointer (&trace_devices, g_ptr_array_unref);
+	}
+	if (trace_ostream != NULL) {
+		g_autoptr(GOutputStream) ostream = g_steal_pointer (&trace_ostream);
+		if (!g_output_stream_close (ostream, NULL, error))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * fu_io_trace_record:
+ * @device: A #FuDevice
+ * @kind: transaction kind, e.g. `usb-control` or `pread`
+ * @request: an identifier for the request, e.g. the offset or ioctl number
+ * @buf_in: (nullable): data sent to the device
+ * @buf_insz: size of @buf_in
+ * @buf_out: (nullable): data received from the device
+ * @buf_outsz: size of @buf_out
+ * @actual_length: the number of bytes transferred, or the return value
+ * @start: the monotonic time the transaction was started
+ * @error_io: (nullable): the error returned by the transaction
+ *
+ * Saves a transaction to the trace if recording, otherwise does nothing.
+ *
+ * Since: 1.6.0
+ **/
+void
+fu_io_trace_record (FuDevice *device,
+		    const gchar *kind,
+		    guint64 request,
+		    const guint8 *buf_in,
+		    gsize buf_insz,
+		    const guint8 *buf_out,
+		    gsize buf_outsz,
+		    gsize actual_length,
+		    gint64 start,
+		    const GError *error_io)
+{
+	gint64 now = g_get_monotonic_time ();
+	g_autoptr(GByteArray) buf = NULL;
+
+	g_return_if_fail (FU_IS_DEVICE (device));
+	g_return_if_fail (kind != NULL);
+
+	if (fu_io_trace_get_mode () != FU_IO_TRACE_MODE_RECORD)
+		return;
+
+	buf = g_byte_array_new ();
+	fu_byte_array_append_uint8 (buf, FU_IO_TRACE_TAG_TRANSACTION);
+	fu_io_trace_append_str (buf, kind);
+	fu_byte_array_append_uint64 (buf, request, G_LITTLE_ENDIAN);
+	fu_byte_array_append_uint64 (buf, start - trace_start, G_LITTLE_ENDIAN);
+	fu_byte_array_append_uint32 (buf, (guint32) MIN(now - start, (gint64) G_MAXUINT32), G_LITTLE_ENDIAN);
+	fu_byte_array_append_uint32 (buf, MIN(actual_length, G_MAXUINT32), G_LITTLE_ENDIAN);
+	fu_io_trace_append_data (buf, buf_in, buf_insz);
+	fu_io_trace_append_data (buf, buf_out, buf_outsz);
+	fu_byte_array_append_uint8 (buf, error_io != NULL);
+	if (error_io != NULL) {
+		fu_io_trace_append_str (buf, g_quark_to_string (error_io->domain));
+		fu_byte_array_append_uint32 (buf, error_io->code, G_LITTLE_ENDIAN);
+		fu_io_trace_append_str (buf, error_io->message);
+	}
+	fu_io_trace_write (buf, kind);
+}
+
+/**
+ * fu_io_trace_replay:
+ * @device: A #FuDevice
+ * @kind: transaction kind, e.g. `usb-control` or `pread`
+ * @request: an identifier for the request, e.g. the offset or ioctl number
+ * @buf_in: (nullable): data sent to the device
+ * @buf_insz: size of @buf_in
+ * @buf_out: (nullable): buffer for data received from the device
+ * @buf_outsz: size of @buf_out
+ * @actual_length: (out) (optional): the recorded number of bytes transferred
+ * @error: A #GError, or %NULL
+ *
+ * Answers a transaction from the trace. The next transaction in the trace has
+ * to have the same kind and request, and data sent to the device has to match
+ * what was recorded, unless @buf_out is also set as for an ioctl.
+ *
+ * Returns: %TRUE for success, or the recorded error
+ *
+ * Since: 1.6.0
+ **/
+gboolean
+fu_io_trace_replay (FuDevice *device,
+		    const gchar *kind,
+		    guint64 request,
+		    const guint8 *buf_in,
+		    gsize buf_insz,
+		    guint8 *buf_out,
+		    gsize buf_outsz,
+		    gsize *actual_length,
+		    GError **error)
+{
+	FuIoTraceItem *item;
+	gsize actual_length_tmp;
+	gulong delay = 0;
+	g_autoptr(GBytes) blob_out = NULL;
+	g_autoptr(GError) error_io = NULL;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&trace_mutex);
+
+	g_return_val_if_fail (FU_IS_DEVICE (device), FALSE);
+	g_return_val_if_fail (kind != NULL, FALSE);
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+	/* devices added while recording are created by the backend later */
+	while (trace_items != NULL && trace_idx < trace_items->len) {
+		item = g_ptr_array_index (trace_items, trace_idx);
+		if (item->device == NULL)
+			break;
+		g_ptr_array_add (trace_devices, item);
+		trace_idx++;
+	}
+
+	/* find next item */
+	if (trace_items == NULL || trace_idx >= trace_items->len) {
+		g_set_error (error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_NOT_FOUND,
+			     "no more transactions in trace for %s 0x%" G_GINT64_MODIFIER "x",
+			     kind, request);
+		return FALSE;
+	}
+	item = g_ptr_array_index (trace_items, trace_idx);
+	if (g_strcmp0 (item->kind, kind) != 0 || item->request != request) {
+		g_set_error (error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_INVALID_FILE,
+			     "trace mismatch at transaction %u: expected %s 0x%"
+			     G_GINT64_MODIFIER "x, got %s 0x%" G_GINT64_MODIFIER "x",
+			     trace_idx, item->kind, item->request, kind, request);
+		return FALSE;
+	}
+
+	/* check the data written is the same */
+	if (buf_out == NULL && buf_in != NULL && item->buf_in != NULL) {
+		g_autoptr(GBytes) blob = g_bytes_new_static (buf_in, buf_insz);
+		if (!g_bytes_equal (blob, item->buf_in)) {
+			g_set_error (error,
+				     FWUPD_ERROR,
+				     FWUPD_ERROR_INVALID_FILE,
+				     "trace mismatch at transaction %u: "
+				     "different %s data for 0x%" G_GINT64_MODIFIER "x",
+				     trace_idx, kind, request);
+			return FALSE;
+		}
+	}
+	trace_idx++;
+
+	/* the item is freed if the trace is stopped, so copy what is needed
+	 * and do not block other devices while waiting */
+	if (trace_speed > 0.f)
+		delay = (gulong) (item->duration / trace_speed);
+	if (item->error != NULL)
+		error_io = g_error_copy (item->error);
+	if (item->buf_out != NULL)
+		blob_out = g_bytes_ref (item->buf_out);
+	actual_length_tmp = item->actual_length;
+	g_clear_pointer (&locker, g_mutex_locker_free);
+
+	/* pretend to be the hardware */
+	if (delay > 0)
+		g_usleep (delay);
+	if (error_io != NULL) {
+		g_propagate_error (error, g_steal_pointer (&error_io));
+		return FALSE;
+	}
+	if (buf_out != NULL && blob_out != NULL) {
+		gsize bufsz = 0;
+		const guint8 *buf = g_bytes_get_data (blob_out, &bufsz);
+		if (bufsz > buf_outsz) {
+			g_set_error (error,
+				     FWUPD_ERROR,
+				     FWUPD_ERROR_INVALID_FILE,
+				     "trace has 0x%x bytes of %s data for 0x%"
+				     G_GINT64_MODIFIER "x, buffer is 0x%x",
+				     (guint) bufsz, kind, request, (guint) buf_outsz);
+			return FALSE;
+		}
+		memcpy (buf_out, buf, bufsz);
+	}
+	if (actual_length != NULL)
+		*actual_length = actual_length_tmp;
+	return TRUE;
+}
+
+/**
+ * fu_io_trace_record_device:
+ * @device: A #FuDevice
+ *
+ * Saves a device added by a backend to the trace if recording, otherwise does
+ * nothing. This should be called after the device has been probed and before
+ * any plugin opens it.
+ *
+ * Since: 1.6.0
+ **/
+void
+fu_io_trace_record_device (FuDevice *device)
+{
+	g_autoptr(GByteArray) buf = NULL;
+	g_autoptr(GPtrArray) possible_plugins = NULL;
+
+	g_return_if_fail (FU_IS_DEVICE (device));
+
+	if (fu_io_trace_get_mode () != FU_IO_TRACE_MODE_RECORD)
+		return;
+
+	buf = g_byte_array_new ();
+	possible_plugins = fu_device_get_possible_plugins (device);
+	fu_byte_array_append_uint8 (buf, FU_IO_TRACE_TAG_DEVICE);
+	fu_byte_array_append_uint8 (buf, FU_IO_TRACE_DEVICE_FIELDS - 1);
+	fu_io_trace_append_str (buf, G_OBJECT_TYPE_NAME (device));
+	fu_io_trace_append_str (buf, fu_device_get_backend_id (device));
+	fu_io_trace_append_str (buf, fu_device_get_physical_id (device));
+	fu_io_trace_append_str (buf, fu_device_get_logical_id (device));
+	fu_io_trace_append_strv (buf, fu_device_get_instance_ids (device));
+	fu_io_trace_append_strv (buf, fu_device_get_guids (device));
+	fu_io_trace_append_strv (buf, possible_plugins);
+	fu_io_trace_write (buf, "device");
+}
+
+static gchar **
+fu_io_trace_split_list (const gchar *str)
+{
+	if (g_strcmp0 (str, "-") == 0)
+		return g_new0 (gchar *, 1);
+	return g_strsplit (str, ",", -1);
+}
+
+/**
+ * fu_io_trace_replay_next_device:
+ * @error: A #GError, or %NULL
+ *
+ * Creates the next device that was added while recording the trace, using
+ * the recorded GType, IDs, instance IDs, GUIDs and possible plugins. The
+ * device is not probed or opened, and #FuUsbDevice types are not supported.
+ *
+ * Returns: (transfer full): a #FuDevice, or %NULL with @error unset if there
+ * are no more devices to add at this point in the trace
+ *
+ * Since: 1.6.0
+ **/
+FuDevice *
+fu_io_trace_replay_next_device (GError **error)
+{
+	FuIoTraceItem *item = NULL;
+	GType gtype;
+	g_auto(GStrv) device = NULL;
+	g_auto(GStrv) guids = NULL;
+	g_auto(GStrv) instance_ids = NULL;
+	g_auto(GStrv) possible_plugins = NULL;
+	g_autoptr(FuDevice) dev = NULL;
+
+	g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+	/* devices skipped over by earlier transactions come first */
+	g_mutex_lock (&trace_mutex);
+	if (trace_devices != NULL && trace_devices->len > 0) {
+		item = g_ptr_array_index (trace_devices, 0);
+		g_ptr_array_remove_index (trace_devices, 0);
+	} else if (trace_items != NULL && trace_idx < trace_items->len) {
+		FuIoTraceItem *item_tmp = g_ptr_array_index (trace_items, trace_idx);
+		if (item_tmp->device != NULL) {
+			item = item_tmp;
+			trace_idx++;
+		}
+	}
+	if (item != NULL)
+		device = g_strdupv (item->device);
+	g_mutex_unlock (&trace_mutex);
+	if (device == NULL)
+		return NULL;
+
+	/* the type has to be registered already, e.g. by the backend */
+	gtype = g_type_from_name (device[1]);
+	if (gtype == G_TYPE_INVALID || !g_type_is_a (gtype, FU_TYPE_DEVICE)) {
+		g_set_error (error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_NOT_SUPPORTED,
+			     "cannot create device of type %s", device[1]);
+		return NULL;
+	}
+
+	/* plugins use the GUsbDevice directly, and there is none to create */
+	if (g_type_is_a (gtype, FU_TYPE_USB_DEVICE)) {
+		g_set_error (error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_NOT_SUPPORTED,
+			     "cannot replay USB device of type %s", device[1]);
+		return NULL;
+	}
+	dev = g_object_new (gtype, NULL);
+	if (g_strcmp0 (device[2], "-") != 0)
+		fu_device_set_backend_id (dev, device[2]);
+	if (g_strcmp0 (device[3], "-") != 0)
+		fu_device_set_physical_id (dev, device[3]);
+	if (g_strcmp0 (device[4], "-") != 0)
+		fu_device_set_logical_id (dev, device[4]);
+	instance_ids = fu_io_trace_split_list (device[5]);
+	for (guint i = 0; instance_ids[i] != NULL; i++)
+		fu_device_add_instance_id (dev, instance_ids[i]);
+	guids = fu_io_trace_split_list (device[6]);
+	for (guint i = 0; guids[i] != NULL; i++)
+		fu_device_add_guid (dev, guids[i]);
+	possible_plugins = fu_io_trace_split_list (device[7]);
+	for (guint i = 0; possible_plugins[i] != NULL; i++)
+		fu_device_add_possible_plugin (dev, possible_plugins[i]);
+	return g_steal_pointer (&dev);
+}
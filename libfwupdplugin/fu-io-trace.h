@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2021 Richard Hughes <richard@hughsie.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1+
+ */
+
+#pragma once
+
+#include "fu-device.h"
+
+/**
+ * FuIoTraceMode:
+ * @FU_IO_TRACE_MODE_NONE:		Transactions go to the device
+ * @FU_IO_TRACE_MODE_RECORD:		Transactions go to the device and are saved
+ * @FU_IO_TRACE_MODE_REPLAY:		Transactions are answered from a saved trace
+ *
+ * The mode used for device I/O.
+ **/
+typedef enum {
+	FU_IO_TRACE_MODE_NONE,
+	FU_IO_TRACE_MODE_RECORD,
+	FU_IO_TRACE_MODE_REPLAY,
+	/*< private >*/
+	FU_IO_TRACE_MODE_LAST
+} FuIoTraceMode;
+
+FuIoTraceMode	 fu_io_trace_get_mode		(void);
+gboolean	 fu_io_trace_record_start	(const gchar	*filename,
+						 GError		**error)
+						 G_GNUC_WARN_UNUSED_RESULT;
+gboolean	 fu_io_trace_replay_start	(const gchar	*filename,
+						 gdouble	 speed,
+						 GError		**error)
+						 G_GNUC_WARN_UNUSED_RESULT;
+gboolean	 fu_io_trace_stop		(GError		**error)
+						 G_GNUC_WARN_UNUSED_RESULT;
+void		 fu_io_trace_record		(FuDevice	*device,
+						 const gchar	*kind,
+						 guint64	 request,
+						 const guint8	*buf_in,
+						 gsize		 buf_insz,
+						 const guint8	*buf_out,
+						 gsize		 buf_outsz,
+						 gsize		 actual_length,
+						 gint64		 start,
+						 const GError	*error_io);
+void		 fu_io_trace_record_device	(FuDevice	*device);
+FuDevice	*fu_io_trace_replay_next_device	(GError		**error);
+gboolean	 fu_io_trace_replay		(FuDevice	*device,
+						 const gchar	*kind,
+						 guint64	 request,
+						 const guint8	*buf_in,
+						 gsize		 buf_insz,
+						 guint8		*buf_out,
+						 gsize		 buf_outsz,
+						 gsize		*actual_length,
+						 GError		**error)
+						 G_GNUC_WARN_UNUSED_RESULT;
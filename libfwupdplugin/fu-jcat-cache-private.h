@@ -0,0 +1,20 @@
+/*
+ * Copyright (C) 2021 Richard Hughes <richard@hughsie.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1+
+ */
+
+#pragma once
+
+#include <jcat.h>
+
+void		 fu_jcat_cache_add_public_keys		(JcatContext	*context,
+							 const gchar	*path);
+gboolean	 fu_jcat_cache_verify_item		(JcatContext	*context,
+							 GBytes		*blob,
+							 JcatItem	*item,
+							 JcatVerifyFlags flags,
+							 gint64		*timestamp,
+							 gchar		**authority,
+							 GError		**error);
+void		 fu_jcat_cache_reset			(void);
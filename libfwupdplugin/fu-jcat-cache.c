@@ -0,0 +1,361 @@
+/*
+ * Copyright (C) 2021 Richard Hughes <richard@hughsie.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1+
+ */
+
+#define G_LOG_DOMAIN				"FuJcatCache"
+
+#include "config.h"
+
+#include <glib/gstdio.h>
+
+#ifdef HAVE_GNUTLS
+#include <gnutls/x509.h>
+#endif
+
+/* only needed until we hard depend on jcat 0.1.3 */
+#include <libjcat/jcat-version.h>
+
+#include "fu-common.h"
+#include "fu-jcat-cache-private.h"
+#include "fu-metrics.h"
+
+#include "fwupd-error.h"
+
+/*
+ * Verifying a GPG or PKCS#7 signature is slow, and the same data is often
+ * verified again, e.g. the existing metadata when checking for a rollback.
+ *
+ * The newest signature timestamp and authority of each successful verification
+ * is saved, keyed by the SHA256 of the data, the SHA256 of the signatures, the
+ * verify flags and a fingerprint of the public keys the context trusts. Only
+ * contexts with keys added using fu_jcat_cache_add_public_keys() use the saved
+ * results, as the keys of any other context are unknown.
+ *
+ * Results are only used until the first of the certificates expires, and never
+ * for longer than a day so that revoked keys are noticed.
+ */
+
+/* the oldest results are forgotten after this many */
+#define FU_JCAT_CACHE_ENTRIES_MAX		256
+
+/* the longest a result is used for, in seconds */
+#define FU_JCAT_CACHE_AGE_MAX			(24 * 60 * 60)
+
+typedef struct {
+	gchar			*id;		/* SHA256 of every key file */
+	gint64			 expires;	/* of the first certificate, or G_MAXINT64 */
+} FuJcatCacheKeys;
+
+static GMutex		 jcat_cache_mutex;
+static GKeyFile		*jcat_cache_kf = NULL;
+
+static void
+fu_jcat_cache_keys_free (FuJcatCacheKeys *keys)
+{
+	g_free (keys->id);
+	g_free (keys);
+}
+
+static gchar *
+fu_jcat_cache_get_filename (void)
+{
+	g_autofree gchar *cachedir = fu_common_get_path (FU_PATH_KIND_CACHEDIR_PKG);
+	return g_build_filename (cachedir, "jcat.ini", NULL);
+}
+
+#ifdef HAVE_GNUTLS
+G_DEFINE_AUTO_CLEANUP_FREE_FUNC(gnutls_x509_crt_t, gnutls_x509_crt_deinit, NULL)
+
+/* the earliest expiry time of any certificate in the PEM file */
+static gint64
+fu_jcat_cache_get_pem_expires (GBytes *blob)
+{
+	gint64 expires = G_MAXINT64;
+	guint crtsz = 0;
+	gnutls_x509_crt_t *crts = NULL;
+	gnutls_datum_t d = { 0x0 };
+
+	d.data = (unsigned char *) g_bytes_get_data (blob, NULL);
+	d.size = g_bytes_get_size (blob);
+	if (gnutls_x509_crt_list_import2 (&crts, &crtsz, &d, GNUTLS_X509_FMT_PEM, 0) < 0)
+		return expires;
+	for (guint i = 0; i < crtsz; i++) {
+		time_t expires_tmp = gnutls_x509_crt_get_expiration_time (crts[i]);
+		if (expires_tmp != (time_t) -1)
+			expires = MIN(expires, (gint64) expires_tmp);
+		gnutls_x509_crt_deinit (crts[i]);
+	}
+	gnutls_free (crts);
+	return expires;
+}
+#endif
+
+/**
+ * fu_jcat_cache_add_public_keys:
+ * @context: a #JcatContext
+ * @path: a directory of public keys or certificates
+ *
+ * Adds the public keys to the context like jcat_context_add_public_keys(), and
+ * records a fingerprint of them so that saved verification results are only
+ * used by contexts that trust exactly the same keys.
+ *
+ * Since: 1.6.0
+ **/
+void
+fu_jcat_cache_add_public_keys (JcatContext *context, const gchar *path)
+{
+	FuJcatCacheKeys *keys;
+	FuJcatCacheKeys *keys_old;
+	g_autoptr(GChecksum) csum = g_checksum_new (G_CHECKSUM_SHA256);
+	g_autoptr(GPtrArray) files = NULL;
+
+	g_return_if_fail (JCAT_IS_CONTEXT (context));
+	g_return_if_fail (path != NULL);
+
+	jcat_context_add_public_keys (context, path);
+
+	/* the contents of each file, not the mtime, as that can be preserved */
+	keys = g_new0 (FuJcatCacheKeys, 1);
+	keys->expires = G_MAXINT64;
+	keys_old = g_object_get_data (G_OBJECT (context), "fwupd::JcatCacheKeys");
+	if (keys_old != NULL) {
+		g_checksum_update (csum, (const guchar *) keys_old->id, -1);
+		keys->expires = keys_old->expires;
+	}
+	if (g_file_test (path, G_FILE_TEST_IS_DIR))
+		files = fu_common_get_files_recursive (path, NULL);
+	if (files != NULL) {
+		g_ptr_array_sort (files, (GCompareFunc) g_strcmp0);
+		for (guint i = 0; i < files->len; i++) {
+			const gchar *fn = g_ptr_array_index (files, i);
+			g_autofree gchar *checksum = NULL;
+			g_autofree gchar *str = NULL;
+			g_autoptr(GBytes) blob = fu_common_get_contents_bytes (fn, NULL);
+			if (blob == NULL)
+				continue;
+			checksum = g_compute_checksum_for_bytes (G_CHECKSUM_SHA256, blob);
+			str = g_strdup_printf ("%s:%s\n", fn, checksum);
+			g_checksum_update (csum, (const guchar *) str, -1);
+#ifdef HAVE_GNUTLS
+			if (g_str_has_suffix (fn, ".pem"))
+				keys->expires = MIN(keys->expires, fu_jcat_cache_get_pem_expires (blob));
+#endif
+		}
+	}
+	keys->id = g_strdup (g_checksum_get_string (csum));
+	g_object_set_data_full (G_OBJECT (context), "fwupd::JcatCacheKeys",
+				keys, (GDestroyNotify) fu_jcat_cache_keys_free);
+}
+
+/* must hold jcat_cache_mutex */
+static void
+fu_jcat_cache_save_unlocked (void)
+{
+	g_autofree gchar *fn = fu_jcat_cache_get_filename ();
+	g_autoptr(GError) error_local = NULL;
+	if (!fu_common_mkdir_parent (fn, &error_local) ||
+	    !g_key_file_save_to_file (jcat_cache_kf, fn, &error_local))
+		g_debug ("failed to save verification results: %s", error_local->message);
+}
+
+/* must hold jcat_cache_mutex */
+static void
+fu_jcat_cache_load_unlocked (void)
+{
+	g_autofree gchar *fn = NULL;
+	g_autoptr(GError) error_local = NULL;
+
+	/* already done */
+	if (jcat_cache_kf != NULL)
+		return;
+	jcat_cache_kf = g_key_file_new ();
+	fn = fu_jcat_cache_get_filename ();
+	if (g_file_test (fn, G_FILE_TEST_EXISTS) &&
+	    !g_key_file_load_from_file (jcat_cache_kf, fn, G_KEY_FILE_NONE, &error_local))
+		g_debug ("ignoring verification results: %s", error_local->message);
+}
+
+/**
+ * fu_jcat_cache_reset:
+ *
+ * Forgets all the saved verification results.
+ *
+ * Since: 1.6.0
+ **/
+void
+fu_jcat_cache_reset (void)
+{
+	g_autofree gchar *fn = fu_jcat_cache_get_filename ();
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&jcat_cache_mutex);
+	g_clear_pointer (&jcat_cache_kf, g_key_file_free);
+	g_unlink (fn);
+}
+
+static gchar *
+fu_jcat_cache_get_key (FuJcatCacheKeys *keys, GBytes *blob, JcatItem *item, JcatVerifyFlags flags)
+{
+	g_autofree gchar *checksum = g_compute_checksum_for_bytes (G_CHECKSUM_SHA256, blob);
+	g_autoptr(GChecksum) csum = g_checksum_new (G_CHECKSUM_SHA256);
+	g_autoptr(GPtrArray) blobs = jcat_item_get_blobs (item);
+
+	/* contexts using different keys do not share results */
+	g_checksum_update (csum, (const guchar *) keys->id, -1);
+
+	for (guint i = 0; i < blobs->len; i++) {
+		JcatBlob *jcat_blob = g_ptr_array_index (blobs, i);
+		GBytes *data = jcat_blob_get_data (jcat_blob);
+		g_autofree gchar *str = g_strdup_printf ("%u:%" G_GSIZE_FORMAT ":",
+							 (guint) jcat_blob_get_kind (jcat_blob),
+							 g_bytes_get_size (data));
+		g_checksum_update (csum, (const guchar *) str, -1);
+		g_checksum_update (csum,
+				   g_bytes_get_data (data, NULL),
+				   g_bytes_get_size (data));
+	}
+	return g_strdup_printf ("%s-%s-%x", checksum, g_checksum_get_string (csum), flags);
+}
+
+static gint
+fu_jcat_cache_sort_results_timestamp_cb (gconstpointer a, gconstpointer b)
+{
+	JcatResult *ra = *((JcatResult **) a);
+	JcatResult *rb = *((JcatResult **) b);
+	if (jcat_result_get_timestamp (ra) < jcat_result_get_timestamp (rb))
+		return 1;
+	if (jcat_result_get_timestamp (ra) > jcat_result_get_timestamp (rb))
+		return -1;
+	return 0;
+}
+
+/* the newest signature, ignoring the checksums, or %NULL */
+static JcatResult *
+fu_jcat_cache_get_newest_signature (GPtrArray *results)
+{
+	g_ptr_array_sort (results, fu_jcat_cache_sort_results_timestamp_cb);
+	for (guint i = 0; i < results->len; i++) {
+		JcatResult *result = g_ptr_array_index (results, i);
+#if LIBJCAT_CHECK_VERSION(0, 1, 3)
+		if (jcat_result_get_method (result) == JCAT_BLOB_METHOD_SIGNATURE)
+			return result;
+#else
+		guint verify_kind = 0;
+		g_autoptr(JcatEngine) engine = NULL;
+		g_object_get (result, "engine", &engine, NULL);
+		g_object_get (engine, "verify-kind", &verify_kind, NULL);
+		if (verify_kind == 2) /* SIGNATURE */
+			return result;
+#endif
+	}
+	return NULL;
+}
+
+/**
+ * fu_jcat_cache_verify_item:
+ * @context: a #JcatContext
+ * @blob: the data
+ * @item: a #JcatItem with the checksums and signatures of @blob
+ * @flags: a #JcatVerifyFlags, e.g. %JCAT_VERIFY_FLAG_REQUIRE_SIGNATURE
+ * @timestamp: (out) (optional): the newest signing timestamp, or 0 for none
+ * @authority: (out) (optional): the authority of the newest signature
+ * @error: A #GError, or %NULL
+ *
+ * Verifies the item like jcat_context_verify_item(), but if the same data,
+ * signatures and flags have been successfully verified recently with the same
+ * public keys then the saved result is used instead.
+ *
+ * Returns: %TRUE if the data was verified
+ *
+ * Since: 1.6.0
+ **/
+gboolean
+fu_jcat_cache_verify_item (JcatContext *context,
+			   GBytes *blob,
+			   JcatItem *item,
+			   JcatVerifyFlags flags,
+			   gint64 *timestamp,
+			   gchar **authority,
+			   GError **error)
+{
+	FuJcatCacheKeys *keys;
+	JcatResult *result;
+	gint64 now = g_get_real_time () / G_USEC_PER_SEC;
+	gint64 timestamp_tmp = 0;
+	g_autofree gchar *authority_tmp = NULL;
+	g_autofree gchar *key = NULL;
+	g_autoptr(GMutexLocker) locker = NULL;
+	g_autoptr(GPtrArray) results = NULL;
+
+	g_return_val_if_fail (JCAT_IS_CONTEXT (context), FALSE);
+	g_return_val_if_fail (blob != NULL, FALSE);
+	g_return_val_if_fail (JCAT_IS_ITEM (item), FALSE);
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+	/* verified before with the same keys, and still valid */
+	keys = g_object_get_data (G_OBJECT (context), "fwupd::JcatCacheKeys");
+	if (keys != NULL) {
+		key = fu_jcat_cache_get_key (keys, blob, item, flags);
+		locker = g_mutex_locker_new (&jcat_cache_mutex);
+		fu_jcat_cache_load_unlocked ();
+		if (g_key_file_has_group (jcat_cache_kf, key)) {
+			gint64 expires = g_key_file_get_int64 (jcat_cache_kf, key, "Expires", NULL);
+			if (now < expires) {
+				g_debug ("using saved verification result for %s", key);
+				fu_metrics_add_counter ("jcat.cache-hit", 1);
+				if (timestamp != NULL)
+					*timestamp = g_key_file_get_int64 (jcat_cache_kf, key, "Timestamp", NULL);
+				if (authority != NULL)
+					*authority = g_key_file_get_string (jcat_cache_kf, key, "Authority", NULL);
+				return TRUE;
+			}
+			g_debug ("saved verification result for %s has expired", key);
+			g_key_file_remove_group (jcat_cache_kf, key, NULL);
+		}
+		g_clear_pointer (&locker, g_mutex_locker_free);
+	}
+
+	/* verify without the lock held as this is slow */
+	fu_metrics_add_counter ("jcat.cache-miss", 1);
+	results = jcat_context_verify_item (context, blob, item, flags, error);
+	if (results == NULL)
+		return FALSE;
+	result = fu_jcat_cache_get_newest_signature (results);
+	if (result == NULL && (flags & JCAT_VERIFY_FLAG_REQUIRE_SIGNATURE) > 0) {
+		g_set_error_literal (error,
+				     FWUPD_ERROR,
+				     FWUPD_ERROR_INVALID_FILE,
+				     "no signature method in results");
+		return FALSE;
+	}
+	if (result != NULL) {
+		timestamp_tmp = jcat_result_get_timestamp (result);
+		authority_tmp = g_strdup (jcat_result_get_authority (result));
+	}
+
+	/* save for next time, forgetting the oldest */
+	if (keys != NULL) {
+		locker = g_mutex_locker_new (&jcat_cache_mutex);
+		fu_jcat_cache_load_unlocked ();
+		g_key_file_set_int64 (jcat_cache_kf, key, "Timestamp", timestamp_tmp);
+		g_key_file_set_int64 (jcat_cache_kf, key, "Expires",
+				      MIN(keys->expires, now + FU_JCAT_CACHE_AGE_MAX));
+		if (authority_tmp != NULL)
+			g_key_file_set_string (jcat_cache_kf, key, "Authority", authority_tmp);
+		while (TRUE) {
+			gsize groupsz = 0;
+			g_auto(GStrv) groups = g_key_file_get_groups (jcat_cache_kf, &groupsz);
+			if (groupsz <= FU_JCAT_CACHE_ENTRIES_MAX)
+				break;
+			g_key_file_remove_group (jcat_cache_kf, groups[0], NULL);
+		}
+		fu_jcat_cache_save_unlocked ();
+	}
+
+	/* success */
+	if (timestamp != NULL)
+		*timestamp = timestamp_tmp;
+	if (authority != NULL)
+		*authority = g_steal_pointer (&authority_tmp);
+	return TRUE;
+}
@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2021 Richard Hughes <richard@hughsie.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1+
+ */
+
+#define G_LOG_DOMAIN				"FuMetrics"
+
+#include <config.h>
+
+#include "fu-metrics.h"
+
+/**
+ * SECTION:fu-metrics
+ * @short_description: a process-wide registry of counters and latencies
+ *
+ * Metrics are identified by a dotted ID, e.g. `plugin.dell.coldplug`, and are
+ * either a counter, or a duration which records the number of calls, the
+ * total and maximum time taken and a coarse latency histogram.
+ *
+ * All functions are threadsafe.
+ */
+
+typedef enum {
+	FU_METRIC_KIND_COUNTER,
+	FU_METRIC_KIND_DURATION,
+} FuMetricKind;
+
+/* upper bounds in microseconds, with a final overflow bucket */
+static const guint64 fu_metrics_bucket_limits[] = {
+	1000, 10000, 100000, 1000000, 10000000
+};
+static const gchar *fu_metrics_bucket_names[] = {
+	"le-1ms", "le-10ms", "le-100ms", "le-1s", "le-10s", "gt-10s"
+};
+
+typedef struct {
+	FuMetricKind	 kind;
+	guint64		 value;		/* counter value, or number of durations */
+	guint64		 total;
+	guint64		 max;
+	guint64		 buckets[G_N_ELEMENTS(fu_metrics_bucket_names)];
+} FuMetric;
+
+static GMutex		 metrics_mutex;
+static GHashTable	*metrics = NULL;	/* utf8:FuMetric */
+
+static FuMetric *
+fu_metrics_ensure (const gchar *id, FuMetricKind kind)
+{
+	FuMetric *metric;
+
+	if (metrics == NULL)
+		metrics = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+	metric = g_hash_table_lookup (metrics, id);
+	if (metric == NULL) {
+		metric = g_new0 (FuMetric, 1);
+		metric->kind = kind;
+		g_hash_table_insert (metrics, g_strdup (id), metric);
+	} else if (metric->kind != kind) {
+		g_warning ("metric %s used as both counter and duration", id);
+		return NULL;
+	}
+	return metric;
+}
+
+/**
+ * fu_metrics_add_counter:
+ * @id: a metric ID, e.g. `device.FuNvmeDevice.write-bytes`
+ * @value: the amount to increment the counter by
+ *
+ * Increments a counter, creating it if required.
+ *
+ * Since: 1.6.0
+ **/
+void
+fu_metrics_add_counter (const gchar *id, guint64 value)
+{
+	FuMetric *metric;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&metrics_mutex);
+
+	g_return_if_fail (id != NULL);
+
+	metric = fu_metrics_ensure (id, FU_METRIC_KIND_COUNTER);
+	if (metric == NULL)
+		return;
+	metric->value += value;
+}
+
+/**
+ * fu_metrics_add_duration:
+ * @id: a metric ID, e.g. `plugin.dell.coldplug`
+ * @usecs: the time taken in microseconds
+ *
+ * Records the time taken for one call, creating the metric if required.
+ *
+ * Since: 1.6.0
+ **/
+void
+fu_metrics_add_duration (const gchar *id, guint64 usecs)
+{
+	FuMetric *metric;
+	guint idx = 0;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&metrics_mutex);
+
+	g_return_if_fail (id != NULL);
+
+	metric = fu_metrics_ensure (id, FU_METRIC_KIND_DURATION);
+	if (metric == NULL)
+		return;
+	metric->value++;
+	metric->total += usecs;
+	metric->max = MAX(metric->max, usecs);
+	while (idx < G_N_ELEMENTS(fu_metrics_bucket_limits) &&
+	       usecs > fu_metrics_bucket_limits[idx])
+		idx++;
+	metric->buckets[idx]++;
+}
+
+static void
+fu_metrics_insert (GHashTable *hash, const gchar *id, const gchar *suffix, guint64 value)
+{
+	gchar *key;
+	if (suffix != NULL)
+		key = g_strdup_printf ("%s.%s", id, suffix);
+	else
+		key = g_strdup (id);
+	g_hash_table_insert (hash, key, g_strdup_printf ("%" G_GUINT64_FORMAT, value));
+}
+
+/**
+ * fu_metrics_get_all:
+ *
+ * Gets all the recorded metrics as string values. Counters use the metric ID
+ * as the key, and durations use keys with suffixes of `count`, `total-us`,
+ * `max-us` and the histogram buckets, e.g. `plugin.dell.coldplug.le-10ms`.
+ *
+ * Returns: (transfer container) (element-type utf8 utf8): metrics
+ *
+ * Since: 1.6.0
+ **/
+GHashTable *
+fu_metrics_get_all (void)
+{
+	GHashTable *hash = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+	GHashTableIter iter;
+	gpointer key;
+	gpointer value;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&metrics_mutex);
+
+	if (metrics == NULL)
+		return hash;
+	g_hash_table_iter_init (&iter, metrics);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		const gchar *id = (const gchar *) key;
+		FuMetric *metric = (FuMetric *) value;
+		if (metric->kind == FU_METRIC_KIND_COUNTER) {
+			fu_metrics_insert (hash, id, NULL, metric->value);
+			continue;
+		}
+		fu_metrics_insert (hash, id, "count", metric->value);
+		fu_metrics_insert (hash, id, "total-us", metric->total);
+		fu_metrics_insert (hash, id, "max-us", metric->max);
+		for (guint i = 0; i < G_N_ELEMENTS(fu_metrics_bucket_names); i++)
+			fu_metrics_insert (hash, id, fu_metrics_bucket_names[i], metric->buckets[i]);
+	}
+	return hash;
+}
+
+/**
+ * fu_metrics_reset:
+ *
+ * Removes all the recorded metrics.
+ *
+ * Since: 1.6.0
+ **/
+void
+fu_metrics_reset (void)
+{
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&metrics_mutex);
+	if (metrics != NULL)
+		g_hash_table_remove_all (metrics);
+}
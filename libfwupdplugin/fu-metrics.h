@@ -0,0 +1,16 @@
+/*
+ * Copyright (C) 2021 Richard Hughes <richard@hughsie.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1+
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+void		 fu_metrics_add_counter		(const gchar	*id,
+						 guint64	 value);
+void		 fu_metrics_add_duration	(const gchar	*id,
+						 guint64	 usecs);
+GHashTable	*fu_metrics_get_all		(void);
+void		 fu_metrics_reset		(void);
@@ -18,6 +18,7 @@
 #endif /* HAVE_VALGRIND */
 
 #include "fu-device-private.h"
+#include "fu-metrics.h"
 #include "fu-plugin-private.h"
 #include "fu-mutex.h"
 
@@ -38,6 +39,7 @@ typedef struct {
 	GModule			*module;
 	guint			 order;
 	guint			 priority;
+	guint64			 internal_flags;
 	GPtrArray		*rules[FU_PLUGIN_RULE_LAST];
 	GPtrArray		*devices;		/* (nullable) (element-type FuDevice) */
 	gchar			*build_hash;
@@ -693,6 +695,42 @@ fu_plugin_get_hwids (FuPlugin *self)
 	return fu_hwids_get_guids (priv->hwids);
 }
 
+/**
+ * fu_plugin_add_internal_flag:
+ * @self: A #FuPlugin
+ * @flag: A #FuPluginInternalFlags, e.g. %FU_PLUGIN_INTERNAL_FLAG_THREADSAFE_SECURITY_ATTRS
+ *
+ * Adds a private flag that stays internal to the engine and is not leaked to the client.
+ *
+ * Since: 1.6.0
+ **/
+void
+fu_plugin_add_internal_flag (FuPlugin *self, FuPluginInternalFlags flag)
+{
+	FuPluginPrivate *priv = GET_PRIVATE (self);
+	g_return_if_fail (FU_IS_PLUGIN (self));
+	priv->internal_flags |= flag;
+}
+
+/**
+ * fu_plugin_has_internal_flag:
+ * @self: A #FuPlugin
+ * @flag: A #FuPluginInternalFlags, e.g. %FU_PLUGIN_INTERNAL_FLAG_THREADSAFE_SECURITY_ATTRS
+ *
+ * Tests for a private flag that stays internal to the engine and is not leaked to the client.
+ *
+ * Returns: %TRUE if the flag is set
+ *
+ * Since: 1.6.0
+ **/
+gboolean
+fu_plugin_has_internal_flag (FuPlugin *self, FuPluginInternalFlags flag)
+{
+	FuPluginPrivate *priv = GET_PRIVATE (self);
+	g_return_val_if_fail (FU_IS_PLUGIN (self), FALSE);
+	return (priv->internal_flags & flag) > 0;
+}
+
 /**
  * fu_plugin_has_custom_flag:
  * @self: A #FuPlugin
@@ -1165,6 +1203,14 @@ fu_plugin_device_read_firmware (FuPlugin *self, FuDevice *device, GError **error
 	return fu_device_attach (device, error);
 }
 
+static void
+fu_plugin_add_metric (FuPlugin *self, const gchar *vfunc, gint64 start)
+{
+	g_autofree gchar *id = NULL;
+	id = g_strdup_printf ("plugin.%s.%s", fu_plugin_get_name (self), vfunc);
+	fu_metrics_add_duration (id, g_get_monotonic_time () - start);
+}
+
 /**
  * fu_plugin_runner_startup:
  * @self: a #FuPlugin
@@ -1180,6 +1226,8 @@ gboolean
 fu_plugin_runner_startup (FuPlugin *self, GError **error)
 {
 	FuPluginPrivate *priv = GET_PRIVATE (self);
+	gboolean ret;
+	gint64 start;
 	FuPluginStartupFunc func = NULL;
 	g_autoptr(GError) error_local = NULL;
 
@@ -1196,7 +1244,10 @@ fu_plugin_runner_startup (FuPlugin *self, GError **error)
 	if (func == NULL)
 		return TRUE;
 	g_debug ("startup(%s)", fu_plugin_get_name (self));
-	if (!func (self, &error_local)) {
+	start = g_get_monotonic_time ();
+	ret = func (self, &error_local);
+	fu_plugin_add_metric (self, "startup", start);
+	if (!ret) {
 		if (error_local == NULL) {
 			g_critical ("unset plugin error in startup(%s)",
 				    fu_plugin_get_name (self));
@@ -1220,6 +1271,8 @@ fu_plugin_runner_device_generic (FuPlugin *self, FuDevice *device,
 				 GError **error)
 {
 	FuPluginPrivate *priv = GET_PRIVATE (self);
+	gboolean ret;
+	gint64 start;
 	FuPluginDeviceFunc func = NULL;
 	g_autoptr(GError) error_local = NULL;
 
@@ -1242,7 +1295,10 @@ fu_plugin_runner_device_generic (FuPlugin *self, FuDevice *device,
 		return TRUE;
 	}
 	g_debug ("%s(%s)", symbol_name + 10, fu_plugin_get_name (self));
-	if (!func (self, device, &error_local)) {
+	start = g_get_monotonic_time ();
+	ret = func (self, device, &error_local);
+	fu_plugin_add_metric (self, symbol_name + 10, start);
+	if (!ret) {
 		if (error_local == NULL) {
 			g_critical ("unset plugin error in %s(%s)",
 				    fu_plugin_get_name (self), symbol_name + 10);
@@ -1265,6 +1321,8 @@ fu_plugin_runner_flagged_device_generic (FuPlugin *self, FwupdInstallFlags flags
 					 const gchar *symbol_name, GError **error)
 {
 	FuPluginPrivate *priv = GET_PRIVATE (self);
+	gboolean ret;
+	gint64 start;
 	FuPluginFlaggedDeviceFunc func = NULL;
 	g_autoptr(GError) error_local = NULL;
 
@@ -1281,7 +1339,10 @@ fu_plugin_runner_flagged_device_generic (FuPlugin *self, FwupdInstallFlags flags
 	if (func == NULL)
 		return TRUE;
 	g_debug ("%s(%s)", symbol_name + 10, fu_plugin_get_name (self));
-	if (!func (self, flags, device, &error_local)) {
+	start = g_get_monotonic_time ();
+	ret = func (self, flags, device, &error_local);
+	fu_plugin_add_metric (self, symbol_name + 10, start);
+	if (!ret) {
 		if (error_local == NULL) {
 			g_critical ("unset plugin error in %s(%s)",
 				    fu_plugin_get_name (self), symbol_name + 10);
@@ -1304,6 +1365,8 @@ fu_plugin_runner_device_array_generic (FuPlugin *self, GPtrArray *devices,
 				       const gchar *symbol_name, GError **error)
 {
 	FuPluginPrivate *priv = GET_PRIVATE (self);
+	gboolean ret;
+	gint64 start;
 	FuPluginDeviceArrayFunc func = NULL;
 	g_autoptr(GError) error_local = NULL;
 
@@ -1320,7 +1383,10 @@ fu_plugin_runner_device_array_generic (FuPlugin *self, GPtrArray *devices,
 	if (func == NULL)
 		return TRUE;
 	g_debug ("%s(%s)", symbol_name + 10, fu_plugin_get_name (self));
-	if (!func (self, devices, &error_local)) {
+	start = g_get_monotonic_time ();
+	ret = func (self, devices, &error_local);
+	fu_plugin_add_metric (self, symbol_name + 10, start);
+	if (!ret) {
 		if (error_local == NULL) {
 			g_critical ("unset plugin error in for %s(%s)",
 				    fu_plugin_get_name (self), symbol_name + 10);
@@ -1352,6 +1418,8 @@ gboolean
 fu_plugin_runner_coldplug (FuPlugin *self, GError **error)
 {
 	FuPluginPrivate *priv = GET_PRIVATE (self);
+	gboolean ret;
+	gint64 start;
 	FuPluginStartupFunc func = NULL;
 	g_autoptr(GError) error_local = NULL;
 
@@ -1368,7 +1436,10 @@ fu_plugin_runner_coldplug (FuPlugin *self, GError **error)
 	if (func == NULL)
 		return TRUE;
 	g_debug ("coldplug(%s)", fu_plugin_get_name (self));
-	if (!func (self, &error_local)) {
+	start = g_get_monotonic_time ();
+	ret = func (self, &error_local);
+	fu_plugin_add_metric (self, "coldplug", start);
+	if (!ret) {
 		if (error_local == NULL) {
 			g_critical ("unset plugin error in coldplug(%s)",
 				    fu_plugin_get_name (self));
@@ -1399,6 +1470,8 @@ gboolean
 fu_plugin_runner_recoldplug (FuPlugin *self, GError **error)
 {
 	FuPluginPrivate *priv = GET_PRIVATE (self);
+	gboolean ret;
+	gint64 start;
 	FuPluginStartupFunc func = NULL;
 	g_autoptr(GError) error_local = NULL;
 
@@ -1415,7 +1488,10 @@ fu_plugin_runner_recoldplug (FuPlugin *self, GError **error)
 	if (func == NULL)
 		return TRUE;
 	g_debug ("recoldplug(%s)", fu_plugin_get_name (self));
-	if (!func (self, &error_local)) {
+	start = g_get_monotonic_time ();
+	ret = func (self, &error_local);
+	fu_plugin_add_metric (self, "recoldplug", start);
+	if (!ret) {
 		if (error_local == NULL) {
 			g_critical ("unset plugin error in recoldplug(%s)",
 				    fu_plugin_get_name (self));
@@ -1447,6 +1523,8 @@ gboolean
 fu_plugin_runner_coldplug_prepare (FuPlugin *self, GError **error)
 {
 	FuPluginPrivate *priv = GET_PRIVATE (self);
+	gboolean ret;
+	gint64 start;
 	FuPluginStartupFunc func = NULL;
 	g_autoptr(GError) error_local = NULL;
 
@@ -1463,7 +1541,10 @@ fu_plugin_runner_coldplug_prepare (FuPlugin *self, GError **error)
 	if (func == NULL)
 		return TRUE;
 	g_debug ("coldplug_prepare(%s)", fu_plugin_get_name (self));
-	if (!func (self, &error_local)) {
+	start = g_get_monotonic_time ();
+	ret = func (self, &error_local);
+	fu_plugin_add_metric (self, "coldplug_prepare", start);
+	if (!ret) {
 		if (error_local == NULL) {
 			g_critical ("unset plugin error in coldplug_prepare(%s)",
 				    fu_plugin_get_name (self));
@@ -1495,6 +1576,8 @@ gboolean
 fu_plugin_runner_coldplug_cleanup (FuPlugin *self, GError **error)
 {
 	FuPluginPrivate *priv = GET_PRIVATE (self);
+	gboolean ret;
+	gint64 start;
 	FuPluginStartupFunc func = NULL;
 	g_autoptr(GError) error_local = NULL;
 
@@ -1511,7 +1594,10 @@ fu_plugin_runner_coldplug_cleanup (FuPlugin *self, GError **error)
 	if (func == NULL)
 		return TRUE;
 	g_debug ("coldplug_cleanup(%s)", fu_plugin_get_name (self));
-	if (!func (self, &error_local)) {
+	start = g_get_monotonic_time ();
+	ret = func (self, &error_local);
+	fu_plugin_add_metric (self, "coldplug_cleanup", start);
+	if (!ret) {
 		if (error_local == NULL) {
 			g_critical ("unset plugin error in coldplug_cleanup(%s)",
 				    fu_plugin_get_name (self));
@@ -1695,6 +1781,7 @@ void
 fu_plugin_runner_add_security_attrs (FuPlugin *self, FuSecurityAttrs *attrs)
 {
 	FuPluginPrivate *priv = GET_PRIVATE (self);
+	gint64 start;
 	FuPluginSecurityAttrsFunc func = NULL;
 	const gchar *symbol_name = "fu_plugin_add_security_attrs";
 
@@ -1707,7 +1794,9 @@ fu_plugin_runner_add_security_attrs (FuPlugin *self, FuSecurityAttrs *attrs)
 	if (func == NULL)
 		return;
 	g_debug ("%s(%s)", symbol_name + 10, fu_plugin_get_name (self));
+	start = g_get_monotonic_time ();
 	func (self, attrs);
+	fu_plugin_add_metric (self, symbol_name + 10, start);
 }
 
 /**
@@ -1895,6 +1984,8 @@ gboolean
 fu_plugin_runner_backend_device_added (FuPlugin *self, FuDevice *device, GError **error)
 {
 	FuPluginPrivate *priv = GET_PRIVATE (self);
+	gboolean ret;
+	gint64 start;
 	FuPluginDeviceFunc func = NULL;
 	g_autoptr(GError) error_local = NULL;
 
@@ -1924,7 +2015,10 @@ fu_plugin_runner_backend_device_added (FuPlugin *self, FuDevice *device, GError
 		return FALSE;
 	}
 	g_debug ("backend_device_added(%s)", fu_plugin_get_name (self));
-	if (!func (self, device, &error_local)) {
+	start = g_get_monotonic_time ();
+	ret = func (self, device, &error_local);
+	fu_plugin_add_metric (self, "backend_device_added", start);
+	if (!ret) {
 		if (error_local == NULL) {
 			g_critical ("unset plugin error in backend_device_added(%s)",
 				    fu_plugin_get_name (self));
@@ -1957,6 +2051,8 @@ gboolean
 fu_plugin_runner_backend_device_changed (FuPlugin *self, FuDevice *device, GError **error)
 {
 	FuPluginPrivate *priv = GET_PRIVATE (self);
+	gboolean ret;
+	gint64 start;
 	FuPluginDeviceFunc func = NULL;
 	g_autoptr(GError) error_local = NULL;
 
@@ -1977,7 +2073,10 @@ fu_plugin_runner_backend_device_changed (FuPlugin *self, FuDevice *device, GErro
 	if (func == NULL)
 		return TRUE;
 	g_debug ("udev_device_changed(%s)", fu_plugin_get_name (self));
-	if (!func (self, device, &error_local)) {
+	start = g_get_monotonic_time ();
+	ret = func (self, device, &error_local);
+	fu_plugin_add_metric (self, "backend_device_changed", start);
+	if (!ret) {
 		if (error_local == NULL) {
 			g_critical ("unset plugin error in udev_device_changed(%s)",
 				    fu_plugin_get_name (self));
@@ -2007,6 +2106,7 @@ void
 fu_plugin_runner_device_added (FuPlugin *self, FuDevice *device)
 {
 	FuPluginPrivate *priv = GET_PRIVATE (self);
+	gint64 start;
 	FuPluginDeviceRegisterFunc func = NULL;
 
 	/* not enabled */
@@ -2020,7 +2120,9 @@ fu_plugin_runner_device_added (FuPlugin *self, FuDevice *device)
 	if (func == NULL)
 		return;
 	g_debug ("fu_plugin_device_added(%s)", fu_plugin_get_name (self));
+	start = g_get_monotonic_time ();
 	func (self, device);
+	fu_plugin_add_metric (self, "device_added", start);
 }
 
 /**
@@ -2057,6 +2159,7 @@ void
 fu_plugin_runner_device_register (FuPlugin *self, FuDevice *device)
 {
 	FuPluginPrivate *priv = GET_PRIVATE (self);
+	gint64 start;
 	FuPluginDeviceRegisterFunc func = NULL;
 
 	/* not enabled */
@@ -2069,7 +2172,9 @@ fu_plugin_runner_device_register (FuPlugin *self, FuDevice *device)
 	g_module_symbol (priv->module, "fu_plugin_device_registered", (gpointer *) &func);
 	if (func != NULL) {
 		g_debug ("fu_plugin_device_registered(%s)", fu_plugin_get_name (self));
+		start = g_get_monotonic_time ();
 		func (self, device);
+		fu_plugin_add_metric (self, "device_registered", start);
 	}
 }
 
@@ -2089,6 +2194,8 @@ gboolean
 fu_plugin_runner_device_created (FuPlugin *self, FuDevice *device, GError **error)
 {
 	FuPluginPrivate *priv = GET_PRIVATE (self);
+	gboolean ret;
+	gint64 start;
 	FuPluginDeviceFunc func = NULL;
 
 	g_return_val_if_fail (FU_IS_PLUGIN (self), FALSE);
@@ -2106,7 +2213,10 @@ fu_plugin_runner_device_created (FuPlugin *self, FuDevice *device, GError **erro
 	if (func == NULL)
 		return TRUE;
 	g_debug ("fu_plugin_device_created(%s)", fu_plugin_get_name (self));
-	return func (self, device, error);
+	start = g_get_monotonic_time ();
+	ret = func (self, device, error);
+	fu_plugin_add_metric (self, "device_created", start);
+	return ret;
 }
 
 /**
@@ -2129,6 +2239,8 @@ fu_plugin_runner_verify (FuPlugin *self,
 			 GError **error)
 {
 	FuPluginPrivate *priv = GET_PRIVATE (self);
+	gboolean ret;
+	gint64 start;
 	FuPluginVerifyFunc func = NULL;
 	GPtrArray *checksums;
 	g_autoptr(GError) error_local = NULL;
@@ -2172,7 +2284,10 @@ fu_plugin_runner_verify (FuPlugin *self,
 
 	/* run vfunc */
 	g_debug ("verify(%s)", fu_plugin_get_name (self));
-	if (!func (self, device, flags, &error_local)) {
+	start = g_get_monotonic_time ();
+	ret = func (self, device, flags, &error_local);
+	fu_plugin_add_metric (self, "verify", start);
+	if (!ret) {
 		g_autoptr(GError) error_attach = NULL;
 		if (error_local == NULL) {
 			g_critical ("unset plugin error in verify(%s)",
@@ -2325,6 +2440,8 @@ fu_plugin_runner_update (FuPlugin *self,
 			 GError **error)
 {
 	FuPluginPrivate *priv = GET_PRIVATE (self);
+	gboolean ret;
+	gint64 start;
 	FuPluginUpdateFunc update_func;
 	g_autoptr(GError) error_local = NULL;
 
@@ -2352,7 +2469,10 @@ fu_plugin_runner_update (FuPlugin *self,
 	}
 
 	/* online */
-	if (!update_func (self, device, blob_fw, flags, &error_local)) {
+	start = g_get_monotonic_time ();
+	ret = update_func (self, device, blob_fw, flags, &error_local);
+	fu_plugin_add_metric (self, "update", start);
+	if (!ret) {
 		if (error_local == NULL) {
 			g_critical ("unset plugin error in update(%s)",
 				    fu_plugin_get_name (self));
@@ -2394,6 +2514,8 @@ gboolean
 fu_plugin_runner_clear_results (FuPlugin *self, FuDevice *device, GError **error)
 {
 	FuPluginPrivate *priv = GET_PRIVATE (self);
+	gboolean ret;
+	gint64 start;
 	FuPluginDeviceFunc func = NULL;
 	g_autoptr(GError) error_local = NULL;
 
@@ -2414,7 +2536,10 @@ fu_plugin_runner_clear_results (FuPlugin *self, FuDevice *device, GError **error
 	if (func == NULL)
 		return TRUE;
 	g_debug ("clear_result(%s)", fu_plugin_get_name (self));
-	if (!func (self, device, &error_local)) {
+	start = g_get_monotonic_time ();
+	ret = func (self, device, &error_local);
+	fu_plugin_add_metric (self, "clear_results", start);
+	if (!ret) {
 		if (error_local == NULL) {
 			g_critical ("unset plugin error in clear_result(%s)",
 				    fu_plugin_get_name (self));
@@ -2447,6 +2572,8 @@ gboolean
 fu_plugin_runner_get_results (FuPlugin *self, FuDevice *device, GError **error)
 {
 	FuPluginPrivate *priv = GET_PRIVATE (self);
+	gboolean ret;
+	gint64 start;
 	FuPluginDeviceFunc func = NULL;
 	g_autoptr(GError) error_local = NULL;
 
@@ -2467,7 +2594,10 @@ fu_plugin_runner_get_results (FuPlugin *self, FuDevice *device, GError **error)
 	if (func == NULL)
 		return TRUE;
 	g_debug ("get_results(%s)", fu_plugin_get_name (self));
-	if (!func (self, device, &error_local)) {
+	start = g_get_monotonic_time ();
+	ret = func (self, device, &error_local);
+	fu_plugin_add_metric (self, "get_results", start);
+	if (!ret) {
 		if (error_local == NULL) {
 			g_critical ("unset plugin error in get_results(%s)",
 				    fu_plugin_get_name (self));
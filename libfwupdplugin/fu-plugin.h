@@ -98,6 +98,18 @@ typedef enum {
 	FU_PLUGIN_RULE_LAST
 } FuPluginRule;
 
+/**
+ * FuPluginInternalFlags:
+ * @FU_PLUGIN_INTERNAL_FLAG_NONE:			No flags set
+ * @FU_PLUGIN_INTERNAL_FLAG_THREADSAFE_SECURITY_ATTRS:	Security attributes can be added from a thread
+ *
+ * The plugin internal flags.
+ **/
+typedef enum {
+	FU_PLUGIN_INTERNAL_FLAG_NONE				= 0,
+	FU_PLUGIN_INTERNAL_FLAG_THREADSAFE_SECURITY_ATTRS	= (1llu << 0),	/* Since: 1.6.0 */
+} FuPluginInternalFlags;
+
 typedef struct	FuPluginData	FuPluginData;
 
 /* for plugins to use */
@@ -178,3 +190,7 @@ void		 fu_plugin_add_compile_version		(FuPlugin	*self,
 							 const gchar	*version);
 gboolean	 fu_plugin_has_custom_flag		(FuPlugin	*self,
 							 const gchar	*flag);
+void		 fu_plugin_add_internal_flag		(FuPlugin	*self,
+							 FuPluginInternalFlags flag);
+gboolean	 fu_plugin_has_internal_flag		(FuPlugin	*self,
+							 FuPluginInternalFlags flag);
@@ -0,0 +1,16 @@
+/*
+ * Copyright (C) 2021 Richard Hughes <richard@hughsie.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1+
+ */
+
+#pragma once
+
+#include "fu-device.h"
+
+void		 fu_poll_scheduler_add			(FuDevice	*device,
+							 guint		 interval);
+void		 fu_poll_scheduler_remove		(FuDevice	*device);
+void		 fu_poll_scheduler_set_suspended	(gboolean	 suspended);
+gboolean	 fu_poll_scheduler_get_suspended	(void);
+guint64		 fu_poll_scheduler_get_wakeups_saved	(void);
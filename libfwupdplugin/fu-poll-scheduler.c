@@ -0,0 +1,325 @@
+/*
+ * Copyright (C) 2021 Richard Hughes <richard@hughsie.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1+
+ */
+
+#define G_LOG_DOMAIN				"FuPollScheduler"
+
+#include "config.h"
+
+#include "fu-device-private.h"
+#include "fu-metrics.h"
+#include "fu-poll-scheduler-private.h"
+
+/*
+ * All the devices using fu_device_set_poll_interval() share one timeout, and
+ * each wakeup also polls any device that is due within a quarter of its own
+ * interval so that devices drift into polling on the same ticks.
+ *
+ * Only devices where the poll has no side effects can be polled less often: a
+ * device with %FU_DEVICE_INTERNAL_FLAG_POLL_RELAXED that has not changed for a
+ * number of polls is polled progressively less often and is not polled at all
+ * while suspended. Any other device, e.g. one draining notifications, is always
+ * polled on schedule.
+ */
+
+/* number of polls without a property change before backing off */
+#define FU_POLL_SCHEDULER_IDLE_THRESHOLD	16
+/* the interval is doubled at most this many times when idle */
+#define FU_POLL_SCHEDULER_BACKOFF_MAX		3
+/* poll up to 1/N of the interval early to share a wakeup */
+#define FU_POLL_SCHEDULER_SLACK_DIVISOR		4
+
+typedef struct {
+	FuDevice	*device;	/* no ref */
+	gulong		 notify_id;
+	guint		 interval;	/* ms */
+	guint		 idle_cnt;
+	gboolean	 changed;
+	gint64		 last_poll;	/* us */
+	gint64		 next_due;	/* us */
+} FuPollItem;
+
+static GMutex		 poll_mutex;
+static GPtrArray	*poll_items = NULL;	/* of FuPollItem */
+static guint		 poll_source_id = 0;
+static gboolean		 poll_suspended = FALSE;
+static guint64		 poll_wakeups_saved = 0;
+
+static void
+fu_poll_scheduler_item_free (FuPollItem *item)
+{
+	/* already destroyed if called when the device is finalized */
+	if (g_signal_handler_is_connected (item->device, item->notify_id))
+		g_signal_handler_disconnect (item->device, item->notify_id);
+	g_free (item);
+}
+
+static void
+fu_poll_scheduler_notify_cb (FuDevice *device, GParamSpec *pspec, gpointer user_data)
+{
+	FuPollItem *item = (FuPollItem *) user_data;
+	item->changed = TRUE;
+}
+
+/* must hold poll_mutex */
+static FuPollItem *
+fu_poll_scheduler_find_unlocked (FuDevice *device, guint *idx)
+{
+	if (poll_items == NULL)
+		return NULL;
+	for (guint i = 0; i < poll_items->len; i++) {
+		FuPollItem *item = g_ptr_array_index (poll_items, i);
+		if (item->device == device) {
+			if (idx != NULL)
+				*idx = i;
+			return item;
+		}
+	}
+	return NULL;
+}
+
+static gboolean
+fu_poll_scheduler_is_relaxed (FuPollItem *item)
+{
+	return fu_device_has_internal_flag (item->device,
+					    FU_DEVICE_INTERNAL_FLAG_POLL_RELAXED);
+}
+
+/* the interval including any backoff for an idle device, in us */
+static gint64
+fu_poll_scheduler_get_interval (FuPollItem *item)
+{
+	guint shift = 0;
+	if (fu_poll_scheduler_is_relaxed (item) &&
+	    item->idle_cnt >= FU_POLL_SCHEDULER_IDLE_THRESHOLD) {
+		shift = item->idle_cnt - FU_POLL_SCHEDULER_IDLE_THRESHOLD + 1;
+		shift = MIN(shift, FU_POLL_SCHEDULER_BACKOFF_MAX);
+	}
+	return ((gint64) item->interval << shift) * 1000;
+}
+
+static gboolean fu_poll_scheduler_cb (gpointer user_data);
+
+/* must hold poll_mutex */
+static void
+fu_poll_scheduler_reschedule_unlocked (void)
+{
+	gint64 next_due = G_MAXINT64;
+	gint64 delay;
+
+	if (poll_source_id != 0) {
+		g_source_remove (poll_source_id);
+		poll_source_id = 0;
+	}
+	if (poll_items == NULL)
+		return;
+	for (guint i = 0; i < poll_items->len; i++) {
+		FuPollItem *item = g_ptr_array_index (poll_items, i);
+		if (poll_suspended && fu_poll_scheduler_is_relaxed (item))
+			continue;
+		next_due = MIN(next_due, item->next_due);
+	}
+	if (next_due == G_MAXINT64)
+		return;
+
+	/* seconds timeouts are coalesced with the rest of the system */
+	delay = MAX(next_due - g_get_monotonic_time (), 0) / 1000;
+	if (delay >= 1000) {
+		poll_source_id = g_timeout_add_seconds ((delay + 999) / 1000,
+							fu_poll_scheduler_cb, NULL);
+	} else {
+		poll_source_id = g_timeout_add (delay, fu_poll_scheduler_cb, NULL);
+	}
+}
+
+/* must hold poll_mutex */
+static void
+fu_poll_scheduler_remove_unlocked (FuDevice *device)
+{
+	guint idx = 0;
+	if (fu_poll_scheduler_find_unlocked (device, &idx) == NULL)
+		return;
+	g_ptr_array_remove_index (poll_items, idx);
+}
+
+/* polls without the lock held, as ->poll() may change the poll interval */
+static void
+fu_poll_scheduler_poll_devices (GPtrArray *devices)
+{
+	for (guint i = 0; i < devices->len; i++) {
+		FuDevice *device = g_ptr_array_index (devices, i);
+		FuPollItem *item;
+		gboolean ret;
+		g_autoptr(GError) error_local = NULL;
+		g_autoptr(GMutexLocker) locker = NULL;
+
+		ret = fu_device_poll (device, &error_local);
+		locker = g_mutex_locker_new (&poll_mutex);
+		item = fu_poll_scheduler_find_unlocked (device, NULL);
+		if (item == NULL)
+			continue;
+		if (!ret) {
+			g_warning ("disabling polling: %s", error_local->message);
+			fu_poll_scheduler_remove_unlocked (device);
+			continue;
+		}
+		if (item->changed) {
+			item->idle_cnt = 0;
+		} else {
+			item->idle_cnt++;
+		}
+		item->last_poll = g_get_monotonic_time ();
+		item->next_due = item->last_poll + fu_poll_scheduler_get_interval (item);
+	}
+}
+
+static gboolean
+fu_poll_scheduler_cb (gpointer user_data)
+{
+	gint64 now = g_get_monotonic_time ();
+	g_autoptr(GPtrArray) devices = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&poll_mutex);
+
+	poll_source_id = 0;
+	for (guint i = 0; i < poll_items->len; i++) {
+		FuPollItem *item = g_ptr_array_index (poll_items, i);
+
+		/* due, or nearly due */
+		if (poll_suspended && fu_poll_scheduler_is_relaxed (item))
+			continue;
+		if (item->next_due - (fu_poll_scheduler_get_interval (item) /
+				      FU_POLL_SCHEDULER_SLACK_DIVISOR) > now)
+			continue;
+		item->changed = FALSE;
+		g_ptr_array_add (devices, g_object_ref (item->device));
+	}
+
+	/* every device after the first shared this wakeup */
+	if (devices->len > 1) {
+		poll_wakeups_saved += devices->len - 1;
+		fu_metrics_add_counter ("poll.wakeups-saved", devices->len - 1);
+	}
+	fu_metrics_add_counter ("poll.wakeups", 1);
+	g_clear_pointer (&locker, g_mutex_locker_free);
+
+	fu_poll_scheduler_poll_devices (devices);
+
+	locker = g_mutex_locker_new (&poll_mutex);
+	fu_poll_scheduler_reschedule_unlocked ();
+	return G_SOURCE_REMOVE;
+}
+
+/**
+ * fu_poll_scheduler_add:
+ * @device: a #FuDevice
+ * @interval: duration in ms, or 0 to disable
+ *
+ * Adds a device to be polled, or changes the interval of a device that is
+ * already being polled.
+ *
+ * Since: 1.6.0
+ **/
+void
+fu_poll_scheduler_add (FuDevice *device, guint interval)
+{
+	FuPollItem *item;
+	gint64 now = g_get_monotonic_time ();
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&poll_mutex);
+
+	g_return_if_fail (FU_IS_DEVICE (device));
+
+	if (interval == 0) {
+		fu_poll_scheduler_remove_unlocked (device);
+		fu_poll_scheduler_reschedule_unlocked ();
+		return;
+	}
+	if (poll_items == NULL)
+		poll_items = g_ptr_array_new_with_free_func ((GDestroyNotify) fu_poll_scheduler_item_free);
+	item = fu_poll_scheduler_find_unlocked (device, NULL);
+	if (item == NULL) {
+		item = g_new0 (FuPollItem, 1);
+		item->device = device;
+		item->notify_id = g_signal_connect (device, "notify",
+						    G_CALLBACK (fu_poll_scheduler_notify_cb),
+						    item);
+		g_ptr_array_add (poll_items, item);
+	}
+	item->interval = interval;
+	item->idle_cnt = 0;
+	item->next_due = now + (gint64) interval * 1000;
+	fu_poll_scheduler_reschedule_unlocked ();
+}
+
+/**
+ * fu_poll_scheduler_remove:
+ * @device: a #FuDevice
+ *
+ * Stops polling a device.
+ *
+ * Since: 1.6.0
+ **/
+void
+fu_poll_scheduler_remove (FuDevice *device)
+{
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&poll_mutex);
+	g_return_if_fail (FU_IS_DEVICE (device));
+	fu_poll_scheduler_remove_unlocked (device);
+	fu_poll_scheduler_reschedule_unlocked ();
+}
+
+/**
+ * fu_poll_scheduler_set_suspended:
+ * @suspended: %TRUE to stop polling
+ *
+ * Suspends the timed polling of devices with
+ * %FU_DEVICE_INTERNAL_FLAG_POLL_RELAXED, typically because there are no
+ * clients connected that could use the results. Any overdue devices are polled
+ * straight away when resumed.
+ *
+ * Since: 1.6.0
+ **/
+void
+fu_poll_scheduler_set_suspended (gboolean suspended)
+{
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&poll_mutex);
+	if (poll_suspended == suspended)
+		return;
+	g_debug ("%s polling", suspended ? "suspending" : "resuming");
+	poll_suspended = suspended;
+	fu_poll_scheduler_reschedule_unlocked ();
+}
+
+/**
+ * fu_poll_scheduler_get_suspended:
+ *
+ * Gets if the timed polling of relaxed devices is suspended.
+ *
+ * Returns: %TRUE if suspended
+ *
+ * Since: 1.6.0
+ **/
+gboolean
+fu_poll_scheduler_get_suspended (void)
+{
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&poll_mutex);
+	return poll_suspended;
+}
+
+/**
+ * fu_poll_scheduler_get_wakeups_saved:
+ *
+ * Gets the number of device polls that shared a wakeup with another device,
+ * rather than needing a timeout of their own.
+ *
+ * Returns: integer
+ *
+ * Since: 1.6.0
+ **/
+guint64
+fu_poll_scheduler_get_wakeups_saved (void)
+{
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&poll_mutex);
+	return poll_wakeups_saved;
+}
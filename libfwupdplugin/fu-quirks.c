@@ -8,14 +8,18 @@
 
 #include "config.h"
 
+#include <errno.h>
 #include <glib-object.h>
+#include <glib/gstdio.h>
 #include <gio/gio.h>
 #include <string.h>
 #include <xmlb.h>
 
 #include "fu-common.h"
+#include "fu-metrics.h"
 #include "fu-mutex.h"
 #include "fu-quirks.h"
+#include "fu-silo-cache-private.h"
 
 #include "fwupd-common.h"
 #include "fwupd-error.h"
@@ -82,24 +86,17 @@ fu_quirks_build_group_key (const gchar *group)
 	return fwupd_guid_hash_string (group);
 }
 
-static GInputStream *
-fu_quirks_convert_quirk_to_xml_cb (XbBuilderSource *source,
-				   XbBuilderSourceCtx *ctx,
-				   gpointer user_data,
-				   GCancellable *cancellable,
-				   GError **error)
+static gchar *
+fu_quirks_convert_quirk_to_xml (FuQuirks *self,
+				GBytes *bytes,
+				GPtrArray *invalid_keys,
+				GError **error)
 {
-	FuQuirks *self = FU_QUIRKS (user_data);
-	g_autofree gchar *xml = NULL;
 	g_auto(GStrv) groups = NULL;
-	g_autoptr(GBytes) bytes = NULL;
 	g_autoptr(GKeyFile) kf = g_key_file_new ();
 	g_autoptr(XbBuilderNode) root = xb_builder_node_new ("quirk");
 
 	/* parse keyfile */
-	bytes = xb_builder_source_ctx_get_bytes (ctx, cancellable, error);
-	if (bytes == NULL)
-		return NULL;
 	if (!g_key_file_load_from_data (kf,
 					g_bytes_get_data (bytes, NULL),
 					g_bytes_get_size (bytes),
@@ -133,11 +130,11 @@ fu_quirks_convert_quirk_to_xml_cb (XbBuilderSource *source,
 
 			/* sanity check key */
 			if (g_hash_table_lookup (self->possible_keys, keys[j]) == NULL) {
-				if (!g_ptr_array_find_with_equal_func (self->invalid_keys,
+				if (!g_ptr_array_find_with_equal_func (invalid_keys,
 								       keys[j],
 								       g_str_equal,
 								       NULL)) {
-					g_ptr_array_add (self->invalid_keys,
+					g_ptr_array_add (invalid_keys,
 							 g_strdup (keys[j]));
 				}
 			}
@@ -152,10 +149,7 @@ fu_quirks_convert_quirk_to_xml_cb (XbBuilderSource *source,
 	}
 
 	/* export as XML */
-	xml = xb_builder_node_export (root, XB_NODE_EXPORT_FLAG_ADD_HEADER, error);
-	if (xml == NULL)
-		return NULL;
-	return g_memory_input_stream_new_from_data (g_steal_pointer (&xml), -1, g_free);
+	return xb_builder_node_export (root, XB_NODE_EXPORT_FLAG_ADD_HEADER, error);
 }
 
 static gint
@@ -167,13 +161,12 @@ fu_quirks_filename_sort_cb (gconstpointer a, gconstpointer b)
 }
 
 static gboolean
-fu_quirks_add_quirks_for_path (FuQuirks *self, XbBuilder *builder,
-			       const gchar *path, GError **error)
+fu_quirks_add_filenames_for_path (GPtrArray *filenames, const gchar *path, GError **error)
 {
 	const gchar *tmp;
 	g_autofree gchar *path_hw = NULL;
 	g_autoptr(GDir) dir = NULL;
-	g_autoptr(GPtrArray) filenames = g_ptr_array_new_with_free_func (g_free);
+	g_autoptr(GPtrArray) filenames_tmp = g_ptr_array_new_with_free_func (g_free);
 
 	/* add valid files to the array */
 	path_hw = g_build_filename (path, "quirks.d", NULL);
@@ -187,41 +180,220 @@ fu_quirks_add_quirks_for_path (FuQuirks *self, XbBuilder *builder,
 			g_debug ("skipping invalid file %s", tmp);
 			continue;
 		}
-		g_ptr_array_add (filenames, g_build_filename (path_hw, tmp, NULL));
+		g_ptr_array_add (filenames_tmp, g_build_filename (path_hw, tmp, NULL));
 	}
 
 	/* sort */
-	g_ptr_array_sort (filenames, fu_quirks_filename_sort_cb);
+	g_ptr_array_sort (filenames_tmp, fu_quirks_filename_sort_cb);
+	for (guint i = 0; i < filenames_tmp->len; i++) {
+		const gchar *filename = g_ptr_array_index (filenames_tmp, i);
+		g_ptr_array_add (filenames, g_strdup (filename));
+	}
 
-	/* process files */
-	for (guint i = 0; i < filenames->len; i++) {
-		const gchar *filename = g_ptr_array_index (filenames, i);
-		g_autoptr(GFile) file = g_file_new_for_path (filename);
-		g_autoptr(XbBuilderSource) source = xb_builder_source_new ();
-
-		/* load from keyfile */
-#if LIBXMLB_CHECK_VERSION(0,1,15)
-		xb_builder_source_add_simple_adapter (source, "text/plain,.quirk",
-						      fu_quirks_convert_quirk_to_xml_cb,
-						      self, NULL);
-#else
-		xb_builder_source_add_adapter (source, "text/plain,.quirk",
-					       fu_quirks_convert_quirk_to_xml_cb,
-					       self, NULL);
-#endif
-		if (!xb_builder_source_load_file (source, file,
-						  XB_BUILDER_SOURCE_FLAG_WATCH_FILE |
-						  XB_BUILDER_SOURCE_FLAG_LITERAL_TEXT,
-						  NULL, error)) {
-			g_prefix_error (error, "failed to load %s: ", filename);
+	/* success */
+	return TRUE;
+}
+
+typedef struct {
+	FuQuirks		*self;
+	gchar			*filename;	/* .quirk */
+	GBytes			*bytes;		/* of .quirk */
+	gchar			*fragment_fn;	/* .xml */
+	gchar			*invalid_keys_fn; /* .txt */
+	gchar			*xml;		/* (nullable): if the fragment could not be saved */
+	gboolean		 convert;
+	GPtrArray		*invalid_keys;
+	GError			*error;
+} FuQuirksFragmentJob;
+
+static void
+fu_quirks_fragment_job_free (FuQuirksFragmentJob *job)
+{
+	g_free (job->filename);
+	g_bytes_unref (job->bytes);
+	g_free (job->fragment_fn);
+	g_free (job->invalid_keys_fn);
+	g_free (job->xml);
+	g_ptr_array_unref (job->invalid_keys);
+	if (job->error != NULL)
+		g_error_free (job->error);
+	g_free (job);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(FuQuirksFragmentJob, fu_quirks_fragment_job_free)
+
+/* the invalid keys are only found when converting */
+static void
+fu_quirks_fragment_job_load_invalid_keys (FuQuirksFragmentJob *job)
+{
+	g_autofree gchar *buf = NULL;
+	g_auto(GStrv) keys = NULL;
+
+	if (!g_file_get_contents (job->invalid_keys_fn, &buf, NULL, NULL)) {
+		job->convert = TRUE;
+		return;
+	}
+	keys = g_strsplit (buf, "\n", -1);
+	for (guint i = 0; keys[i] != NULL; i++) {
+		if (keys[i][0] == '\0')
+			continue;
+		g_ptr_array_add (job->invalid_keys, g_strdup (keys[i]));
+	}
+}
+
+/* the fragment filename changes when the quirk file contents change, even if
+ * the modification time and size do not */
+static FuQuirksFragmentJob *
+fu_quirks_fragment_job_new (FuQuirks *self,
+			    const gchar *filename,
+			    const gchar *fragmentdir,
+			    GError **error)
+{
+	gsize bufsz = 0;
+	g_autofree gchar *buf = NULL;
+	g_autofree gchar *basename = NULL;
+	g_autoptr(FuQuirksFragmentJob) job = NULL;
+	g_autoptr(GChecksum) csum = g_checksum_new (G_CHECKSUM_SHA1);
+
+	if (!g_file_get_contents (filename, &buf, &bufsz, error))
+		return NULL;
+	g_checksum_update (csum, (const guchar *) PACKAGE_VERSION, -1);
+	g_checksum_update (csum, (const guchar *) filename, -1);
+	g_checksum_update (csum, (const guchar *) buf, bufsz);
+
+	job = g_new0 (FuQuirksFragmentJob, 1);
+	job->self = self;
+	job->filename = g_strdup (filename);
+	job->bytes = g_bytes_new_take (g_steal_pointer (&buf), bufsz);
+	basename = g_strdup_printf ("%s.xml", g_checksum_get_string (csum));
+	job->fragment_fn = g_build_filename (fragmentdir, basename, NULL);
+	g_free (basename);
+	basename = g_strdup_printf ("%s.txt", g_checksum_get_string (csum));
+	job->invalid_keys_fn = g_build_filename (fragmentdir, basename, NULL);
+	job->invalid_keys = g_ptr_array_new_with_free_func (g_free);
+	job->convert = !g_file_test (job->fragment_fn, G_FILE_TEST_EXISTS);
+	if (!job->convert)
+		fu_quirks_fragment_job_load_invalid_keys (job);
+	return g_steal_pointer (&job);
+}
+
+static gboolean
+fu_quirks_fragment_job_convert (FuQuirksFragmentJob *job, GError **error)
+{
+	g_autofree gchar *invalid_keys = NULL;
+	g_autofree gchar *xml = NULL;
+	g_autoptr(GError) error_local = NULL;
+
+	g_ptr_array_set_size (job->invalid_keys, 0);
+	xml = fu_quirks_convert_quirk_to_xml (job->self, job->bytes, job->invalid_keys, error);
+	if (xml == NULL)
+		return FALSE;
+	fu_metrics_add_counter ("quirks.convert", 1);
+
+	/* keep in memory on a read-only filesystem, and save the invalid keys
+	 * with the fragment so they are still shown when it is reused */
+	invalid_keys = fu_common_strjoin_array ("\n", job->invalid_keys);
+	if ((job->self->load_flags & FU_QUIRKS_LOAD_FLAG_READONLY_FS) == 0 &&
+	    g_file_set_contents (job->fragment_fn, xml, -1, &error_local) &&
+	    g_file_set_contents (job->invalid_keys_fn, invalid_keys, -1, &error_local))
+		return TRUE;
+	if (error_local != NULL)
+		g_debug ("failed to save %s: %s", job->fragment_fn, error_local->message);
+	job->xml = g_steal_pointer (&xml);
+	return TRUE;
+}
+
+static void
+fu_quirks_fragment_worker_cb (gpointer data, gpointer user_data)
+{
+	FuQuirksFragmentJob *job = (FuQuirksFragmentJob *) data;
+	if (!fu_quirks_fragment_job_convert (job, &job->error))
+		g_prefix_error (&job->error, "failed to load %s: ", job->filename);
+}
+
+/* each job only writes to its own fragment */
+static gboolean
+fu_quirks_fragment_jobs_convert (GPtrArray *jobs, GError **error)
+{
+	GThreadPool *pool = NULL;
+	guint convert_cnt = 0;
+
+	for (guint i = 0; i < jobs->len; i++) {
+		FuQuirksFragmentJob *job = g_ptr_array_index (jobs, i);
+		if (job->convert)
+			convert_cnt++;
+	}
+	if (convert_cnt > 1) {
+		pool = g_thread_pool_new (fu_quirks_fragment_worker_cb, NULL,
+					  MIN (g_get_num_processors (), convert_cnt),
+					  FALSE, error);
+		if (pool == NULL)
+			return FALSE;
+	}
+	for (guint i = 0; i < jobs->len; i++) {
+		FuQuirksFragmentJob *job = g_ptr_array_index (jobs, i);
+		if (!job->convert)
+			continue;
+		if (pool != NULL && g_thread_pool_push (pool, job, &job->error))
+			continue;
+		if (job->error == NULL)
+			fu_quirks_fragment_worker_cb (job, NULL);
+	}
+	if (pool != NULL)
+		g_thread_pool_free (pool, FALSE, TRUE);
+
+	/* report the first failure in file order */
+	for (guint i = 0; i < jobs->len; i++) {
+		FuQuirksFragmentJob *job = g_ptr_array_index (jobs, i);
+		if (job->error != NULL) {
+			g_propagate_error (error, g_steal_pointer (&job->error));
 			return FALSE;
 		}
+	}
+	return TRUE;
+}
 
-		/* watch the file for changes */
-		xb_builder_import_source (builder, source);
+static void
+fu_quirks_fragments_cleanup (GPtrArray *jobs, const gchar *fragmentdir)
+{
+	const gchar *tmp;
+	g_autoptr(GDir) dir = NULL;
+	g_autoptr(GHashTable) fragments = g_hash_table_new (g_str_hash, g_str_equal);
+
+	for (guint i = 0; i < jobs->len; i++) {
+		FuQuirksFragmentJob *job = g_ptr_array_index (jobs, i);
+		g_hash_table_add (fragments, job->fragment_fn);
+		g_hash_table_add (fragments, job->invalid_keys_fn);
+	}
+	dir = g_dir_open (fragmentdir, 0, NULL);
+	if (dir == NULL)
+		return;
+	while ((tmp = g_dir_read_name (dir)) != NULL) {
+		g_autofree gchar *fn = g_build_filename (fragmentdir, tmp, NULL);
+		if (g_hash_table_contains (fragments, fn))
+			continue;
+		if (g_unlink (fn) != 0)
+			g_debug ("failed to delete %s", fn);
 	}
+}
 
-	/* success */
+static gboolean
+fu_quirks_import_fragment (XbBuilder *builder, FuQuirksFragmentJob *job, GError **error)
+{
+	g_autoptr(XbBuilderSource) source = xb_builder_source_new ();
+	if (job->xml != NULL) {
+		if (!xb_builder_source_load_xml (source, job->xml,
+						 XB_BUILDER_SOURCE_FLAG_LITERAL_TEXT,
+						 error))
+			return FALSE;
+	} else {
+		g_autoptr(GFile) file = g_file_new_for_path (job->fragment_fn);
+		if (!xb_builder_source_load_file (source, file,
+						  XB_BUILDER_SOURCE_FLAG_LITERAL_TEXT,
+						  NULL, error))
+			return FALSE;
+	}
+	xb_builder_import_source (builder, source);
 	return TRUE;
 }
 
@@ -233,45 +405,111 @@ fu_quirks_strcasecmp_cb (gconstpointer a, gconstpointer b)
 	return g_ascii_strcasecmp (entry1, entry2);
 }
 
+/* must hold the fragment lock, as another process may delete the fragments
+ * it does not use */
 static gboolean
-fu_quirks_check_silo (FuQuirks *self, GError **error)
+fu_quirks_build_silo (FuQuirks *self,
+		      GPtrArray *filenames,
+		      const gchar *fragmentdir,
+		      GError **error)
 {
 	XbBuilderCompileFlags compile_flags = XB_BUILDER_COMPILE_FLAG_WATCH_BLOB;
+	g_autoptr(GPtrArray) jobs = NULL;
+	g_autoptr(XbBuilder) builder = NULL;
+
+	jobs = g_ptr_array_new_with_free_func ((GDestroyNotify) fu_quirks_fragment_job_free);
+	for (guint i = 0; i < filenames->len; i++) {
+		const gchar *filename = g_ptr_array_index (filenames, i);
+		FuQuirksFragmentJob *job;
+		job = fu_quirks_fragment_job_new (self, filename, fragmentdir, error);
+		if (job == NULL)
+			return FALSE;
+		g_ptr_array_add (jobs, job);
+	}
+	if (!fu_quirks_fragment_jobs_convert (jobs, error))
+		return FALSE;
+
+	/* merge the fragments in the same order as the quirk files */
+	builder = xb_builder_new ();
+	for (guint i = 0; i < jobs->len; i++) {
+		FuQuirksFragmentJob *job = g_ptr_array_index (jobs, i);
+		for (guint j = 0; j < job->invalid_keys->len; j++) {
+			const gchar *key = g_ptr_array_index (job->invalid_keys, j);
+			if (!g_ptr_array_find_with_equal_func (self->invalid_keys, key,
+							       g_str_equal, NULL))
+				g_ptr_array_add (self->invalid_keys, g_strdup (key));
+		}
+		if (!fu_quirks_import_fragment (builder, job, error)) {
+			g_prefix_error (error, "failed to load %s: ", job->filename);
+			return FALSE;
+		}
+	}
+
+	/* load silo */
+	if (g_getenv ("FWUPD_XMLB_VERBOSE") != NULL) {
+		xb_builder_set_profile_flags (builder,
+					      XB_SILO_PROFILE_FLAG_XPATH |
+					      XB_SILO_PROFILE_FLAG_DEBUG);
+	}
+	if (self->load_flags & FU_QUIRKS_LOAD_FLAG_READONLY_FS)
+		compile_flags |= XB_BUILDER_COMPILE_FLAG_IGNORE_GUID;
+	self->silo = fu_silo_cache_ensure (builder, "quirks.xmlb", compile_flags, NULL, error);
+	if (self->silo == NULL)
+		return FALSE;
+
+	/* rebuild when any of the quirk files are modified */
+	for (guint i = 0; i < jobs->len; i++) {
+		FuQuirksFragmentJob *job = g_ptr_array_index (jobs, i);
+		g_autoptr(GFile) file_quirk = g_file_new_for_path (job->filename);
+		if (!xb_silo_watch_file (self->silo, file_quirk, NULL, error))
+			return FALSE;
+	}
+
+	/* fragments for old versions of quirk files are never used again */
+	if ((self->load_flags & FU_QUIRKS_LOAD_FLAG_READONLY_FS) == 0)
+		fu_quirks_fragments_cleanup (jobs, fragmentdir);
+
+	/* success */
+	return TRUE;
+}
+
+static gboolean
+fu_quirks_check_silo (FuQuirks *self, GError **error)
+{
+	gboolean ret;
+	gint fd = -1;
 	g_autofree gchar *cachedirpkg = NULL;
 	g_autofree gchar *datadir = NULL;
+	g_autofree gchar *fragmentdir = NULL;
 	g_autofree gchar *localstatedir = NULL;
-	g_autofree gchar *xmlbfn = NULL;
-	g_autoptr(GFile) file = NULL;
-	g_autoptr(XbBuilder) builder = NULL;
+	g_autoptr(GPtrArray) filenames = g_ptr_array_new_with_free_func (g_free);
 
 	/* everything is okay */
 	if (self->silo != NULL && xb_silo_is_valid (self->silo))
 		return TRUE;
 
 	/* system datadir */
-	builder = xb_builder_new ();
 	datadir = fu_common_get_path (FU_PATH_KIND_DATADIR_PKG);
-	if (!fu_quirks_add_quirks_for_path (self, builder, datadir, error))
+	if (!fu_quirks_add_filenames_for_path (filenames, datadir, error))
 		return FALSE;
 
 	/* something we can write when using Ostree */
 	localstatedir = fu_common_get_path (FU_PATH_KIND_LOCALSTATEDIR_PKG);
-	if (!fu_quirks_add_quirks_for_path (self, builder, localstatedir, error))
+	if (!fu_quirks_add_filenames_for_path (filenames, localstatedir, error))
 		return FALSE;
 
-	/* load silo */
+	/* each quirk file is converted to a XML fragment only when it changes,
+	 * and the fragments are shared with other processes */
 	cachedirpkg = fu_common_get_path (FU_PATH_KIND_CACHEDIR_PKG);
-	xmlbfn = g_build_filename (cachedirpkg, "quirks.xmlb", NULL);
-	file = g_file_new_for_path (xmlbfn);
-	if (g_getenv ("FWUPD_XMLB_VERBOSE") != NULL) {
-		xb_builder_set_profile_flags (builder,
-					      XB_SILO_PROFILE_FLAG_XPATH |
-					      XB_SILO_PROFILE_FLAG_DEBUG);
+	fragmentdir = g_build_filename (cachedirpkg, "quirks", NULL);
+	if ((self->load_flags & FU_QUIRKS_LOAD_FLAG_READONLY_FS) == 0) {
+		if (g_mkdir_with_parents (fragmentdir, 0755) != 0)
+			g_debug ("failed to create %s: %s", fragmentdir, g_strerror (errno));
+		fd = fu_silo_cache_lock (fragmentdir);
 	}
-	if (self->load_flags & FU_QUIRKS_LOAD_FLAG_READONLY_FS)
-		compile_flags |= XB_BUILDER_COMPILE_FLAG_IGNORE_GUID;
-	self->silo = xb_builder_ensure (builder, file, compile_flags, NULL, error);
-	if (self->silo == NULL)
+	ret = fu_quirks_build_silo (self, filenames, fragmentdir, error);
+	fu_silo_cache_unlock (fd);
+	if (!ret)
 		return FALSE;
 
 	/* dump warnings to console, just once */
@@ -320,6 +558,7 @@ fu_quirks_lookup_by_id (FuQuirks *self, const gchar *group, const gchar *key)
 	}
 
 	/* query */
+	fu_metrics_add_counter ("quirks.lookup", 1);
 	group_key = fu_quirks_build_group_key (group);
 	query = xb_query_new_full (self->silo,
 				   "quirk/device[@id=?]/value[@key=?]",
@@ -397,6 +636,7 @@ fu_quirks_lookup_by_id_iter (FuQuirks *self, const gchar *group,
 	}
 
 	/* query */
+	fu_metrics_add_counter ("quirks.lookup-iter", 1);
 	group_key = fu_quirks_build_group_key (group);
 	query = xb_query_new_full (self->silo,
 				   "quirk/device[@id=?]/value",
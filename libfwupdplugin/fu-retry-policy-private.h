@@ -0,0 +1,16 @@
+/*
+ * Copyright (C) 2021 Richard Hughes <richard@hughsie.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1+
+ */
+
+#pragma once
+
+#include "fu-retry-policy.h"
+
+guint		 fu_retry_policy_get_settle		(FuRetryPolicy	*self,
+							 const gchar	*model);
+void		 fu_retry_policy_add_settle		(FuRetryPolicy	*self,
+							 const gchar	*model,
+							 guint		 settle);
+gboolean	 fu_retry_policy_save_settle		(GError		**error);
@@ -0,0 +1,389 @@
+/*
+ * Copyright (C) 2021 Richard Hughes <richard@hughsie.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1+
+ */
+
+#define G_LOG_DOMAIN				"FuRetryPolicy"
+
+#include "config.h"
+
+#include "fu-common.h"
+#include "fu-retry-policy-private.h"
+
+/**
+ * SECTION:fu-retry-policy
+ * @short_description: How to retry a device operation
+ *
+ * An object that describes how fu_device_retry_with_policy() should retry
+ * an operation: the delay doubles from a minimum up to a maximum with some
+ * random jitter, and the operation is abandoned when the total time budget
+ * has been used rather than after a fixed number of tries.
+ *
+ * If the policy has an ID then the time each device model took to settle is
+ * remembered between updates, and is used to choose the first delay the next
+ * time the same model is retried. The daemon saves the settle times when the
+ * update has finished.
+ *
+ * See also: #FuDevice
+ */
+
+struct _FuRetryPolicy {
+	GObject			 parent_instance;
+	gchar			*id;
+	guint			 delay_min;	/* ms */
+	guint			 delay_max;	/* ms */
+	guint			 jitter;	/* percentage */
+	guint			 budget;	/* ms */
+	guint			 ready_interval;/* ms */
+};
+
+G_DEFINE_TYPE (FuRetryPolicy, fu_retry_policy, G_TYPE_OBJECT)
+
+/* the learned settle times, shared by all policies with the same ID */
+static GMutex		 settle_mutex;
+static GKeyFile		*settle_kf = NULL;
+static gboolean		 settle_changed = FALSE;
+
+/**
+ * fu_retry_policy_get_id:
+ * @self: a #FuRetryPolicy
+ *
+ * Gets the ID used to remember the settle time.
+ *
+ * Return value: string, or %NULL if the settle time is not remembered
+ *
+ * Since: 1.6.0
+ **/
+const gchar *
+fu_retry_policy_get_id (FuRetryPolicy *self)
+{
+	g_return_val_if_fail (FU_IS_RETRY_POLICY (self), NULL);
+	return self->id;
+}
+
+/**
+ * fu_retry_policy_set_delay:
+ * @self: a #FuRetryPolicy
+ * @delay_min: the first delay in ms
+ * @delay_max: the largest delay in ms
+ *
+ * Sets the range of the delay between tries, where each failed try doubles
+ * the delay up to @delay_max.
+ *
+ * Since: 1.6.0
+ **/
+void
+fu_retry_policy_set_delay (FuRetryPolicy *self, guint delay_min, guint delay_max)
+{
+	g_return_if_fail (FU_IS_RETRY_POLICY (self));
+	g_return_if_fail (delay_min <= delay_max);
+	self->delay_min = delay_min;
+	self->delay_max = delay_max;
+}
+
+/**
+ * fu_retry_policy_get_delay_min:
+ * @self: a #FuRetryPolicy
+ *
+ * Gets the first delay between tries.
+ *
+ * Return value: delay in ms
+ *
+ * Since: 1.6.0
+ **/
+guint
+fu_retry_policy_get_delay_min (FuRetryPolicy *self)
+{
+	g_return_val_if_fail (FU_IS_RETRY_POLICY (self), G_MAXUINT);
+	return self->delay_min;
+}
+
+/**
+ * fu_retry_policy_get_delay_max:
+ * @self: a #FuRetryPolicy
+ *
+ * Gets the largest delay between tries.
+ *
+ * Return value: delay in ms
+ *
+ * Since: 1.6.0
+ **/
+guint
+fu_retry_policy_get_delay_max (FuRetryPolicy *self)
+{
+	g_return_val_if_fail (FU_IS_RETRY_POLICY (self), G_MAXUINT);
+	return self->delay_max;
+}
+
+/**
+ * fu_retry_policy_set_jitter:
+ * @self: a #FuRetryPolicy
+ * @jitter: a percentage, e.g. 10
+ *
+ * Sets the amount each delay may randomly be shortened or lengthened by, which
+ * stops several devices reset at the same time from being retried in lockstep.
+ *
+ * Since: 1.6.0
+ **/
+void
+fu_retry_policy_set_jitter (FuRetryPolicy *self, guint jitter)
+{
+	g_return_if_fail (FU_IS_RETRY_POLICY (self));
+	g_return_if_fail (jitter <= 100);
+	self->jitter = jitter;
+}
+
+/**
+ * fu_retry_policy_get_jitter:
+ * @self: a #FuRetryPolicy
+ *
+ * Gets the amount each delay may randomly be changed by.
+ *
+ * Return value: a percentage
+ *
+ * Since: 1.6.0
+ **/
+guint
+fu_retry_policy_get_jitter (FuRetryPolicy *self)
+{
+	g_return_val_if_fail (FU_IS_RETRY_POLICY (self), G_MAXUINT);
+	return self->jitter;
+}
+
+/**
+ * fu_retry_policy_set_budget:
+ * @self: a #FuRetryPolicy
+ * @budget: time in ms
+ *
+ * Sets the total time that can be spent retrying before giving up.
+ *
+ * Since: 1.6.0
+ **/
+void
+fu_retry_policy_set_budget (FuRetryPolicy *self, guint budget)
+{
+	g_return_if_fail (FU_IS_RETRY_POLICY (self));
+	self->budget = budget;
+}
+
+/**
+ * fu_retry_policy_get_budget:
+ * @self: a #FuRetryPolicy
+ *
+ * Gets the total time that can be spent retrying.
+ *
+ * Return value: time in ms
+ *
+ * Since: 1.6.0
+ **/
+guint
+fu_retry_policy_get_budget (FuRetryPolicy *self)
+{
+	g_return_val_if_fail (FU_IS_RETRY_POLICY (self), G_MAXUINT);
+	return self->budget;
+}
+
+/**
+ * fu_retry_policy_set_ready_interval:
+ * @self: a #FuRetryPolicy
+ * @ready_interval: time in ms
+ *
+ * Sets how often the readiness function is polled while waiting between tries.
+ *
+ * Since: 1.6.0
+ **/
+void
+fu_retry_policy_set_ready_interval (FuRetryPolicy *self, guint ready_interval)
+{
+	g_return_if_fail (FU_IS_RETRY_POLICY (self));
+	g_return_if_fail (ready_interval > 0);
+	self->ready_interval = ready_interval;
+}
+
+/**
+ * fu_retry_policy_get_ready_interval:
+ * @self: a #FuRetryPolicy
+ *
+ * Gets how often the readiness function is polled while waiting between tries.
+ *
+ * Return value: time in ms
+ *
+ * Since: 1.6.0
+ **/
+guint
+fu_retry_policy_get_ready_interval (FuRetryPolicy *self)
+{
+	g_return_val_if_fail (FU_IS_RETRY_POLICY (self), G_MAXUINT);
+	return self->ready_interval;
+}
+
+/**
+ * fu_retry_policy_get_next_delay:
+ * @self: a #FuRetryPolicy
+ * @delay: the previous delay in ms, or 0 for the first
+ *
+ * Gets the delay to use before the next try, including any jitter.
+ *
+ * Return value: delay in ms
+ *
+ * Since: 1.6.0
+ **/
+guint
+fu_retry_policy_get_next_delay (FuRetryPolicy *self, guint delay)
+{
+	guint64 next;
+
+	g_return_val_if_fail (FU_IS_RETRY_POLICY (self), 0);
+
+	/* double, clamped to the range */
+	next = MAX(((guint64) delay) * 2, self->delay_min);
+	next = MIN(next, self->delay_max);
+
+	/* randomly move by up to the jitter in either direction */
+	if (self->jitter > 0 && next > 0) {
+		guint64 range = (next * self->jitter) / 100;
+		if (range > 0) {
+			next -= range;
+			next += (guint64) g_random_int_range (0, (gint32) MIN(range * 2, G_MAXINT32) + 1);
+		}
+	}
+	return (guint) next;
+}
+
+static gchar *
+fu_retry_policy_settle_get_filename (void)
+{
+	g_autofree gchar *cachedir = fu_common_get_path (FU_PATH_KIND_CACHEDIR_PKG);
+	return g_build_filename (cachedir, "retry.ini", NULL);
+}
+
+/* must hold settle_mutex */
+static void
+fu_retry_policy_settle_load_unlocked (void)
+{
+	g_autofree gchar *fn = NULL;
+	g_autoptr(GError) error_local = NULL;
+
+	/* already done */
+	if (settle_kf != NULL)
+		return;
+	settle_kf = g_key_file_new ();
+	fn = fu_retry_policy_settle_get_filename ();
+	if (!g_file_test (fn, G_FILE_TEST_EXISTS))
+		return;
+	if (!g_key_file_load_from_file (settle_kf, fn, G_KEY_FILE_NONE, &error_local))
+		g_debug ("ignoring learned settle times: %s", error_local->message);
+}
+
+/* private: saves the learned settle times if any have changed, which is done
+ * once after an update rather than every time a device settles */
+gboolean
+fu_retry_policy_save_settle (GError **error)
+{
+	g_autofree gchar *fn = NULL;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&settle_mutex);
+
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+	if (!settle_changed)
+		return TRUE;
+	fn = fu_retry_policy_settle_get_filename ();
+	if (!fu_common_mkdir_parent (fn, error))
+		return FALSE;
+	if (!g_key_file_save_to_file (settle_kf, fn, error))
+		return FALSE;
+	settle_changed = FALSE;
+	return TRUE;
+}
+
+/* private: returns the learned settle time in ms, or 0 for unknown */
+guint
+fu_retry_policy_get_settle (FuRetryPolicy *self, const gchar *model)
+{
+	guint64 settle;
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_val_if_fail (FU_IS_RETRY_POLICY (self), 0);
+
+	if (self->id == NULL || model == NULL)
+		return 0;
+	locker = g_mutex_locker_new (&settle_mutex);
+	fu_retry_policy_settle_load_unlocked ();
+	settle = g_key_file_get_uint64 (settle_kf, self->id, model, NULL);
+	return (guint) MIN(settle, self->budget);
+}
+
+/* private: blends a new settle time in ms into the learned value */
+void
+fu_retry_policy_add_settle (FuRetryPolicy *self, const gchar *model, guint settle)
+{
+	guint64 settle_old;
+	guint64 settle_new;
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_if_fail (FU_IS_RETRY_POLICY (self));
+
+	if (self->id == NULL || model == NULL)
+		return;
+	locker = g_mutex_locker_new (&settle_mutex);
+	fu_retry_policy_settle_load_unlocked ();
+
+	/* weight the history so one slow enumeration does not dominate */
+	if (g_key_file_has_key (settle_kf, self->id, model, NULL)) {
+		settle_old = g_key_file_get_uint64 (settle_kf, self->id, model, NULL);
+		settle_new = ((settle_old * 3) + settle) / 4;
+		if (settle_new == settle_old)
+			return;
+	} else {
+		settle_new = settle;
+	}
+	g_debug ("learned settle time for %s:%s is now %" G_GUINT64_FORMAT "ms",
+		 self->id, model, settle_new);
+	g_key_file_set_uint64 (settle_kf, self->id, model, settle_new);
+	settle_changed = TRUE;
+}
+
+static void
+fu_retry_policy_finalize (GObject *object)
+{
+	FuRetryPolicy *self = FU_RETRY_POLICY (object);
+	g_free (self->id);
+	G_OBJECT_CLASS (fu_retry_policy_parent_class)->finalize (object);
+}
+
+static void
+fu_retry_policy_class_init (FuRetryPolicyClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+	object_class->finalize = fu_retry_policy_finalize;
+}
+
+static void
+fu_retry_policy_init (FuRetryPolicy *self)
+{
+	self->delay_min = 10;
+	self->delay_max = 1000;
+	self->jitter = 10;
+	self->budget = 5000;
+	self->ready_interval = 10;
+}
+
+/**
+ * fu_retry_policy_new:
+ * @id: (nullable): an ID for the operation, e.g. `replug`
+ *
+ * Creates a new retry policy. If @id is set then the time taken for each
+ * device model to settle is remembered and used for the next retry.
+ *
+ * Return value: (transfer full): a #FuRetryPolicy
+ *
+ * Since: 1.6.0
+ **/
+FuRetryPolicy *
+fu_retry_policy_new (const gchar *id)
+{
+	FuRetryPolicy *self = g_object_new (FU_TYPE_RETRY_POLICY, NULL);
+	self->id = g_strdup (id);
+	return self;
+}
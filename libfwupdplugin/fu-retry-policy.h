@@ -0,0 +1,32 @@
+/*
+ * Copyright (C) 2021 Richard Hughes <richard@hughsie.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1+
+ */
+
+#pragma once
+
+#include <glib-object.h>
+
+#define FU_TYPE_RETRY_POLICY (fu_retry_policy_get_type ())
+
+G_DECLARE_FINAL_TYPE (FuRetryPolicy, fu_retry_policy, FU, RETRY_POLICY, GObject)
+
+FuRetryPolicy	*fu_retry_policy_new			(const gchar	*id);
+const gchar	*fu_retry_policy_get_id			(FuRetryPolicy	*self);
+void		 fu_retry_policy_set_delay		(FuRetryPolicy	*self,
+							 guint		 delay_min,
+							 guint		 delay_max);
+guint		 fu_retry_policy_get_delay_min		(FuRetryPolicy	*self);
+guint		 fu_retry_policy_get_delay_max		(FuRetryPolicy	*self);
+void		 fu_retry_policy_set_jitter		(FuRetryPolicy	*self,
+							 guint		 jitter);
+guint		 fu_retry_policy_get_jitter		(FuRetryPolicy	*self);
+void		 fu_retry_policy_set_budget		(FuRetryPolicy	*self,
+							 guint		 budget);
+guint		 fu_retry_policy_get_budget		(FuRetryPolicy	*self);
+void		 fu_retry_policy_set_ready_interval	(FuRetryPolicy	*self,
+							 guint		 ready_interval);
+guint		 fu_retry_policy_get_ready_interval	(FuRetryPolicy	*self);
+guint		 fu_retry_policy_get_next_delay		(FuRetryPolicy	*self,
+							 guint		 delay);
@@ -6,7 +6,9 @@
 
 #include "config.h"
 
+#include <fcntl.h>
 #include <string.h>
+#include <utime.h>
 #include <xmlb.h>
 #include <fwupd.h>
 #include <fwupdplugin.h>
@@ -14,9 +16,15 @@
 #include <glib/gstdio.h>
 
 #include "fu-device-private.h"
+#include "fu-hwids-private.h"
+#include "fu-jcat-cache-private.h"
 #include "fu-plugin-private.h"
+#include "fu-poll-scheduler-private.h"
+#include "fu-retry-policy-private.h"
 #include "fu-security-attrs-private.h"
+#include "fu-silo-cache-private.h"
 #include "fu-smbios-private.h"
+#include "fu-usb-device-private.h"
 #include "fwupd-security-attr-private.h"
 
 static GMainLoop *_test_loop = NULL;
@@ -119,6 +127,717 @@ fu_archive_cab_func (void)
 	g_assert_null (data_tmp);
 }
 
+static void
+fu_metrics_func (void)
+{
+	g_autoptr(GHashTable) metrics = NULL;
+
+	fu_metrics_reset ();
+	fu_metrics_add_counter ("test.write-bytes", 10);
+	fu_metrics_add_counter ("test.write-bytes", 5);
+	fu_metrics_add_duration ("test.probe", 500);
+	fu_metrics_add_duration ("test.probe", 20000);
+	fu_metrics_add_duration ("test.probe", 20000000);
+
+	/* mixing kinds is ignored */
+	g_test_expect_message ("FuMetrics", G_LOG_LEVEL_WARNING, "*both counter and duration*");
+	fu_metrics_add_duration ("test.write-bytes", 1);
+	g_test_assert_expected_messages ();
+
+	metrics = fu_metrics_get_all ();
+	g_assert_cmpint (g_hash_table_size (metrics), ==, 10);
+	g_assert_cmpstr (g_hash_table_lookup (metrics, "test.write-bytes"), ==, "15");
+	g_assert_cmpstr (g_hash_table_lookup (metrics, "test.probe.count"), ==, "3");
+	g_assert_cmpstr (g_hash_table_lookup (metrics, "test.probe.total-us"), ==, "20020500");
+	g_assert_cmpstr (g_hash_table_lookup (metrics, "test.probe.max-us"), ==, "20000000");
+	g_assert_cmpstr (g_hash_table_lookup (metrics, "test.probe.le-1ms"), ==, "1");
+	g_assert_cmpstr (g_hash_table_lookup (metrics, "test.probe.le-10ms"), ==, "0");
+	g_assert_cmpstr (g_hash_table_lookup (metrics, "test.probe.le-100ms"), ==, "1");
+	g_assert_cmpstr (g_hash_table_lookup (metrics, "test.probe.gt-10s"), ==, "1");
+
+	/* clear */
+	fu_metrics_reset ();
+	g_hash_table_unref (metrics);
+	metrics = fu_metrics_get_all ();
+	g_assert_cmpint (g_hash_table_size (metrics), ==, 0);
+}
+
+static void
+fu_jcat_cache_func (void)
+{
+	gboolean ret;
+	gint64 timestamp = -1;
+	g_autofree gchar *checksum = NULL;
+	g_autofree gchar *fn = NULL;
+	g_autofree gchar *pkidir = NULL;
+	g_autoptr(GBytes) blob = g_bytes_new_static ("hello world", 11);
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GHashTable) metrics = NULL;
+	g_autoptr(JcatBlob) jcat_blob = NULL;
+	g_autoptr(JcatContext) jcat_context = jcat_context_new ();
+	g_autoptr(JcatContext) jcat_context2 = jcat_context_new ();
+	g_autoptr(JcatContext) jcat_context3 = jcat_context_new ();
+	g_autoptr(JcatItem) jcat_item = jcat_item_new ("firmware.bin");
+
+	fu_metrics_reset ();
+	fu_jcat_cache_reset ();
+	checksum = g_compute_checksum_for_bytes (G_CHECKSUM_SHA256, blob);
+	jcat_blob = jcat_blob_new_utf8 (JCAT_BLOB_KIND_SHA256, checksum);
+	jcat_item_add_blob (jcat_item, jcat_blob);
+
+	/* verified, then loaded */
+	pkidir = g_build_filename (g_get_tmp_dir (), "fwupd-self-test", "pki", NULL);
+	fn = g_build_filename (pkidir, "test.pem", NULL);
+	g_unlink (fn);
+	fu_jcat_cache_add_public_keys (jcat_context, pkidir);
+	for (guint i = 0; i < 2; i++) {
+		ret = fu_jcat_cache_verify_item (jcat_context, blob, jcat_item,
+						 JCAT_VERIFY_FLAG_REQUIRE_CHECKSUM,
+						 &timestamp, NULL, &error);
+		g_assert_no_error (error);
+		g_assert_true (ret);
+		g_assert_cmpint (timestamp, ==, 0);
+	}
+	metrics = fu_metrics_get_all ();
+	g_assert_cmpstr (g_hash_table_lookup (metrics, "jcat.cache-miss"), ==, "1");
+	g_assert_cmpstr (g_hash_table_lookup (metrics, "jcat.cache-hit"), ==, "1");
+
+	/* a context trusting different keys, so verify again */
+	ret = fu_common_mkdir_parent (fn, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	ret = g_file_set_contents (fn, "key", -1, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	fu_jcat_cache_add_public_keys (jcat_context2, pkidir);
+	ret = fu_jcat_cache_verify_item (jcat_context2, blob, jcat_item,
+					 JCAT_VERIFY_FLAG_REQUIRE_CHECKSUM,
+					 NULL, NULL, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	g_hash_table_unref (metrics);
+	metrics = fu_metrics_get_all ();
+	g_assert_cmpstr (g_hash_table_lookup (metrics, "jcat.cache-miss"), ==, "2");
+
+	/* the keys of this context are unknown, so it never uses the cache */
+	for (guint i = 0; i < 2; i++) {
+		ret = fu_jcat_cache_verify_item (jcat_context3, blob, jcat_item,
+						 JCAT_VERIFY_FLAG_REQUIRE_CHECKSUM,
+						 NULL, NULL, &error);
+		g_assert_no_error (error);
+		g_assert_true (ret);
+	}
+	g_hash_table_unref (metrics);
+	metrics = fu_metrics_get_all ();
+	g_assert_cmpstr (g_hash_table_lookup (metrics, "jcat.cache-miss"), ==, "4");
+	g_assert_cmpstr (g_hash_table_lookup (metrics, "jcat.cache-hit"), ==, "1");
+
+	g_unlink (fn);
+	fu_jcat_cache_reset ();
+	fu_metrics_reset ();
+}
+
+static void
+fu_udev_device_snapshot_func (void)
+{
+	gboolean ret;
+	guint8 buf[4] = { 0x0 };
+	guint8 data[0x100] = { 0x0 };
+	g_autofree gchar *fn = NULL;
+	g_autoptr(FuUdevDevice) udev_device1 = NULL;
+	g_autoptr(FuUdevDevice) udev_device2 = NULL;
+	g_autoptr(GBytes) blob1 = NULL;
+	g_autoptr(GBytes) blob2 = NULL;
+	g_autoptr(GError) error = NULL;
+
+	/* fake config space */
+	fn = g_build_filename (g_get_tmp_dir (), "fwupd-self-test", "snapshot.bin", NULL);
+	for (guint i = 0; i < sizeof(data); i++)
+		data[i] = i;
+	blob1 = g_bytes_new (data, sizeof(data));
+	ret = fu_common_set_contents_bytes (fn, blob1, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+
+	udev_device1 = g_object_new (FU_TYPE_UDEV_DEVICE, "device-file", fn, NULL);
+	fu_device_set_physical_id (FU_DEVICE (udev_device1), "snapshot");
+	fu_udev_device_set_flags (udev_device1, FU_UDEV_DEVICE_FLAG_OPEN_READ);
+	fu_udev_device_add_snapshot_register (udev_device1, 0x40, 4);
+	fu_udev_device_add_snapshot_register (udev_device1, 0x60, 4);
+	ret = fu_udev_device_read_snapshot (udev_device1, 0x40, buf, sizeof(buf), &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	g_assert_cmpint (buf[0], ==, 0x40);
+	g_assert_cmpint (buf[3], ==, 0x43);
+	ret = fu_udev_device_read_snapshot (udev_device1, 0x62, buf, 2, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	g_assert_cmpint (buf[0], ==, 0x62);
+	g_assert_cmpint (buf[1], ==, 0x63);
+
+	/* not declared */
+	ret = fu_udev_device_read_snapshot (udev_device1, 0x62, buf, 4, &error);
+	g_assert_error (error, FWUPD_ERROR, FWUPD_ERROR_NOT_FOUND);
+	g_assert_false (ret);
+	g_clear_error (&error);
+
+	/* values are cached for the boot, even for a new device */
+	memset (data, 0x00, sizeof(data));
+	blob2 = g_bytes_new (data, sizeof(data));
+	ret = fu_common_set_contents_bytes (fn, blob2, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	udev_device2 = g_object_new (FU_TYPE_UDEV_DEVICE, "device-file", fn, NULL);
+	fu_device_set_physical_id (FU_DEVICE (udev_device2), "snapshot");
+	fu_udev_device_set_flags (udev_device2, FU_UDEV_DEVICE_FLAG_OPEN_READ);
+	fu_udev_device_add_snapshot_register (udev_device2, 0x60, 4);
+	ret = fu_udev_device_read_snapshot (udev_device2, 0x60, buf, sizeof(buf), &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	g_assert_cmpint (buf[0], ==, 0x60);
+}
+
+static void
+fu_udev_device_write_bytes_func (void)
+{
+	gboolean ret;
+	gint fd;
+	g_autofree gchar *fn_sink = NULL;
+	g_autofree gchar *fn_src = NULL;
+	g_autoptr(FuUdevDevice) udev_device = NULL;
+	g_autoptr(GBytes) blob = NULL;
+	g_autoptr(GBytes) blob_empty = g_bytes_new_static ("", 0);
+	g_autoptr(GBytes) blob_sink1 = NULL;
+	g_autoptr(GBytes) blob_sink2 = NULL;
+	g_autoptr(GByteArray) buf = g_byte_array_new ();
+	g_autoptr(GError) error = NULL;
+
+	for (guint i = 0; i < 0x3000; i++) {
+		guint8 tmp = i % 0xfb;
+		g_byte_array_append (buf, &tmp, 1);
+	}
+	blob = g_byte_array_free_to_bytes (g_steal_pointer (&buf));
+	fn_src = g_build_filename (g_get_tmp_dir (), "fwupd-self-test", "write-src.bin", NULL);
+	ret = fu_common_set_contents_bytes (fn_src, blob, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	fn_sink = g_build_filename (g_get_tmp_dir (), "fwupd-self-test", "write-sink.bin", NULL);
+	ret = fu_common_set_contents_bytes (fn_sink, blob_empty, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	udev_device = g_object_new (FU_TYPE_UDEV_DEVICE, NULL);
+
+	/* from memory, starting on an unaligned offset */
+	ret = fu_udev_device_write_bytes (udev_device, fn_sink, 0x10, blob, 0x1000, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	g_assert_cmpint (fu_device_get_progress (FU_DEVICE (udev_device)), ==, 100);
+	blob_sink1 = fu_common_get_contents_bytes (fn_sink, &error);
+	g_assert_no_error (error);
+	g_assert_nonnull (blob_sink1);
+	g_assert_cmpint (g_bytes_get_size (blob_sink1), ==, 0x3010);
+	g_assert_cmpint (memcmp ((const guint8 *) g_bytes_get_data (blob_sink1, NULL) + 0x10,
+				 g_bytes_get_data (blob, NULL), 0x3000), ==, 0);
+
+	/* from a file descriptor */
+	fd = g_open (fn_src, O_RDONLY, 0);
+	g_assert_cmpint (fd, >=, 0);
+	ret = fu_udev_device_write_fd (udev_device, fn_sink, 0x0, fd, 0x1000, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	g_close (fd, NULL);
+	blob_sink2 = fu_common_get_contents_bytes (fn_sink, &error);
+	g_assert_no_error (error);
+	g_assert_nonnull (blob_sink2);
+	g_assert_cmpint (memcmp (g_bytes_get_data (blob_sink2, NULL),
+				 g_bytes_get_data (blob, NULL), 0x3000), ==, 0);
+}
+
+static void
+fu_io_trace_func (void)
+{
+	gboolean ret;
+	guint8 buf[4] = { 0x0 };
+	const guint8 buf_write[] = { 0xde, 0xad, 0xbe, 0xef };
+	g_autofree gchar *fn = NULL;
+	g_autofree gchar *fn_trace = NULL;
+	g_autoptr(FuDeviceLocker) locker = NULL;
+	g_autoptr(FuUdevDevice) udev_device1 = NULL;
+	g_autoptr(FuUdevDevice) udev_device2 = NULL;
+	g_autoptr(GBytes) blob = NULL;
+	g_autoptr(GError) error = NULL;
+
+	/* record a real device */
+	fn = g_build_filename (g_get_tmp_dir (), "fwupd-self-test", "io-trace.bin", NULL);
+	fn_trace = g_build_filename (g_get_tmp_dir (), "fwupd-self-test", "io-trace.trace", NULL);
+	blob = g_bytes_new_static ("\0\0\0\0\0\0\0\0", 8);
+	ret = fu_common_set_contents_bytes (fn, blob, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	udev_device1 = g_object_new (FU_TYPE_UDEV_DEVICE, "device-file", fn, NULL);
+	fu_device_set_physical_id (FU_DEVICE (udev_device1), "io-trace");
+	ret = fu_io_trace_record_start (fn_trace, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	g_assert_cmpint (fu_io_trace_get_mode (), ==, FU_IO_TRACE_MODE_RECORD);
+	locker = fu_device_locker_new (FU_DEVICE (udev_device1), &error);
+	g_assert_no_error (error);
+	g_assert_nonnull (locker);
+	ret = fu_udev_device_pwrite_full (udev_device1, 0x2, buf_write, sizeof(buf_write), &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	ret = fu_udev_device_pread_full (udev_device1, 0x4, buf, sizeof(buf), &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	g_assert_cmpint (buf[0], ==, 0xbe);
+	g_clear_object (&locker);
+	ret = fu_io_trace_stop (&error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	g_assert_cmpint (fu_io_trace_get_mode (), ==, FU_IO_TRACE_MODE_NONE);
+
+	/* replay with no hardware at all */
+	ret = fu_io_trace_replay_start (fn_trace, 0.f, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	udev_device2 = g_object_new (FU_TYPE_UDEV_DEVICE, "device-file", "/dev/null/invalid", NULL);
+	fu_device_set_physical_id (FU_DEVICE (udev_device2), "io-trace");
+	locker = fu_device_locker_new (FU_DEVICE (udev_device2), &error);
+	g_assert_no_error (error);
+	g_assert_nonnull (locker);
+	ret = fu_udev_device_pwrite_full (udev_device2, 0x2, buf_write, sizeof(buf_write), &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	memset (buf, 0x0, sizeof(buf));
+	ret = fu_udev_device_pread_full (udev_device2, 0x4, buf, sizeof(buf), &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	g_assert_cmpint (buf[0], ==, 0xbe);
+	g_assert_cmpint (buf[1], ==, 0xef);
+
+	/* nothing left */
+	ret = fu_udev_device_pread_full (udev_device2, 0x4, buf, sizeof(buf), &error);
+	g_assert_error (error, FWUPD_ERROR, FWUPD_ERROR_NOT_FOUND);
+	g_assert_false (ret);
+	g_clear_error (&error);
+	g_clear_object (&locker);
+	ret = fu_io_trace_stop (&error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+
+	/* different data written */
+	ret = fu_io_trace_replay_start (fn_trace, 0.f, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	ret = fu_udev_device_pwrite_full (udev_device2, 0x2, buf, sizeof(buf), &error);
+	g_assert_error (error, FWUPD_ERROR, FWUPD_ERROR_INVALID_FILE);
+	g_assert_false (ret);
+	g_clear_error (&error);
+	ret = fu_io_trace_stop (&error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+}
+
+#define FU_TYPE_IO_TRACE_TEST_DEVICE (fu_io_trace_test_device_get_type ())
+G_DECLARE_FINAL_TYPE (FuIoTraceTestDevice, fu_io_trace_test_device,
+		      FU, IO_TRACE_TEST_DEVICE, FuUdevDevice)
+
+struct _FuIoTraceTestDevice {
+	FuUdevDevice		 parent_instance;
+};
+
+G_DEFINE_TYPE (FuIoTraceTestDevice, fu_io_trace_test_device, FU_TYPE_UDEV_DEVICE)
+
+static gboolean
+fu_io_trace_test_device_setup (FuDevice *device, GError **error)
+{
+	guint8 buf[4] = { 0x0 };
+	g_autofree gchar *version = NULL;
+
+	if (!fu_udev_device_pread_full (FU_UDEV_DEVICE (device), 0x0,
+					buf, sizeof(buf), error))
+		return FALSE;
+	version = fu_common_version_from_uint32 (fu_common_read_uint32 (buf, G_BIG_ENDIAN),
+						 FWUPD_VERSION_FORMAT_QUAD);
+	fu_device_set_version (device, version);
+	return TRUE;
+}
+
+static gboolean
+fu_io_trace_test_device_write_firmware (FuDevice *device,
+					FuFirmware *firmware,
+					FwupdInstallFlags flags,
+					GError **error)
+{
+	gsize bufsz = 0;
+	const guint8 *buf;
+	g_autoptr(GBytes) fw = fu_firmware_get_bytes (firmware, error);
+	if (fw == NULL)
+		return FALSE;
+	buf = g_bytes_get_data (fw, &bufsz);
+	return fu_udev_device_pwrite_full (FU_UDEV_DEVICE (device), 0x4,
+					   buf, bufsz, error);
+}
+
+static void
+fu_io_trace_test_device_init (FuIoTraceTestDevice *self)
+{
+	fu_device_set_version_format (FU_DEVICE (self), FWUPD_VERSION_FORMAT_QUAD);
+}
+
+static void
+fu_io_trace_test_device_class_init (FuIoTraceTestDeviceClass *klass)
+{
+	FuDeviceClass *klass_device = FU_DEVICE_CLASS (klass);
+	klass_device->setup = fu_io_trace_test_device_setup;
+	klass_device->write_firmware = fu_io_trace_test_device_write_firmware;
+}
+
+static void
+fu_io_trace_update_func (void)
+{
+	gboolean ret;
+	guint8 buf[4] = { 0x0 };
+	g_autofree gchar *fn = NULL;
+	g_autofree gchar *fn_trace = NULL;
+	g_autoptr(FuDevice) device1 = NULL;
+	g_autoptr(FuDevice) device2 = NULL;
+	g_autoptr(FuDevice) device3 = NULL;
+	g_autoptr(FuDeviceLocker) locker = NULL;
+	g_autoptr(GBytes) blob = NULL;
+	g_autoptr(GBytes) fw = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GPtrArray) possible_plugins = NULL;
+
+	/* record an update on a real file */
+	fn = g_build_filename (g_get_tmp_dir (), "fwupd-self-test", "io-trace-update.bin", NULL);
+	fn_trace = g_build_filename (g_get_tmp_dir (), "fwupd-self-test", "io-trace-update.trace", NULL);
+	blob = g_bytes_new_static ("\x01\x02\x03\x04\0\0\0\0", 8);
+	ret = fu_common_set_contents_bytes (fn, blob, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	ret = fu_io_trace_record_start (fn_trace, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	device1 = g_object_new (FU_TYPE_IO_TRACE_TEST_DEVICE, "device-file", fn, NULL);
+	fu_device_set_backend_id (device1, "io-trace-update");
+	fu_device_set_physical_id (device1, "io-trace-update");
+	fu_device_add_instance_id (device1, "TEST\\IO_TRACE");
+	fu_device_add_possible_plugin (device1, "test");
+	fu_io_trace_record_device (device1);
+	locker = fu_device_locker_new (device1, &error);
+	g_assert_no_error (error);
+	g_assert_nonnull (locker);
+	g_assert_cmpstr (fu_device_get_version (device1), ==, "1.2.3.4");
+	fw = g_bytes_new_static ("\x05\x06\x07\x08", 4);
+	ret = fu_device_write_firmware (device1, fw, FWUPD_INSTALL_FLAG_NONE, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	g_clear_object (&locker);
+	ret = fu_io_trace_stop (&error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+
+	/* the device is created from the trace with no hardware at all */
+	ret = fu_io_trace_replay_start (fn_trace, 0.f, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	device2 = fu_io_trace_replay_next_device (&error);
+	g_assert_no_error (error);
+	g_assert_nonnull (device2);
+	g_assert_true (FU_IS_IO_TRACE_TEST_DEVICE (device2));
+	g_assert_cmpstr (fu_device_get_backend_id (device2), ==, "io-trace-update");
+	g_assert_cmpstr (fu_device_get_physical_id (device2), ==, "io-trace-update");
+	g_assert_true (fu_device_has_instance_id (device2, "TEST\\IO_TRACE"));
+	possible_plugins = fu_device_get_possible_plugins (device2);
+	g_assert_cmpint (possible_plugins->len, ==, 1);
+	device3 = fu_io_trace_replay_next_device (&error);
+	g_assert_no_error (error);
+	g_assert_null (device3);
+
+	/* setup and update are answered from the trace */
+	locker = fu_device_locker_new (device2, &error);
+	g_assert_no_error (error);
+	g_assert_nonnull (locker);
+	g_assert_cmpstr (fu_device_get_version (device2), ==, "1.2.3.4");
+	ret = fu_device_write_firmware (device2, fw, FWUPD_INSTALL_FLAG_NONE, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+
+	/* nothing left */
+	ret = fu_udev_device_pread_full (FU_UDEV_DEVICE (device2), 0x0, buf, sizeof(buf), &error);
+	g_assert_error (error, FWUPD_ERROR, FWUPD_ERROR_NOT_FOUND);
+	g_assert_false (ret);
+	g_clear_error (&error);
+	g_clear_object (&locker);
+	ret = fu_io_trace_stop (&error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+}
+
+static void
+fu_usb_device_bulk_transfer_chunks_func (void)
+{
+#ifdef HAVE_GUSB
+	gboolean ret;
+	const guint8 buf[] = { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06 };
+	const gchar *trace =
+		"# fwupd-io-trace 1\n"
+		"0\t0\tusb-bulk\t1\t2\t0102\t-\n"
+		"0\t0\tusb-bulk\t1\t2\t0304\t-\n";
+	g_autofree gchar *fn = NULL;
+	g_autoptr(FuUsbDevice) usb_device = g_object_new (FU_TYPE_USB_DEVICE, NULL);
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GPtrArray) chunks = NULL;
+
+	fn = g_build_filename (g_get_tmp_dir (), "fwupd-self-test", "usb-chunks.txt", NULL);
+	ret = g_file_set_contents (fn, trace, -1, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	ret = fu_io_trace_replay_start (fn, 0.f, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+
+	/* the first two chunks are answered, and the last is reported */
+	chunks = fu_chunk_array_new (buf, sizeof(buf), 0x0, 0x0, 2);
+	ret = fu_usb_device_bulk_transfer_chunks (usb_device, 0x01, chunks, 4,
+						  1000, NULL, &error);
+	g_assert_error (error, FWUPD_ERROR, FWUPD_ERROR_NOT_FOUND);
+	g_assert_nonnull (g_strstr_len (error->message, -1, "chunk 2 @0x4"));
+	g_assert_false (ret);
+	g_clear_error (&error);
+	ret = fu_io_trace_stop (&error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+#else
+	g_test_skip ("no GUsb support");
+#endif
+}
+
+#ifdef HAVE_GUSB
+/* a bus where each transfer takes @latency ms, and completes in order */
+typedef struct {
+	GQueue			*pending;	/* GTask */
+	GByteArray		*data;		/* in the order completed */
+	guint			 latency;
+	guint			 submitted;
+	guint			 in_flight;
+	guint			 in_flight_max;
+	guint			 fail_idx;
+} FuUsbDeviceFakeBus;
+
+typedef struct {
+	guint			 idx;
+	const guint8		*data;
+	gsize			 length;
+} FuUsbDeviceFakeTransfer;
+
+static FuUsbDeviceFakeBus *
+fu_usb_device_fake_bus_get (FuUsbDevice *self)
+{
+	return g_object_get_data (G_OBJECT (self), "fake-bus");
+}
+
+static gboolean
+fu_usb_device_fake_bus_complete_cb (gpointer user_data)
+{
+	FuUsbDeviceFakeBus *bus = (FuUsbDeviceFakeBus *) user_data;
+	FuUsbDeviceFakeTransfer *transfer;
+	g_autoptr(GTask) task = g_queue_pop_head (bus->pending);
+
+	bus->in_flight--;
+	transfer = g_task_get_task_data (task);
+	if (g_task_return_error_if_cancelled (task))
+		return G_SOURCE_REMOVE;
+	if (transfer->idx == bus->fail_idx) {
+		g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
+					 "stalled");
+		return G_SOURCE_REMOVE;
+	}
+	g_byte_array_append (bus->data, transfer->data, transfer->length);
+	g_task_return_int (task, (gssize) transfer->length);
+	return G_SOURCE_REMOVE;
+}
+
+static void
+fu_usb_device_fake_bus_async (FuUsbDevice *self,
+			      guint8 endpoint,
+			      guint8 *data,
+			      gsize length,
+			      guint timeout,
+			      GCancellable *cancellable,
+			      GAsyncReadyCallback callback,
+			      gpointer user_data)
+{
+	FuUsbDeviceFakeBus *bus = fu_usb_device_fake_bus_get (self);
+	FuUsbDeviceFakeTransfer *transfer = g_new0 (FuUsbDeviceFakeTransfer, 1);
+	GTask *task = g_task_new (self, cancellable, callback, user_data);
+	g_autoptr(GSource) source = g_timeout_source_new (bus->latency);
+
+	transfer->idx = bus->submitted++;
+	transfer->data = data;
+	transfer->length = length;
+	g_task_set_task_data (task, transfer, g_free);
+	g_queue_push_tail (bus->pending, task);
+	bus->in_flight_max = MAX(bus->in_flight_max, ++bus->in_flight);
+
+	/* completions are dispatched in the context of the caller */
+	g_source_set_callback (source, fu_usb_device_fake_bus_complete_cb, bus, NULL);
+	g_source_attach (source, g_main_context_get_thread_default ());
+}
+
+static gssize
+fu_usb_device_fake_bus_finish (FuUsbDevice *self, GAsyncResult *res, GError **error)
+{
+	return g_task_propagate_int (G_TASK (res), error);
+}
+
+static void
+fu_usb_device_fake_bus_free (FuUsbDeviceFakeBus *bus)
+{
+	g_queue_free (bus->pending);
+	g_byte_array_unref (bus->data);
+	g_free (bus);
+}
+
+static FuUsbDevice *
+fu_usb_device_fake_new (guint latency, guint fail_idx)
+{
+	FuUsbDevice *usb_device = g_object_new (FU_TYPE_USB_DEVICE, NULL);
+	FuUsbDeviceFakeBus *bus = g_new0 (FuUsbDeviceFakeBus, 1);
+
+	bus->pending = g_queue_new ();
+	bus->data = g_byte_array_new ();
+	bus->latency = latency;
+	bus->fail_idx = fail_idx;
+	g_object_set_data_full (G_OBJECT (usb_device), "fake-bus", bus,
+				(GDestroyNotify) fu_usb_device_fake_bus_free);
+	fu_usb_device_set_bulk_transfer_funcs (usb_device,
+					       fu_usb_device_fake_bus_async,
+					       fu_usb_device_fake_bus_finish);
+	return usb_device;
+}
+#endif
+
+static void
+fu_usb_device_bulk_transfer_chunks_async_func (void)
+{
+#ifdef HAVE_GUSB
+	FuUsbDeviceFakeBus *bus;
+	gboolean ret;
+	gint64 elapsed[2] = { 0 };
+	guint8 buf[0x400];
+	const guint in_flight[2] = { 1, 8 };
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GPtrArray) chunks = NULL;
+
+	for (guint i = 0; i < sizeof(buf); i++)
+		buf[i] = (guint8) i;
+	chunks = fu_chunk_array_new (buf, sizeof(buf), 0x0, 0x0, 0x20);
+
+	/* in order, never more than allowed in flight, and faster when queued */
+	for (guint j = 0; j < G_N_ELEMENTS (in_flight); j++) {
+		gint64 start = g_get_monotonic_time ();
+		g_autoptr(FuUsbDevice) usb_device = fu_usb_device_fake_new (2, G_MAXUINT);
+		ret = fu_usb_device_bulk_transfer_chunks (usb_device, 0x01, chunks,
+							  in_flight[j], 1000,
+							  NULL, &error);
+		g_assert_no_error (error);
+		g_assert_true (ret);
+		elapsed[j] = g_get_monotonic_time () - start;
+		bus = fu_usb_device_fake_bus_get (usb_device);
+		g_assert_cmpint (bus->submitted, ==, chunks->len);
+		g_assert_cmpint (bus->in_flight, ==, 0);
+		g_assert_cmpint (bus->in_flight_max, ==, in_flight[j]);
+		g_assert_cmpint (bus->data->len, ==, sizeof(buf));
+		g_assert_cmpint (memcmp (bus->data->data, buf, sizeof(buf)), ==, 0);
+		g_assert_cmpint (fu_device_get_progress (FU_DEVICE (usb_device)), ==, 100);
+		g_test_message ("%u in flight: %.0f kB/s", in_flight[j],
+				(gdouble) sizeof(buf) * 1000.f / elapsed[j]);
+	}
+	g_assert_cmpint (elapsed[1], <, elapsed[0]);
+
+	/* the first failure is reported, and the rest are cancelled */
+	{
+		g_autoptr(FuUsbDevice) usb_device = fu_usb_device_fake_new (2, 5);
+		ret = fu_usb_device_bulk_transfer_chunks (usb_device, 0x01, chunks, 8,
+							  1000, NULL, &error);
+		g_assert_error (error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT);
+		g_assert_nonnull (g_strstr_len (error->message, -1, "chunk 5 @0xa0"));
+		g_assert_false (ret);
+		g_clear_error (&error);
+		bus = fu_usb_device_fake_bus_get (usb_device);
+		g_assert_cmpint (bus->in_flight, ==, 0);
+		g_assert_cmpint (bus->submitted, <, chunks->len);
+		g_assert_cmpint (bus->data->len, ==, 5 * 0x20);
+	}
+#else
+	g_test_skip ("no GUsb support");
+#endif
+}
+
+static void
+fu_hid_device_transfer_reports_func (void)
+{
+#ifdef HAVE_GUSB
+	gboolean ret;
+	GByteArray *response;
+	const guint8 buf1[] = { 0x01, 0xaa };
+	const guint8 buf2[] = { 0x02, 0xbb };
+	const gchar *trace =
+		"# fwupd-io-trace 1\n"
+		"0\t0\tusb-control\t210902010000\t2\t01aa\t-\n"
+		"0\t0\tusb-control\t210902020000\t2\t02bb\t-\n"
+		"0\t0\tusb-interrupt\t81\t2\t-\t03ff\n"
+		"0\t0\tusb-interrupt\t81\t2\t-\t02cc\n"
+		"0\t0\tusb-interrupt\t81\t2\t-\t01dd\n";
+	g_autofree gchar *fn = NULL;
+	g_autofree gchar *metric_id = NULL;
+	g_autoptr(FuHidDevice) hid_device = g_object_new (FU_TYPE_HID_DEVICE, NULL);
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GHashTable) metrics = NULL;
+	g_autoptr(GPtrArray) requests = g_ptr_array_new_with_free_func ((GDestroyNotify) g_byte_array_unref);
+	g_autoptr(GPtrArray) responses = NULL;
+
+	fn = g_build_filename (g_get_tmp_dir (), "fwupd-self-test", "hid-reports.txt", NULL);
+	ret = g_file_set_contents (fn, trace, -1, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	ret = fu_io_trace_replay_start (fn, 0.f, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+
+	/* both requests are sent first, and answered out of order */
+	g_ptr_array_add (requests, g_byte_array_append (g_byte_array_new (), buf1, sizeof(buf1)));
+	g_ptr_array_add (requests, g_byte_array_append (g_byte_array_new (), buf2, sizeof(buf2)));
+	fu_hid_device_set_interrupt_endpoint (hid_device, 0x81, 8);
+	fu_device_set_id (FU_DEVICE (hid_device), "hid-reports");
+	fu_metrics_reset ();
+	responses = fu_hid_device_transfer_reports (hid_device, requests, 2, 1000,
+						    FU_HID_DEVICE_FLAG_NONE,
+						    NULL, NULL, &error);
+	g_assert_no_error (error);
+	g_assert_nonnull (responses);
+	g_assert_cmpint (responses->len, ==, 2);
+	response = g_ptr_array_index (responses, 0);
+	g_assert_cmpint (response->len, ==, 2);
+	g_assert_cmpint (response->data[1], ==, 0xdd);
+	response = g_ptr_array_index (responses, 1);
+	g_assert_cmpint (response->data[1], ==, 0xcc);
+
+	/* the latency is recorded for this device */
+	metrics = fu_metrics_get_all ();
+	metric_id = g_strdup_printf ("device.FuHidDevice.%s.report-latency.count",
+				     fu_device_get_id (FU_DEVICE (hid_device)));
+	g_assert_cmpstr (g_hash_table_lookup (metrics, metric_id), ==, "2");
+	ret = fu_io_trace_stop (&error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+#else
+	g_test_skip ("no GUsb support");
+#endif
+}
+
 static void
 fu_common_align_up_func (void)
 {
@@ -386,8 +1105,10 @@ static void
 fu_hwids_func (void)
 {
 	g_autoptr(FuHwids) hwids = NULL;
+	g_autoptr(FuHwids) hwids_cached = NULL;
 	g_autoptr(FuSmbios) smbios = NULL;
 	g_autoptr(GError) error = NULL;
+	g_autoptr(GKeyFile) kf = NULL;
 	gboolean ret;
 
 	struct {
@@ -446,6 +1167,21 @@ fu_hwids_func (void)
 	}
 	for (guint i = 0; guids[i].key != NULL; i++)
 		g_assert (fu_hwids_has_guid (hwids, guids[i].value));
+
+	/* save and load without the SMBIOS data */
+	kf = g_key_file_new ();
+	fu_hwids_to_keyfile (hwids, kf);
+	hwids_cached = fu_hwids_new ();
+	ret = fu_hwids_setup_from_keyfile (hwids_cached, kf, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert_cmpstr (fu_hwids_get_value (hwids_cached, FU_HWIDS_KEY_BIOS_VERSION), ==,
+			 "GJET75WW (2.25 )");
+	g_assert_cmpstr (fu_hwids_get_value (hwids_cached, FU_HWIDS_KEY_BIOS_MAJOR_RELEASE), ==, "02");
+	g_assert_cmpint (fu_hwids_get_guids (hwids_cached)->len, ==,
+			 fu_hwids_get_guids (hwids)->len);
+	for (guint i = 0; guids[i].key != NULL; i++)
+		g_assert (fu_hwids_has_guid (hwids_cached, guids[i].value));
 }
 
 static void
@@ -560,6 +1296,158 @@ fu_plugin_quirks_performance_func (void)
 	g_print ("lookup=%.3fms ", g_timer_elapsed (timer, NULL) * 1000.f);
 }
 
+static void
+fu_plugin_quirks_fragments_func (void)
+{
+	gboolean ret;
+	g_autoptr(FuQuirks) quirks1 = fu_quirks_new ();
+	g_autoptr(FuQuirks) quirks2 = fu_quirks_new ();
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GHashTable) metrics = NULL;
+
+	ret = fu_quirks_load (quirks1, FU_QUIRKS_LOAD_FLAG_NONE, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+
+	/* unchanged quirk files are not converted again */
+	fu_metrics_reset ();
+	ret = fu_quirks_load (quirks2, FU_QUIRKS_LOAD_FLAG_NONE, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	metrics = fu_metrics_get_all ();
+	g_assert_null (g_hash_table_lookup (metrics, "quirks.convert"));
+	g_assert_cmpstr (fu_quirks_lookup_by_id (quirks2, "USB\\VID_0BDA&PID_1100", "Name"), ==,
+			 fu_quirks_lookup_by_id (quirks1, "USB\\VID_0BDA&PID_1100", "Name"));
+}
+
+static guint
+fu_plugin_quirks_fragments_count (const gchar *fragmentdir)
+{
+	guint cnt = 0;
+	g_autoptr(GDir) dir = g_dir_open (fragmentdir, 0, NULL);
+	g_assert_nonnull (dir);
+	while (g_dir_read_name (dir) != NULL)
+		cnt++;
+	return cnt;
+}
+
+static void
+fu_plugin_quirks_fragments_modified_func (void)
+{
+	gboolean ret;
+	guint fragments_cnt;
+	g_autofree gchar *cachedirpkg = fu_common_get_path (FU_PATH_KIND_CACHEDIR_PKG);
+	g_autofree gchar *localstatedir = fu_common_get_path (FU_PATH_KIND_LOCALSTATEDIR_PKG);
+	g_autofree gchar *fn = NULL;
+	g_autofree gchar *fragmentdir = NULL;
+	g_autofree gchar *quirksdir = NULL;
+	g_autoptr(FuQuirks) quirks1 = fu_quirks_new ();
+	g_autoptr(FuQuirks) quirks2 = fu_quirks_new ();
+	g_autoptr(FuQuirks) quirks3 = fu_quirks_new ();
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GHashTable) metrics = NULL;
+	GStatBuf statbuf = { 0 };
+	struct utimbuf utb = { 0 };
+
+	/* a quirk file we can modify */
+	quirksdir = g_build_filename (localstatedir, "quirks.d", NULL);
+	g_assert_cmpint (g_mkdir_with_parents (quirksdir, 0755), ==, 0);
+	fn = g_build_filename (quirksdir, "self-test.quirk", NULL);
+	ret = g_file_set_contents (fn,
+				   "[USB\\VID_FFFF&PID_0001]\n"
+				   "Name=Before\n", -1, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	ret = fu_quirks_load (quirks1, FU_QUIRKS_LOAD_FLAG_NONE, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert_cmpstr (fu_quirks_lookup_by_id (quirks1, "USB\\VID_FFFF&PID_0001", "Name"), ==, "Before");
+	fragmentdir = g_build_filename (cachedirpkg, "quirks", NULL);
+	fragments_cnt = fu_plugin_quirks_fragments_count (fragmentdir);
+
+	/* only the modified file is converted again */
+	ret = g_file_set_contents (fn,
+				   "[USB\\VID_FFFF&PID_0001]\n"
+				   "Name=After the change\n", -1, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	fu_metrics_reset ();
+	ret = fu_quirks_load (quirks2, FU_QUIRKS_LOAD_FLAG_NONE, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	metrics = fu_metrics_get_all ();
+	g_assert_cmpstr (g_hash_table_lookup (metrics, "quirks.convert"), ==, "1");
+	g_assert_cmpstr (fu_quirks_lookup_by_id (quirks2, "USB\\VID_FFFF&PID_0001", "Name"), ==, "After the change");
+
+	/* the fragment for the old version of the file was deleted */
+	g_assert_cmpint (fu_plugin_quirks_fragments_count (fragmentdir), ==, fragments_cnt);
+
+	/* a change that keeps the same size and modification time is noticed */
+	ret = g_stat (fn, &statbuf) == 0;
+	g_assert (ret);
+	ret = g_file_set_contents (fn,
+				   "[USB\\VID_FFFF&PID_0001]\n"
+				   "Name=After the CHANGE\n", -1, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	utb.actime = statbuf.st_atime;
+	utb.modtime = statbuf.st_mtime;
+	g_assert_cmpint (g_utime (fn, &utb), ==, 0);
+	ret = fu_quirks_load (quirks3, FU_QUIRKS_LOAD_FLAG_NONE, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert_cmpstr (fu_quirks_lookup_by_id (quirks3, "USB\\VID_FFFF&PID_0001", "Name"), ==, "After the CHANGE");
+
+	/* do not affect the other tests */
+	g_assert_cmpint (g_unlink (fn), ==, 0);
+}
+
+static XbBuilder *
+fu_silo_cache_builder_new (const gchar *xml)
+{
+	XbBuilder *builder = xb_builder_new ();
+	g_autoptr(XbBuilderSource) source = xb_builder_source_new ();
+	g_autoptr(GError) error = NULL;
+	gboolean ret = xb_builder_source_load_xml (source, xml, XB_BUILDER_SOURCE_FLAG_NONE, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	xb_builder_import_source (builder, source);
+	return builder;
+}
+
+static void
+fu_silo_cache_func (void)
+{
+	g_autoptr(GError) error = NULL;
+	g_autoptr(XbBuilder) builder1 = fu_silo_cache_builder_new ("<id>one</id>");
+	g_autoptr(XbBuilder) builder2 = fu_silo_cache_builder_new ("<id>one</id>");
+	g_autoptr(XbBuilder) builder3 = fu_silo_cache_builder_new ("<id>two</id>");
+	g_autoptr(XbSilo) silo1 = NULL;
+	g_autoptr(XbSilo) silo2 = NULL;
+	g_autoptr(XbSilo) silo3 = NULL;
+	g_autoptr(XbNode) root = NULL;
+
+	silo1 = fu_silo_cache_ensure (builder1, "self-test.xmlb", XB_BUILDER_COMPILE_FLAG_NONE, NULL, &error);
+	g_assert_no_error (error);
+	g_assert_nonnull (silo1);
+
+	/* same sources, so the published silo is reused */
+	silo2 = fu_silo_cache_ensure (builder2, "self-test.xmlb", XB_BUILDER_COMPILE_FLAG_NONE, NULL, &error);
+	g_assert_no_error (error);
+	g_assert_nonnull (silo2);
+	g_assert_cmpstr (xb_silo_get_guid (silo1), ==, xb_silo_get_guid (silo2));
+
+	/* different sources, so it is replaced */
+	silo3 = fu_silo_cache_ensure (builder3, "self-test.xmlb", XB_BUILDER_COMPILE_FLAG_NONE, NULL, &error);
+	g_assert_no_error (error);
+	g_assert_nonnull (silo3);
+	g_assert_cmpstr (xb_silo_get_guid (silo1), !=, xb_silo_get_guid (silo3));
+
+	/* the old silo is still usable */
+	root = xb_silo_get_root (silo1);
+	g_assert_cmpstr (xb_node_get_text (root), ==, "one");
+}
+
 static void
 fu_plugin_quirks_device_func (void)
 {
@@ -1147,6 +2035,43 @@ fu_device_poll_func (void)
 	g_assert_cmpint (fu_device_get_metadata_integer (device, "cnt"), ==, cnt);
 }
 
+static void
+fu_device_poll_scheduler_func (void)
+{
+	guint64 saved = fu_poll_scheduler_get_wakeups_saved ();
+	guint cnt1;
+	guint cnt2;
+	g_autoptr(FuDevice) device1 = fu_device_new ();
+	g_autoptr(FuDevice) device2 = fu_device_new ();
+	FuDeviceClass *klass = FU_DEVICE_GET_CLASS (device1);
+
+	/* polls with similar intervals share wakeups */
+	klass->poll = fu_device_poll_cb;
+	fu_device_set_poll_interval (device1, 10);
+	fu_device_set_poll_interval (device2, 12);
+	fu_test_loop_run_with_timeout (100);
+	fu_test_loop_quit ();
+	cnt1 = fu_device_get_metadata_integer (device1, "cnt");
+	cnt2 = fu_device_get_metadata_integer (device2, "cnt");
+	g_assert_cmpint (cnt1, >=, 5);
+	g_assert_cmpint (cnt2, >=, 5);
+	g_assert_cmpint (fu_poll_scheduler_get_wakeups_saved (), >, saved);
+
+	/* no polling of relaxed devices when suspended, but the others are
+	 * still polled as they may be draining notifications */
+	fu_device_add_internal_flag (device1, FU_DEVICE_INTERNAL_FLAG_POLL_RELAXED);
+	fu_poll_scheduler_set_suspended (TRUE);
+	cnt1 = fu_device_get_metadata_integer (device1, "cnt");
+	cnt2 = fu_device_get_metadata_integer (device2, "cnt");
+	fu_test_loop_run_with_timeout (50);
+	fu_test_loop_quit ();
+	g_assert_cmpint (fu_device_get_metadata_integer (device1, "cnt"), ==, cnt1);
+	g_assert_cmpint (fu_device_get_metadata_integer (device2, "cnt"), >, cnt2);
+	fu_poll_scheduler_set_suspended (FALSE);
+	fu_device_set_poll_interval (device1, 0);
+	fu_device_set_poll_interval (device2, 0);
+}
+
 static void
 fu_device_func (void)
 {
@@ -2144,6 +3069,35 @@ fu_firmware_func (void)
 	g_assert_false (ret);
 }
 
+static void
+fu_firmware_lazy_func (void)
+{
+	gboolean ret;
+	g_autoptr(FuFirmware) firmware = fu_firmware_new ();
+	g_autoptr(FuFirmware) img = fu_ihex_firmware_new ();
+	g_autoptr(GBytes) blob = g_bytes_new_static ("not ihex", 8);
+	g_autoptr(GBytes) blob_img = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GPtrArray) images = NULL;
+
+	/* invalid data is only recorded */
+	ret = fu_firmware_parse_lazy (img, blob, FWUPD_INSTALL_FLAG_LAZY_PARSE, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	fu_firmware_add_image (firmware, img);
+
+	/* the parse error is returned when the image is used */
+	images = fu_firmware_get_images_full (firmware, &error);
+	g_assert_error (error, FWUPD_ERROR, FWUPD_ERROR_INVALID_FILE);
+	g_assert_null (images);
+	g_clear_error (&error);
+
+	/* and is not forgotten */
+	blob_img = fu_firmware_write (img, &error);
+	g_assert_error (error, FWUPD_ERROR, FWUPD_ERROR_INVALID_FILE);
+	g_assert_null (blob_img);
+}
+
 static void
 fu_firmware_dedupe_func (void)
 {
@@ -2350,6 +3304,125 @@ fu_device_retry_hardware_func (void)
 	g_assert_cmpint (helper.cnt_failed, ==, 2);
 }
 
+static gboolean
+fu_device_retry_ready (FuDevice *device, gpointer user_data, GError **error)
+{
+	FuDeviceRetryHelper *helper = (FuDeviceRetryHelper *) user_data;
+	helper->cnt_success++;
+	return TRUE;
+}
+
+static void
+fu_device_retry_policy_func (void)
+{
+	gboolean ret;
+	g_autoptr(FuDevice) device = fu_device_new ();
+	g_autoptr(FuRetryPolicy) policy = fu_retry_policy_new (NULL);
+	g_autoptr(GError) error = NULL;
+	FuDeviceRetryHelper helper = {
+		.cnt_success = 0,
+		.cnt_failed = 0,
+	};
+
+	/* exponential backoff without jitter */
+	fu_retry_policy_set_delay (policy, 2, 16);
+	fu_retry_policy_set_jitter (policy, 0);
+	g_assert_cmpint (fu_retry_policy_get_next_delay (policy, 0), ==, 2);
+	g_assert_cmpint (fu_retry_policy_get_next_delay (policy, 2), ==, 4);
+	g_assert_cmpint (fu_retry_policy_get_next_delay (policy, 16), ==, 16);
+
+	/* jitter stays within the percentage */
+	fu_retry_policy_set_jitter (policy, 50);
+	for (guint i = 0; i < 100; i++) {
+		guint delay = fu_retry_policy_get_next_delay (policy, 4);
+		g_assert_cmpint (delay, >=, 4);
+		g_assert_cmpint (delay, <=, 12);
+	}
+	fu_retry_policy_set_jitter (policy, 0);
+
+	/* succeeds within the budget */
+	fu_retry_policy_set_budget (policy, 5000);
+	ret = fu_device_retry_with_policy (device, policy,
+					   fu_device_retry_success_3rd_try,
+					   NULL, &helper, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	g_assert_cmpint (helper.cnt_success, ==, 1);
+	g_assert_cmpint (helper.cnt_failed, ==, 2);
+
+	/* the device says it is ready before the delay has finished */
+	helper.cnt_success = 0;
+	helper.cnt_failed = 0;
+	fu_retry_policy_set_delay (policy, 1000, 1000);
+	fu_retry_policy_set_ready_interval (policy, 1);
+	ret = fu_device_retry_with_policy (device, policy,
+					   fu_device_retry_success_3rd_try,
+					   fu_device_retry_ready, &helper, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	g_assert_cmpint (helper.cnt_success, ==, 3);
+	g_assert_cmpint (helper.cnt_failed, ==, 2);
+
+	/* gives up when out of time */
+	helper.cnt_success = 0;
+	helper.cnt_failed = 0;
+	fu_retry_policy_set_delay (policy, 5, 5);
+	fu_retry_policy_set_budget (policy, 20);
+	ret = fu_device_retry_with_policy (device, policy,
+					   fu_device_retry_failed,
+					   NULL, &helper, &error);
+	g_assert_error (error, FWUPD_ERROR, FWUPD_ERROR_INTERNAL);
+	g_assert_false (ret);
+	g_assert_cmpint (helper.cnt_failed, >=, 2);
+}
+
+static void
+fu_device_retry_policy_settle_func (void)
+{
+	gboolean ret;
+	gint64 start;
+	guint settle;
+	g_autoptr(FuDevice) device = fu_device_new ();
+	g_autoptr(FuRetryPolicy) policy = fu_retry_policy_new ("self-test");
+	g_autoptr(GError) error = NULL;
+	FuDeviceRetryHelper helper = {
+		.cnt_success = 0,
+		.cnt_failed = 0,
+	};
+
+	fu_retry_policy_set_delay (policy, 1, 1);
+	fu_retry_policy_set_jitter (policy, 0);
+	fu_retry_policy_set_budget (policy, 5000);
+	fu_retry_policy_add_settle (policy, "FuDevice", 400);
+
+	/* a device that is ready straight away does not wait */
+	settle = fu_retry_policy_get_settle (policy, "FuDevice");
+	g_assert_cmpint (settle, >, 0);
+	start = g_get_monotonic_time ();
+	ret = fu_device_retry_with_policy (device, policy,
+					   fu_device_retry_success,
+					   NULL, &helper, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	g_assert_cmpint ((g_get_monotonic_time () - start) / 1000, <, (settle * 3) / 4);
+
+	/* but waits for most of the learned time after the first failure */
+	settle = fu_retry_policy_get_settle (policy, "FuDevice");
+	g_assert_cmpint (settle, >, 0);
+	start = g_get_monotonic_time ();
+	ret = fu_device_retry_with_policy (device, policy,
+					   fu_device_retry_success_3rd_try,
+					   NULL, &helper, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	g_assert_cmpint ((g_get_monotonic_time () - start) / 1000, >=, (settle * 3) / 4);
+
+	/* saved once at the end */
+	ret = fu_retry_policy_save_settle (&error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+}
+
 static void
 fu_security_attrs_hsi_func (void)
 {
@@ -2611,8 +3684,20 @@ main (int argc, char **argv)
 	g_test_add_func ("/fwupd/plugin{delay}", fu_plugin_delay_func);
 	g_test_add_func ("/fwupd/plugin{quirks}", fu_plugin_quirks_func);
 	g_test_add_func ("/fwupd/plugin{quirks-performance}", fu_plugin_quirks_performance_func);
+	g_test_add_func ("/fwupd/plugin{quirks-fragments}", fu_plugin_quirks_fragments_func);
+	g_test_add_func ("/fwupd/plugin{quirks-fragments-modified}", fu_plugin_quirks_fragments_modified_func);
 	g_test_add_func ("/fwupd/plugin{quirks-device}", fu_plugin_quirks_device_func);
+	g_test_add_func ("/fwupd/silo-cache", fu_silo_cache_func);
 	g_test_add_func ("/fwupd/chunk", fu_chunk_func);
+	g_test_add_func ("/fwupd/metrics", fu_metrics_func);
+	g_test_add_func ("/fwupd/jcat-cache", fu_jcat_cache_func);
+	g_test_add_func ("/fwupd/udev-device{snapshot}", fu_udev_device_snapshot_func);
+	g_test_add_func ("/fwupd/udev-device{write-bytes}", fu_udev_device_write_bytes_func);
+	g_test_add_func ("/fwupd/io-trace", fu_io_trace_func);
+	g_test_add_func ("/fwupd/io-trace{update}", fu_io_trace_update_func);
+	g_test_add_func ("/fwupd/usb-device{bulk-transfer-chunks}", fu_usb_device_bulk_transfer_chunks_func);
+	g_test_add_func ("/fwupd/usb-device{bulk-transfer-chunks-async}", fu_usb_device_bulk_transfer_chunks_async_func);
+	g_test_add_func ("/fwupd/hid-device{transfer-reports}", fu_hid_device_transfer_reports_func);
 	g_test_add_func ("/fwupd/common{align-up}", fu_common_align_up_func);
 	g_test_add_func ("/fwupd/common{byte-array}", fu_common_byte_array_func);
 	g_test_add_func ("/fwupd/common{crc}", fu_common_crc_func);
@@ -2644,6 +3729,7 @@ main (int argc, char **argv)
 	g_test_add_func ("/fwupd/smbios{dt}", fu_smbios_dt_func);
 	g_test_add_func ("/fwupd/firmware", fu_firmware_func);
 	g_test_add_func ("/fwupd/firmware{dedupe}", fu_firmware_dedupe_func);
+	g_test_add_func ("/fwupd/firmware{lazy}", fu_firmware_lazy_func);
 	g_test_add_func ("/fwupd/firmware{build}", fu_firmware_build_func);
 	g_test_add_func ("/fwupd/firmware{ihex}", fu_firmware_ihex_func);
 	g_test_add_func ("/fwupd/firmware{ihex-xml}", fu_firmware_ihex_xml_func);
@@ -2666,8 +3752,10 @@ main (int argc, char **argv)
 	g_test_add_func ("/fwupd/device{parent}", fu_device_parent_func);
 	g_test_add_func ("/fwupd/device{children}", fu_device_children_func);
 	g_test_add_func ("/fwupd/device{incorporate}", fu_device_incorporate_func);
-	if (g_test_slow ())
+	if (g_test_slow ()) {
 		g_test_add_func ("/fwupd/device{poll}", fu_device_poll_func);
+		g_test_add_func ("/fwupd/device{poll-scheduler}", fu_device_poll_scheduler_func);
+	}
 	g_test_add_func ("/fwupd/device-locker{success}", fu_device_locker_func);
 	g_test_add_func ("/fwupd/device-locker{fail}", fu_device_locker_fail_func);
 	g_test_add_func ("/fwupd/device{metadata}", fu_device_metadata_func);
@@ -2676,5 +3764,7 @@ main (int argc, char **argv)
 	g_test_add_func ("/fwupd/device{retry-success}", fu_device_retry_success_func);
 	g_test_add_func ("/fwupd/device{retry-failed}", fu_device_retry_failed_func);
 	g_test_add_func ("/fwupd/device{retry-hardware}", fu_device_retry_hardware_func);
+	g_test_add_func ("/fwupd/device{retry-policy}", fu_device_retry_policy_func);
+	g_test_add_func ("/fwupd/device{retry-policy-settle}", fu_device_retry_policy_settle_func);
 	return g_test_run ();
 }
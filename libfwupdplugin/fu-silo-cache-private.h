@@ -0,0 +1,17 @@
+/*
+ * Copyright (C) 2021 Richard Hughes <richard@hughsie.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1+
+ */
+
+#pragma once
+
+#include <xmlb.h>
+
+XbSilo		*fu_silo_cache_ensure			(XbBuilder	*builder,
+							 const gchar	*basename,
+							 XbBuilderCompileFlags flags,
+							 GCancellable	*cancellable,
+							 GError		**error);
+gint		 fu_silo_cache_lock			(const gchar	*fn);
+void		 fu_silo_cache_unlock			(gint		 fd);
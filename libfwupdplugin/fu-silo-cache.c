@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2021 Richard Hughes <richard@hughsie.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1+
+ */
+
+#define G_LOG_DOMAIN				"FuSiloCache"
+
+#include "config.h"
+
+#include <fcntl.h>
+#include <glib/gstdio.h>
+#ifdef HAVE_FLOCK
+#include <sys/file.h>
+#endif
+
+#include "fu-common.h"
+#include "fu-metrics.h"
+#include "fu-silo-cache-private.h"
+
+/*
+ * The daemon and fwupdtool share the compiled silos in CACHEDIR_PKG, so that
+ * running fwupdtool many times in a row only pays the compile cost once.
+ *
+ * A silo is only reused if the GUID of the sources and the version of fwupd
+ * that compiled it both match; libxmlb also checks the header is valid before
+ * using it. Writers take an exclusive lock on a file next to the silo so only
+ * one process compiles it, and the new silo replaces the old one atomically,
+ * so processes that have the old silo mapped can continue to use it.
+ */
+
+/**
+ * fu_silo_cache_lock:
+ * @fn: a filename, e.g. `/var/cache/fwupd/quirks.xmlb`
+ *
+ * Waits for an exclusive lock on a file next to @fn, which is shared with
+ * other processes using the same cache directory.
+ *
+ * Returns: a file descriptor for fu_silo_cache_unlock(), or -1 if not locked
+ *
+ * Since: 1.6.0
+ **/
+gint
+fu_silo_cache_lock (const gchar *fn)
+{
+#ifdef HAVE_FLOCK
+	gint fd;
+	g_autofree gchar *fn_lock = g_strdup_printf ("%s.lock", fn);
+
+	fd = g_open (fn_lock, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		g_debug ("failed to open %s, not locking", fn_lock);
+		return -1;
+	}
+	if (flock (fd, LOCK_EX) != 0) {
+		g_debug ("failed to lock %s, not locking", fn_lock);
+		g_close (fd, NULL);
+		return -1;
+	}
+	return fd;
+#else
+	return -1;
+#endif
+}
+
+/**
+ * fu_silo_cache_unlock:
+ * @fd: a file descriptor from fu_silo_cache_lock()
+ *
+ * Releases the lock, which does nothing if @fd is -1.
+ *
+ * Since: 1.6.0
+ **/
+void
+fu_silo_cache_unlock (gint fd)
+{
+	if (fd < 0)
+		return;
+#ifdef HAVE_FLOCK
+	flock (fd, LOCK_UN);
+#endif
+	g_close (fd, NULL);
+}
+
+/**
+ * fu_silo_cache_ensure:
+ * @builder: A #XbBuilder with the sources imported
+ * @basename: the cache filename, e.g. `metadata.xmlb`
+ * @flags: some #XbBuilderCompileFlags
+ * @cancellable: A #GCancellable, or %NULL
+ * @error: A #GError, or %NULL
+ *
+ * Loads the shared silo if it is still valid for the builder sources, or
+ * compiles and publishes a new one.
+ *
+ * Returns: (transfer full): a #XbSilo, or %NULL for error
+ *
+ * Since: 1.6.0
+ **/
+XbSilo *
+fu_silo_cache_ensure (XbBuilder *builder,
+		      const gchar *basename,
+		      XbBuilderCompileFlags flags,
+		      GCancellable *cancellable,
+		      GError **error)
+{
+	gint fd;
+	gint64 start = g_get_monotonic_time ();
+	g_autofree gchar *cachedirpkg = NULL;
+	g_autofree gchar *fn = NULL;
+	g_autofree gchar *metric = NULL;
+	g_autoptr(GError) error_local = NULL;
+	g_autoptr(GFile) file = NULL;
+	g_autoptr(XbSilo) silo = NULL;
+
+	g_return_val_if_fail (XB_IS_BUILDER (builder), NULL);
+	g_return_val_if_fail (basename != NULL, NULL);
+	g_return_val_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable), NULL);
+	g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+	/* a different fwupd version may produce a different silo */
+	xb_builder_append_guid (builder, PACKAGE_VERSION);
+
+	cachedirpkg = fu_common_get_path (FU_PATH_KIND_CACHEDIR_PKG);
+	fn = g_build_filename (cachedirpkg, basename, NULL);
+	file = g_file_new_for_path (fn);
+
+	/* nothing can be written on a read-only filesystem */
+	if (flags & XB_BUILDER_COMPILE_FLAG_IGNORE_GUID)
+		return xb_builder_ensure (builder, file, flags, cancellable, error);
+
+	/* other processes wait for the silo being published, then reuse it */
+	if (!fu_common_mkdir_parent (fn, &error_local))
+		g_debug ("failed to create %s: %s", cachedirpkg, error_local->message);
+	fd = fu_silo_cache_lock (fn);
+	silo = xb_builder_ensure (builder, file, flags, cancellable, error);
+	fu_silo_cache_unlock (fd);
+	if (silo == NULL)
+		return NULL;
+
+	metric = g_strdup_printf ("silo-cache.%s", basename);
+	fu_metrics_add_duration (metric, g_get_monotonic_time () - start);
+	return g_steal_pointer (&silo);
+}
@@ -339,6 +339,7 @@ fu_smbios_setup_from_path_dmi (FuSmbios *self, const gchar *path, GError **error
 	g_autofree gchar *dmi_raw = NULL;
 	g_autofree gchar *ep_fn = NULL;
 	g_autofree gchar *ep_raw = NULL;
+	g_autoptr(GBytes) blob = NULL;
 
 	g_return_val_if_fail (FU_IS_SMBIOS (self), FALSE);
 
@@ -390,8 +391,12 @@ fu_smbios_setup_from_path_dmi (FuSmbios *self, const gchar *path, GError **error
 		return FALSE;
 	}
 
-	/* parse blob */
-	return fu_smbios_setup_from_data (self, (guint8 *) dmi_raw, sz, error);
+	/* parse blob, keeping a copy so the checksum can be used as a cache key */
+	blob = g_bytes_new_take (g_steal_pointer (&dmi_raw), sz);
+	if (!fu_smbios_setup_from_data (self, g_bytes_get_data (blob, NULL), sz, error))
+		return FALSE;
+	fu_firmware_set_bytes (FU_FIRMWARE (self), blob);
+	return TRUE;
 }
 
 static gboolean
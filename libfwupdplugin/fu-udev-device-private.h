@@ -9,3 +9,4 @@
 #include "fu-udev-device.h"
 
 void		 fu_udev_device_emit_changed		(FuUdevDevice	*self);
+void		 fu_udev_device_snapshot_save		(void);
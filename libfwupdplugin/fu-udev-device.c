@@ -16,13 +16,19 @@
 #ifdef HAVE_IOCTL_H
 #include <sys/ioctl.h>
 #endif
+#ifdef HAVE_MMAN_H
+#include <sys/mman.h>
+#endif
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 #include <glib/gstdio.h>
 
+#include "fu-common.h"
+#include "fu-device-locker.h"
 #include "fu-device-private.h"
+#include "fu-io-trace.h"
 #include "fu-udev-device-private.h"
 
 /**
@@ -47,8 +53,26 @@ typedef struct
 	gchar			*device_file;
 	gint			 fd;
 	FuUdevDeviceFlags	 flags;
+	GPtrArray		*snapshot;	/* of FuUdevDeviceRegister */
 } FuUdevDevicePrivate;
 
+typedef struct {
+	goffset			 port;
+	gsize			 size;
+	GBytes			*blob;
+} FuUdevDeviceRegister;
+
+/* registers in config space closer than this are read in one pass */
+#define FU_UDEV_DEVICE_SNAPSHOT_GAP_MAX		0x20
+
+/* process-wide cache of register values, which are persisted for the boot */
+static GMutex		 snapshot_mutex;
+static GHashTable	*snapshot_cache = NULL;		/* utf8:GBytes */
+static GKeyFile		*snapshot_kf = NULL;
+static gchar		*snapshot_boot_id = NULL;
+static gboolean		 snapshot_kf_changed = FALSE;
+static guint		 snapshot_save_id = 0;
+
 G_DEFINE_TYPE_WITH_PRIVATE (FuUdevDevice, fu_udev_device, FU_TYPE_DEVICE)
 
 enum {
@@ -1266,6 +1290,10 @@ fu_udev_device_open (FuDevice *device, GError **error)
 	FuUdevDevice *self = FU_UDEV_DEVICE (device);
 	FuUdevDevicePrivate *priv = GET_PRIVATE (self);
 
+	/* replaying a trace, so there is no device */
+	if (fu_io_trace_get_mode () == FU_IO_TRACE_MODE_REPLAY)
+		return TRUE;
+
 	/* open device */
 	if (priv->device_file != NULL && priv->flags != FU_UDEV_DEVICE_FLAG_NONE) {
 		gint flags;
@@ -1348,6 +1376,18 @@ fu_udev_device_close (FuDevice *device, GError **error)
 	return TRUE;
 }
 
+#ifdef HAVE_IOCTL_H
+static gsize
+fu_udev_device_ioctl_size (gulong request)
+{
+#ifdef _IOC_SIZE
+	return _IOC_SIZE (request);
+#else
+	return 0;
+#endif
+}
+#endif
+
 /**
  * fu_udev_device_ioctl:
  * @self: A #FuUdevDevice
@@ -1358,6 +1398,9 @@ fu_udev_device_close (FuDevice *device, GError **error)
  *
  * Control a device using a low-level request.
  *
+ * When using an I/O trace only the buffer size encoded in @request is saved,
+ * so requests without one, e.g. `SG_IO`, cannot be replayed.
+ *
  * Returns: %TRUE for success
  *
  * Since: 1.3.3
@@ -1372,12 +1415,35 @@ fu_udev_device_ioctl (FuUdevDevice *self,
 #ifdef HAVE_IOCTL_H
 	FuUdevDevicePrivate *priv = GET_PRIVATE (self);
 	gint rc_tmp;
+	gint64 start;
+	g_autoptr(GError) error_local = NULL;
 
 	g_return_val_if_fail (FU_IS_UDEV_DEVICE (self), FALSE);
 	g_return_val_if_fail (request != 0x0, FALSE);
 	g_return_val_if_fail (buf != NULL, FALSE);
 	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 
+	/* replaying a trace, where only the size encoded in the request number
+	 * can have been saved */
+	if (fu_io_trace_get_mode () == FU_IO_TRACE_MODE_REPLAY) {
+		gsize rc_replay = 0;
+		if (fu_udev_device_ioctl_size (request) == 0) {
+			g_set_error (error,
+				     FWUPD_ERROR,
+				     FWUPD_ERROR_NOT_SUPPORTED,
+				     "cannot replay ioctl 0x%lx with no encoded size",
+				     request);
+			return FALSE;
+		}
+		if (!fu_io_trace_replay (FU_DEVICE (self), "ioctl", request, NULL, 0,
+					 buf, fu_udev_device_ioctl_size (request),
+					 &rc_replay, error))
+			return FALSE;
+		if (rc != NULL)
+			*rc = (gint) rc_replay;
+		return TRUE;
+	}
+
 	/* not open! */
 	if (priv->fd == 0) {
 		g_set_error (error,
@@ -1389,29 +1455,36 @@ fu_udev_device_ioctl (FuUdevDevice *self,
 		return FALSE;
 	}
 
+	start = g_get_monotonic_time ();
 	rc_tmp = ioctl (priv->fd, request, buf);
 	if (rc != NULL)
 		*rc = rc_tmp;
 	if (rc_tmp < 0) {
 #ifdef HAVE_ERRNO_H
 		if (errno == EPERM) {
-			g_set_error_literal (error,
+			g_set_error_literal (&error_local,
 					     FWUPD_ERROR,
 					     FWUPD_ERROR_PERMISSION_DENIED,
 					     "permission denied");
-			return FALSE;
+		} else {
+			g_set_error (&error_local,
+				     FWUPD_ERROR,
+				     FWUPD_ERROR_INTERNAL,
+				     "ioctl error: %s",
+				     strerror (errno));
 		}
-		g_set_error (error,
-			     FWUPD_ERROR,
-			     FWUPD_ERROR_INTERNAL,
-			     "ioctl error: %s",
-			     strerror (errno));
 #else
-		g_set_error (error,
+		g_set_error (&error_local,
 			     FWUPD_ERROR,
 			     FWUPD_ERROR_INTERNAL,
 			     "unspecified ioctl error");
 #endif
+	}
+	fu_io_trace_record (FU_DEVICE (self), "ioctl", request, NULL, 0,
+			    buf, fu_udev_device_ioctl_size (request),
+			    MAX(rc_tmp, 0), start, error_local);
+	if (error_local != NULL) {
+		g_propagate_error (error, g_steal_pointer (&error_local));
 		return FALSE;
 	}
 	return TRUE;
@@ -1444,11 +1517,21 @@ fu_udev_device_pread_full (FuUdevDevice *self, goffset port,
 			   GError **error)
 {
 	FuUdevDevicePrivate *priv = GET_PRIVATE (self);
+#ifdef HAVE_PWRITE
+	gint64 start;
+	g_autoptr(GError) error_local = NULL;
+#endif
 
 	g_return_val_if_fail (FU_IS_UDEV_DEVICE (self), FALSE);
 	g_return_val_if_fail (buf != NULL, FALSE);
 	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 
+	/* replaying a trace */
+	if (fu_io_trace_get_mode () == FU_IO_TRACE_MODE_REPLAY) {
+		return fu_io_trace_replay (FU_DEVICE (self), "pread", port,
+					   NULL, 0, buf, bufsz, NULL, error);
+	}
+
 	/* not open! */
 	if (priv->fd == 0) {
 		g_set_error (error,
@@ -1461,15 +1544,22 @@ fu_udev_device_pread_full (FuUdevDevice *self, goffset port,
 	}
 
 #ifdef HAVE_PWRITE
+	start = g_get_monotonic_time ();
 	if (pread (priv->fd, buf, bufsz, port) != (gssize) bufsz) {
-		g_set_error (error,
+		g_set_error (&error_local,
 			     G_IO_ERROR,
 			     G_IO_ERROR_FAILED,
 			     "failed to read from port 0x%04x: %s",
 			     (guint) port,
 			     strerror (errno));
+		fu_io_trace_record (FU_DEVICE (self), "pread", port, NULL, 0,
+				    NULL, 0, 0, start, error_local);
+		g_propagate_error (error, g_steal_pointer (&error_local));
 		return FALSE;
 	}
+	fu_io_trace_record (FU_DEVICE (self), "pread", port, NULL, 0,
+			    buf, bufsz, bufsz, start, NULL);
+	fu_device_add_metric_counter (FU_DEVICE (self), "read-bytes", bufsz);
 	return TRUE;
 #else
 	g_set_error_literal (error,
@@ -1500,10 +1590,20 @@ fu_udev_device_pwrite_full (FuUdevDevice *self, goffset port,
 			    GError **error)
 {
 	FuUdevDevicePrivate *priv = GET_PRIVATE (self);
+#ifdef HAVE_PWRITE
+	gint64 start;
+	g_autoptr(GError) error_local = NULL;
+#endif
 
 	g_return_val_if_fail (FU_IS_UDEV_DEVICE (self), FALSE);
 	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 
+	/* replaying a trace */
+	if (fu_io_trace_get_mode () == FU_IO_TRACE_MODE_REPLAY) {
+		return fu_io_trace_replay (FU_DEVICE (self), "pwrite", port,
+					   buf, bufsz, NULL, 0, NULL, error);
+	}
+
 	/* not open! */
 	if (priv->fd == 0) {
 		g_set_error (error,
@@ -1516,15 +1616,22 @@ fu_udev_device_pwrite_full (FuUdevDevice *self, goffset port,
 	}
 
 #ifdef HAVE_PWRITE
+	start = g_get_monotonic_time ();
 	if (pwrite (priv->fd, buf, bufsz, port) != (gssize) bufsz) {
-		g_set_error (error,
+		g_set_error (&error_local,
 			     G_IO_ERROR,
 			     G_IO_ERROR_FAILED,
 			     "failed to write to port %04x: %s",
 			     (guint) port,
 			     strerror (errno));
+		fu_io_trace_record (FU_DEVICE (self), "pwrite", port, buf, bufsz,
+				    NULL, 0, 0, start, error_local);
+		g_propagate_error (error, g_steal_pointer (&error_local));
 		return FALSE;
 	}
+	fu_io_trace_record (FU_DEVICE (self), "pwrite", port, buf, bufsz,
+			    NULL, 0, bufsz, start, NULL);
+	fu_device_add_metric_counter (FU_DEVICE (self), "write-bytes", bufsz);
 	return TRUE;
 #else
 	g_set_error_literal (error,
@@ -1554,6 +1661,269 @@ fu_udev_device_pwrite (FuUdevDevice *self, goffset port, guint8 data, GError **e
 	return fu_udev_device_pwrite_full (self, port, &data, 0x01, error);
 }
 
+/* writes straight from @buf in blocks aligned to @block_sz, from @i onwards */
+static gboolean
+fu_udev_device_write_blocks (FuUdevDevice *self,
+			     gint fd,
+			     goffset offset,
+			     const guint8 *buf,
+			     gsize bufsz,
+			     gsize i,
+			     gsize block_sz,
+			     GError **error)
+{
+#ifdef HAVE_PWRITE
+	fu_device_add_metric_counter (FU_DEVICE (self), "write-bytes", bufsz - i);
+	while (i < bufsz) {
+		gsize sz = block_sz - ((offset + i) % block_sz);
+		gssize n;
+
+		/* sysfs attributes accept at most a page at a time */
+		n = pwrite (fd, buf + i, MIN(sz, bufsz - i), offset + i);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			g_set_error (error,
+				     G_IO_ERROR,
+				     G_IO_ERROR_FAILED,
+				     "failed to write at 0x%x: %s",
+				     (guint) (offset + i),
+				     n < 0 ? strerror (errno) : "no data written");
+			return FALSE;
+		}
+		i += n;
+		fu_device_set_progress_full (FU_DEVICE (self), i, bufsz);
+	}
+	return TRUE;
+#else
+	g_set_error_literal (error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_NOT_SUPPORTED,
+			     "Not supported as pwrite() is unavailable");
+	return FALSE;
+#endif
+}
+
+/* the device file, or a new fd that has to be closed by the caller */
+static gint
+fu_udev_device_open_sink (FuUdevDevice *self, const gchar *filename, GError **error)
+{
+	FuUdevDevicePrivate *priv = GET_PRIVATE (self);
+	gint fd;
+
+	if (filename == NULL) {
+		if (priv->fd == 0) {
+			g_set_error (error,
+				     FWUPD_ERROR,
+				     FWUPD_ERROR_INTERNAL,
+				     "%s [%s] has not been opened",
+				     fu_device_get_id (FU_DEVICE (self)),
+				     fu_device_get_name (FU_DEVICE (self)));
+			return -1;
+		}
+		return priv->fd;
+	}
+	fd = open (filename, O_WRONLY | O_CLOEXEC);
+	if (fd < 0) {
+		g_set_error (error,
+			     G_IO_ERROR,
+			     g_io_error_from_errno (errno),
+			     "could not open %s: %s",
+			     filename,
+			     g_strerror (errno));
+		return -1;
+	}
+	return fd;
+}
+
+static gboolean
+fu_udev_device_close_sink (FuUdevDevice *self, const gchar *filename, gint fd, GError **error)
+{
+	if (filename == NULL)
+		return TRUE;
+	if (close (fd) < 0 && errno != EINTR) {
+		g_set_error (error,
+			     G_IO_ERROR,
+			     g_io_error_from_errno (errno),
+			     "could not close %s: %s",
+			     filename,
+			     g_strerror (errno));
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * fu_udev_device_write_bytes:
+ * @self: A #FuUdevDevice
+ * @filename: (nullable): a file to write to, or %NULL for the device file
+ * @offset: offset address
+ * @blob: data to write
+ * @block_sz: the block size, e.g. 0x10000
+ *
+ * Writes a large buffer, e.g. a complete firmware image, to the device file or
+ * to a sysfs attribute such as `nvmem`. The data is written straight from
+ * @blob in blocks aligned to @block_sz, and short writes are continued, so no
+ * intermediate copies are made.
+ *
+ * The device progress is updated after each block.
+ *
+ * Returns: %TRUE for success
+ *
+ * Since: 1.6.0
+ **/
+gboolean
+fu_udev_device_write_bytes (FuUdevDevice *self,
+			    const gchar *filename,
+			    goffset offset,
+			    GBytes *blob,
+			    gsize block_sz,
+			    GError **error)
+{
+	gboolean ret;
+	gint fd;
+	gsize bufsz = 0;
+	const guint8 *buf;
+
+	g_return_val_if_fail (FU_IS_UDEV_DEVICE (self), FALSE);
+	g_return_val_if_fail (blob != NULL, FALSE);
+	g_return_val_if_fail (block_sz > 0, FALSE);
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+	buf = g_bytes_get_data (blob, &bufsz);
+
+	/* each block has to be recorded or replayed as a transaction */
+	if (filename == NULL && fu_io_trace_get_mode () != FU_IO_TRACE_MODE_NONE) {
+		for (gsize i = 0; i < bufsz; ) {
+			gsize sz = MIN(block_sz - ((offset + i) % block_sz), bufsz - i);
+			if (!fu_udev_device_pwrite_full (self, offset + i, buf + i, sz, error))
+				return FALSE;
+			i += sz;
+			fu_device_set_progress_full (FU_DEVICE (self), i, bufsz);
+		}
+		return TRUE;
+	}
+
+	fd = fu_udev_device_open_sink (self, filename, error);
+	if (fd < 0)
+		return FALSE;
+	ret = fu_udev_device_write_blocks (self, fd, offset, buf, bufsz, 0, block_sz, error);
+	if (!fu_udev_device_close_sink (self, filename, fd, ret ? error : NULL))
+		return FALSE;
+	return ret;
+}
+
+/**
+ * fu_udev_device_write_fd:
+ * @self: A #FuUdevDevice
+ * @filename: (nullable): a file to write to, or %NULL for the device file
+ * @offset: offset address
+ * @fd: a file descriptor to read the data from, e.g. a memfd
+ * @block_sz: the block size, e.g. 0x10000
+ *
+ * Writes the entire contents of @fd to the device file or to a sysfs attribute.
+ *
+ * If the kernel can copy between the two files directly then the data is never
+ * copied into userspace, otherwise @fd is mapped and written as with
+ * fu_udev_device_write_bytes().
+ *
+ * Returns: %TRUE for success
+ *
+ * Since: 1.6.0
+ **/
+gboolean
+fu_udev_device_write_fd (FuUdevDevice *self,
+			 const gchar *filename,
+			 goffset offset,
+			 gint fd,
+			 gsize block_sz,
+			 GError **error)
+{
+#ifdef HAVE_MMAN_H
+	gboolean ret = FALSE;
+	gint fd_sink;
+	gsize bufsz;
+	gsize i = 0;
+	struct stat st;
+	gpointer buf;
+
+	g_return_val_if_fail (FU_IS_UDEV_DEVICE (self), FALSE);
+	g_return_val_if_fail (fd >= 0, FALSE);
+	g_return_val_if_fail (block_sz > 0, FALSE);
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+	if (fstat (fd, &st) < 0) {
+		g_set_error (error,
+			     G_IO_ERROR,
+			     g_io_error_from_errno (errno),
+			     "failed to get size: %s",
+			     g_strerror (errno));
+		return FALSE;
+	}
+	bufsz = st.st_size;
+	if (bufsz == 0)
+		return TRUE;
+
+	/* map the pages rather than reading them into a buffer */
+	buf = mmap (NULL, bufsz, PROT_READ, MAP_SHARED, fd, 0);
+	if (buf == MAP_FAILED) {
+		g_set_error (error,
+			     G_IO_ERROR,
+			     g_io_error_from_errno (errno),
+			     "failed to map: %s",
+			     g_strerror (errno));
+		return FALSE;
+	}
+
+	/* each block has to be recorded or replayed as a transaction */
+	if (filename == NULL && fu_io_trace_get_mode () != FU_IO_TRACE_MODE_NONE) {
+		g_autoptr(GBytes) blob = g_bytes_new_static (buf, bufsz);
+		ret = fu_udev_device_write_bytes (self, NULL, offset, blob, block_sz, error);
+		munmap (buf, bufsz);
+		return ret;
+	}
+
+	fd_sink = fu_udev_device_open_sink (self, filename, error);
+	if (fd_sink < 0) {
+		munmap (buf, bufsz);
+		return FALSE;
+	}
+
+#ifdef HAVE_COPY_FILE_RANGE
+	/* copy in the kernel, as long as both ends support it */
+	while (i < bufsz) {
+		loff_t off_in = i;
+		loff_t off_out = offset + i;
+		gsize sz = MIN(block_sz - ((offset + i) % block_sz), bufsz - i);
+		gssize n = copy_file_range (fd, &off_in, fd_sink, &off_out, sz, 0);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		i += n;
+		fu_device_set_progress_full (FU_DEVICE (self), i, bufsz);
+	}
+	fu_device_add_metric_counter (FU_DEVICE (self), "write-bytes", i);
+	if (i < bufsz)
+		g_debug ("falling back from copy_file_range() at 0x%x", (guint) i);
+#endif
+
+	/* write the rest from the mapping */
+	ret = fu_udev_device_write_blocks (self, fd_sink, offset, buf, bufsz,
+					   i, block_sz, error);
+	munmap (buf, bufsz);
+	if (!fu_udev_device_close_sink (self, filename, fd_sink, ret ? error : NULL))
+		return FALSE;
+	return ret;
+#else
+	g_set_error_literal (error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_NOT_SUPPORTED,
+			     "Not supported as mmap() is unavailable");
+	return FALSE;
+#endif
+}
+
 /**
  * fu_udev_device_get_parent_name
  * @self: A #FuUdevDevice
@@ -1651,6 +2021,379 @@ fu_udev_device_pread (FuUdevDevice *self, goffset port, guint8 *data, GError **e
 	return fu_udev_device_pread_full (self, port, data, 0x1, error);
 }
 
+static void
+fu_udev_device_register_free (FuUdevDeviceRegister *reg)
+{
+	if (reg->blob != NULL)
+		g_bytes_unref (reg->blob);
+	g_free (reg);
+}
+
+static gint
+fu_udev_device_register_sort_cb (gconstpointer a, gconstpointer b)
+{
+	FuUdevDeviceRegister *reg1 = *((FuUdevDeviceRegister **) a);
+	FuUdevDeviceRegister *reg2 = *((FuUdevDeviceRegister **) b);
+	if (reg1->port < reg2->port)
+		return -1;
+	if (reg1->port > reg2->port)
+		return 1;
+	return 0;
+}
+
+static gchar *
+fu_udev_device_snapshot_get_filename (void)
+{
+	g_autofree gchar *cachedir = fu_common_get_path (FU_PATH_KIND_CACHEDIR_PKG);
+	return g_build_filename (cachedir, "registers.ini", NULL);
+}
+
+/* must hold snapshot_mutex */
+static void
+fu_udev_device_snapshot_load_unlocked (void)
+{
+	g_autofree gchar *boot_id = NULL;
+	g_autofree gchar *boot_id_old = NULL;
+	g_autofree gchar *fn = NULL;
+	g_auto(GStrv) groups = NULL;
+	g_autoptr(GError) error_local = NULL;
+
+	/* already done */
+	if (snapshot_cache != NULL)
+		return;
+	snapshot_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+						g_free, (GDestroyNotify) g_bytes_unref);
+	snapshot_kf = g_key_file_new ();
+
+	/* values are only valid for the current boot */
+	if (!g_file_get_contents ("/proc/sys/kernel/random/boot_id",
+				  &boot_id, NULL, &error_local)) {
+		g_debug ("not persisting register snapshots: %s",
+			 error_local->message);
+		return;
+	}
+	snapshot_boot_id = g_strdup (g_strstrip (boot_id));
+
+	/* load any previous snapshot from this boot */
+	fn = fu_udev_device_snapshot_get_filename ();
+	if (!g_file_test (fn, G_FILE_TEST_EXISTS))
+		return;
+	if (!g_key_file_load_from_file (snapshot_kf, fn, G_KEY_FILE_NONE, &error_local)) {
+		g_debug ("ignoring register snapshot: %s", error_local->message);
+		return;
+	}
+	boot_id_old = g_key_file_get_string (snapshot_kf, "fwupd", "BootId", NULL);
+	if (g_strcmp0 (boot_id_old, snapshot_boot_id) != 0) {
+		g_debug ("ignoring register snapshot from previous boot");
+		g_key_file_unref (snapshot_kf);
+		snapshot_kf = g_key_file_new ();
+		return;
+	}
+	groups = g_key_file_get_groups (snapshot_kf, NULL);
+	for (guint i = 0; groups[i] != NULL; i++) {
+		g_auto(GStrv) keys = NULL;
+		if (g_strcmp0 (groups[i], "fwupd") == 0)
+			continue;
+		keys = g_key_file_get_keys (snapshot_kf, groups[i], NULL, NULL);
+		for (guint j = 0; keys != NULL && keys[j] != NULL; j++) {
+			gsize bufsz = 0;
+			guchar *buf = NULL;
+			g_autofree gchar *str = NULL;
+			str = g_key_file_get_string (snapshot_kf, groups[i], keys[j], NULL);
+			if (str == NULL)
+				continue;
+			buf = g_base64_decode (str, &bufsz);
+			g_hash_table_insert (snapshot_cache,
+					     g_strdup_printf ("%s:%s", groups[i], keys[j]),
+					     g_bytes_new_take (buf, bufsz));
+		}
+	}
+}
+
+/* must hold snapshot_mutex */
+static void
+fu_udev_device_snapshot_save_unlocked (void)
+{
+	g_autofree gchar *fn = fu_udev_device_snapshot_get_filename ();
+	g_autoptr(GError) error_local = NULL;
+
+	if (snapshot_boot_id == NULL || !snapshot_kf_changed)
+		return;
+	snapshot_kf_changed = FALSE;
+	g_key_file_set_string (snapshot_kf, "fwupd", "BootId", snapshot_boot_id);
+	if (!fu_common_mkdir_parent (fn, &error_local) ||
+	    !g_key_file_save_to_file (snapshot_kf, fn, &error_local))
+		g_debug ("failed to save register snapshot: %s", error_local->message);
+}
+
+/**
+ * fu_udev_device_snapshot_save:
+ *
+ * Writes any register values added since the last save to the cache
+ * directory. Saves are also scheduled automatically when idle, so this is
+ * only needed when the caller has no main loop running.
+ *
+ * Since: 1.6.0
+ **/
+void
+fu_udev_device_snapshot_save (void)
+{
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&snapshot_mutex);
+	if (snapshot_save_id != 0) {
+		g_source_remove (snapshot_save_id);
+		snapshot_save_id = 0;
+	}
+	fu_udev_device_snapshot_save_unlocked ();
+}
+
+static gboolean
+fu_udev_device_snapshot_save_cb (gpointer user_data)
+{
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&snapshot_mutex);
+	snapshot_save_id = 0;
+	fu_udev_device_snapshot_save_unlocked ();
+	return G_SOURCE_REMOVE;
+}
+
+static gchar *
+fu_udev_device_snapshot_get_key (FuUdevDeviceRegister *reg)
+{
+	return g_strdup_printf ("%" G_GINT64_MODIFIER "x-%" G_GSIZE_FORMAT,
+				(gint64) reg->port, reg->size);
+}
+
+/**
+ * fu_udev_device_add_snapshot_register:
+ * @self: A #FuUdevDevice
+ * @port: offset address
+ * @size: size of the register in bytes
+ *
+ * Declares a register that should be included in the device snapshot. The
+ * value is read once by fu_udev_device_ensure_snapshot() and is then cached
+ * for the rest of the boot.
+ *
+ * Only registers that are fixed until the next reboot may be added, for
+ * instance configuration that firmware sets and then locks. Anything that
+ * can be changed by the OS or that reports a runtime event must be read
+ * directly using fu_udev_device_pread_full() every time instead.
+ *
+ * Since: 1.6.0
+ **/
+void
+fu_udev_device_add_snapshot_register (FuUdevDevice *self, goffset port, gsize size)
+{
+	FuUdevDevicePrivate *priv = GET_PRIVATE (self);
+	FuUdevDeviceRegister *reg;
+
+	g_return_if_fail (FU_IS_UDEV_DEVICE (self));
+	g_return_if_fail (size > 0);
+
+	/* already added */
+	for (guint i = 0; i < priv->snapshot->len; i++) {
+		reg = g_ptr_array_index (priv->snapshot, i);
+		if (reg->port == port && reg->size == size)
+			return;
+	}
+	reg = g_new0 (FuUdevDeviceRegister, 1);
+	reg->port = port;
+	reg->size = size;
+	g_ptr_array_add (priv->snapshot, reg);
+}
+
+static gboolean
+fu_udev_device_snapshot_read_span (FuUdevDevice *self,
+				   GPtrArray *regs,
+				   guint idx_start,
+				   guint idx_end,
+				   GError **error)
+{
+	FuUdevDeviceRegister *reg_start = g_ptr_array_index (regs, idx_start);
+	goffset port_end = 0;
+	g_autofree guint8 *buf = NULL;
+
+	for (guint i = idx_start; i <= idx_end; i++) {
+		FuUdevDeviceRegister *reg = g_ptr_array_index (regs, i);
+		port_end = MAX(port_end, reg->port + (goffset) reg->size);
+	}
+	buf = g_malloc0 (port_end - reg_start->port);
+	if (!fu_udev_device_pread_full (self, reg_start->port, buf,
+					port_end - reg_start->port, error))
+		return FALSE;
+	for (guint i = idx_start; i <= idx_end; i++) {
+		FuUdevDeviceRegister *reg = g_ptr_array_index (regs, i);
+		reg->blob = g_bytes_new (buf + (reg->port - reg_start->port), reg->size);
+	}
+	return TRUE;
+}
+
+/**
+ * fu_udev_device_ensure_snapshot:
+ * @self: A #FuUdevDevice
+ * @error: A #GError, or %NULL
+ *
+ * Reads all the registers declared using fu_udev_device_add_snapshot_register()
+ * that have not already been read during this boot.
+ *
+ * For devices using %FU_UDEV_DEVICE_FLAG_USE_CONFIG nearby registers are read
+ * using one call, otherwise each register is read separately, as required for
+ * MSRs. The device is only opened if any register has to be read.
+ *
+ * Returns: %TRUE for success
+ *
+ * Since: 1.6.0
+ **/
+gboolean
+fu_udev_device_ensure_snapshot (FuUdevDevice *self, GError **error)
+{
+	FuUdevDevicePrivate *priv = GET_PRIVATE (self);
+	const gchar *sysfs_path = fu_udev_device_get_sysfs_path (self);
+	const gchar *id = sysfs_path != NULL ? sysfs_path : priv->device_file;
+	g_autoptr(GMutexLocker) mutex_locker = NULL;
+	g_autoptr(FuDeviceLocker) locker = NULL;
+	g_autoptr(GPtrArray) regs = g_ptr_array_new ();
+
+	g_return_val_if_fail (FU_IS_UDEV_DEVICE (self), FALSE);
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+	/* nothing to do */
+	if (id == NULL) {
+		g_set_error_literal (error,
+				     FWUPD_ERROR,
+				     FWUPD_ERROR_NOT_SUPPORTED,
+				     "no sysfs path or device file");
+		return FALSE;
+	}
+
+	/* use values from earlier in the boot where possible */
+	mutex_locker = g_mutex_locker_new (&snapshot_mutex);
+	fu_udev_device_snapshot_load_unlocked ();
+	for (guint i = 0; i < priv->snapshot->len; i++) {
+		FuUdevDeviceRegister *reg = g_ptr_array_index (priv->snapshot, i);
+		g_autofree gchar *key = NULL;
+		g_autofree gchar *key_cache = NULL;
+		GBytes *blob;
+
+		if (reg->blob != NULL)
+			continue;
+		key = fu_udev_device_snapshot_get_key (reg);
+		key_cache = g_strdup_printf ("%s:%s", id, key);
+		blob = g_hash_table_lookup (snapshot_cache, key_cache);
+		if (blob != NULL && g_bytes_get_size (blob) == reg->size) {
+			reg->blob = g_bytes_ref (blob);
+			continue;
+		}
+		g_ptr_array_add (regs, reg);
+	}
+	if (regs->len == 0)
+		return TRUE;
+
+	/* do not hold the global lock while opening the device */
+	g_clear_pointer (&mutex_locker, g_mutex_locker_free);
+
+	/* read what is left */
+	locker = fu_device_locker_new (FU_DEVICE (self), error);
+	if (locker == NULL)
+		return FALSE;
+	g_ptr_array_sort (regs, fu_udev_device_register_sort_cb);
+	for (guint i = 0; i < regs->len; i++) {
+		FuUdevDeviceRegister *reg = g_ptr_array_index (regs, i);
+		goffset port_end = reg->port + (goffset) reg->size;
+		guint j = i;
+
+		/* coalesce nearby registers in config space */
+		if (priv->flags & FU_UDEV_DEVICE_FLAG_USE_CONFIG) {
+			while (j + 1 < regs->len) {
+				FuUdevDeviceRegister *reg_next = g_ptr_array_index (regs, j + 1);
+				if (reg_next->port > port_end + FU_UDEV_DEVICE_SNAPSHOT_GAP_MAX)
+					break;
+				port_end = MAX(port_end, reg_next->port + (goffset) reg_next->size);
+				j++;
+			}
+		}
+		if (!fu_udev_device_snapshot_read_span (self, regs, i, j, error)) {
+			g_prefix_error (error,
+					"failed to snapshot 0x%" G_GINT64_MODIFIER "x: ",
+					(gint64) reg->port);
+			return FALSE;
+		}
+		i = j;
+	}
+	if (!fu_device_locker_close (locker, error))
+		return FALSE;
+
+	/* add to the cache, only persisting real devices */
+	mutex_locker = g_mutex_locker_new (&snapshot_mutex);
+	for (guint i = 0; i < regs->len; i++) {
+		FuUdevDeviceRegister *reg = g_ptr_array_index (regs, i);
+		g_autofree gchar *key = fu_udev_device_snapshot_get_key (reg);
+		g_hash_table_insert (snapshot_cache,
+				     g_strdup_printf ("%s:%s", id, key),
+				     g_bytes_ref (reg->blob));
+		if (sysfs_path != NULL) {
+			g_autofree gchar *str = NULL;
+			str = g_base64_encode (g_bytes_get_data (reg->blob, NULL),
+					       g_bytes_get_size (reg->blob));
+			g_key_file_set_string (snapshot_kf, sysfs_path, key, str);
+			snapshot_kf_changed = TRUE;
+		}
+	}
+
+	/* coalesce the writes for all the devices added during coldplug */
+	if (snapshot_kf_changed && snapshot_save_id == 0)
+		snapshot_save_id = g_idle_add (fu_udev_device_snapshot_save_cb, NULL);
+	return TRUE;
+}
+
+/**
+ * fu_udev_device_read_snapshot:
+ * @self: A #FuUdevDevice
+ * @port: offset address
+ * @buf: (out): data
+ * @bufsz: size of @buf
+ * @error: A #GError, or %NULL
+ *
+ * Copies a register value from the device snapshot, reading all the declared
+ * registers using fu_udev_device_ensure_snapshot() if required. The range
+ * @port to @port + @bufsz has to be contained in one declared register.
+ *
+ * Returns: %TRUE for success
+ *
+ * Since: 1.6.0
+ **/
+gboolean
+fu_udev_device_read_snapshot (FuUdevDevice *self,
+			      goffset port,
+			      guint8 *buf,
+			      gsize bufsz,
+			      GError **error)
+{
+	FuUdevDevicePrivate *priv = GET_PRIVATE (self);
+
+	g_return_val_if_fail (FU_IS_UDEV_DEVICE (self), FALSE);
+	g_return_val_if_fail (buf != NULL, FALSE);
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+	if (!fu_udev_device_ensure_snapshot (self, error))
+		return FALSE;
+	for (guint i = 0; i < priv->snapshot->len; i++) {
+		FuUdevDeviceRegister *reg = g_ptr_array_index (priv->snapshot, i);
+		if (port < reg->port ||
+		    port + (goffset) bufsz > reg->port + (goffset) reg->size)
+			continue;
+		return fu_memcpy_safe (buf, bufsz, 0x0,				/* dst */
+				       g_bytes_get_data (reg->blob, NULL),
+				       g_bytes_get_size (reg->blob),
+				       port - reg->port,				/* src */
+				       bufsz, error);
+	}
+	g_set_error (error,
+		     FWUPD_ERROR,
+		     FWUPD_ERROR_NOT_FOUND,
+		     "register 0x%" G_GINT64_MODIFIER "x not in snapshot",
+		     (gint64) port);
+	return FALSE;
+}
+
 
 /**
  * fu_udev_device_write_sysfs:
@@ -1805,6 +2548,7 @@ fu_udev_device_finalize (GObject *object)
 	g_free (priv->subsystem);
 	g_free (priv->driver);
 	g_free (priv->device_file);
+	g_ptr_array_unref (priv->snapshot);
 	if (priv->udev_device != NULL)
 		g_object_unref (priv->udev_device);
 	if (priv->fd > 0)
@@ -1819,6 +2563,7 @@ fu_udev_device_init (FuUdevDevice *self)
 	FuUdevDevicePrivate *priv = GET_PRIVATE (self);
 	priv->flags = FU_UDEV_DEVICE_FLAG_OPEN_READ |
 		      FU_UDEV_DEVICE_FLAG_OPEN_WRITE;
+	priv->snapshot = g_ptr_array_new_with_free_func ((GDestroyNotify) fu_udev_device_register_free);
 }
 
 static void
@@ -96,6 +96,20 @@ gboolean	 fu_udev_device_pwrite_full		(FuUdevDevice	*self,
 							 gsize		 bufsz,
 							 GError		**error)
 							 G_GNUC_WARN_UNUSED_RESULT;
+gboolean	 fu_udev_device_write_bytes		(FuUdevDevice	*self,
+							 const gchar	*filename,
+							 goffset	 offset,
+							 GBytes		*blob,
+							 gsize		 block_sz,
+							 GError		**error)
+							 G_GNUC_WARN_UNUSED_RESULT;
+gboolean	 fu_udev_device_write_fd		(FuUdevDevice	*self,
+							 const gchar	*filename,
+							 goffset	 offset,
+							 gint		 fd,
+							 gsize		 block_sz,
+							 GError		**error)
+							 G_GNUC_WARN_UNUSED_RESULT;
 gboolean	 fu_udev_device_pread			(FuUdevDevice	*self,
 							 goffset	 port,
 							 guint8		*data,
@@ -107,6 +121,18 @@ gboolean	 fu_udev_device_pread_full		(FuUdevDevice	*self,
 							 gsize		 bufsz,
 							 GError		**error)
 							 G_GNUC_WARN_UNUSED_RESULT;
+void		 fu_udev_device_add_snapshot_register	(FuUdevDevice	*self,
+							 goffset	 port,
+							 gsize		 size);
+gboolean	 fu_udev_device_ensure_snapshot		(FuUdevDevice	*self,
+							 GError		**error)
+							 G_GNUC_WARN_UNUSED_RESULT;
+gboolean	 fu_udev_device_read_snapshot		(FuUdevDevice	*self,
+							 goffset	 port,
+							 guint8		*buf,
+							 gsize		 bufsz,
+							 GError		**error)
+							 G_GNUC_WARN_UNUSED_RESULT;
 const gchar	*fu_udev_device_get_sysfs_attr		 (FuUdevDevice	*self,
 							  const gchar	*attr,
 							  GError	**error);
@@ -9,3 +9,20 @@
 #include "fu-usb-device.h"
 
 const gchar	*fu_usb_device_get_platform_id		(FuUsbDevice	*self);
+
+/* for the self tests, to replace the asynchronous GUsb bulk transfers */
+typedef void	 (*FuUsbDeviceBulkTransferAsyncFunc)	(FuUsbDevice	*self,
+							 guint8		 endpoint,
+							 guint8		*data,
+							 gsize		 length,
+							 guint		 timeout,
+							 GCancellable	*cancellable,
+							 GAsyncReadyCallback callback,
+							 gpointer	 user_data);
+typedef gssize	 (*FuUsbDeviceBulkTransferFinishFunc)	(FuUsbDevice	*self,
+							 GAsyncResult	*res,
+							 GError		**error);
+
+void		 fu_usb_device_set_bulk_transfer_funcs	(FuUsbDevice	*self,
+							 FuUsbDeviceBulkTransferAsyncFunc async_func,
+							 FuUsbDeviceBulkTransferFinishFunc finish_func);
@@ -8,7 +8,9 @@
 
 #include "config.h"
 
+#include "fu-chunk.h"
 #include "fu-device-private.h"
+#include "fu-io-trace.h"
 #include "fu-usb-device-private.h"
 
 /**
@@ -24,6 +26,8 @@ typedef struct
 {
 	GUsbDevice		*usb_device;
 	FuDeviceLocker		*usb_device_locker;
+	FuUsbDeviceBulkTransferAsyncFunc bulk_transfer_async;	/* nullable */
+	FuUsbDeviceBulkTransferFinishFunc bulk_transfer_finish;	/* nullable */
 } FuUsbDevicePrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE (FuUsbDevice, fu_usb_device, FU_TYPE_DEVICE)
@@ -174,6 +178,10 @@ fu_usb_device_open (FuDevice *device, GError **error)
 	if (priv->usb_device_locker != NULL)
 		return TRUE;
 
+	/* replaying a trace, so there is no device */
+	if (fu_io_trace_get_mode () == FU_IO_TRACE_MODE_REPLAY)
+		return TRUE;
+
 	/* open */
 	locker = fu_device_locker_new (priv->usb_device, error);
 	if (locker == NULL)
@@ -299,6 +307,10 @@ fu_usb_device_probe (FuDevice *device, GError **error)
 	g_autofree gchar *vendor_id = NULL;
 	g_autoptr(GPtrArray) intfs = NULL;
 
+	/* nothing to do, e.g. when replaying a trace */
+	if (priv->usb_device == NULL)
+		return TRUE;
+
 	/* set vendor ID */
 	vendor_id = g_strdup_printf ("USB:0x%04X", g_usb_device_get_vid (priv->usb_device));
 	fu_device_add_vendor_id (device, vendor_id);
@@ -565,6 +577,474 @@ fu_usb_device_get_dev (FuUsbDevice *device)
 	return priv->usb_device;
 }
 
+#ifdef HAVE_GUSB
+static gboolean
+fu_usb_device_endpoint_transfer (FuUsbDevice *self,
+				 const gchar *kind,
+				 guint8 endpoint,
+				 guint8 *data,
+				 gsize length,
+				 gsize *actual_length,
+				 guint timeout,
+				 GCancellable *cancellable,
+				 GError **error)
+{
+	FuUsbDevicePrivate *priv = GET_PRIVATE (self);
+	gboolean ret;
+	gboolean is_in = (endpoint & 0x80) > 0;
+	gint64 start;
+	gsize actual_length_tmp = 0;
+	g_autoptr(GError) error_local = NULL;
+
+	/* replaying a trace */
+	if (fu_io_trace_get_mode () == FU_IO_TRACE_MODE_REPLAY) {
+		return fu_io_trace_replay (FU_DEVICE (self), kind, endpoint,
+					   is_in ? NULL : data, is_in ? 0 : length,
+					   is_in ? data : NULL, is_in ? length : 0,
+					   actual_length, error);
+	}
+
+	start = g_get_monotonic_time ();
+	if (g_strcmp0 (kind, "usb-bulk") == 0) {
+		ret = g_usb_device_bulk_transfer (priv->usb_device, endpoint,
+						  data, length, &actual_length_tmp,
+						  timeout, cancellable, &error_local);
+	} else {
+		ret = g_usb_device_interrupt_transfer (priv->usb_device, endpoint,
+						       data, length, &actual_length_tmp,
+						       timeout, cancellable, &error_local);
+	}
+	fu_io_trace_record (FU_DEVICE (self), kind, endpoint,
+			    is_in ? NULL : data, is_in ? 0 : length,
+			    is_in ? data : NULL, is_in ? actual_length_tmp : 0,
+			    actual_length_tmp, start, error_local);
+	if (!ret) {
+		g_propagate_error (error, g_steal_pointer (&error_local));
+		return FALSE;
+	}
+	if (actual_length != NULL)
+		*actual_length = actual_length_tmp;
+	return TRUE;
+}
+#endif
+
+/**
+ * fu_usb_device_control_transfer:
+ * @self: A #FuUsbDevice
+ * @direction: the direction of the request
+ * @request_type: the type of the request
+ * @recipient: the recipient of the request
+ * @request: the request number, e.g. 0x01
+ * @value: the request value
+ * @idx: the request index
+ * @data: (array length=length): a buffer of data to send or receive
+ * @length: the size of @data
+ * @actual_length: (out) (optional): the number of bytes transferred
+ * @timeout: timeout in milliseconds
+ * @cancellable: (nullable): a #GCancellable
+ * @error: A #GError, or %NULL
+ *
+ * Performs a USB control transfer, as g_usb_device_control_transfer() does,
+ * but the transfer is saved when recording an I/O trace and does not use the
+ * hardware at all when replaying one.
+ *
+ * Returns: %TRUE for success
+ *
+ * Since: 1.6.0
+ **/
+gboolean
+fu_usb_device_control_transfer (FuUsbDevice *self,
+				GUsbDeviceDirection direction,
+				GUsbDeviceRequestType request_type,
+				GUsbDeviceRecipient recipient,
+				guint8 request,
+				guint16 value,
+				guint16 idx,
+				guint8 *data,
+				gsize length,
+				gsize *actual_length,
+				guint timeout,
+				GCancellable *cancellable,
+				GError **error)
+{
+#ifdef HAVE_GUSB
+	FuUsbDevicePrivate *priv = GET_PRIVATE (self);
+	gboolean ret;
+	gboolean is_in = direction == G_USB_DEVICE_DIRECTION_DEVICE_TO_HOST;
+	gint64 start;
+	gsize actual_length_tmp = 0;
+	guint8 bm_request_type = (request_type << 5) | recipient;
+	guint64 setup;
+	g_autoptr(GError) error_local = NULL;
+
+	g_return_val_if_fail (FU_IS_USB_DEVICE (self), FALSE);
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+	/* the setup packet identifies the request */
+	if (is_in)
+		bm_request_type |= 0x80;
+	setup = ((guint64) bm_request_type << 40) | ((guint64) request << 32) |
+		((guint64) value << 16) | idx;
+
+	/* replaying a trace */
+	if (fu_io_trace_get_mode () == FU_IO_TRACE_MODE_REPLAY) {
+		return fu_io_trace_replay (FU_DEVICE (self), "usb-control", setup,
+					   is_in ? NULL : data, is_in ? 0 : length,
+					   is_in ? data : NULL, is_in ? length : 0,
+					   actual_length, error);
+	}
+
+	start = g_get_monotonic_time ();
+	ret = g_usb_device_control_transfer (priv->usb_device,
+					     direction, request_type, recipient,
+					     request, value, idx,
+					     data, length, &actual_length_tmp,
+					     timeout, cancellable, &error_local);
+	fu_io_trace_record (FU_DEVICE (self), "usb-control", setup,
+			    is_in ? NULL : data, is_in ? 0 : length,
+			    is_in ? data : NULL, is_in ? actual_length_tmp : 0,
+			    actual_length_tmp, start, error_local);
+	if (!ret) {
+		g_propagate_error (error, g_steal_pointer (&error_local));
+		return FALSE;
+	}
+	if (actual_length != NULL)
+		*actual_length = actual_length_tmp;
+	return TRUE;
+#else
+	g_set_error_literal (error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_NOT_SUPPORTED,
+			     "Not supported as GUsb is unavailable");
+	return FALSE;
+#endif
+}
+
+/**
+ * fu_usb_device_bulk_transfer:
+ * @self: A #FuUsbDevice
+ * @endpoint: the endpoint address, with 0x80 set for IN transfers
+ * @data: (array length=length): a buffer of data to send or receive
+ * @length: the size of @data
+ * @actual_length: (out) (optional): the number of bytes transferred
+ * @timeout: timeout in milliseconds
+ * @cancellable: (nullable): a #GCancellable
+ * @error: A #GError, or %NULL
+ *
+ * Performs a USB bulk transfer, as g_usb_device_bulk_transfer() does, but
+ * using the I/O trace when recording or replaying.
+ *
+ * Returns: %TRUE for success
+ *
+ * Since: 1.6.0
+ **/
+gboolean
+fu_usb_device_bulk_transfer (FuUsbDevice *self,
+			     guint8 endpoint,
+			     guint8 *data,
+			     gsize length,
+			     gsize *actual_length,
+			     guint timeout,
+			     GCancellable *cancellable,
+			     GError **error)
+{
+	g_return_val_if_fail (FU_IS_USB_DEVICE (self), FALSE);
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+#ifdef HAVE_GUSB
+	return fu_usb_device_endpoint_transfer (self, "usb-bulk", endpoint,
+						data, length, actual_length,
+						timeout, cancellable, error);
+#else
+	g_set_error_literal (error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_NOT_SUPPORTED,
+			     "Not supported as GUsb is unavailable");
+	return FALSE;
+#endif
+}
+
+/**
+ * fu_usb_device_interrupt_transfer:
+ * @self: A #FuUsbDevice
+ * @endpoint: the endpoint address, with 0x80 set for IN transfers
+ * @data: (array length=length): a buffer of data to send or receive
+ * @length: the size of @data
+ * @actual_length: (out) (optional): the number of bytes transferred
+ * @timeout: timeout in milliseconds
+ * @cancellable: (nullable): a #GCancellable
+ * @error: A #GError, or %NULL
+ *
+ * Performs a USB interrupt transfer, as g_usb_device_interrupt_transfer()
+ * does, but using the I/O trace when recording or replaying.
+ *
+ * Returns: %TRUE for success
+ *
+ * Since: 1.6.0
+ **/
+gboolean
+fu_usb_device_interrupt_transfer (FuUsbDevice *self,
+				  guint8 endpoint,
+				  guint8 *data,
+				  gsize length,
+				  gsize *actual_length,
+				  guint timeout,
+				  GCancellable *cancellable,
+				  GError **error)
+{
+	g_return_val_if_fail (FU_IS_USB_DEVICE (self), FALSE);
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+#ifdef HAVE_GUSB
+	return fu_usb_device_endpoint_transfer (self, "usb-interrupt", endpoint,
+						data, length, actual_length,
+						timeout, cancellable, error);
+#else
+	g_set_error_literal (error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_NOT_SUPPORTED,
+			     "Not supported as GUsb is unavailable");
+	return FALSE;
+#endif
+}
+
+#ifdef HAVE_GUSB
+typedef struct {
+	FuUsbDevice		*self;
+	GPtrArray		*chunks;
+	guint8			 endpoint;
+	guint			 timeout;
+	guint			 max_in_flight;
+	guint			 idx_next;
+	guint			 in_flight;
+	guint			 done;
+	GCancellable		*cancellable;	/* cancels the rest on the first error */
+	GError			*error;
+} FuUsbDeviceChunksHelper;
+
+typedef struct {
+	FuUsbDeviceChunksHelper	*helper;
+	FuChunk			*chk;
+} FuUsbDeviceChunksTransfer;
+
+static void fu_usb_device_chunks_submit (FuUsbDeviceChunksHelper *helper);
+
+static void
+fu_usb_device_chunks_cb (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+	FuUsbDeviceChunksTransfer *transfer = (FuUsbDeviceChunksTransfer *) user_data;
+	FuUsbDeviceChunksHelper *helper = transfer->helper;
+	FuUsbDevicePrivate *priv = GET_PRIVATE (helper->self);
+	FuChunk *chk = transfer->chk;
+	gssize actual_length;
+	g_autoptr(GError) error_local = NULL;
+
+	g_free (transfer);
+	helper->in_flight--;
+	if (priv->bulk_transfer_finish != NULL) {
+		actual_length = priv->bulk_transfer_finish (helper->self, res, &error_local);
+	} else {
+		actual_length = g_usb_device_bulk_transfer_finish (G_USB_DEVICE (source_object),
+								   res, &error_local);
+	}
+
+	/* only the first failure is interesting, as the rest get cancelled */
+	if (helper->error != NULL)
+		return;
+	if (actual_length < 0) {
+		g_propagate_prefixed_error (&helper->error,
+					    g_steal_pointer (&error_local),
+					    "failed to transfer chunk %u @0x%x: ",
+					    fu_chunk_get_idx (chk),
+					    fu_chunk_get_address (chk));
+		g_cancellable_cancel (helper->cancellable);
+		return;
+	}
+	if ((gsize) actual_length != fu_chunk_get_data_sz (chk)) {
+		g_set_error (&helper->error,
+			     G_IO_ERROR,
+			     G_IO_ERROR_PARTIAL_INPUT,
+			     "only transferred 0x%x of 0x%x bytes of chunk %u @0x%x",
+			     (guint) actual_length,
+			     fu_chunk_get_data_sz (chk),
+			     fu_chunk_get_idx (chk),
+			     fu_chunk_get_address (chk));
+		g_cancellable_cancel (helper->cancellable);
+		return;
+	}
+	fu_device_set_progress_full (FU_DEVICE (helper->self), ++helper->done,
+				     helper->chunks->len);
+	fu_usb_device_chunks_submit (helper);
+}
+
+static void
+fu_usb_device_chunks_submit (FuUsbDeviceChunksHelper *helper)
+{
+	FuUsbDevicePrivate *priv = GET_PRIVATE (helper->self);
+	while (helper->error == NULL &&
+	       helper->in_flight < helper->max_in_flight &&
+	       helper->idx_next < helper->chunks->len) {
+		FuUsbDeviceChunksTransfer *transfer = g_new0 (FuUsbDeviceChunksTransfer, 1);
+		FuChunk *chk = g_ptr_array_index (helper->chunks, helper->idx_next++);
+		guint8 *data = (helper->endpoint & 0x80) > 0 ?
+			fu_chunk_get_data_out (chk) : (guint8 *) fu_chunk_get_data (chk);
+
+		/* transfers on one endpoint complete in the order submitted */
+		transfer->helper = helper;
+		transfer->chk = chk;
+		helper->in_flight++;
+		if (priv->bulk_transfer_async != NULL) {
+			priv->bulk_transfer_async (helper->self, helper->endpoint,
+						   data, fu_chunk_get_data_sz (chk),
+						   helper->timeout, helper->cancellable,
+						   fu_usb_device_chunks_cb, transfer);
+			continue;
+		}
+		g_usb_device_bulk_transfer_async (priv->usb_device, helper->endpoint,
+						  data, fu_chunk_get_data_sz (chk),
+						  helper->timeout, helper->cancellable,
+						  fu_usb_device_chunks_cb, transfer);
+	}
+}
+
+static void
+fu_usb_device_chunks_cancelled_cb (GCancellable *cancellable, gpointer user_data)
+{
+	g_cancellable_cancel (G_CANCELLABLE (user_data));
+}
+#endif
+
+/**
+ * fu_usb_device_bulk_transfer_chunks:
+ * @self: A #FuUsbDevice
+ * @endpoint: the endpoint address, with 0x80 set for IN transfers
+ * @chunks: (element-type FuChunk): chunks, which must be mutable for IN transfers
+ * @max_in_flight: the maximum number of transfers submitted at the same time
+ * @timeout: timeout in milliseconds for each chunk
+ * @cancellable: (nullable): a #GCancellable
+ * @error: A #GError, or %NULL
+ *
+ * Transfers each chunk in order using the chunk data directly, keeping up to
+ * @max_in_flight transfers queued so that the bus is not idle between chunks.
+ * The device progress is updated as each chunk completes.
+ *
+ * Any failure cancels the remaining chunks, and the error includes the index
+ * and address of the chunk that failed. When recording or replaying an I/O
+ * trace the chunks are transferred one at a time.
+ *
+ * Returns: %TRUE for success
+ *
+ * Since: 1.6.0
+ **/
+gboolean
+fu_usb_device_bulk_transfer_chunks (FuUsbDevice *self,
+				    guint8 endpoint,
+				    GPtrArray *chunks,
+				    guint max_in_flight,
+				    guint timeout,
+				    GCancellable *cancellable,
+				    GError **error)
+{
+#ifdef HAVE_GUSB
+	gulong handler_id = 0;
+	gint64 elapsed;
+	gint64 start = g_get_monotonic_time ();
+	gsize total = 0;
+	FuUsbDeviceChunksHelper helper = {
+		.self = self,
+		.chunks = chunks,
+		.endpoint = endpoint,
+		.timeout = timeout,
+		.max_in_flight = MAX(max_in_flight, 1),
+	};
+	g_autoptr(GMainContext) context = NULL;
+#endif
+
+	g_return_val_if_fail (FU_IS_USB_DEVICE (self), FALSE);
+	g_return_val_if_fail (chunks != NULL, FALSE);
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+#ifdef HAVE_GUSB
+	/* one at a time so that the trace is in order */
+	if (fu_io_trace_get_mode () != FU_IO_TRACE_MODE_NONE) {
+		for (guint i = 0; i < chunks->len; i++) {
+			FuChunk *chk = g_ptr_array_index (chunks, i);
+			guint8 *data = (endpoint & 0x80) > 0 ?
+				fu_chunk_get_data_out (chk) : (guint8 *) fu_chunk_get_data (chk);
+			if (!fu_usb_device_bulk_transfer (self, endpoint, data,
+							  fu_chunk_get_data_sz (chk),
+							  NULL, timeout,
+							  cancellable, error)) {
+				g_prefix_error (error, "failed to transfer chunk %u @0x%x: ",
+						fu_chunk_get_idx (chk),
+						fu_chunk_get_address (chk));
+				return FALSE;
+			}
+			fu_device_set_progress_full (FU_DEVICE (self), i + 1, chunks->len);
+		}
+		return TRUE;
+	}
+
+	/* completions are dispatched to this thread, whatever else is running */
+	context = g_main_context_new ();
+	g_main_context_push_thread_default (context);
+	helper.cancellable = g_cancellable_new ();
+	if (cancellable != NULL) {
+		handler_id = g_cancellable_connect (cancellable,
+						    G_CALLBACK (fu_usb_device_chunks_cancelled_cb),
+						    helper.cancellable, NULL);
+	}
+	fu_usb_device_chunks_submit (&helper);
+	while (helper.in_flight > 0)
+		g_main_context_iteration (context, TRUE);
+	if (cancellable != NULL)
+		g_cancellable_disconnect (cancellable, handler_id);
+	g_object_unref (helper.cancellable);
+	g_main_context_pop_thread_default (context);
+	if (helper.error != NULL) {
+		g_propagate_error (error, helper.error);
+		return FALSE;
+	}
+
+	/* success */
+	for (guint i = 0; i < chunks->len; i++) {
+		FuChunk *chk = g_ptr_array_index (chunks, i);
+		total += fu_chunk_get_data_sz (chk);
+	}
+	elapsed = MAX(g_get_monotonic_time () - start, 1);
+	g_debug ("transferred 0x%x bytes in %u chunks with %u in flight in %.1fms (%.0f kB/s)",
+		 (guint) total, chunks->len, helper.max_in_flight,
+		 elapsed / 1000.f, (gdouble) total * 1000.f / elapsed);
+	return TRUE;
+#else
+	g_set_error_literal (error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_NOT_SUPPORTED,
+			     "Not supported as GUsb is unavailable");
+	return FALSE;
+#endif
+}
+
+/**
+ * fu_usb_device_set_bulk_transfer_funcs:
+ * @self: A #FuUsbDevice
+ * @async_func: (nullable): a #FuUsbDeviceBulkTransferAsyncFunc
+ * @finish_func: (nullable): a #FuUsbDeviceBulkTransferFinishFunc
+ *
+ * Replaces the asynchronous bulk transfers used by
+ * fu_usb_device_bulk_transfer_chunks(), which is only useful in the self tests.
+ *
+ * Since: 1.6.0
+ **/
+void
+fu_usb_device_set_bulk_transfer_funcs (FuUsbDevice *self,
+				       FuUsbDeviceBulkTransferAsyncFunc async_func,
+				       FuUsbDeviceBulkTransferFinishFunc finish_func)
+{
+	FuUsbDevicePrivate *priv = GET_PRIVATE (self);
+	g_return_if_fail (FU_IS_USB_DEVICE (self));
+	priv->bulk_transfer_async = async_func;
+	priv->bulk_transfer_finish = finish_func;
+}
+
 static void
 fu_usb_device_incorporate (FuDevice *self, FuDevice *donor)
 {
@@ -13,6 +13,7 @@ void
 fu_plugin_init (FuPlugin *plugin)
 {
 	fu_plugin_set_build_hash (plugin, FU_BUILD_HASH);
+	fu_plugin_add_internal_flag (plugin, FU_PLUGIN_INTERNAL_FLAG_THREADSAFE_SECURITY_ATTRS);
 }
 
 void
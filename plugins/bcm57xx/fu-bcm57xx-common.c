@@ -9,7 +9,9 @@
 
 #include <string.h>
 
+#include "fu-chunk.h"
 #include "fu-common.h"
+#include "fu-metrics.h"
 
 #include "fu-bcm57xx-common.h"
 
@@ -70,6 +72,62 @@ fu_bcm57xx_verify_magic (GBytes *fw, gsize offset, GError **error)
 	return TRUE;
 }
 
+/* returns the pages of @fw_new that are different to @fw_old, with runs of
+ * changed pages merged into chunks no larger than @chunk_sz_max; the chunk
+ * data points into @fw_new which has to outlive the array */
+GPtrArray *
+fu_bcm57xx_nvram_diff (GBytes *fw_old, GBytes *fw_new, gsize chunk_sz_max)
+{
+	gsize bufsz_old = 0;
+	gsize bufsz_new = 0;
+	gsize run_start = G_MAXSIZE;
+	const guint8 *buf_old = g_bytes_get_data (fw_old, &bufsz_old);
+	const guint8 *buf_new = g_bytes_get_data (fw_new, &bufsz_new);
+	GPtrArray *chunks = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+
+	for (gsize addr = 0; addr < bufsz_new; addr += BCM_NVRAM_PAGE_SZ) {
+		gsize sz = MIN(BCM_NVRAM_PAGE_SZ, bufsz_new - addr);
+		gboolean changed = addr + sz > bufsz_old ||
+				   memcmp (buf_old + addr, buf_new + addr, sz) != 0;
+
+		/* finish the current run */
+		if (run_start != G_MAXSIZE &&
+		    (!changed || addr - run_start >= chunk_sz_max)) {
+			g_ptr_array_add (chunks,
+					 fu_chunk_new (chunks->len, 0x0, run_start,
+						       buf_new + run_start,
+						       addr - run_start));
+			run_start = G_MAXSIZE;
+		}
+		if (changed && run_start == G_MAXSIZE)
+			run_start = addr;
+	}
+	if (run_start != G_MAXSIZE) {
+		g_ptr_array_add (chunks,
+				 fu_chunk_new (chunks->len, 0x0, run_start,
+					       buf_new + run_start,
+					       bufsz_new - run_start));
+	}
+	return chunks;
+}
+
+void
+fu_bcm57xx_nvram_diff_report (GBytes *fw_new, GPtrArray *chunks)
+{
+	gsize bufsz = g_bytes_get_size (fw_new);
+	gsize bufsz_write = 0;
+
+	for (guint i = 0; i < chunks->len; i++) {
+		FuChunk *chk = g_ptr_array_index (chunks, i);
+		bufsz_write += fu_chunk_get_data_sz (chk);
+	}
+	g_debug ("writing 0x%x of 0x%x bytes in %u chunks, saving 0x%x bytes",
+		 (guint) bufsz_write, (guint) bufsz, chunks->len,
+		 (guint) (bufsz - bufsz_write));
+	fu_metrics_add_counter ("plugin.bcm57xx.nvram-bytes-written", bufsz_write);
+	fu_metrics_add_counter ("plugin.bcm57xx.nvram-bytes-saved", bufsz - bufsz_write);
+}
+
 void
 fu_bcm57xx_veritem_free (Bcm57xxVeritem *veritem)
 {
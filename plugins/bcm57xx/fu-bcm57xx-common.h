@@ -18,6 +18,7 @@
 #define BCM_PHYS_ADDR_DEFAULT			0x08003800
 
 #define BCM_NVRAM_MAGIC				0x669955AA
+#define BCM_NVRAM_PAGE_SZ			0x100
 
 /* offsets into NVMRAM */
 #define BCM_NVRAM_HEADER_BASE			0x00
@@ -64,6 +65,11 @@ gboolean	 fu_bcm57xx_verify_crc		(GBytes		*fw,
 gboolean	 fu_bcm57xx_verify_magic	(GBytes		*fw,
 						 gsize		 offset,
 						 GError		**error);
+GPtrArray	*fu_bcm57xx_nvram_diff		(GBytes		*fw_old,
+						 GBytes		*fw_new,
+						 gsize		 chunk_sz_max);
+void		 fu_bcm57xx_nvram_diff_report	(GBytes		*fw_new,
+						 GPtrArray	*chunks);
 
 /* parses stage1 version */
 void		 fu_bcm57xx_veritem_free	(Bcm57xxVeritem	*veritem);
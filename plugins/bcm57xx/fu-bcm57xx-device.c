@@ -34,12 +34,15 @@
 #include "fu-bcm57xx-dict-image.h"
 
 #define FU_BCM57XX_BLOCK_SZ		0x4000 /* 16kb */
+#define FU_BCM57XX_READ_BLOCK_SZ	0x10000 /* 64kb */
 
 struct _FuBcm57xxDevice {
 	FuUdevDevice		 parent_instance;
 	FuBcm57xxRecoveryDevice	*recovery;
 	gchar			*ethtool_iface;
 	int			 ethtool_fd;
+	guint8			*eeprom_buf;	/* reused for every request */
+	gsize			 eeprom_bufsz;
 };
 
 G_DEFINE_TYPE (FuBcm57xxDevice, fu_bcm57xx_device, FU_TYPE_UDEV_DEVICE)
@@ -96,6 +99,21 @@ fu_bcm57xx_device_probe (FuDevice *device, GError **error)
 	return fu_udev_device_set_physical_id (FU_UDEV_DEVICE (device), "pci", error);
 }
 
+#ifdef HAVE_ETHTOOL_H
+static struct ethtool_eeprom *
+fu_bcm57xx_device_get_eeprom (FuBcm57xxDevice *self, gsize bufsz)
+{
+	gsize eepromsz = sizeof(struct ethtool_eeprom) + bufsz;
+	if (eepromsz > self->eeprom_bufsz) {
+		g_free (self->eeprom_buf);
+		self->eeprom_buf = g_malloc0 (eepromsz);
+		self->eeprom_bufsz = eepromsz;
+	}
+	memset (self->eeprom_buf, 0x0, sizeof(struct ethtool_eeprom));
+	return (struct ethtool_eeprom *) self->eeprom_buf;
+}
+#endif
+
 static gboolean
 fu_bcm57xx_device_nvram_write (FuBcm57xxDevice *self,
 			       guint32 address,
@@ -104,10 +122,9 @@ fu_bcm57xx_device_nvram_write (FuBcm57xxDevice *self,
 			       GError **error)
 {
 #ifdef HAVE_ETHTOOL_H
-	gsize eepromsz;
 	gint rc = -1;
 	struct ifreq ifr = { 0 };
-	g_autofree struct ethtool_eeprom *eeprom = NULL;
+	struct ethtool_eeprom *eeprom;
 
 	/* failed to load tg3 */
 	if (self->ethtool_iface == NULL) {
@@ -129,8 +146,7 @@ fu_bcm57xx_device_nvram_write (FuBcm57xxDevice *self,
 	}
 
 	/* write EEPROM (NVRAM) data */
-	eepromsz = sizeof(struct ethtool_eeprom) + bufsz;
-	eeprom = (struct ethtool_eeprom *) g_malloc0 (eepromsz);
+	eeprom = fu_bcm57xx_device_get_eeprom (self, bufsz);
 	eeprom->cmd = ETHTOOL_SEEPROM;
 	eeprom->magic = BCM_NVRAM_MAGIC;
 	eeprom->len = bufsz;
@@ -177,7 +193,7 @@ fu_bcm57xx_device_nvram_read (FuBcm57xxDevice *self,
 	gsize eepromsz;
 	gint rc = -1;
 	struct ifreq ifr = { 0 };
-	g_autofree struct ethtool_eeprom *eeprom = NULL;
+	struct ethtool_eeprom *eeprom;
 
 	/* failed to load tg3 */
 	if (self->ethtool_iface == NULL) {
@@ -200,7 +216,7 @@ fu_bcm57xx_device_nvram_read (FuBcm57xxDevice *self,
 
 	/* read EEPROM (NVRAM) data */
 	eepromsz = sizeof(struct ethtool_eeprom) + bufsz;
-	eeprom = (struct ethtool_eeprom *) g_malloc0 (eepromsz);
+	eeprom = fu_bcm57xx_device_get_eeprom (self, bufsz);
 	eeprom->cmd = ETHTOOL_GEEPROM;
 	eeprom->len = bufsz;
 	eeprom->offset = address;
@@ -345,7 +361,7 @@ fu_bcm57xx_device_dump_firmware (FuDevice *device, GError **error)
 	g_autoptr(GPtrArray) chunks = NULL;
 
 	fu_device_set_status (device, FWUPD_STATUS_DEVICE_READ);
-	chunks = fu_chunk_array_mutable_new (buf, bufsz, 0x0, 0x0, FU_BCM57XX_BLOCK_SZ);
+	chunks = fu_chunk_array_mutable_new (buf, bufsz, 0x0, 0x0, FU_BCM57XX_READ_BLOCK_SZ);
 	for (guint i = 0; i < chunks->len; i++) {
 		FuChunk *chk = g_ptr_array_index (chunks, i);
 		if (!fu_bcm57xx_device_nvram_read (self, fu_chunk_get_address (chk),
@@ -353,7 +369,7 @@ fu_bcm57xx_device_dump_firmware (FuDevice *device, GError **error)
 						   fu_chunk_get_data_sz (chk),
 						   error))
 			return NULL;
-		fu_device_set_progress_full (device, i, chunks->len - 1);
+		fu_device_set_progress_full (device, i + 1, chunks->len);
 	}
 
 	/* read from hardware */
@@ -473,7 +489,7 @@ fu_bcm57xx_device_write_firmware (FuDevice *device,
 {
 	FuBcm57xxDevice *self = FU_BCM57XX_DEVICE (device);
 	g_autoptr(GBytes) blob = NULL;
-	g_autoptr(GBytes) blob_verify = NULL;
+	g_autoptr(GBytes) blob_old = NULL;
 	g_autoptr(GPtrArray) chunks = NULL;
 
 	/* build the images into one linear blob of the correct size */
@@ -482,9 +498,15 @@ fu_bcm57xx_device_write_firmware (FuDevice *device,
 	if (blob == NULL)
 		return FALSE;
 
+	/* only write the pages that have changed */
+	blob_old = fu_bcm57xx_device_dump_firmware (device, error);
+	if (blob_old == NULL)
+		return FALSE;
+	chunks = fu_bcm57xx_nvram_diff (blob_old, blob, FU_BCM57XX_BLOCK_SZ);
+	fu_bcm57xx_nvram_diff_report (blob, chunks);
+
 	/* hit hardware */
 	fu_device_set_status (device, FWUPD_STATUS_DEVICE_WRITE);
-	chunks = fu_chunk_array_new_from_bytes (blob, 0x0, 0x0, FU_BCM57XX_BLOCK_SZ);
 	for (guint i = 0; i < chunks->len; i++) {
 		FuChunk *chk = g_ptr_array_index (chunks, i);
 		if (!fu_bcm57xx_device_nvram_write (self, fu_chunk_get_address (chk),
@@ -492,16 +514,28 @@ fu_bcm57xx_device_write_firmware (FuDevice *device,
 						    fu_chunk_get_data_sz (chk),
 						    error))
 			return FALSE;
-		fu_device_set_progress_full (device, i, chunks->len - 1);
+		fu_device_set_progress_full (device, i + 1, chunks->len);
 	}
 
-	/* verify */
+	/* verify what was written */
 	fu_device_set_status (device, FWUPD_STATUS_DEVICE_VERIFY);
-	blob_verify = fu_bcm57xx_device_dump_firmware (device, error);
-	if (blob_verify == NULL)
-		return FALSE;
-	if (!fu_common_bytes_compare (blob, blob_verify, error))
-		return FALSE;
+	for (guint i = 0; i < chunks->len; i++) {
+		FuChunk *chk = g_ptr_array_index (chunks, i);
+		g_autofree guint8 *buf = g_malloc0 (fu_chunk_get_data_sz (chk));
+		if (!fu_bcm57xx_device_nvram_read (self, fu_chunk_get_address (chk),
+						   buf, fu_chunk_get_data_sz (chk),
+						   error))
+			return FALSE;
+		if (!fu_common_bytes_compare_raw (fu_chunk_get_data (chk),
+						  fu_chunk_get_data_sz (chk),
+						  buf, fu_chunk_get_data_sz (chk),
+						  error)) {
+			g_prefix_error (error, "failed to verify @0x%x: ",
+					fu_chunk_get_address (chk));
+			return FALSE;
+		}
+		fu_device_set_progress_full (device, i + 1, chunks->len);
+	}
 
 	/* reset APE */
 	return fu_device_activate (device, error);
@@ -627,6 +661,7 @@ fu_bcm57xx_device_finalize (GObject *object)
 {
 	FuBcm57xxDevice *self= FU_BCM57XX_DEVICE (object);
 	g_free (self->ethtool_iface);
+	g_free (self->eeprom_buf);
 	G_OBJECT_CLASS (fu_bcm57xx_device_parent_class)->finalize (object);
 }
 
@@ -22,6 +22,7 @@
 #endif /* HAVE_VALGRIND */
 
 #include "fu-common.h"
+#include "fu-chunk.h"
 
 #include "fu-bcm57xx-common.h"
 #include "fu-bcm57xx-recovery-device.h"
@@ -505,6 +506,8 @@ fu_bcm57xx_recovery_device_write_firmware (FuDevice *device,
 	g_autoptr(FuDeviceLocker) locker = NULL;
 	g_autoptr(FuDeviceLocker) locker2 = NULL;
 	g_autoptr(GBytes) blob = NULL;
+	g_autoptr(GBytes) blob_old = NULL;
+	g_autoptr(GPtrArray) chunks = NULL;
 
 	/* build the images into one linear blob of the correct size */
 	fu_device_set_status (device, FWUPD_STATUS_DECOMPRESSING);
@@ -512,6 +515,13 @@ fu_bcm57xx_recovery_device_write_firmware (FuDevice *device,
 	if (blob == NULL)
 		return FALSE;
 
+	/* only write the pages that have changed, in whole pages */
+	blob_old = fu_bcm57xx_recovery_device_dump_firmware (device, error);
+	if (blob_old == NULL)
+		return FALSE;
+	chunks = fu_bcm57xx_nvram_diff (blob_old, blob, 0x40 * BCM_NVRAM_PAGE_SZ);
+	fu_bcm57xx_nvram_diff_report (blob, chunks);
+
 	/* align into uint32_t buffer */
 	buf = g_bytes_get_data (blob, &bufsz);
 	bufsz_dwrds = bufsz / sizeof(guint32);
@@ -535,8 +545,15 @@ fu_bcm57xx_recovery_device_write_firmware (FuDevice *device,
 					     error);
 	if (locker2 == NULL)
 		return FALSE;
-	if (!fu_bcm57xx_recovery_device_nvram_write (self, 0x0, buf_dwrds, bufsz_dwrds, error))
-		return FALSE;
+	for (guint i = 0; i < chunks->len; i++) {
+		FuChunk *chk = g_ptr_array_index (chunks, i);
+		guint32 addr = fu_chunk_get_address (chk);
+		if (!fu_bcm57xx_recovery_device_nvram_write (self, addr,
+							     buf_dwrds + (addr / sizeof(guint32)),
+							     fu_chunk_get_data_sz (chk) / sizeof(guint32),
+							     error))
+			return FALSE;
+	}
 	if (!fu_device_locker_close (locker2, error))
 		return FALSE;
 	if (!fu_device_locker_close (locker, error))
@@ -9,6 +9,7 @@
 #include <fwupd.h>
 #include <string.h>
 
+#include "fu-chunk.h"
 #include "fu-common.h"
 #include "fu-bcm57xx-common.h"
 #include "fu-bcm57xx-dict-image.h"
@@ -52,6 +53,39 @@ fu_bcm57xx_common_veritem_func (void)
 	g_assert_cmpint (veritem3->verfmt, ==, FWUPD_VERSION_FORMAT_UNKNOWN);
 }
 
+static void
+fu_bcm57xx_common_nvram_diff_func (void)
+{
+	FuChunk *chk;
+	guint8 buf_new[0x1000] = { 0x0 };
+	g_autoptr(GBytes) fw_old = NULL;
+	g_autoptr(GBytes) fw_new = NULL;
+	g_autoptr(GPtrArray) chunks = NULL;
+
+	/* change one page, then a run of four pages */
+	buf_new[0x1ff] = 0xff;
+	memset (buf_new + 0x300, 0xaa, 0x400);
+	fw_old = g_bytes_new_take (g_malloc0 (sizeof(buf_new)), sizeof(buf_new));
+	fw_new = g_bytes_new_static (buf_new, sizeof(buf_new));
+	chunks = fu_bcm57xx_nvram_diff (fw_old, fw_new, 0x200);
+	g_assert_cmpint (chunks->len, ==, 3);
+	chk = g_ptr_array_index (chunks, 0);
+	g_assert_cmpint (fu_chunk_get_address (chk), ==, 0x100);
+	g_assert_cmpint (fu_chunk_get_data_sz (chk), ==, 0x100);
+	g_assert_true (fu_chunk_get_data (chk) == buf_new + 0x100);
+	chk = g_ptr_array_index (chunks, 1);
+	g_assert_cmpint (fu_chunk_get_address (chk), ==, 0x300);
+	g_assert_cmpint (fu_chunk_get_data_sz (chk), ==, 0x200);
+	chk = g_ptr_array_index (chunks, 2);
+	g_assert_cmpint (fu_chunk_get_address (chk), ==, 0x500);
+	g_assert_cmpint (fu_chunk_get_data_sz (chk), ==, 0x200);
+
+	/* nothing changed */
+	g_ptr_array_unref (chunks);
+	chunks = fu_bcm57xx_nvram_diff (fw_new, fw_new, 0x200);
+	g_assert_cmpint (chunks->len, ==, 0);
+}
+
 static void
 fu_bcm57xx_firmware_talos_func (void)
 {
@@ -142,5 +176,6 @@ main (int argc, char **argv)
 	g_test_add_func ("/fwupd/bcm57xx/firmware{xml}", fu_bcm57xx_firmware_xml_func);
 	g_test_add_func ("/fwupd/bcm57xx/firmware{talos}", fu_bcm57xx_firmware_talos_func);
 	g_test_add_func ("/fwupd/bcm57xx/common{veritem}", fu_bcm57xx_common_veritem_func);
+	g_test_add_func ("/fwupd/bcm57xx/common{nvram-diff}", fu_bcm57xx_common_nvram_diff_func);
 	return g_test_run ();
 }
@@ -15,6 +15,7 @@
 
 #define FASTBOOT_REMOVE_DELAY_RE_ENUMERATE	60000 /* ms */
 #define FASTBOOT_TRANSACTION_TIMEOUT		1000 /* ms */
+#define FASTBOOT_TRANSFERS_IN_FLIGHT		8
 #define FASTBOOT_TRANSACTION_RETRY_MAX		600
 #define FASTBOOT_EP_IN				0x81
 #define FASTBOOT_EP_OUT				0x01
@@ -282,20 +283,20 @@ fu_fastboot_device_download (FuDevice *device, GBytes *fw, GError **error)
 				     error))
 		return FALSE;
 
-	/* send the data in chunks */
+	/* send the data in chunks; the flash that follows only reports INFO
+	 * status changes, so the download is the whole of the write progress */
 	fu_device_set_status (device, FWUPD_STATUS_DEVICE_WRITE);
 	chunks = fu_chunk_array_new_from_bytes (fw,
 						0x00,	/* start addr */
 						0x00,	/* page_sz */
 						self->blocksz);
-	for (guint i = 0; i < chunks->len; i++) {
-		FuChunk *chk = g_ptr_array_index (chunks, i);
-		if (!fu_fastboot_device_write (device,
-					       fu_chunk_get_data (chk),
-					       fu_chunk_get_data_sz (chk),
-					       error))
-			return FALSE;
-		fu_device_set_progress_full (device, (gsize) i, (gsize) chunks->len * 2);
+	if (!fu_usb_device_bulk_transfer_chunks (FU_USB_DEVICE (device),
+						 FASTBOOT_EP_OUT, chunks,
+						 FASTBOOT_TRANSFERS_IN_FLIGHT,
+						 FASTBOOT_TRANSACTION_TIMEOUT,
+						 NULL, error)) {
+		g_prefix_error (error, "failed to download: ");
+		return FALSE;
 	}
 	if (!fu_fastboot_device_read (device, NULL,
 				      FU_FASTBOOT_DEVICE_READ_FLAG_STATUS_POLL, error))
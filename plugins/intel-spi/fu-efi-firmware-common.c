@@ -14,6 +14,160 @@
 #include "fu-efi-firmware-common.h"
 #include "fu-efi-firmware-section.h"
 
+/* decompressed payloads are kept so that identical sections, e.g. in a
+ * backup region, are not decompressed twice; the cache is flushed when the
+ * last section is finalized so it only lives as long as the firmware */
+#define FU_EFI_FIRMWARE_DECOMPRESS_BUDGET_DEFAULT	0x2000000	/* bytes */
+
+static GMutex		 decompress_mutex;
+static GHashTable	*decompress_cache = NULL;	/* GBytes:compressed -> GBytes */
+static GQueue		 decompress_lru = G_QUEUE_INIT;	/* GBytes:compressed, newest first */
+static gsize		 decompress_cache_sz = 0;
+static guint		 decompress_cache_users = 0;
+static gsize		 decompress_budget = FU_EFI_FIRMWARE_DECOMPRESS_BUDGET_DEFAULT;
+
+typedef struct {
+	FuFirmware		*img;
+	GBytes			*fw;
+	guint64			 offset;
+	FwupdInstallFlags	 flags;
+	GError			*error;
+} FuEfiFirmwareParseJob;
+
+static GPrivate		 parse_worker = G_PRIVATE_INIT (NULL);
+static gint		 parse_max_threads = 0;	/* 0 is the number of CPUs */
+
+/**
+ * fu_efi_firmware_set_max_threads:
+ * @max_threads: maximum number of worker threads, 1 to parse serially, or 0 to
+ * use the number of processors
+ *
+ * Sets the number of threads used to parse sibling images.
+ **/
+void
+fu_efi_firmware_set_max_threads (guint max_threads)
+{
+	g_atomic_int_set (&parse_max_threads, max_threads);
+}
+
+/**
+ * fu_efi_firmware_get_max_threads:
+ *
+ * Gets the number of threads used to parse sibling images.
+ *
+ * Returns: maximum number of worker threads, or 0 for the number of processors
+ **/
+guint
+fu_efi_firmware_get_max_threads (void)
+{
+	return g_atomic_int_get (&parse_max_threads);
+}
+
+static void
+fu_efi_firmware_parse_worker_cb (gpointer data, gpointer user_data)
+{
+	FuEfiFirmwareParseJob *job = (FuEfiFirmwareParseJob *) data;
+
+	/* nested images are parsed serially in this thread */
+	g_private_set (&parse_worker, GINT_TO_POINTER (TRUE));
+	if (!fu_firmware_parse (job->img, job->fw, job->flags, &job->error))
+		g_prefix_error (&job->error, "failed to parse @0x%x: ", (guint) job->offset);
+	fu_firmware_set_offset (job->img, job->offset);
+	g_private_set (&parse_worker, NULL);
+}
+
+/**
+ * fu_efi_firmware_parse_images:
+ * @imgs: (element-type FuFirmware): images
+ * @blobs: (element-type GBytes): data for each image
+ * @flags: some #FwupdInstallFlags
+ * @error: A #GError, or %NULL
+ *
+ * Parses independent sibling images, e.g. the sections or files of an FFS,
+ * which may require decompression. If the images are not being parsed lazily
+ * they are parsed using a bounded pool of worker threads. The first error in
+ * image order is returned, so the result is the same as when parsing serially.
+ *
+ * The offset of each image is set by the caller and preserved.
+ *
+ * Returns: %TRUE for success
+ **/
+gboolean
+fu_efi_firmware_parse_images (GPtrArray *imgs,
+			      GPtrArray *blobs,
+			      FwupdInstallFlags flags,
+			      GError **error)
+{
+	guint max_threads = g_atomic_int_get (&parse_max_threads);
+	g_autofree FuEfiFirmwareParseJob *jobs = NULL;
+	GThreadPool *pool;
+
+	g_return_val_if_fail (imgs->len == blobs->len, FALSE);
+
+	if (max_threads == 0)
+		max_threads = g_get_num_processors ();
+	max_threads = MIN(max_threads, imgs->len);
+
+	/* serial, either as lazy, nested, or no benefit */
+	if ((flags & FWUPD_INSTALL_FLAG_LAZY_PARSE) > 0 ||
+	    g_private_get (&parse_worker) != NULL ||
+	    max_threads <= 1) {
+		for (guint i = 0; i < imgs->len; i++) {
+			FuFirmware *img = g_ptr_array_index (imgs, i);
+			GBytes *blob = g_ptr_array_index (blobs, i);
+			guint64 offset = fu_firmware_get_offset (img);
+			if (!fu_firmware_parse_lazy (img, blob, flags, error)) {
+				g_prefix_error (error, "failed to parse @0x%x: ", (guint) offset);
+				return FALSE;
+			}
+			fu_firmware_set_offset (img, offset);
+		}
+		return TRUE;
+	}
+
+	/* each job only writes to its own image */
+	pool = g_thread_pool_new (fu_efi_firmware_parse_worker_cb, NULL,
+				  max_threads, FALSE, error);
+	if (pool == NULL)
+		return FALSE;
+	jobs = g_new0 (FuEfiFirmwareParseJob, imgs->len);
+	for (guint i = 0; i < imgs->len; i++) {
+		jobs[i].img = g_ptr_array_index (imgs, i);
+		jobs[i].fw = g_ptr_array_index (blobs, i);
+		jobs[i].offset = fu_firmware_get_offset (jobs[i].img);
+		jobs[i].flags = flags;
+	}
+	for (guint i = 0; i < imgs->len; i++) {
+		g_autoptr(GError) error_local = NULL;
+		if (g_thread_pool_push (pool, &jobs[i], &error_local))
+			continue;
+
+		/* no more threads, so parse what is left in this one */
+		g_debug ("parsing %u images serially: %s",
+			 imgs->len - i, error_local->message);
+		g_thread_pool_free (pool, FALSE, TRUE);
+		pool = NULL;
+		for (guint j = i; j < imgs->len; j++)
+			fu_efi_firmware_parse_worker_cb (&jobs[j], NULL);
+		break;
+	}
+	if (pool != NULL)
+		g_thread_pool_free (pool, FALSE, TRUE);
+
+	/* reassemble in order */
+	for (guint i = 0; i < imgs->len; i++) {
+		if (jobs[i].error != NULL) {
+			g_propagate_error (error, g_steal_pointer (&jobs[i].error));
+			for (guint j = i + 1; j < imgs->len; j++)
+				g_clear_error (&jobs[j].error);
+			return FALSE;
+		}
+	}
+
+	/* success */
+	return TRUE;
+}
+
 gboolean
 fu_efi_firmware_parse_sections (FuFirmware *firmware,
 				GBytes *fw,
@@ -21,41 +175,176 @@ fu_efi_firmware_parse_sections (FuFirmware *firmware,
 				GError **error)
 {
 	gsize offset = 0;
-	gsize bufsz = g_bytes_get_size (fw);
+	gsize bufsz = 0;
+	const guint8 *buf = g_bytes_get_data (fw, &bufsz);
+	g_autoptr(GPtrArray) imgs = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+	g_autoptr(GPtrArray) blobs = g_ptr_array_new_with_free_func ((GDestroyNotify) g_bytes_unref);
 
+	/* only the section header is needed to find the next section */
 	while (offset < bufsz) {
+		guint32 size = 0;
 		g_autoptr(FuFirmware) img = fu_efi_firmware_section_new ();
 		g_autoptr(GBytes) blob = NULL;
 
-		/* maximum payload */
-		blob = fu_common_bytes_new_offset (fw, offset, bufsz - offset, error);
-		if (blob == NULL)
+		if (!fu_common_read_uint32_safe (buf, bufsz, offset, /* uint24_t! */
+						 &size, G_LITTLE_ENDIAN, error))
 			return FALSE;
-
-		/* parse section */
-		if (!fu_firmware_parse (img, blob, flags, error))
+		size &= 0xFFFFFF;
+		if (size < FU_EFI_FIRMWARE_SECTION_SIZE) {
+			g_set_error (error,
+				     FWUPD_ERROR,
+				     FWUPD_ERROR_INTERNAL,
+				     "invalid section size, got 0x%x",
+				     (guint) size);
 			return FALSE;
+		}
+		blob = fu_common_bytes_new_offset (fw, offset, size, error);
+		if (blob == NULL) {
+			g_prefix_error (error, "EFI sections overflow: ");
+			return FALSE;
+		}
 		fu_firmware_set_offset (img, offset);
-		fu_firmware_add_image (firmware, img);
+		g_ptr_array_add (imgs, g_steal_pointer (&img));
+		g_ptr_array_add (blobs, g_steal_pointer (&blob));
 
 		/* next! */
-		offset += fu_firmware_get_size (img);
+		offset += size;
 	}
-	if (offset != g_bytes_get_size (fw)) {
-		g_set_error (error,
-			     FWUPD_ERROR,
-			     FWUPD_ERROR_INTERNAL,
-			     "EFI sections overflow 0x%x of 0x%x",
-			     (guint) offset, (guint) g_bytes_get_size (fw));
+
+	/* parse sections, possibly only when required */
+	if (!fu_efi_firmware_parse_images (imgs, blobs, flags, error))
 		return FALSE;
+	for (guint i = 0; i < imgs->len; i++) {
+		FuFirmware *img = g_ptr_array_index (imgs, i);
+		fu_firmware_add_image (firmware, img);
 	}
 
 	/* success */
 	return TRUE;
 }
 
-GBytes *
-fu_efi_firmware_decompress_lzma (GBytes *blob, GError **error)
+/* must be called with decompress_mutex held */
+static void
+fu_efi_firmware_decompress_cache_evict (gsize budget)
+{
+	while (decompress_cache_sz > budget) {
+		GBytes *key = g_queue_pop_tail (&decompress_lru);
+		GBytes *value;
+		if (key == NULL)
+			break;
+		value = g_hash_table_lookup (decompress_cache, key);
+		decompress_cache_sz -= g_bytes_get_size (key) + g_bytes_get_size (value);
+		g_hash_table_remove (decompress_cache, key);
+	}
+}
+
+static GBytes *
+fu_efi_firmware_decompress_cache_lookup (GBytes *blob)
+{
+	GBytes *key = NULL;
+	GBytes *value = NULL;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&decompress_mutex);
+
+	if (decompress_cache == NULL)
+		return NULL;
+	if (!g_hash_table_lookup_extended (decompress_cache, blob,
+					   (gpointer *) &key,
+					   (gpointer *) &value))
+		return NULL;
+
+	/* most recently used */
+	g_queue_remove (&decompress_lru, key);
+	g_queue_push_head (&decompress_lru, key);
+	return g_bytes_ref (value);
+}
+
+static void
+fu_efi_firmware_decompress_cache_insert (GBytes *blob, GBytes *blob_uncomp)
+{
+	gsize sz = g_bytes_get_size (blob) + g_bytes_get_size (blob_uncomp);
+	GBytes *key;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&decompress_mutex);
+
+	/* would never fit */
+	if (sz > decompress_budget)
+		return;
+	if (decompress_cache == NULL) {
+		decompress_cache = g_hash_table_new_full (g_bytes_hash, g_bytes_equal,
+							  (GDestroyNotify) g_bytes_unref,
+							  (GDestroyNotify) g_bytes_unref);
+	}
+	if (g_hash_table_contains (decompress_cache, blob))
+		return;
+
+	/* copy the key so the entire parent image is not kept alive */
+	key = g_bytes_new (g_bytes_get_data (blob, NULL), g_bytes_get_size (blob));
+	g_hash_table_insert (decompress_cache, key, g_bytes_ref (blob_uncomp));
+	g_queue_push_head (&decompress_lru, key);
+	decompress_cache_sz += sz;
+	fu_efi_firmware_decompress_cache_evict (decompress_budget);
+}
+
+/**
+ * fu_efi_firmware_set_decompress_budget:
+ * @budget: maximum size in bytes, or 0 to disable the cache
+ *
+ * Sets the maximum amount of memory used to cache decompressed sections.
+ **/
+void
+fu_efi_firmware_set_decompress_budget (gsize budget)
+{
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&decompress_mutex);
+	decompress_budget = budget;
+	if (decompress_cache != NULL)
+		fu_efi_firmware_decompress_cache_evict (budget);
+}
+
+/**
+ * fu_efi_firmware_decompress_cache_ref:
+ *
+ * Registers a user of the decompression cache, typically a section.
+ **/
+void
+fu_efi_firmware_decompress_cache_ref (void)
+{
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&decompress_mutex);
+	decompress_cache_users++;
+}
+
+/**
+ * fu_efi_firmware_decompress_cache_unref:
+ *
+ * Unregisters a user of the decompression cache, flushing it when there are
+ * no users left.
+ **/
+void
+fu_efi_firmware_decompress_cache_unref (void)
+{
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&decompress_mutex);
+	g_return_if_fail (decompress_cache_users > 0);
+	if (--decompress_cache_users > 0)
+		return;
+	g_queue_clear (&decompress_lru);
+	g_clear_pointer (&decompress_cache, g_hash_table_unref);
+	decompress_cache_sz = 0;
+}
+
+/**
+ * fu_efi_firmware_get_decompress_budget:
+ *
+ * Gets the maximum amount of memory used to cache decompressed sections.
+ *
+ * Returns: size in bytes
+ **/
+gsize
+fu_efi_firmware_get_decompress_budget (void)
+{
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&decompress_mutex);
+	return decompress_budget;
+}
+
+static GBytes *
+fu_efi_firmware_decompress_lzma_raw (GBytes *blob, GError **error)
 {
 #ifdef HAVE_LZMA
 	const gsize tmpbufsz = 0x20000;
@@ -104,3 +393,20 @@ fu_efi_firmware_decompress_lzma (GBytes *blob, GError **error)
 	return NULL;
 #endif
 }
+
+GBytes *
+fu_efi_firmware_decompress_lzma (GBytes *blob, GError **error)
+{
+	g_autoptr(GBytes) blob_uncomp = NULL;
+
+	/* already done */
+	blob_uncomp = fu_efi_firmware_decompress_cache_lookup (blob);
+	if (blob_uncomp != NULL)
+		return g_steal_pointer (&blob_uncomp);
+
+	blob_uncomp = fu_efi_firmware_decompress_lzma_raw (blob, error);
+	if (blob_uncomp == NULL)
+		return NULL;
+	fu_efi_firmware_decompress_cache_insert (blob, blob_uncomp);
+	return g_steal_pointer (&blob_uncomp);
+}
@@ -8,9 +8,19 @@
 
 #include "fu-firmware.h"
 
+gboolean	fu_efi_firmware_parse_images		(GPtrArray	*imgs,
+							 GPtrArray	*blobs,
+							 FwupdInstallFlags flags,
+							 GError		**error);
 gboolean	fu_efi_firmware_parse_sections		(FuFirmware	*firmware,
 							 GBytes		*fw,
 							 FwupdInstallFlags flags,
 							 GError		**error);
 GBytes		*fu_efi_firmware_decompress_lzma	(GBytes		*fw,
 							 GError		**error);
+void		 fu_efi_firmware_decompress_cache_ref	(void);
+void		 fu_efi_firmware_decompress_cache_unref	(void);
+gsize		 fu_efi_firmware_get_decompress_budget	(void);
+void		 fu_efi_firmware_set_decompress_budget	(gsize		 budget);
+guint		 fu_efi_firmware_get_max_threads	(void);
+void		 fu_efi_firmware_set_max_threads	(guint		 max_threads);
@@ -7,6 +7,7 @@
 #include "config.h"
 
 #include "fu-common.h"
+#include "fu-efi-firmware-common.h"
 #include "fu-efi-firmware-file.h"
 #include "fu-efi-firmware-filesystem.h"
 
@@ -32,11 +33,15 @@ fu_efi_firmware_filesystem_parse (FuFirmware *firmware,
 	gsize offset = 0;
 	gsize bufsz = 0x0;
 	const guint8 *buf = g_bytes_get_data (fw, &bufsz);
+	g_autoptr(GPtrArray) imgs = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+	g_autoptr(GPtrArray) blobs = g_ptr_array_new_with_free_func ((GDestroyNotify) g_bytes_unref);
 
+	/* find each file using just the header */
 	while (offset + 0x18 < bufsz) {
 		g_autoptr(FuFirmware) img = fu_efi_firmware_file_new ();
 		g_autoptr(GBytes) fw_tmp = NULL;
 		gboolean is_freespace = TRUE;
+		guint32 size = 0x0;
 
 		/* ignore free space */
 		for (guint i = 0; i < 0x18; i++) {
@@ -48,20 +53,38 @@ fu_efi_firmware_filesystem_parse (FuFirmware *firmware,
 		if (is_freespace)
 			break;
 
-		fw_tmp = fu_common_bytes_new_offset (fw, offset, bufsz - offset, error);
-		if (fw_tmp == NULL)
+		if (!fu_common_read_uint32_safe (buf, bufsz, offset + 0x14, /* uint24_t! */
+						 &size, G_LITTLE_ENDIAN, error))
 			return FALSE;
-		if (!fu_firmware_parse (img, fw_tmp, flags, error)) {
-			g_prefix_error (error,
-					"failed to parse EFI file at 0x%x: ",
-					(guint) offset);
+		size &= 0xFFFFFF;
+		if (size < 0x18) {
+			g_set_error (error,
+				     FWUPD_ERROR,
+				     FWUPD_ERROR_INTERNAL,
+				     "invalid FFS length at 0x%x, got 0x%x",
+				     (guint) offset, (guint) size);
 			return FALSE;
 		}
+		fw_tmp = fu_common_bytes_new_offset (fw, offset, size, error);
+		if (fw_tmp == NULL)
+			return FALSE;
 		fu_firmware_set_offset (firmware, offset);
-		fu_firmware_add_image (firmware, img);
+		fu_firmware_set_offset (img, offset);
 
 		/* next! */
-		offset += fu_firmware_get_size (img);
+		offset += fu_common_align_up (size, fu_firmware_get_alignment (img));
+		g_ptr_array_add (imgs, g_steal_pointer (&img));
+		g_ptr_array_add (blobs, g_steal_pointer (&fw_tmp));
+	}
+
+	/* the files are independent of each other */
+	if (!fu_efi_firmware_parse_images (imgs, blobs, flags, error)) {
+		g_prefix_error (error, "failed to parse EFI file: ");
+		return FALSE;
+	}
+	for (guint i = 0; i < imgs->len; i++) {
+		FuFirmware *img = g_ptr_array_index (imgs, i);
+		fu_firmware_add_image (firmware, img);
 	}
 
 	/* success */
@@ -22,7 +22,6 @@ G_DEFINE_TYPE_WITH_PRIVATE (FuEfiFirmwareSection, fu_efi_firmware_section, FU_TY
 
 #define FU_EFI_FIRMWARE_SECTION_OFFSET_SIZE			0x00
 #define FU_EFI_FIRMWARE_SECTION_OFFSET_TYPE			0x03
-#define FU_EFI_FIRMWARE_SECTION_SIZE				0x04
 
 /* only GUID defined */
 #define FU_EFI_FIRMWARE_SECTION_OFFSET_GUID_NAME		0x04
@@ -252,13 +251,23 @@ fu_efi_firmware_section_init (FuEfiFirmwareSection *self)
 {
 	FuEfiFirmwareSectionPrivate *priv = GET_PRIVATE (self);
 	priv->type = FU_EFI_FIRMWARE_SECTION_TYPE_RAW;
+	fu_efi_firmware_decompress_cache_ref ();
 //	fu_firmware_set_alignment (FU_FIRMWARE (self), FU_FIRMWARE_ALIGNMENT_8);
 }
 
+static void
+fu_efi_firmware_section_finalize (GObject *object)
+{
+	fu_efi_firmware_decompress_cache_unref ();
+	G_OBJECT_CLASS (fu_efi_firmware_section_parent_class)->finalize (object);
+}
+
 static void
 fu_efi_firmware_section_class_init (FuEfiFirmwareSectionClass *klass)
 {
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
 	FuFirmwareClass *klass_firmware = FU_FIRMWARE_CLASS (klass);
+	object_class->finalize = fu_efi_firmware_section_finalize;
 	klass_firmware->parse = fu_efi_firmware_section_parse;
 	klass_firmware->write = fu_efi_firmware_section_write;
 	klass_firmware->build = fu_efi_firmware_section_build;
@@ -8,6 +8,8 @@
 
 #include "fu-firmware.h"
 
+#define FU_EFI_FIRMWARE_SECTION_SIZE				0x04
+
 #define FU_TYPE_EFI_FIRMWARE_SECTION (fu_efi_firmware_section_get_type ())
 G_DECLARE_DERIVABLE_TYPE (FuEfiFirmwareSection, fu_efi_firmware_section, FU, EFI_FIRMWARE_SECTION, FuFirmware)
 
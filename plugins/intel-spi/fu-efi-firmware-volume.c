@@ -216,7 +216,7 @@ fu_efi_firmware_volume_parse (FuFirmware *firmware,
 	if (g_strcmp0 (guid_str, FU_EFI_FIRMWARE_VOLUME_GUID_FFS2) == 0) {
 		g_autoptr(FuFirmware) img = fu_efi_firmware_filesystem_new ();
 		fu_firmware_set_alignment (img, fu_firmware_get_alignment (firmware));
-		if (!fu_firmware_parse (img, blob, flags, error))
+		if (!fu_firmware_parse_lazy (img, blob, flags, error))
 			return FALSE;
 		fu_firmware_add_image (firmware, img);
 	} else {
@@ -221,7 +221,7 @@ fu_ifd_firmware_parse (FuFirmware *firmware,
 		} else {
 			img = fu_ifd_image_new ();
 		}
-		if (!fu_firmware_parse (img, contents, flags, error))
+		if (!fu_firmware_parse_lazy (img, contents, flags, error))
 			return FALSE;
 		fu_firmware_set_addr (img, freg_base);
 		fu_firmware_set_idx (img, i);
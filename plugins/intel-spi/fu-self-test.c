@@ -6,12 +6,17 @@
 
 #include "config.h"
 
+#include <lzma.h>
+
 #include "fu-common.h"
+#include "fu-efi-common.h"
+#include "fu-efi-firmware-common.h"
 #include "fu-efi-firmware-file.h"
 #include "fu-efi-firmware-filesystem.h"
 #include "fu-efi-firmware-section.h"
 #include "fu-efi-firmware-volume.h"
 #include "fu-ifd-bios.h"
+#include "fu-ifd-firmware.h"
 #include "fu-ifd-image.h"
 
 static void
@@ -193,11 +198,166 @@ fu_ifd_image_xml_func (void)
 	csum2 = fu_firmware_get_checksum (firmware2, G_CHECKSUM_SHA1, &error);
 	g_assert_cmpstr (csum1, ==, csum2);
 }
+
+static void
+fu_ifd_firmware_lazy_func (void)
+{
+	gboolean ret;
+	g_autofree gchar *csum1 = NULL;
+	g_autofree gchar *csum2 = NULL;
+	g_autofree gchar *xml_lazy = NULL;
+	g_autofree gchar *xml_src = NULL;
+	g_autoptr(FuFirmware) firmware1 = fu_ifd_firmware_new ();
+	g_autoptr(FuFirmware) firmware2 = fu_ifd_firmware_new ();
+	g_autoptr(FuFirmware) firmware3 = fu_ifd_firmware_new ();
+	g_autoptr(FuFirmware) img_bios = NULL;
+	g_autoptr(GBytes) blob = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GPtrArray) volumes = NULL;
+
+	/* build and write */
+	ret = g_file_get_contents (FWUPD_FUZZINGSRCDIR "/ifd.builder.xml",
+				   &xml_src, NULL, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	ret = fu_firmware_build_from_xml (firmware1, xml_src, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	blob = fu_firmware_write (firmware1, &error);
+	g_assert_no_error (error);
+	g_assert_nonnull (blob);
+
+	/* parse everything up front */
+	ret = fu_firmware_parse (firmware2, blob, FWUPD_INSTALL_FLAG_NONE, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	csum1 = fu_firmware_get_checksum (firmware2, G_CHECKSUM_SHA1, &error);
+	g_assert_no_error (error);
+
+	/* only record the regions */
+	ret = fu_firmware_parse (firmware3, blob, FWUPD_INSTALL_FLAG_LAZY_PARSE, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	xml_lazy = fu_firmware_export_to_xml (firmware3, FU_FIRMWARE_EXPORT_FLAG_NONE, &error);
+	g_assert_no_error (error);
+	g_assert_nonnull (g_strstr_len (xml_lazy, -1, "<lazy>true</lazy>"));
+
+	/* the BIOS region is parsed when requested */
+	img_bios = fu_firmware_get_image_by_id (firmware3, "bios", &error);
+	g_assert_no_error (error);
+	g_assert_nonnull (img_bios);
+	volumes = fu_firmware_get_images (img_bios);
+	g_assert_cmpint (volumes->len, ==, 2);
+
+	/* writing parses everything else, and the result is the same */
+	csum2 = fu_firmware_get_checksum (firmware3, G_CHECKSUM_SHA1, &error);
+	g_assert_no_error (error);
+	g_assert_cmpstr (csum1, ==, csum2);
+}
+
+static GBytes *
+fu_efi_firmware_lzma_section_new (guint8 seed, gsize datasz)
+{
+	fwupd_guid_t guid = { 0x0 };
+	gboolean ret;
+	gsize outbufsz = 0;
+	gsize outbufsz_max;
+	lzma_ret rc;
+	g_autofree guint8 *outbuf = NULL;
+	g_autoptr(GByteArray) buf = g_byte_array_new ();
+	g_autoptr(GByteArray) raw = g_byte_array_new ();
+	g_autoptr(GError) error = NULL;
+
+	/* raw section with data that is compressible, but not trivially so */
+	fu_byte_array_append_uint32 (raw, (0x19 << 24) | (datasz + 0x4), G_LITTLE_ENDIAN);
+	for (gsize i = 0; i < datasz; i++)
+		fu_byte_array_append_uint8 (raw, (guint8) ((i >> 4) ^ (i % 13) ^ seed));
+	outbufsz_max = lzma_stream_buffer_bound (raw->len);
+	outbuf = g_malloc0 (outbufsz_max);
+	rc = lzma_easy_buffer_encode (0, LZMA_CHECK_CRC32, NULL,
+				      raw->data, raw->len,
+				      outbuf, &outbufsz, outbufsz_max);
+	g_assert_cmpint (rc, ==, LZMA_OK);
+
+	/* GUID-defined section */
+	fu_byte_array_append_uint32 (buf, (0x02 << 24) | (0x18 + outbufsz), G_LITTLE_ENDIAN);
+	ret = fwupd_guid_from_string (FU_EFI_FIRMWARE_SECTION_LZMA_COMPRESS, &guid,
+				      FWUPD_GUID_FLAG_MIXED_ENDIAN, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	g_byte_array_append (buf, (const guint8 *) &guid, sizeof(guid));
+	fu_byte_array_append_uint16 (buf, 0x18, G_LITTLE_ENDIAN);
+	fu_byte_array_append_uint16 (buf, 0x0, G_LITTLE_ENDIAN);
+	g_byte_array_append (buf, outbuf, outbufsz);
+	return g_byte_array_free_to_bytes (g_steal_pointer (&buf));
+}
+
+static void
+fu_efi_firmware_sections_parallel_func (void)
+{
+	gboolean ret;
+	gsize budget = fu_efi_firmware_get_decompress_budget ();
+	guint max_threads = fu_efi_firmware_get_max_threads ();
+	g_autofree gchar *xml_parallel = NULL;
+	g_autofree gchar *xml_serial = NULL;
+	g_autoptr(FuFirmware) firmware_parallel = fu_firmware_new ();
+	g_autoptr(FuFirmware) firmware_serial = fu_firmware_new ();
+	g_autoptr(GByteArray) buf = g_byte_array_new ();
+	g_autoptr(GBytes) blob = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GPtrArray) imgs = NULL;
+
+	/* several independent compressed sections */
+	for (guint i = 0; i < 8; i++) {
+		g_autoptr(GBytes) section = fu_efi_firmware_lzma_section_new (i, 0x100000);
+		fu_byte_array_append_bytes (buf, section);
+	}
+	blob = g_byte_array_free_to_bytes (g_steal_pointer (&buf));
+
+	/* decompress every section in both passes */
+	fu_efi_firmware_set_decompress_budget (0);
+
+	/* serial */
+	fu_efi_firmware_set_max_threads (1);
+	ret = fu_efi_firmware_parse_sections (firmware_serial, blob,
+					      FWUPD_INSTALL_FLAG_NONE, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+
+	/* parallel */
+	fu_efi_firmware_set_max_threads (0);
+	ret = fu_efi_firmware_parse_sections (firmware_parallel, blob,
+					      FWUPD_INSTALL_FLAG_NONE, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+
+	/* the output has to be identical */
+	imgs = fu_firmware_get_images (firmware_parallel);
+	g_assert_cmpint (imgs->len, ==, 8);
+	xml_serial = fu_firmware_export_to_xml (firmware_serial,
+						FU_FIRMWARE_EXPORT_FLAG_NONE,
+						&error);
+	g_assert_no_error (error);
+	xml_parallel = fu_firmware_export_to_xml (firmware_parallel,
+						  FU_FIRMWARE_EXPORT_FLAG_NONE,
+						  &error);
+	g_assert_no_error (error);
+	g_assert_cmpstr (xml_serial, ==, xml_parallel);
+
+	fu_efi_firmware_set_decompress_budget (budget);
+	fu_efi_firmware_set_max_threads (max_threads);
+}
+
 int
 main (int argc, char **argv)
 {
 	g_test_init (&argc, &argv, NULL);
 	g_type_ensure (FU_TYPE_IFD_BIOS);
+	g_type_ensure (FU_TYPE_IFD_IMAGE);
+	g_type_ensure (FU_TYPE_EFI_FIRMWARE_FILE);
+	g_type_ensure (FU_TYPE_EFI_FIRMWARE_FILESYSTEM);
+	g_type_ensure (FU_TYPE_EFI_FIRMWARE_SECTION);
+	g_type_ensure (FU_TYPE_EFI_FIRMWARE_VOLUME);
 
 	/* only critical and error are fatal */
 	g_log_set_fatal_mask (NULL, G_LOG_LEVEL_ERROR | G_LOG_LEVEL_CRITICAL);
@@ -208,5 +368,7 @@ main (int argc, char **argv)
 	g_test_add_func ("/efi/firmware-filesystem{xml}", fu_efi_firmware_filesystem_xml_func);
 	g_test_add_func ("/efi/firmware-volume{xml}", fu_efi_firmware_volume_xml_func);
 	g_test_add_func ("/ifd/image{xml}", fu_ifd_image_xml_func);
+	g_test_add_func ("/ifd/firmware{lazy}", fu_ifd_firmware_lazy_func);
+	g_test_add_func ("/efi/firmware-sections{parallel}", fu_efi_firmware_sections_parallel_func);
 	return g_test_run ();
 }
@@ -1059,4 +1059,9 @@ fu_logitech_hidpp_peripheral_init (FuLogitechHidPpPeripheral *self)
 	 * well to opening -- so limit to ones with issued updates */
 	fu_device_add_internal_flag (FU_DEVICE (self),
 				     FU_DEVICE_INTERNAL_FLAG_ONLY_SUPPORTED);
+
+	/* the ping only tracks if the device is active and sets it up the
+	 * first time, which can wait when there are no clients to see it */
+	fu_device_add_internal_flag (FU_DEVICE (self),
+				     FU_DEVICE_INTERNAL_FLAG_POLL_RELAXED);
 }
@@ -32,8 +32,10 @@ typedef union {
 struct FuPluginData {
 	gboolean		 ia32_debug_supported;
 	FuMsrIa32Debug		 ia32_debug;
+	guint			 ia32_debug_cnt;
 	gboolean		 k8_syscfg_supported;
 	FuMsrK8Syscfg		 k8_syscfg;
+	guint			 k8_syscfg_cnt;
 };
 
 #define PCI_MSR_IA32_DEBUG_INTERFACE		0xc80
@@ -45,6 +47,7 @@ fu_plugin_init (FuPlugin *plugin)
 {
 	fu_plugin_alloc_data (plugin, sizeof (FuPluginData));
 	fu_plugin_set_build_hash (plugin, FU_BUILD_HASH);
+	fu_plugin_add_internal_flag (plugin, FU_PLUGIN_INTERNAL_FLAG_THREADSAFE_SECURITY_ATTRS);
 	fu_plugin_add_udev_subsystem (plugin, "msr");
 }
 
@@ -72,11 +75,52 @@ fu_plugin_startup (FuPlugin *plugin, GError **error)
 	return TRUE;
 }
 
+/* use the least secure value from any processor */
+static void
+fu_plugin_msr_add_ia32_debug (FuPlugin *plugin, const gchar *name, FuMsrIa32Debug ia32_debug)
+{
+	FuPluginData *priv = fu_plugin_get_data (plugin);
+
+	g_debug ("%s IA32_DEBUG_INTERFACE: enabled=%i, locked=%i, debug_occurred=%i",
+		 name,
+		 ia32_debug.fields.enabled,
+		 ia32_debug.fields.locked,
+		 ia32_debug.fields.debug_occurred);
+	if (priv->ia32_debug_cnt++ == 0) {
+		priv->ia32_debug = ia32_debug;
+		return;
+	}
+	if (priv->ia32_debug.fields.enabled != ia32_debug.fields.enabled ||
+	    priv->ia32_debug.fields.locked != ia32_debug.fields.locked)
+		g_warning ("%s IA32_DEBUG_INTERFACE inconsistent with other processors", name);
+	priv->ia32_debug.fields.enabled |= ia32_debug.fields.enabled;
+	priv->ia32_debug.fields.locked &= ia32_debug.fields.locked;
+	priv->ia32_debug.fields.debug_occurred |= ia32_debug.fields.debug_occurred;
+}
+
+/* use the least secure value from any processor */
+static void
+fu_plugin_msr_add_k8_syscfg (FuPlugin *plugin, const gchar *name, FuMsrK8Syscfg k8_syscfg)
+{
+	FuPluginData *priv = fu_plugin_get_data (plugin);
+
+	g_debug ("%s MSR_K8_SYSCFG: sev_is_enabled=%i",
+		 name, k8_syscfg.fields.sev_is_enabled);
+	if (priv->k8_syscfg_cnt++ == 0) {
+		priv->k8_syscfg = k8_syscfg;
+		return;
+	}
+	if (priv->k8_syscfg.fields.sev_is_enabled != k8_syscfg.fields.sev_is_enabled)
+		g_warning ("%s MSR_K8_SYSCFG inconsistent with other processors", name);
+	priv->k8_syscfg.fields.sev_is_enabled &= k8_syscfg.fields.sev_is_enabled;
+}
+
 gboolean
 fu_plugin_backend_device_added (FuPlugin *plugin, FuDevice *device, GError **error)
 {
 	FuDevice *device_cpu = fu_plugin_cache_lookup (plugin, "cpu");
 	FuPluginData *priv = fu_plugin_get_data (plugin);
+	FuUdevDevice *udev_device;
 	guint8 buf[8] = { 0x0 };
 	g_autoptr(FuDeviceLocker) locker = NULL;
 	g_autofree gchar *basename = NULL;
@@ -84,56 +128,63 @@ fu_plugin_backend_device_added (FuPlugin *plugin, FuDevice *device, GError **err
 	/* interesting device? */
 	if (!FU_IS_UDEV_DEVICE (device))
 		return TRUE;
-	if (g_strcmp0 (fu_udev_device_get_subsystem (FU_UDEV_DEVICE (device)), "msr") != 0)
+	udev_device = FU_UDEV_DEVICE (device);
+	if (g_strcmp0 (fu_udev_device_get_subsystem (udev_device), "msr") != 0)
 		return TRUE;
+	basename = g_path_get_basename (fu_udev_device_get_sysfs_path (udev_device));
+	fu_device_set_physical_id (FU_DEVICE (device), "msr");
 
-	/* we only care about the first processor */
-	basename = g_path_get_basename (fu_udev_device_get_sysfs_path (FU_UDEV_DEVICE (device)));
-	if (g_strcmp0 (basename, "msr0") != 0)
-		return TRUE;
+	/* snapshot the MSRs of every processor to detect inconsistent setup;
+	 * IA32_DEBUG_INTERFACE is not included as debug_occurred can be set
+	 * at runtime */
+	if (priv->k8_syscfg_supported)
+		fu_udev_device_add_snapshot_register (udev_device, PCI_MSR_K8_SYSCFG, sizeof(buf));
+	if (!fu_udev_device_ensure_snapshot (udev_device, error))
+		return FALSE;
 
 	/* open the config */
-	fu_device_set_physical_id (FU_DEVICE (device), "msr");
-	locker = fu_device_locker_new (device, error);
-	if (locker == NULL)
-		return FALSE;
+	if (priv->ia32_debug_supported ||
+	    (device_cpu != NULL && g_strcmp0 (basename, "msr0") == 0)) {
+		locker = fu_device_locker_new (device, error);
+		if (locker == NULL)
+			return FALSE;
+	}
 
 	/* grab MSR */
 	if (priv->ia32_debug_supported) {
-		if (!fu_udev_device_pread_full (FU_UDEV_DEVICE (device), PCI_MSR_IA32_DEBUG_INTERFACE,
+		FuMsrIa32Debug ia32_debug = { 0x0 };
+		if (!fu_udev_device_pread_full (udev_device, PCI_MSR_IA32_DEBUG_INTERFACE,
 						buf, sizeof(buf), error)) {
 			g_prefix_error (error, "could not read IA32_DEBUG_INTERFACE: ");
 			return FALSE;
 		}
 		if (!fu_common_read_uint32_safe (buf, sizeof(buf), 0x0,
-						 &priv->ia32_debug.data, G_LITTLE_ENDIAN,
+						 &ia32_debug.data, G_LITTLE_ENDIAN,
 						 error))
 			return FALSE;
-		g_debug ("IA32_DEBUG_INTERFACE: enabled=%i, locked=%i, debug_occurred=%i",
-			 priv->ia32_debug.fields.enabled,
-			 priv->ia32_debug.fields.locked,
-			 priv->ia32_debug.fields.debug_occurred);
+		fu_plugin_msr_add_ia32_debug (plugin, basename, ia32_debug);
 	}
 
 	/* grab MSR */
 	if (priv->k8_syscfg_supported) {
-		if (!fu_udev_device_pread_full (FU_UDEV_DEVICE (device), PCI_MSR_K8_SYSCFG,
-						buf, sizeof(buf), error)) {
+		FuMsrK8Syscfg k8_syscfg = { 0x0 };
+		if (!fu_udev_device_read_snapshot (udev_device, PCI_MSR_K8_SYSCFG,
+						   buf, sizeof(buf), error)) {
 			g_prefix_error (error, "could not read MSR_K8_SYSCFG: ");
 			return FALSE;
 		}
 		if (!fu_common_read_uint32_safe (buf, sizeof(buf), 0x0,
-						 &priv->k8_syscfg.data, G_LITTLE_ENDIAN,
+						 &k8_syscfg.data, G_LITTLE_ENDIAN,
 						 error))
 			return FALSE;
-		g_debug ("MSR_K8_SYSCFG: sev_is_enabled=%i",
-			 priv->k8_syscfg.fields.sev_is_enabled);
+		fu_plugin_msr_add_k8_syscfg (plugin, basename, k8_syscfg);
 	}
 
-	/* get microcode version */
-	if (device_cpu != NULL) {
+	/* get microcode version from the first processor, not using the
+	 * snapshot as this changes with a late microcode load */
+	if (device_cpu != NULL && g_strcmp0 (basename, "msr0") == 0) {
 		guint32 ver_raw;
-		if (!fu_udev_device_pread_full (FU_UDEV_DEVICE (device), PCI_MSR_IA32_BIOS_SIGN_ID,
+		if (!fu_udev_device_pread_full (udev_device, PCI_MSR_IA32_BIOS_SIGN_ID,
 						buf, sizeof(buf), error)) {
 			g_prefix_error (error, "could not read IA32_BIOS_SIGN_ID: ");
 			return FALSE;
@@ -142,55 +142,45 @@ gboolean
 fu_plugin_backend_device_added (FuPlugin *plugin, FuDevice *device, GError **error)
 {
 	FuPluginData *priv = fu_plugin_get_data (plugin);
+	FuUdevDevice *udev_device;
 	const gchar *fwvers;
 	guint8 buf[4] = { 0x0 };
+	guint32 hfs[6] = { 0x0 };
+	const goffset hfs_addrs[] = { PCI_CFG_HFS_1, PCI_CFG_HFS_2, PCI_CFG_HFS_3,
+				      PCI_CFG_HFS_4, PCI_CFG_HFS_5, PCI_CFG_HFS_6 };
 	g_autoptr(FuDeviceLocker) locker = NULL;
 
 	/* interesting device? */
 	if (!FU_IS_UDEV_DEVICE (device))
 		return TRUE;
-	if (g_strcmp0 (fu_udev_device_get_subsystem (FU_UDEV_DEVICE (device)), "pci") != 0)
+	udev_device = FU_UDEV_DEVICE (device);
+	if (g_strcmp0 (fu_udev_device_get_subsystem (udev_device), "pci") != 0)
 		return TRUE;
 
 	/* open the config */
-	fu_udev_device_set_flags (FU_UDEV_DEVICE (device), FU_UDEV_DEVICE_FLAG_USE_CONFIG);
-	if (!fu_udev_device_set_physical_id (FU_UDEV_DEVICE (device), "pci", error))
+	fu_udev_device_set_flags (udev_device, FU_UDEV_DEVICE_FLAG_USE_CONFIG);
+	if (!fu_udev_device_set_physical_id (udev_device, "pci", error))
 		return FALSE;
 	locker = fu_device_locker_new (device, error);
 	if (locker == NULL)
 		return FALSE;
 
-	/* grab MEI config registers */
-	if (!fu_udev_device_pread_full (FU_UDEV_DEVICE (device), PCI_CFG_HFS_1, buf, sizeof(buf), error)) {
-		g_prefix_error (error, "could not read HFS1: ");
-		return FALSE;
-	}
-	priv->hfsts1.data = fu_common_read_uint32 (buf, G_LITTLE_ENDIAN);
-	if (!fu_udev_device_pread_full (FU_UDEV_DEVICE (device), PCI_CFG_HFS_2, buf, sizeof(buf), error)) {
-		g_prefix_error (error, "could not read HFS2: ");
-		return FALSE;
-	}
-	priv->hfsts2.data = fu_common_read_uint32 (buf, G_LITTLE_ENDIAN);
-	if (!fu_udev_device_pread_full (FU_UDEV_DEVICE (device), PCI_CFG_HFS_3, buf, sizeof(buf), error)) {
-		g_prefix_error (error, "could not read HFS3: ");
-		return FALSE;
-	}
-	priv->hfsts3.data = fu_common_read_uint32 (buf, G_LITTLE_ENDIAN);
-	if (!fu_udev_device_pread_full (FU_UDEV_DEVICE (device), PCI_CFG_HFS_4, buf, sizeof(buf), error)) {
-		g_prefix_error (error, "could not read HFS4: ");
-		return FALSE;
-	}
-	priv->hfsts4.data = fu_common_read_uint32 (buf, G_LITTLE_ENDIAN);
-	if (!fu_udev_device_pread_full (FU_UDEV_DEVICE (device), PCI_CFG_HFS_5, buf, sizeof(buf), error)) {
-		g_prefix_error (error, "could not read HFS5: ");
-		return FALSE;
-	}
-	priv->hfsts5.data = fu_common_read_uint32 (buf, G_LITTLE_ENDIAN);
-	if (!fu_udev_device_pread_full (FU_UDEV_DEVICE (device), PCI_CFG_HFS_6, buf, sizeof(buf), error)) {
-		g_prefix_error (error, "could not read HFS6: ");
-		return FALSE;
+	/* grab MEI config registers; these are not snapshotted as the ME
+	 * firmware changes the status at runtime */
+	for (guint i = 0; i < G_N_ELEMENTS(hfs_addrs); i++) {
+		if (!fu_udev_device_pread_full (udev_device, hfs_addrs[i],
+						buf, sizeof(buf), error)) {
+			g_prefix_error (error, "could not read HFS%u: ", i + 1);
+			return FALSE;
+		}
+		hfs[i] = fu_common_read_uint32 (buf, G_LITTLE_ENDIAN);
 	}
-	priv->hfsts6.data = fu_common_read_uint32 (buf, G_LITTLE_ENDIAN);
+	priv->hfsts1.data = hfs[0];
+	priv->hfsts2.data = hfs[1];
+	priv->hfsts3.data = hfs[2];
+	priv->hfsts4.data = hfs[3];
+	priv->hfsts5.data = hfs[4];
+	priv->hfsts6.data = hfs[5];
 	priv->has_device = TRUE;
 
 	/* dump to console */
@@ -201,7 +191,7 @@ fu_plugin_backend_device_added (FuPlugin *plugin, FuDevice *device, GError **err
 	}
 
 	/* check firmware version */
-	fwvers = fu_udev_device_get_sysfs_attr (FU_UDEV_DEVICE (device), "mei/mei0/fw_ver", NULL);
+	fwvers = fu_udev_device_get_sysfs_attr (udev_device, "mei/mei0/fw_ver", NULL);
 	if (fwvers != NULL) {
 		if (!fu_mei_parse_fwvers (plugin, fwvers, error))
 			return FALSE;
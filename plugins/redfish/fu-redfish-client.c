@@ -19,10 +19,15 @@
 #include "fu-redfish-client.h"
 #include "fu-redfish-common.h"
 
+/* the maximum number of inventory members fetched at the same time */
+#define FU_REDFISH_CLIENT_MAX_PARALLEL	8
+
 struct _FuRedfishClient
 {
 	GObject			 parent_instance;
 	CURL			*curl;
+	CURLM			*multi;		/* shares keep-alive connections */
+	GHashTable		*members;	/* utf8:FuRedfishClientMember */
 	gchar			*hostname;
 	guint			 port;
 	gchar			*update_uri_path;
@@ -32,6 +37,26 @@ struct _FuRedfishClient
 	GPtrArray		*devices;
 };
 
+typedef struct {
+	gchar			*etag;
+	JsonObject		*obj;
+} FuRedfishClientMember;
+
+typedef struct {
+	CURL			*curl;
+	const gchar		*uri_path;
+	JsonObject		*obj;
+	JsonObject		*cached;	/* nullable, sent with If-None-Match */
+	GByteArray		*buf;
+	gchar			*etag;
+	struct curl_slist	*headers;
+#ifdef HAVE_LIBCURL_7_62_0
+	CURLU			*uri;
+#else
+	gchar			*uri;
+#endif
+} FuRedfishClientRequest;
+
 G_DEFINE_TYPE (FuRedfishClient, fu_redfish_client, G_TYPE_OBJECT)
 
 #ifdef HAVE_LIBCURL_7_62_0
@@ -50,7 +75,10 @@ fu_redfish_client_fetch_data_cb (char *ptr, size_t size, size_t nmemb, void *use
 }
 
 static GBytes *
-fu_redfish_client_fetch_data (FuRedfishClient *self, const gchar *uri_path, GError **error)
+fu_redfish_client_fetch_data_full (FuRedfishClient *self,
+				   CURL *curl,
+				   const gchar *uri_path,
+				   GError **error)
 {
 	CURLcode res;
 	g_autofree gchar *port = g_strdup_printf ("%u", self->port);
@@ -68,7 +96,7 @@ fu_redfish_client_fetch_data (FuRedfishClient *self, const gchar *uri_path, GErr
 	curl_url_set (uri, CURLUPART_PATH, uri_path, 0);
 	curl_url_set (uri, CURLUPART_HOST, self->hostname, 0);
 	curl_url_set (uri, CURLUPART_PORT, port, 0);
-	if (curl_easy_setopt (self->curl, CURLOPT_CURLU, uri) != CURLE_OK) {
+	if (curl_easy_setopt (curl, CURLOPT_CURLU, uri) != CURLE_OK) {
 		g_set_error_literal (error,
 				     FWUPD_ERROR,
 				     FWUPD_ERROR_INVALID_FILE,
@@ -81,7 +109,7 @@ fu_redfish_client_fetch_data (FuRedfishClient *self, const gchar *uri_path, GErr
 			       self->hostname,
 			       port,
 			       uri_path);
-	if (curl_easy_setopt (self->curl, CURLOPT_URL, uri) != CURLE_OK) {
+	if (curl_easy_setopt (curl, CURLOPT_URL, uri) != CURLE_OK) {
 		g_set_error_literal (error,
 				     FWUPD_ERROR,
 				     FWUPD_ERROR_INVALID_FILE,
@@ -89,15 +117,19 @@ fu_redfish_client_fetch_data (FuRedfishClient *self, const gchar *uri_path, GErr
 		return NULL;
 	}
 #endif
-	curl_easy_setopt (self->curl, CURLOPT_WRITEFUNCTION, fu_redfish_client_fetch_data_cb);
-	curl_easy_setopt (self->curl, CURLOPT_WRITEDATA, buf);
-	res = curl_easy_perform (self->curl);
+	curl_easy_setopt (curl, CURLOPT_WRITEFUNCTION, fu_redfish_client_fetch_data_cb);
+	curl_easy_setopt (curl, CURLOPT_WRITEDATA, buf);
+	res = curl_easy_perform (curl);
+#ifdef HAVE_LIBCURL_7_62_0
+	/* do not leave a dangling URI to be copied by curl_easy_duphandle() */
+	curl_easy_setopt (curl, CURLOPT_CURLU, NULL);
+#endif
 	if (res != CURLE_OK) {
 		glong status_code = 0;
 #ifdef HAVE_LIBCURL_7_62_0
 		g_autoptr(curlptr) uri_str = NULL;
 #endif
-		curl_easy_getinfo (self->curl, CURLINFO_RESPONSE_CODE, &status_code);
+		curl_easy_getinfo (curl, CURLINFO_RESPONSE_CODE, &status_code);
 #ifdef HAVE_LIBCURL_7_62_0
 		curl_url_get (uri, CURLUPART_URL, &uri_str, 0);
 		g_set_error (error,
@@ -118,6 +150,12 @@ fu_redfish_client_fetch_data (FuRedfishClient *self, const gchar *uri_path, GErr
 	return g_byte_array_free_to_bytes (g_steal_pointer (&buf));
 }
 
+static GBytes *
+fu_redfish_client_fetch_data (FuRedfishClient *self, const gchar *uri_path, GError **error)
+{
+	return fu_redfish_client_fetch_data_full (self, self->curl, uri_path, error);
+}
+
 static gboolean
 fu_redfish_client_coldplug_member (FuRedfishClient *self,
 				   JsonObject *member,
@@ -172,24 +210,218 @@ fu_redfish_client_coldplug_member (FuRedfishClient *self,
 	return TRUE;
 }
 
+static void
+fu_redfish_client_member_free (FuRedfishClientMember *member)
+{
+	g_free (member->etag);
+	if (member->obj != NULL)
+		json_object_unref (member->obj);
+	g_free (member);
+}
+
+static void
+fu_redfish_client_request_free (FuRedfishClientRequest *req)
+{
+	if (req->curl != NULL)
+		curl_easy_cleanup (req->curl);
+	if (req->headers != NULL)
+		curl_slist_free_all (req->headers);
+#ifdef HAVE_LIBCURL_7_62_0
+	if (req->uri != NULL)
+		curl_url_cleanup (req->uri);
+#else
+	g_free (req->uri);
+#endif
+	if (req->obj != NULL)
+		json_object_unref (req->obj);
+	if (req->cached != NULL)
+		json_object_unref (req->cached);
+	g_byte_array_unref (req->buf);
+	g_free (req->etag);
+	g_free (req);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(FuRedfishClientRequest, fu_redfish_client_request_free)
+
+static size_t
+fu_redfish_client_request_header_cb (char *ptr, size_t size, size_t nmemb, void *userdata)
+{
+	FuRedfishClientRequest *req = (FuRedfishClientRequest *) userdata;
+	gsize realsize = size * nmemb;
+	g_autofree gchar *line = g_strndup (ptr, realsize);
+
+	/* the header name is case insensitive */
+	if (g_ascii_strncasecmp (line, "ETag:", 5) == 0) {
+		g_free (req->etag);
+		req->etag = g_strstrip (g_strdup (line + 5));
+	}
+	return realsize;
+}
+
+static FuRedfishClientRequest *
+fu_redfish_client_request_new (FuRedfishClient *self,
+			       const gchar *uri_path,
+			       GError **error)
+{
+	FuRedfishClientMember *member = g_hash_table_lookup (self->members, uri_path);
+	g_autofree gchar *port = g_strdup_printf ("%u", self->port);
+	g_autoptr(FuRedfishClientRequest) req = g_new0 (FuRedfishClientRequest, 1);
+
+	/* inherit the user agent, timeouts and credentials */
+	req->curl = curl_easy_duphandle (self->curl);
+	req->uri_path = uri_path;
+	req->buf = g_byte_array_new ();
+
+	/* create URI */
+#ifdef HAVE_LIBCURL_7_62_0
+	req->uri = curl_url ();
+	curl_url_set (req->uri, CURLU_DEFAULT_SCHEME, self->use_https ? "https" : "http", 0);
+	curl_url_set (req->uri, CURLUPART_PATH, uri_path, 0);
+	curl_url_set (req->uri, CURLUPART_HOST, self->hostname, 0);
+	curl_url_set (req->uri, CURLUPART_PORT, port, 0);
+	if (curl_easy_setopt (req->curl, CURLOPT_CURLU, req->uri) != CURLE_OK) {
+#else
+	req->uri = g_strdup_printf ("%s://%s:%s%s",
+				    self->use_https ? "https" : "http",
+				    self->hostname,
+				    port,
+				    uri_path);
+	if (curl_easy_setopt (req->curl, CURLOPT_URL, req->uri) != CURLE_OK) {
+#endif
+		g_set_error_literal (error,
+				     FWUPD_ERROR,
+				     FWUPD_ERROR_INVALID_FILE,
+				     "failed to create message for URI");
+		return NULL;
+	}
+	curl_easy_setopt (req->curl, CURLOPT_WRITEFUNCTION, fu_redfish_client_fetch_data_cb);
+	curl_easy_setopt (req->curl, CURLOPT_WRITEDATA, req->buf);
+	curl_easy_setopt (req->curl, CURLOPT_HEADERFUNCTION, fu_redfish_client_request_header_cb);
+	curl_easy_setopt (req->curl, CURLOPT_HEADERDATA, req);
+	curl_easy_setopt (req->curl, CURLOPT_PRIVATE, req);
+
+	/* only get the member again if it has changed, keeping a reference
+	 * as the cache can change before the request completes */
+	if (member != NULL && member->etag != NULL) {
+		g_autofree gchar *hdr = g_strdup_printf ("If-None-Match: %s", member->etag);
+		req->cached = json_object_ref (member->obj);
+		req->headers = curl_slist_append (req->headers, hdr);
+		curl_easy_setopt (req->curl, CURLOPT_HTTPHEADER, req->headers);
+	}
+	return g_steal_pointer (&req);
+}
+
+static JsonObject *
+fu_redfish_client_request_done (FuRedfishClient *self,
+				FuRedfishClientRequest *req,
+				CURLcode res,
+				GError **error)
+{
+	JsonNode *node_root;
+	JsonObject *obj;
+	glong status_code = 0;
+	g_autoptr(JsonParser) parser = json_parser_new ();
+
+	if (res != CURLE_OK) {
+		g_set_error (error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_INVALID_FILE,
+			     "failed to download %s: %s",
+			     req->uri_path, curl_easy_strerror (res));
+		return NULL;
+	}
+
+	/* not modified since the last coldplug */
+	curl_easy_getinfo (req->curl, CURLINFO_RESPONSE_CODE, &status_code);
+	if (status_code == 304 && req->cached != NULL) {
+		g_debug ("%s is unchanged", req->uri_path);
+		return json_object_ref (req->cached);
+	}
+
+	/* the BMC has nothing to compare against, so ask again without any
+	 * conditions rather than parsing the empty body */
+	if (status_code == 304) {
+		g_debug ("%s is unchanged but not cached, requesting again",
+			 req->uri_path);
+		g_byte_array_set_size (req->buf, 0);
+		g_clear_pointer (&req->etag, g_free);
+		curl_easy_setopt (req->curl, CURLOPT_HTTPHEADER, NULL);
+		res = curl_easy_perform (req->curl);
+		if (res != CURLE_OK) {
+			g_set_error (error,
+				     FWUPD_ERROR,
+				     FWUPD_ERROR_INVALID_FILE,
+				     "failed to download %s: %s",
+				     req->uri_path, curl_easy_strerror (res));
+			return NULL;
+		}
+		curl_easy_getinfo (req->curl, CURLINFO_RESPONSE_CODE, &status_code);
+		if (status_code == 304) {
+			g_set_error (error,
+				     FWUPD_ERROR,
+				     FWUPD_ERROR_INVALID_FILE,
+				     "%s was not modified but never downloaded",
+				     req->uri_path);
+			return NULL;
+		}
+	}
+
+	/* get the member object */
+	if (!json_parser_load_from_data (parser,
+					 (const gchar *) req->buf->data,
+					 (gssize) req->buf->len,
+					 error)) {
+		g_prefix_error (error, "failed to parse node: ");
+		return NULL;
+	}
+	node_root = json_parser_get_root (parser);
+	if (node_root == NULL) {
+		g_set_error_literal (error,
+				     FWUPD_ERROR,
+				     FWUPD_ERROR_INVALID_FILE,
+				     "no root node");
+		return NULL;
+	}
+	obj = json_node_get_object (node_root);
+	if (obj == NULL) {
+		g_set_error_literal (error,
+				     FWUPD_ERROR,
+				     FWUPD_ERROR_INVALID_FILE,
+				     "no member object");
+		return NULL;
+	}
+
+	/* save for next time */
+	if (req->etag != NULL) {
+		FuRedfishClientMember *member = g_new0 (FuRedfishClientMember, 1);
+		member->etag = g_strdup (req->etag);
+		member->obj = json_object_ref (obj);
+		g_hash_table_insert (self->members, g_strdup (req->uri_path), member);
+	} else {
+		g_hash_table_remove (self->members, req->uri_path);
+	}
+	return json_object_ref (obj);
+}
+
 static gboolean
 fu_redfish_client_coldplug_collection (FuRedfishClient *self,
 				       JsonObject *collection,
 				       GError **error)
 {
 	JsonArray *members;
-	JsonNode *node_root;
-	JsonObject *member;
+	guint members_len;
+	guint idx_next = 0;
+	guint in_flight = 0;
+	g_autoptr(GError) error_local = NULL;
+	g_autoptr(GPtrArray) reqs = NULL;
 
 	members = json_object_get_array_member (collection, "Members");
-	for (guint i = 0; i < json_array_get_length (members); i++) {
-		g_autoptr(JsonParser) parser = json_parser_new ();
-		g_autoptr(GBytes) blob = NULL;
-		JsonObject *member_id;
-		const gchar *member_uri;
-
-		member_id = json_array_get_object_element (members, i);
-		member_uri = json_object_get_string_member (member_id, "@odata.id");
+	members_len = json_array_get_length (members);
+	reqs = g_ptr_array_new_with_free_func ((GDestroyNotify) fu_redfish_client_request_free);
+	for (guint i = 0; i < members_len; i++) {
+		JsonObject *member_id = json_array_get_object_element (members, i);
+		const gchar *member_uri = json_object_get_string_member (member_id, "@odata.id");
+		FuRedfishClientRequest *req;
 		if (member_uri == NULL) {
 			g_set_error_literal (error,
 					     FWUPD_ERROR,
@@ -197,39 +429,63 @@ fu_redfish_client_coldplug_collection (FuRedfishClient *self,
 					     "no @odata.id string");
 			return FALSE;
 		}
-
-		/* try to connect */
-		blob = fu_redfish_client_fetch_data (self, member_uri, error);
-		if (blob == NULL)
+		req = fu_redfish_client_request_new (self, member_uri, error);
+		if (req == NULL)
 			return FALSE;
+		g_ptr_array_add (reqs, req);
+	}
 
-		/* get the member object */
-		if (!json_parser_load_from_data (parser,
-						 g_bytes_get_data (blob, NULL),
-						 (gssize) g_bytes_get_size (blob),
-						 error)) {
-			g_prefix_error (error, "failed to parse node: ");
-			return FALSE;
+	/* fetch the members concurrently, over as few connections as possible */
+	while (idx_next < reqs->len || in_flight > 0) {
+		CURLMsg *msg;
+		gint msgs_left = 0;
+		gint running = 0;
+
+		while (idx_next < reqs->len && in_flight < FU_REDFISH_CLIENT_MAX_PARALLEL) {
+			FuRedfishClientRequest *req = g_ptr_array_index (reqs, idx_next++);
+			curl_multi_add_handle (self->multi, req->curl);
+			in_flight++;
 		}
-		node_root = json_parser_get_root (parser);
-		if (node_root == NULL) {
-			g_set_error_literal (error,
+		if (curl_multi_perform (self->multi, &running) != CURLM_OK) {
+			g_set_error_literal (&error_local,
 					     FWUPD_ERROR,
-					     FWUPD_ERROR_INVALID_FILE,
-					     "no root node");
-			return FALSE;
+					     FWUPD_ERROR_INTERNAL,
+					     "failed to perform transfers");
+			break;
 		}
-		member = json_node_get_object (node_root);
-		if (member == NULL) {
-			g_set_error_literal (error,
-					     FWUPD_ERROR,
-					     FWUPD_ERROR_INVALID_FILE,
-					     "no member object");
-			return FALSE;
+		while ((msg = curl_multi_info_read (self->multi, &msgs_left)) != NULL) {
+			FuRedfishClientRequest *req = NULL;
+			if (msg->msg != CURLMSG_DONE)
+				continue;
+			curl_easy_getinfo (msg->easy_handle, CURLINFO_PRIVATE, (gchar **) &req);
+			curl_multi_remove_handle (self->multi, req->curl);
+			in_flight--;
+			req->obj = fu_redfish_client_request_done (self, req,
+								   msg->data.result,
+								   &error_local);
+			if (req->obj == NULL)
+				break;
 		}
+		if (error_local != NULL)
+			break;
+		if (running > 0)
+			curl_multi_wait (self->multi, NULL, 0, 1000, NULL);
+	}
 
-		/* Create the device for the member */
-		if (!fu_redfish_client_coldplug_member (self, member, error))
+	/* abandon any transfers still in progress */
+	for (guint i = 0; i < idx_next; i++) {
+		FuRedfishClientRequest *req = g_ptr_array_index (reqs, i);
+		curl_multi_remove_handle (self->multi, req->curl);
+	}
+	if (error_local != NULL) {
+		g_propagate_error (error, g_steal_pointer (&error_local));
+		return FALSE;
+	}
+
+	/* create the devices in the same order as the collection */
+	for (guint i = 0; i < reqs->len; i++) {
+		FuRedfishClientRequest *req = g_ptr_array_index (reqs, i);
+		if (!fu_redfish_client_coldplug_member (self, req->obj, error))
 			return FALSE;
 	}
 	return TRUE;
@@ -313,6 +569,9 @@ fu_redfish_client_coldplug (FuRedfishClient *self, GError **error)
 		return FALSE;
 	}
 
+	/* the inventory may have changed since the last coldplug */
+	g_ptr_array_set_size (self->devices, 0);
+
 	/* try to connect */
 	blob = fu_redfish_client_fetch_data (self, self->update_uri_path, error);
 	if (blob == NULL)
@@ -356,6 +615,7 @@ fu_redfish_client_coldplug (FuRedfishClient *self, GError **error)
 				     "HttpPushUri is not available");
 		return FALSE;
 	}
+	g_free (self->push_uri_path);
 	self->push_uri_path = g_strdup (json_object_get_string_member (obj_root, "HttpPushUri"));
 	if (self->push_uri_path == NULL) {
 		g_set_error_literal (error,
@@ -594,13 +854,274 @@ fu_redfish_client_set_smbios_interfaces (FuRedfishClient *self,
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(curl_mime, curl_mime_free)
 
-gboolean
-fu_redfish_client_update (FuRedfishClient *self, FuDevice *device, GBytes *blob_fw,
+/* the longest a BMC is allowed to take to apply the update */
+#define FU_REDFISH_CLIENT_TASK_TIMEOUT		1800 /* s */
+#define FU_REDFISH_CLIENT_TASK_DELAY_MAX	30 /* s */
+
+typedef struct {
+	FuDevice		*device;
+	GBytes			*blob;
+	gsize			 offset;
+	gchar			*location;
+	CURL			*curl;		/* only used by the upload thread */
+	GMainContext		*context;	/* iterated by the caller */
+	guint			 percentage;
+	gint			 done;
+	GError			*error;
+} FuRedfishClientUpload;
+
+/* a device status or progress change, which has to happen in the context
+ * of the caller rather than in the upload thread */
+typedef struct {
+	FuDevice		*device;
+	FwupdStatus		 status;
+	guint			 percentage;
+} FuRedfishClientProgress;
+
+static void
+fu_redfish_client_progress_free (FuRedfishClientProgress *progress)
+{
+	g_object_unref (progress->device);
+	g_free (progress);
+}
+
+static gboolean
+fu_redfish_client_progress_cb (gpointer user_data)
+{
+	FuRedfishClientProgress *progress = (FuRedfishClientProgress *) user_data;
+	if (progress->status != FWUPD_STATUS_UNKNOWN)
+		fu_device_set_status (progress->device, progress->status);
+	else
+		fu_device_set_progress (progress->device, progress->percentage);
+	return G_SOURCE_REMOVE;
+}
+
+static void
+fu_redfish_client_upload_invoke (FuRedfishClientUpload *upload,
+				 FwupdStatus status,
+				 guint percentage)
+{
+	FuRedfishClientProgress *progress = g_new0 (FuRedfishClientProgress, 1);
+	progress->device = g_object_ref (upload->device);
+	progress->status = status;
+	progress->percentage = percentage;
+	g_main_context_invoke_full (upload->context, G_PRIORITY_DEFAULT,
+				    fu_redfish_client_progress_cb, progress,
+				    (GDestroyNotify) fu_redfish_client_progress_free);
+}
+
+static void
+fu_redfish_client_upload_set_status (FuRedfishClientUpload *upload, FwupdStatus status)
+{
+	fu_redfish_client_upload_invoke (upload, status, 0);
+}
+
+static void
+fu_redfish_client_upload_set_progress (FuRedfishClientUpload *upload, guint percentage)
+{
+	if (upload->percentage == percentage)
+		return;
+	upload->percentage = percentage;
+	fu_redfish_client_upload_invoke (upload, FWUPD_STATUS_UNKNOWN, percentage);
+}
+
+static size_t
+fu_redfish_client_upload_read_cb (char *buffer, size_t size, size_t nitems, void *arg)
+{
+	FuRedfishClientUpload *upload = (FuRedfishClientUpload *) arg;
+	gsize bufsz = 0;
+	const guint8 *buf = g_bytes_get_data (upload->blob, &bufsz);
+	gsize sz = MIN(size * nitems, bufsz - upload->offset);
+
+	/* stream directly from the payload rather than copying it */
+	memcpy (buffer, buf + upload->offset, sz);
+	upload->offset += sz;
+	return sz;
+}
+
+static int
+fu_redfish_client_upload_seek_cb (void *arg, curl_off_t offset, int origin)
+{
+	FuRedfishClientUpload *upload = (FuRedfishClientUpload *) arg;
+	if (origin != SEEK_SET ||
+	    offset < 0 ||
+	    (gsize) offset > g_bytes_get_size (upload->blob))
+		return CURL_SEEKFUNC_CANTSEEK;
+	upload->offset = offset;
+	return CURL_SEEKFUNC_OK;
+}
+
+static int
+fu_redfish_client_upload_progress_cb (void *clientp,
+				      curl_off_t dltotal,
+				      curl_off_t dlnow,
+				      curl_off_t ultotal,
+				      curl_off_t ulnow)
+{
+	FuRedfishClientUpload *upload = (FuRedfishClientUpload *) clientp;
+	if (ultotal > 0)
+		fu_redfish_client_upload_set_progress (upload, (guint) ((ulnow * 100) / ultotal));
+	return 0;
+}
+
+static size_t
+fu_redfish_client_upload_header_cb (char *ptr, size_t size, size_t nmemb, void *userdata)
+{
+	FuRedfishClientUpload *upload = (FuRedfishClientUpload *) userdata;
+	gsize realsize = size * nmemb;
+	g_autofree gchar *line = g_strndup (ptr, realsize);
+
+	/* the TaskMonitor for an asynchronous operation */
+	if (g_ascii_strncasecmp (line, "Location:", 9) == 0) {
+		g_free (upload->location);
+		upload->location = g_strstrip (g_strdup (line + 9));
+	}
+	return realsize;
+}
+
+static JsonObject *
+fu_redfish_client_task_new_running (void)
+{
+	JsonObject *task = json_object_new ();
+	json_object_set_string_member (task, "TaskState", "Running");
+	return task;
+}
+
+static JsonObject *
+fu_redfish_client_fetch_task (FuRedfishClient *self,
+			      CURL *curl,
+			      const gchar *uri_path,
+			      GError **error)
+{
+	JsonNode *node_root;
+	glong status_code = 0;
+	g_autoptr(GBytes) blob = NULL;
+	g_autoptr(GError) error_local = NULL;
+	g_autoptr(JsonParser) parser = json_parser_new ();
+
+	blob = fu_redfish_client_fetch_data_full (self, curl, uri_path, error);
+	if (blob == NULL)
+		return NULL;
+	curl_easy_getinfo (curl, CURLINFO_RESPONSE_CODE, &status_code);
+	if (status_code >= 400) {
+		g_set_error (error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_WRITE,
+			     "failed to get task %s: status %li",
+			     uri_path, status_code);
+		return NULL;
+	}
+
+	/* a TaskMonitor returns 202 until the task is done, optionally with
+	 * the Task itself */
+	if (!json_parser_load_from_data (parser,
+					 g_bytes_get_data (blob, NULL),
+					 (gssize) g_bytes_get_size (blob),
+					 &error_local)) {
+		if (status_code == 202)
+			return fu_redfish_client_task_new_running ();
+		g_propagate_prefixed_error (error, g_steal_pointer (&error_local),
+					    "failed to parse task: ");
+		return NULL;
+	}
+	node_root = json_parser_get_root (parser);
+	if (node_root == NULL ||
+	    !JSON_NODE_HOLDS_OBJECT (node_root) ||
+	    !json_object_has_member (json_node_get_object (node_root), "TaskState")) {
+		if (status_code == 202)
+			return fu_redfish_client_task_new_running ();
+		g_set_error_literal (error,
+				     FWUPD_ERROR,
+				     FWUPD_ERROR_INVALID_FILE,
+				     "no task object");
+		return NULL;
+	}
+	return json_object_ref (json_node_get_object (node_root));
+}
+
+static gchar *
+fu_redfish_client_task_get_message (JsonObject *task)
+{
+	JsonArray *messages;
+	GString *str = g_string_new (NULL);
+
+	if (!json_object_has_member (task, "Messages"))
+		return g_string_free (str, FALSE);
+	messages = json_object_get_array_member (task, "Messages");
+	for (guint i = 0; messages != NULL && i < json_array_get_length (messages); i++) {
+		JsonObject *message = json_array_get_object_element (messages, i);
+		if (message == NULL || !json_object_has_member (message, "Message"))
+			continue;
+		if (str->len > 0)
+			g_string_append (str, ", ");
+		g_string_append (str, json_object_get_string_member (message, "Message"));
+	}
+	return g_string_free (str, FALSE);
+}
+
+/* runs in the upload thread */
+static gboolean
+fu_redfish_client_wait_for_task (FuRedfishClient *self,
+				 FuRedfishClientUpload *upload,
+				 GError **error)
+{
+	guint delay = 1;
+	g_autofree gchar *uri_path = fu_redfish_common_get_uri_path (upload->location);
+	g_autoptr(GTimer) timer = g_timer_new ();
+
+	fu_redfish_client_upload_set_status (upload, FWUPD_STATUS_DEVICE_BUSY);
+	while (g_timer_elapsed (timer, NULL) < FU_REDFISH_CLIENT_TASK_TIMEOUT) {
+		const gchar *state = NULL;
+		g_autoptr(JsonObject) task = NULL;
+
+		task = fu_redfish_client_fetch_task (self, upload->curl, uri_path, error);
+		if (task == NULL)
+			return FALSE;
+		if (json_object_has_member (task, "TaskState"))
+			state = json_object_get_string_member (task, "TaskState");
+		if (json_object_has_member (task, "PercentComplete")) {
+			gint64 pc = json_object_get_int_member (task, "PercentComplete");
+			fu_redfish_client_upload_set_progress (upload, (guint) CLAMP (pc, 0, 100));
+		}
+		g_debug ("task %s is %s", uri_path, state);
+
+		/* the BMC either completed the task, or gave up */
+		if (g_strcmp0 (state, "Completed") == 0)
+			return TRUE;
+		if (g_strcmp0 (state, "Exception") == 0 ||
+		    g_strcmp0 (state, "Killed") == 0 ||
+		    g_strcmp0 (state, "Cancelled") == 0) {
+			g_autofree gchar *msg = fu_redfish_client_task_get_message (task);
+			g_set_error (error,
+				     FWUPD_ERROR,
+				     FWUPD_ERROR_WRITE,
+				     "task %s: %s",
+				     state, msg);
+			return FALSE;
+		}
+
+		/* back off so the BMC is not kept busy answering us */
+		g_usleep ((gulong) delay * G_USEC_PER_SEC);
+		delay = MIN(delay * 2, FU_REDFISH_CLIENT_TASK_DELAY_MAX);
+	}
+	g_set_error (error,
+		     FWUPD_ERROR,
+		     FWUPD_ERROR_WRITE,
+		     "task %s did not complete after %us",
+		     uri_path, (guint) FU_REDFISH_CLIENT_TASK_TIMEOUT);
+	return FALSE;
+}
+
+/* runs in the upload thread */
+static gboolean
+fu_redfish_client_upload (FuRedfishClient *self,
+			  FuRedfishClientUpload *upload,
 			  GError **error)
 {
 	CURLcode res;
 	FwupdRelease *release;
 	curl_mimepart *part;
+	glong status_code = 0;
 	g_autofree gchar *filename = NULL;
 	g_autofree gchar *port = g_strdup_printf ("%u", self->port);
 #ifdef HAVE_LIBCURL_7_62_0
@@ -608,17 +1129,18 @@ fu_redfish_client_update (FuRedfishClient *self, FuDevice *device, GBytes *blob_
 #else
 	g_autofree gchar *uri = NULL;
 #endif
-	g_autoptr(curl_mime) mime = curl_mime_init (self->curl);
+	g_autoptr(curl_mime) mime = curl_mime_init (upload->curl);
+	g_autoptr(GByteArray) buf = g_byte_array_new ();
 
 	/* Get the update version */
-	release = fwupd_device_get_release_default (FWUPD_DEVICE (device));
+	release = fwupd_device_get_release_default (FWUPD_DEVICE (upload->device));
 	if (release != NULL) {
 		filename = g_strdup_printf ("%s-%s.bin",
-					    fu_device_get_name (device),
+					    fu_device_get_name (upload->device),
 					    fwupd_release_get_version (release));
 	} else {
 		filename = g_strdup_printf ("%s.bin",
-					    fu_device_get_name (device));
+					    fu_device_get_name (upload->device));
 	}
 
 	/* create URI */
@@ -627,7 +1149,7 @@ fu_redfish_client_update (FuRedfishClient *self, FuDevice *device, GBytes *blob_
 	curl_url_set (uri, CURLUPART_PATH, self->push_uri_path, 0);
 	curl_url_set (uri, CURLUPART_HOST, self->hostname, 0);
 	curl_url_set (uri, CURLUPART_PORT, port, 0);
-	if (curl_easy_setopt (self->curl, CURLOPT_CURLU, uri) != CURLE_OK) {
+	if (curl_easy_setopt (upload->curl, CURLOPT_CURLU, uri) != CURLE_OK) {
 		g_set_error_literal (error,
 				     FWUPD_ERROR,
 				     FWUPD_ERROR_INVALID_FILE,
@@ -640,7 +1162,7 @@ fu_redfish_client_update (FuRedfishClient *self, FuDevice *device, GBytes *blob_
 			       self->hostname,
 			       port,
 			       self->push_uri_path);
-	if (curl_easy_setopt (self->curl, CURLOPT_URL, uri) != CURLE_OK) {
+	if (curl_easy_setopt (upload->curl, CURLOPT_URL, uri) != CURLE_OK) {
 		g_set_error_literal (error,
 				     FWUPD_ERROR,
 				     FWUPD_ERROR_INVALID_FILE,
@@ -649,19 +1171,40 @@ fu_redfish_client_update (FuRedfishClient *self, FuDevice *device, GBytes *blob_
 	}
 #endif
 
-	/* Create the multipart request */
-	curl_easy_setopt (self->curl, CURLOPT_MIMEPOST, mime);
+	/* Create the multipart request, streamed from the payload */
+	curl_easy_setopt (upload->curl, CURLOPT_MIMEPOST, mime);
 	part = curl_mime_addpart (mime);
-	curl_mime_data (part, g_bytes_get_data (blob_fw, NULL), g_bytes_get_size (blob_fw));
+	curl_mime_data_cb (part, g_bytes_get_size (upload->blob),
+			   fu_redfish_client_upload_read_cb,
+			   fu_redfish_client_upload_seek_cb,
+			   NULL, upload);
+	curl_mime_filename (part, filename);
 	curl_mime_type (part, "application/octet-stream");
-	res = curl_easy_perform (self->curl);
-	if (res != CURLE_OK) {
-		glong status_code = 0;
+
+	/* report progress and capture the TaskMonitor */
+	fu_redfish_client_upload_set_status (upload, FWUPD_STATUS_DEVICE_WRITE);
+	curl_easy_setopt (upload->curl, CURLOPT_NOPROGRESS, 0L);
+	curl_easy_setopt (upload->curl, CURLOPT_XFERINFOFUNCTION, fu_redfish_client_upload_progress_cb);
+	curl_easy_setopt (upload->curl, CURLOPT_XFERINFODATA, upload);
+	curl_easy_setopt (upload->curl, CURLOPT_HEADERFUNCTION, fu_redfish_client_upload_header_cb);
+	curl_easy_setopt (upload->curl, CURLOPT_HEADERDATA, upload);
+	curl_easy_setopt (upload->curl, CURLOPT_WRITEFUNCTION, fu_redfish_client_fetch_data_cb);
+	curl_easy_setopt (upload->curl, CURLOPT_WRITEDATA, buf);
+	res = curl_easy_perform (upload->curl);
+	curl_easy_getinfo (upload->curl, CURLINFO_RESPONSE_CODE, &status_code);
+
+	/* restore the handle for polling the TaskMonitor */
+	curl_easy_setopt (upload->curl, CURLOPT_NOPROGRESS, 1L);
+	curl_easy_setopt (upload->curl, CURLOPT_HEADERFUNCTION, NULL);
+	curl_easy_setopt (upload->curl, CURLOPT_HEADERDATA, NULL);
+	curl_easy_setopt (upload->curl, CURLOPT_MIMEPOST, NULL);
+	curl_easy_setopt (upload->curl, CURLOPT_HTTPGET, 1L);
 #ifdef HAVE_LIBCURL_7_62_0
-		g_autoptr(curlptr) uri_str = NULL;
+	curl_easy_setopt (upload->curl, CURLOPT_CURLU, NULL);
 #endif
-		curl_easy_getinfo (self->curl, CURLINFO_RESPONSE_CODE, &status_code);
+	if (res != CURLE_OK) {
 #ifdef HAVE_LIBCURL_7_62_0
+		g_autoptr(curlptr) uri_str = NULL;
 		curl_url_get (uri, CURLUPART_URL, &uri_str, 0);
 		g_set_error (error,
 			     FWUPD_ERROR,
@@ -680,7 +1223,88 @@ fu_redfish_client_update (FuRedfishClient *self, FuDevice *device, GBytes *blob_
 		return FALSE;
 #endif
 	}
+	if (status_code >= 400) {
+		g_set_error (error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_WRITE,
+			     "failed to upload %s: status %li",
+			     filename, status_code);
+		return FALSE;
+	}
 
+	/* the update was applied synchronously */
+	if (status_code != 202 || upload->location == NULL) {
+		g_debug ("no TaskMonitor, status %li", status_code);
+		return TRUE;
+	}
+	return fu_redfish_client_wait_for_task (self, upload, error);
+}
+
+typedef struct {
+	FuRedfishClient		*self;
+	FuRedfishClientUpload	*upload;
+} FuRedfishClientUploadHelper;
+
+static gpointer
+fu_redfish_client_upload_thread_cb (gpointer user_data)
+{
+	FuRedfishClientUploadHelper *helper = (FuRedfishClientUploadHelper *) user_data;
+	FuRedfishClientUpload *upload = helper->upload;
+
+	if (!fu_redfish_client_upload (helper->self, upload, &upload->error))
+		g_debug ("upload failed: %s", upload->error->message);
+	g_atomic_int_set (&upload->done, TRUE);
+	g_main_context_wakeup (upload->context);
+	return NULL;
+}
+
+gboolean
+fu_redfish_client_update (FuRedfishClient *self, FuDevice *device, GBytes *blob_fw,
+			  GError **error)
+{
+	GThread *thread;
+	g_autoptr(GMainContext) context = g_main_context_new ();
+	FuRedfishClientUpload upload = {
+		.device = device,
+		.blob = blob_fw,
+		.context = context,
+		.percentage = G_MAXUINT,
+	};
+	FuRedfishClientUploadHelper helper = {
+		.self = self,
+		.upload = &upload,
+	};
+
+	/* the thread uses its own handle as it must not share one with
+	 * any other request made by the client */
+	upload.curl = curl_easy_duphandle (self->curl);
+	if (upload.curl == NULL) {
+		g_set_error_literal (error,
+				     FWUPD_ERROR,
+				     FWUPD_ERROR_INTERNAL,
+				     "failed to create upload handle");
+		return FALSE;
+	}
+
+	/* the upload and the TaskMonitor polling can take a long time, so
+	 * they run in a thread while the device status and progress are
+	 * dispatched from a private context -- iterating the context of the
+	 * caller would allow other requests to the daemon to run re-entrantly
+	 * in the middle of the update */
+	g_main_context_push_thread_default (context);
+	thread = g_thread_new ("fu-redfish-upload", fu_redfish_client_upload_thread_cb, &helper);
+	while (!g_atomic_int_get (&upload.done))
+		g_main_context_iteration (context, TRUE);
+	g_thread_join (thread);
+	while (g_main_context_pending (context))
+		g_main_context_iteration (context, FALSE);
+	g_main_context_pop_thread_default (context);
+	curl_easy_cleanup (upload.curl);
+	g_free (upload.location);
+	if (upload.error != NULL) {
+		g_propagate_error (error, upload.error);
+		return FALSE;
+	}
 	return TRUE;
 }
 
@@ -848,8 +1472,11 @@ static void
 fu_redfish_client_finalize (GObject *object)
 {
 	FuRedfishClient *self = FU_REDFISH_CLIENT (object);
+	if (self->multi != NULL)
+		curl_multi_cleanup (self->multi);
 	if (self->curl != NULL)
 		curl_easy_cleanup (self->curl);
+	g_hash_table_unref (self->members);
 	g_free (self->update_uri_path);
 	g_free (self->push_uri_path);
 	g_free (self->hostname);
@@ -868,7 +1495,13 @@ static void
 fu_redfish_client_init (FuRedfishClient *self)
 {
 	self->devices = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+	self->members = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+					       (GDestroyNotify) fu_redfish_client_member_free);
 	self->curl = curl_easy_init ();
+	self->multi = curl_multi_init ();
+	curl_multi_setopt (self->multi, CURLMOPT_MAX_HOST_CONNECTIONS,
+			   (glong) FU_REDFISH_CLIENT_MAX_PARALLEL);
+	curl_multi_setopt (self->multi, CURLMOPT_PIPELINING, (glong) CURLPIPE_MULTIPLEX);
 
 	/* since DSP0266 makes Basic Authorization a requirement,
 	 * it is safe to use Basic Auth for all implementations */
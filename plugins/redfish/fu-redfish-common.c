@@ -36,4 +36,17 @@ fu_redfish_common_buffer_to_ipv6 (const guint8 *buffer)
 	return g_string_free (str, FALSE);
 }
 
+/* a Location header can be a path or an absolute URI */
+gchar *
+fu_redfish_common_get_uri_path (const gchar *location)
+{
+	const gchar *tmp = g_strstr_len (location, -1, "://");
+	if (tmp == NULL)
+		return g_strdup (location);
+	tmp = g_strstr_len (tmp + 3, -1, "/");
+	if (tmp == NULL)
+		return g_strdup ("/");
+	return g_strdup (tmp);
+}
+
 /* vim: set noexpandtab: */
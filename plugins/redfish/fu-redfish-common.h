@@ -40,3 +40,4 @@
 /* shared */
 gchar		*fu_redfish_common_buffer_to_ipv4	(const guint8	*buffer);
 gchar		*fu_redfish_common_buffer_to_ipv6	(const guint8	*buffer);
+gchar		*fu_redfish_common_get_uri_path		(const gchar	*location);
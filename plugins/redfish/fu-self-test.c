@@ -7,11 +7,237 @@
 #include "config.h"
 
 #include <fwupd.h>
+#include <string.h>
 
+#include "fu-device.h"
 #include "fu-plugin-private.h"
 
+#include "fu-redfish-client.h"
 #include "fu-redfish-common.h"
 
+/* a minimal HTTP server standing in for a BMC, answering each request in its
+ * own thread from canned responses so the client can be tested end to end */
+typedef struct {
+	guint			 status;
+	gchar			*headers;	/* nullable, each ending with CRLF */
+	gchar			*body;		/* nullable */
+} FuTestBmcResponse;
+
+typedef struct {
+	GSocketListener		*listener;
+	GCancellable		*cancellable;
+	GThread			*thread;
+	guint16			 port;
+	GMutex			 mutex;
+	GHashTable		*responses;	/* "METHOD path":GPtrArray of FuTestBmcResponse */
+	GPtrArray		*requests;	/* utf8, request line and headers */
+} FuTestBmc;
+
+static void
+fu_test_bmc_response_free (FuTestBmcResponse *response)
+{
+	g_free (response->headers);
+	g_free (response->body);
+	g_free (response);
+}
+
+static void
+fu_test_bmc_add_response (FuTestBmc *bmc,
+			  const gchar *method,
+			  const gchar *path,
+			  guint status,
+			  const gchar *headers,
+			  const gchar *body)
+{
+	FuTestBmcResponse *response = g_new0 (FuTestBmcResponse, 1);
+	GPtrArray *responses;
+	g_autofree gchar *key = g_strdup_printf ("%s %s", method, path);
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&bmc->mutex);
+
+	response->status = status;
+	response->headers = g_strdup (headers);
+	response->body = g_strdup (body);
+	responses = g_hash_table_lookup (bmc->responses, key);
+	if (responses == NULL) {
+		responses = g_ptr_array_new_with_free_func ((GDestroyNotify) fu_test_bmc_response_free);
+		g_hash_table_insert (bmc->responses, g_steal_pointer (&key), responses);
+	}
+	g_ptr_array_add (responses, response);
+}
+
+/* returns the number of requests for @path that contained @header */
+static guint
+fu_test_bmc_get_request_count (FuTestBmc *bmc, const gchar *method,
+			       const gchar *path, const gchar *header)
+{
+	guint cnt = 0;
+	g_autofree gchar *prefix = g_strdup_printf ("%s %s ", method, path);
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&bmc->mutex);
+
+	for (guint i = 0; i < bmc->requests->len; i++) {
+		const gchar *request = g_ptr_array_index (bmc->requests, i);
+		if (!g_str_has_prefix (request, prefix))
+			continue;
+		if (header != NULL && g_strstr_len (request, -1, header) == NULL)
+			continue;
+		cnt++;
+	}
+	return cnt;
+}
+
+static void
+fu_test_bmc_handle_connection (FuTestBmc *bmc, GSocketConnection *conn)
+{
+	GOutputStream *ostream = g_io_stream_get_output_stream (G_IO_STREAM (conn));
+	FuTestBmcResponse *response = NULL;
+	FuTestBmcResponse *response_owned = NULL;
+	gsize content_length = 0;
+	g_auto(GStrv) split = NULL;
+	g_autofree gchar *key = NULL;
+	g_autoptr(GDataInputStream) istream = NULL;
+	g_autoptr(GString) request = g_string_new (NULL);
+	g_autoptr(GString) reply = g_string_new (NULL);
+
+	/* request line and headers */
+	istream = g_data_input_stream_new (g_io_stream_get_input_stream (G_IO_STREAM (conn)));
+	g_data_input_stream_set_newline_type (istream, G_DATA_STREAM_NEWLINE_TYPE_CR_LF);
+	while (TRUE) {
+		g_autofree gchar *line = g_data_input_stream_read_line (istream, NULL,
+									bmc->cancellable,
+									NULL);
+		if (line == NULL || line[0] == '\0')
+			break;
+		g_string_append_printf (request, "%s\n", line);
+		if (g_ascii_strncasecmp (line, "Content-Length:", 15) == 0)
+			content_length = g_ascii_strtoull (line + 15, NULL, 10);
+		if (g_ascii_strncasecmp (line, "Expect: 100-continue", 20) == 0) {
+			const gchar *cont = "HTTP/1.1 100 Continue\r\n\r\n";
+			g_output_stream_write_all (ostream, cont, strlen (cont),
+						   NULL, bmc->cancellable, NULL);
+		}
+	}
+
+	/* the uploaded payload is not interesting */
+	if (content_length > 0) {
+		g_autofree guint8 *body = g_malloc (content_length);
+		g_input_stream_read_all (G_INPUT_STREAM (istream), body, content_length,
+					 NULL, bmc->cancellable, NULL);
+	}
+
+	/* the next canned response, where the last one is used forever */
+	split = g_strsplit (request->str, " ", 3);
+	if (g_strv_length (split) >= 2)
+		key = g_strdup_printf ("%s %s", split[0], split[1]);
+	g_mutex_lock (&bmc->mutex);
+	g_ptr_array_add (bmc->requests, g_strdup (request->str));
+	if (key != NULL) {
+		GPtrArray *responses = g_hash_table_lookup (bmc->responses, key);
+		if (responses != NULL && responses->len > 0) {
+			response = g_ptr_array_index (responses, 0);
+			if (responses->len > 1) {
+				g_ptr_array_set_free_func (responses, NULL);
+				g_ptr_array_remove_index (responses, 0);
+				g_ptr_array_set_free_func (responses, (GDestroyNotify) fu_test_bmc_response_free);
+				response_owned = response;
+			}
+		}
+	}
+	if (response == NULL) {
+		g_string_append (reply, "HTTP/1.1 404 Not Found\r\n"
+					"Content-Length: 0\r\n"
+					"Connection: close\r\n\r\n");
+	} else {
+		gsize bodysz = response->body != NULL ? strlen (response->body) : 0;
+		g_string_append_printf (reply, "HTTP/1.1 %u Canned\r\n", response->status);
+		g_string_append_printf (reply, "Content-Length: %" G_GSIZE_FORMAT "\r\n", bodysz);
+		g_string_append (reply, "Connection: close\r\n");
+		if (response->headers != NULL)
+			g_string_append (reply, response->headers);
+		g_string_append (reply, "\r\n");
+		if (response->body != NULL)
+			g_string_append (reply, response->body);
+	}
+	if (response_owned != NULL)
+		fu_test_bmc_response_free (response_owned);
+	g_mutex_unlock (&bmc->mutex);
+	g_output_stream_write_all (ostream, reply->str, reply->len,
+				   NULL, bmc->cancellable, NULL);
+	g_io_stream_close (G_IO_STREAM (conn), NULL, NULL);
+}
+
+static gpointer
+fu_test_bmc_thread_cb (gpointer user_data)
+{
+	FuTestBmc *bmc = (FuTestBmc *) user_data;
+	while (TRUE) {
+		g_autoptr(GSocketConnection) conn = NULL;
+		conn = g_socket_listener_accept (bmc->listener, NULL, bmc->cancellable, NULL);
+		if (conn == NULL)
+			break;
+		fu_test_bmc_handle_connection (bmc, conn);
+	}
+	return NULL;
+}
+
+static FuTestBmc *
+fu_test_bmc_new (void)
+{
+	FuTestBmc *bmc = g_new0 (FuTestBmc, 1);
+	g_autoptr(GError) error = NULL;
+
+	g_mutex_init (&bmc->mutex);
+	bmc->responses = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+						(GDestroyNotify) g_ptr_array_unref);
+	bmc->requests = g_ptr_array_new_with_free_func (g_free);
+	bmc->cancellable = g_cancellable_new ();
+	bmc->listener = g_socket_listener_new ();
+	bmc->port = g_socket_listener_add_any_inet_port (bmc->listener, NULL, &error);
+	g_assert_no_error (error);
+	g_assert_cmpint (bmc->port, !=, 0);
+
+	/* the root and update service every test needs */
+	fu_test_bmc_add_response (bmc, "GET", "/redfish/v1/", 200, NULL,
+				  "{\"RedfishVersion\": \"1.6.0\","
+				  " \"UpdateService\": {\"@odata.id\": \"/redfish/v1/UpdateService\"}}");
+	fu_test_bmc_add_response (bmc, "GET", "/redfish/v1/UpdateService", 200, NULL,
+				  "{\"ServiceEnabled\": true,"
+				  " \"HttpPushUri\": \"/redfish/v1/UpdateService/upload\","
+				  " \"FirmwareInventory\": {\"@odata.id\": \"/redfish/v1/UpdateService/FirmwareInventory\"}}");
+	bmc->thread = g_thread_new ("fu-test-bmc", fu_test_bmc_thread_cb, bmc);
+	return bmc;
+}
+
+static void
+fu_test_bmc_free (FuTestBmc *bmc)
+{
+	g_cancellable_cancel (bmc->cancellable);
+	g_thread_join (bmc->thread);
+	g_socket_listener_close (bmc->listener);
+	g_object_unref (bmc->listener);
+	g_object_unref (bmc->cancellable);
+	g_hash_table_unref (bmc->responses);
+	g_ptr_array_unref (bmc->requests);
+	g_mutex_clear (&bmc->mutex);
+	g_free (bmc);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(FuTestBmc, fu_test_bmc_free)
+
+static FuRedfishClient *
+fu_test_bmc_client_new (FuTestBmc *bmc)
+{
+	gboolean ret;
+	g_autoptr(FuRedfishClient) client = fu_redfish_client_new ();
+	g_autoptr(GError) error = NULL;
+
+	fu_redfish_client_set_hostname (client, "127.0.0.1");
+	fu_redfish_client_set_port (client, bmc->port);
+	ret = fu_redfish_client_setup (client, NULL, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	return g_steal_pointer (&client);
+}
+
 static void
 fu_test_redfish_common_func (void)
 {
@@ -26,11 +252,195 @@ fu_test_redfish_common_func (void)
 	g_assert_cmpstr (ipv6, ==, "00010203:04050607:08090a0b:0c0d0e0f");
 }
 
+static void
+fu_test_redfish_common_uri_path_func (void)
+{
+	g_autofree gchar *path1 = NULL;
+	g_autofree gchar *path2 = NULL;
+	g_autofree gchar *path3 = NULL;
+
+	path1 = fu_redfish_common_get_uri_path ("/redfish/v1/TaskService/Tasks/1");
+	g_assert_cmpstr (path1, ==, "/redfish/v1/TaskService/Tasks/1");
+	path2 = fu_redfish_common_get_uri_path ("https://10.0.0.1:443/redfish/v1/TaskMonitors/2");
+	g_assert_cmpstr (path2, ==, "/redfish/v1/TaskMonitors/2");
+	path3 = fu_redfish_common_get_uri_path ("http://bmc");
+	g_assert_cmpstr (path3, ==, "/");
+}
+
+static void
+fu_test_redfish_client_etag_func (void)
+{
+	FuDevice *device;
+	GPtrArray *devices;
+	gboolean ret;
+	g_autoptr(FuRedfishClient) client = NULL;
+	g_autoptr(FuTestBmc) bmc = fu_test_bmc_new ();
+	g_autoptr(GError) error = NULL;
+
+	fu_test_bmc_add_response (bmc, "GET", "/redfish/v1/UpdateService/FirmwareInventory", 200, NULL,
+				  "{\"Members\": ["
+				  "{\"@odata.id\": \"/redfish/v1/UpdateService/FirmwareInventory/BMC\"},"
+				  "{\"@odata.id\": \"/redfish/v1/UpdateService/FirmwareInventory/BIOS\"}]}");
+
+	/* cached using the ETag, then unchanged */
+	fu_test_bmc_add_response (bmc, "GET", "/redfish/v1/UpdateService/FirmwareInventory/BMC",
+				  200, "ETag: \"1\"\r\n",
+				  "{\"Id\": \"BMC\", \"Version\": \"1.2.3\","
+				  " \"SoftwareId\": \"a9c8c5e2-bb4c-4ac7-9b34-0d6e6b2a9e11\"}");
+	fu_test_bmc_add_response (bmc, "GET", "/redfish/v1/UpdateService/FirmwareInventory/BMC",
+				  304, NULL, NULL);
+
+	/* claims to be unchanged when nothing was ever sent */
+	fu_test_bmc_add_response (bmc, "GET", "/redfish/v1/UpdateService/FirmwareInventory/BIOS",
+				  304, NULL, NULL);
+	fu_test_bmc_add_response (bmc, "GET", "/redfish/v1/UpdateService/FirmwareInventory/BIOS",
+				  200, NULL,
+				  "{\"Id\": \"BIOS\", \"Version\": \"4.5.6\","
+				  " \"SoftwareId\": \"5b6d2a3e-3c5f-4c4e-8d29-6e1c1b0f7a22\"}");
+
+	client = fu_test_bmc_client_new (bmc);
+	for (guint i = 0; i < 2; i++) {
+		ret = fu_redfish_client_coldplug (client, &error);
+		g_assert_no_error (error);
+		g_assert_true (ret);
+		devices = fu_redfish_client_get_devices (client);
+		g_assert_cmpint (devices->len, ==, 2);
+		device = g_ptr_array_index (devices, 0);
+		g_assert_cmpstr (fu_device_get_version (device), ==, "1.2.3");
+		device = g_ptr_array_index (devices, 1);
+		g_assert_cmpstr (fu_device_get_version (device), ==, "4.5.6");
+	}
+
+	/* only the cached member was requested conditionally */
+	g_assert_cmpint (fu_test_bmc_get_request_count (bmc, "GET",
+							"/redfish/v1/UpdateService/FirmwareInventory/BMC",
+							"If-None-Match: \"1\""), ==, 1);
+	g_assert_cmpint (fu_test_bmc_get_request_count (bmc, "GET",
+							"/redfish/v1/UpdateService/FirmwareInventory/BIOS",
+							"If-None-Match"), ==, 0);
+	g_assert_cmpint (fu_test_bmc_get_request_count (bmc, "GET",
+							"/redfish/v1/UpdateService/FirmwareInventory/BIOS",
+							NULL), ==, 3);
+}
+
+typedef struct {
+	GThread			*thread;
+	guint			 cnt_status;
+	guint			 cnt_progress;
+	guint			 cnt_wrong_thread;
+} FuTestProgressHelper;
+
+static void
+fu_test_redfish_device_notify_cb (FuDevice *device, GParamSpec *pspec, gpointer user_data)
+{
+	FuTestProgressHelper *helper = (FuTestProgressHelper *) user_data;
+	if (g_thread_self () != helper->thread)
+		helper->cnt_wrong_thread++;
+	if (g_strcmp0 (g_param_spec_get_name (pspec), "status") == 0)
+		helper->cnt_status++;
+	else
+		helper->cnt_progress++;
+}
+
+static FuDevice *
+fu_test_redfish_device_new (FuTestProgressHelper *helper)
+{
+	FuDevice *device = fu_device_new ();
+	fu_device_set_name (device, "BMC");
+	g_signal_connect (device, "notify::status",
+			  G_CALLBACK (fu_test_redfish_device_notify_cb), helper);
+	g_signal_connect (device, "notify::progress",
+			  G_CALLBACK (fu_test_redfish_device_notify_cb), helper);
+	return device;
+}
+
+static gboolean
+fu_test_redfish_idle_cb (gpointer user_data)
+{
+	guint *cnt = (guint *) user_data;
+	(*cnt)++;
+	return G_SOURCE_REMOVE;
+}
+
+static void
+fu_test_redfish_client_update_func (void)
+{
+	gboolean ret;
+	guint cnt_idle = 0;
+	FuTestProgressHelper helper = { .thread = g_thread_self () };
+	g_autoptr(FuDevice) device = fu_test_redfish_device_new (&helper);
+	g_autoptr(FuRedfishClient) client = NULL;
+	g_autoptr(FuTestBmc) bmc = fu_test_bmc_new ();
+	g_autoptr(GBytes) blob = g_bytes_new_static ("hello world", 11);
+	g_autoptr(GError) error = NULL;
+
+	/* accepted, then the TaskMonitor has no body, then a Task */
+	fu_test_bmc_add_response (bmc, "POST", "/redfish/v1/UpdateService/upload", 202,
+				  "Location: /redfish/v1/TaskMonitors/1\r\n",
+				  "{\"@odata.id\": \"/redfish/v1/TaskService/Tasks/1\"}");
+	fu_test_bmc_add_response (bmc, "GET", "/redfish/v1/TaskMonitors/1", 202, NULL, NULL);
+	fu_test_bmc_add_response (bmc, "GET", "/redfish/v1/TaskMonitors/1", 200, NULL,
+				  "{\"TaskState\": \"Running\", \"PercentComplete\": 50}");
+	fu_test_bmc_add_response (bmc, "GET", "/redfish/v1/TaskMonitors/1", 200, NULL,
+				  "{\"TaskState\": \"Completed\", \"PercentComplete\": 100}");
+
+	/* nothing else in the default context runs during the update */
+	client = fu_test_bmc_client_new (bmc);
+	g_idle_add (fu_test_redfish_idle_cb, &cnt_idle);
+	ret = fu_redfish_client_update (client, device, blob, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	g_assert_cmpint (cnt_idle, ==, 0);
+	g_assert_cmpint (fu_test_bmc_get_request_count (bmc, "POST",
+							"/redfish/v1/UpdateService/upload",
+							NULL), ==, 1);
+	g_assert_cmpint (fu_test_bmc_get_request_count (bmc, "GET",
+							"/redfish/v1/TaskMonitors/1",
+							NULL), ==, 3);
+	while (g_main_context_iteration (NULL, FALSE));
+	g_assert_cmpint (cnt_idle, ==, 1);
+
+	/* all changes were delivered in this thread */
+	g_assert_cmpint (helper.cnt_status, >=, 2);
+	g_assert_cmpint (helper.cnt_progress, >=, 1);
+	g_assert_cmpint (helper.cnt_wrong_thread, ==, 0);
+	g_assert_cmpint (fu_device_get_progress (device), ==, 100);
+}
+
+static void
+fu_test_redfish_client_update_exception_func (void)
+{
+	gboolean ret;
+	FuTestProgressHelper helper = { .thread = g_thread_self () };
+	g_autoptr(FuDevice) device = fu_test_redfish_device_new (&helper);
+	g_autoptr(FuRedfishClient) client = NULL;
+	g_autoptr(FuTestBmc) bmc = fu_test_bmc_new ();
+	g_autoptr(GBytes) blob = g_bytes_new_static ("hello world", 11);
+	g_autoptr(GError) error = NULL;
+
+	fu_test_bmc_add_response (bmc, "POST", "/redfish/v1/UpdateService/upload", 202,
+				  "Location: /redfish/v1/TaskMonitors/2\r\n", NULL);
+	fu_test_bmc_add_response (bmc, "GET", "/redfish/v1/TaskMonitors/2", 200, NULL,
+				  "{\"TaskState\": \"Exception\","
+				  " \"Messages\": [{\"Message\": \"image signature invalid\"}]}");
+
+	client = fu_test_bmc_client_new (bmc);
+	ret = fu_redfish_client_update (client, device, blob, &error);
+	g_assert_error (error, FWUPD_ERROR, FWUPD_ERROR_WRITE);
+	g_assert_nonnull (g_strstr_len (error->message, -1, "image signature invalid"));
+	g_assert_false (ret);
+	g_assert_cmpint (helper.cnt_wrong_thread, ==, 0);
+}
+
 int
 main (int argc, char **argv)
 {
 	g_test_init (&argc, &argv, NULL);
 	g_log_set_fatal_mask (NULL, G_LOG_LEVEL_ERROR | G_LOG_LEVEL_CRITICAL);
 	g_test_add_func ("/redfish/common", fu_test_redfish_common_func);
+	g_test_add_func ("/redfish/common{uri-path}", fu_test_redfish_common_uri_path_func);
+	g_test_add_func ("/redfish/client{etag}", fu_test_redfish_client_etag_func);
+	g_test_add_func ("/redfish/client{update}", fu_test_redfish_client_update_func);
+	g_test_add_func ("/redfish/client{update-exception}", fu_test_redfish_client_update_exception_func);
 	return g_test_run ();
 }
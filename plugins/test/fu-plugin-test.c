@@ -93,6 +93,13 @@ fu_plugin_coldplug (FuPlugin *plugin, GError **error)
 	return TRUE;
 }
 
+gboolean
+fu_plugin_backend_device_added (FuPlugin *plugin, FuDevice *device, GError **error)
+{
+	fu_plugin_device_add (plugin, device);
+	return TRUE;
+}
+
 void
 fu_plugin_device_registered (FuPlugin *plugin, FuDevice *device)
 {
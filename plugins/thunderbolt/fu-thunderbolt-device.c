@@ -40,6 +40,7 @@ struct _FuThunderboltDevice {
 
 #define TBT_NVM_RETRY_TIMEOUT				200	/* ms */
 #define FU_PLUGIN_THUNDERBOLT_UPDATE_TIMEOUT		60000	/* ms */
+#define TBT_NVM_WRITE_BLOCK_SZ				0x10000	/* bytes */
 
 G_DEFINE_TYPE (FuThunderboltDevice, fu_thunderbolt_device, FU_TYPE_UDEV_DEVICE)
 
@@ -589,59 +590,19 @@ fu_thunderbolt_device_write_data (FuThunderboltDevice	*self,
 				  GBytes		*blob_fw,
 				  GError		**error)
 {
-	gsize fw_size;
-	gsize nwritten;
-	gssize n;
+	g_autofree gchar *fn = NULL;
 	g_autoptr(GFile) nvmem = NULL;
-	g_autoptr(GOutputStream) os = NULL;
 
 	nvmem = fu_thunderbolt_device_find_nvmem (self, FALSE, error);
 	if (nvmem == NULL)
 		return FALSE;
 
-	os = (GOutputStream *) g_file_append_to (nvmem,
-						 G_FILE_CREATE_NONE,
-						 NULL,
-						 error);
-
-	if (os == NULL)
-		return FALSE;
-
-	nwritten = 0;
-	fw_size = g_bytes_get_size (blob_fw);
-	fu_device_set_progress_full (FU_DEVICE (self), nwritten, fw_size);
-
-	do {
-		g_autoptr(GBytes) fw_data = NULL;
-
-		fw_data = fu_common_bytes_new_offset (blob_fw,
-						      nwritten,
-						      fw_size - nwritten,
-						      error);
-		if (fw_data == NULL)
-			return FALSE;
-
-		n = g_output_stream_write_bytes (os,
-						 fw_data,
-						 NULL,
-						 error);
-		if (n < 0)
-			return FALSE;
-
-		nwritten += n;
-		fu_device_set_progress_full (FU_DEVICE (self), nwritten, fw_size);
-
-	} while (nwritten < fw_size);
-
-	if (nwritten != fw_size) {
-		g_set_error_literal (error,
-				     FWUPD_ERROR,
-				     FWUPD_ERROR_WRITE,
-				     "Could not write all data to nvmem");
-		return FALSE;
-	}
-
-	return g_output_stream_close (os, NULL, error);
+	/* the kernel accepts a page per write, which is handled for us */
+	fn = g_file_get_path (nvmem);
+	fu_device_set_progress_full (FU_DEVICE (self), 0, g_bytes_get_size (blob_fw));
+	return fu_udev_device_write_bytes (FU_UDEV_DEVICE (self), fn, 0x0,
+					   blob_fw, TBT_NVM_WRITE_BLOCK_SZ,
+					   error);
 }
 
 static FuFirmware *
@@ -172,31 +172,75 @@ fu_vli_device_spi_write_data (FuVliDevice *self, guint32 addr,
 	return TRUE;
 }
 
+typedef struct {
+	guint32			 cnt;
+	GError			*error;		/* from reading the status */
+} FuVliDeviceSpiWaitHelper;
+
 static gboolean
-fu_vli_device_spi_wait_finish (FuVliDevice *self, GError **error)
+fu_vli_device_spi_wait_finish_cb (FuDevice *device, gpointer user_data, GError **error)
 {
+	FuVliDevice *self = FU_VLI_DEVICE (device);
+	FuVliDeviceSpiWaitHelper *helper = (FuVliDeviceSpiWaitHelper *) user_data;
 	const guint32 rdy_cnt = 2;
-	guint32 cnt = 0;
+	guint8 status = 0x7f;
 
-	for (guint32 idx = 0; idx < 1000; idx++) {
-		guint8 status = 0x7f;
+	/* must get bit[1:0] == 0 twice in a row for success */
+	if (!fu_vli_device_spi_read_status (self, &status, &helper->error)) {
+		g_set_error_literal (error,
+				     FWUPD_ERROR,
+				     FWUPD_ERROR_READ,
+				     helper->error->message);
+		return FALSE;
+	}
+	if ((status & 0x03) != 0x00) {
+		helper->cnt = 0;
+		g_set_error (error,
+			     G_IO_ERROR,
+			     G_IO_ERROR_BUSY,
+			     "SPI busy, status 0x%02x", status);
+		return FALSE;
+	}
+	if (helper->cnt++ < rdy_cnt) {
+		g_set_error (error,
+			     G_IO_ERROR,
+			     G_IO_ERROR_BUSY,
+			     "SPI idle %u times", helper->cnt);
+		return FALSE;
+	}
+	return TRUE;
+}
 
-		/* must get bit[1:0] == 0 twice in a row for success */
-		if (!fu_vli_device_spi_read_status (self, &status, error))
+static gboolean
+fu_vli_device_spi_wait_finish_full (FuVliDevice *self,
+				    const gchar *id,
+				    guint budget,
+				    GError **error)
+{
+	FuVliDeviceSpiWaitHelper helper = { 0 };
+	g_autoptr(FuRetryPolicy) policy = fu_retry_policy_new (id);
+
+	fu_retry_policy_set_delay (policy, 10, 500);
+	fu_retry_policy_set_budget (policy, budget);
+	if (!fu_device_retry_with_policy (FU_DEVICE (self), policy,
+					  fu_vli_device_spi_wait_finish_cb,
+					  NULL, &helper, error)) {
+		if (helper.error != NULL) {
+			g_clear_error (error);
+			g_propagate_error (error, helper.error);
 			return FALSE;
-		if ((status & 0x03) == 0x00) {
-			if (cnt++ >= rdy_cnt)
-				return TRUE;
-		} else {
-			cnt = 0;
 		}
-		g_usleep (500 * 1000);
+		g_prefix_error (error, "failed to wait for SPI: ");
+		return FALSE;
 	}
-	g_set_error (error,
-		     G_IO_ERROR,
-		     G_IO_ERROR_FAILED,
-		     "failed to wait for SPI");
-	return FALSE;
+	return TRUE;
+}
+
+static gboolean
+fu_vli_device_spi_wait_finish (FuVliDevice *self, GError **error)
+{
+	return fu_vli_device_spi_wait_finish_full (self, "vli-spi-wait",
+						   500 * 1000, error);
 }
 
 gboolean
@@ -372,7 +416,16 @@ fu_vli_device_spi_erase_all (FuVliDevice *self, GError **error)
 		return FALSE;
 	if (!fu_vli_device_spi_chip_erase (self, error))
 		return FALSE;
-	fu_device_sleep_with_progress (FU_DEVICE (self), 4); /* seconds */
+
+	/* the erase time depends on the flash part, so wait for the status
+	 * register to say it is done if the device can read it */
+	if (FU_VLI_DEVICE_GET_CLASS (self)->spi_read_status != NULL) {
+		if (!fu_vli_device_spi_wait_finish_full (self, "vli-spi-chip-erase",
+							 60 * 1000, error))
+			return FALSE;
+	} else {
+		fu_device_sleep_with_progress (FU_DEVICE (self), 4); /* seconds */
+	}
 
 	/* verify chip was erased */
 	for (guint addr = 0; addr < 0x10000; addr += 0x1000) {
@@ -699,6 +752,12 @@ fu_vli_device_init (FuVliDevice *self)
 	priv->spi_cmd_read_id_sz = 2;
 	priv->spi_auto_detect = TRUE;
 	fu_device_add_flag (FU_DEVICE (self), FWUPD_DEVICE_FLAG_ADD_COUNTERPART_GUIDS);
+
+	/* waiting for the SPI status is retried, but failing to read it is not */
+	fu_device_retry_add_recovery (FU_DEVICE (self),
+				      FWUPD_ERROR,
+				      FWUPD_ERROR_READ,
+				      NULL);
 }
 
 static void
@@ -35,8 +35,11 @@ fu_util_add_devices_json (FuUtilPrivate *priv, JsonBuilder *builder, GError **er
 {
 	g_autoptr(GPtrArray) devs = NULL;
 
-	/* get results from daemon */
-	devs = fwupd_client_get_devices (priv->client, priv->cancellable, error);
+	/* get results from daemon, with all releases that could be applied */
+	devs = fwupd_client_get_devices_with_releases (priv->client,
+						       FWUPD_RELEASE_KIND_ALL,
+						       priv->cancellable,
+						       error);
 	if (devs == NULL)
 		return FALSE;
 
@@ -44,23 +47,6 @@ fu_util_add_devices_json (FuUtilPrivate *priv, JsonBuilder *builder, GError **er
 	json_builder_begin_array (builder);
 	for (guint i = 0; i < devs->len; i++) {
 		FwupdDevice *dev = g_ptr_array_index (devs, i);
-		g_autoptr(GPtrArray) rels = NULL;
-		g_autoptr(GError) error_local = NULL;
-
-		/* add all releases that could be applied */
-		rels = fwupd_client_get_releases (priv->client,
-						  fwupd_device_get_id (dev),
-						  priv->cancellable,
-						  &error_local);
-		if (rels == NULL) {
-			g_debug ("not adding releases to device: %s",
-				 error_local->message);
-		} else {
-			for (guint j = 0; j < rels->len; j++) {
-				FwupdRelease *rel = g_ptr_array_index (rels, j);
-				fwupd_device_add_release (dev, rel);
-			}
-		}
 
 		/* add to builder */
 		json_builder_begin_object (builder);
@@ -76,33 +62,20 @@ fu_util_add_updates_json (FuUtilPrivate *priv, JsonBuilder *builder, GError **er
 {
 	g_autoptr(GPtrArray) devices = NULL;
 
-	/* get devices from daemon */
-	devices = fwupd_client_get_devices (priv->client, NULL, error);
+	/* get devices from daemon, with the releases filtered for validity */
+	devices = fwupd_client_get_devices_with_releases (priv->client,
+							  FWUPD_RELEASE_KIND_UPGRADES,
+							  NULL, error);
 	if (devices == NULL)
 		return FALSE;
 	json_builder_set_member_name (builder, "Devices");
 	json_builder_begin_array (builder);
 	for (guint i = 0; i < devices->len; i++) {
 		FwupdDevice *dev = g_ptr_array_index (devices, i);
-		g_autoptr(GPtrArray) rels = NULL;
-		g_autoptr(GError) error_local = NULL;
-
-		/* not going to have results, so save a D-Bus round-trip */
-		if (!fwupd_device_has_flag (dev, FWUPD_DEVICE_FLAG_SUPPORTED))
-			continue;
 
-		/* get the releases for this device and filter for validity */
-		rels = fwupd_client_get_upgrades (priv->client,
-						  fwupd_device_get_id (dev),
-						  NULL, &error_local);
-		if (rels == NULL) {
-			g_debug ("no upgrades: %s", error_local->message);
+		/* no upgrades */
+		if (fwupd_device_get_releases (dev)->len == 0)
 			continue;
-		}
-		for (guint j = 0; j < rels->len; j++) {
-			FwupdRelease *rel = g_ptr_array_index (rels, j);
-			fwupd_device_add_release (dev, rel);
-		}
 
 		/* add to builder */
 		json_builder_begin_object (builder);
@@ -13,6 +13,7 @@
 #include <gio/gunixinputstream.h>
 #endif
 #include <glib-object.h>
+#include <glib/gstdio.h>
 #include <string.h>
 #ifdef HAVE_UTSNAME_H
 #include <sys/utsname.h>
@@ -20,6 +21,7 @@
 #include <errno.h>
 
 #include "fwupd-common-private.h"
+#include "fwupd-device-private.h"
 #include "fwupd-enums-private.h"
 #include "fwupd-error.h"
 #include "fwupd-release-private.h"
@@ -35,22 +37,30 @@
 #include "fu-debug.h"
 #include "fu-device-list.h"
 #include "fu-device-private.h"
+#include "fu-efivar.h"
 #include "fu-engine.h"
 #include "fu-engine-helper.h"
 #include "fu-engine-request.h"
-#include "fu-hwids.h"
+#include "fu-hwids-private.h"
 #include "fu-idle.h"
+#include "fu-io-trace.h"
+#include "fu-jcat-cache-private.h"
 #include "fu-keyring-utils.h"
 #include "fu-hash.h"
 #include "fu-history.h"
+#include "fu-metrics.h"
 #include "fu-mutex.h"
 #include "fu-plugin.h"
 #include "fu-plugin-list.h"
+#include "fu-poll-scheduler-private.h"
 #include "fu-plugin-private.h"
 #include "fu-quirks.h"
 #include "fu-remote-list.h"
+#include "fu-replay-backend.h"
+#include "fu-retry-policy-private.h"
 #include "fu-security-attr.h"
 #include "fu-security-attrs-private.h"
+#include "fu-silo-cache-private.h"
 #include "fu-smbios-private.h"
 #include "fu-udev-device-private.h"
 
@@ -94,11 +104,18 @@ struct _FuEngine
 	FuHistory		*history;
 	FuIdle			*idle;
 	XbSilo			*silo;
+	guint64			 silo_generation;	/* incremented on each swap */
+	guint64			 silo_request;		/* incremented on each compile */
+	guint64			 silo_request_loaded;
 	gboolean		 coldplug_running;
 	guint			 coldplug_id;
 	guint			 coldplug_delay;
+	guint			 parse_cabinet_cnt;	/* archives being parsed in a thread */
 	FuPluginList		*plugin_list;
 	GPtrArray		*plugin_filter;
+	GPtrArray		*plugins_deferred;	/* of FuPlugin, not yet opened */
+	guint			 plugins_deferred_id;
+	FuEngineLoadFlags	 load_flags;
 	GPtrArray		*udev_subsystems;
 	FuSmbios		*smbios;
 	FuHwids			*hwids;
@@ -109,6 +126,8 @@ struct _FuEngine
 	GHashTable		*blocked_firmware;	/* (nullable) */
 	GHashTable		*firmware_gtypes;
 	gchar			*host_machine_id;
+	GKeyFile		*boot_cache;		/* (nullable) */
+	gboolean		 boot_cache_changed;
 	JcatContext		*jcat_context;
 	gboolean		 loaded;
 	gchar			*host_security_id;
@@ -129,6 +148,9 @@ static guint signals[SIGNAL_LAST] = { 0 };
 
 G_DEFINE_TYPE (FuEngine, fu_engine, G_TYPE_OBJECT)
 
+/* only one metadata.xmlb can be compiled at a time */
+static GMutex silo_mutex;
+
 #define FU_ENGINE_BATTERY_LEVEL_THRESHOLD	10 /* % */
 
 static void
@@ -587,6 +609,7 @@ fu_engine_get_remote_id_for_checksum (FuEngine *self, const gchar *csum)
 	xpath = g_strdup_printf ("components/component[@type='firmware']/releases/release/"
 				 "checksum[@target='container'][text()='%s']/../../"
 				 "../../custom/value[@key='fwupd::RemoteId']", csum);
+	fu_metrics_add_counter ("engine.silo-query", 1);
 	key = xb_silo_query_first (self->silo, xpath, NULL);
 	if (key == NULL)
 		return NULL;
@@ -901,6 +924,7 @@ fu_engine_get_component_by_guids (FuEngine *self, FuDevice *device)
 					"provides/firmware[@type='flashed'][text()='%s']/"
 					"../..", guid);
 	}
+	fu_metrics_add_counter ("engine.silo-query", 1);
 	component = xb_silo_query_first (self->silo, xpath->str, NULL);
 	if (component != NULL)
 		return g_steal_pointer (&component);
@@ -987,6 +1011,7 @@ fu_engine_verify_from_system_metadata (FuEngine *self,
 #endif
 
 		/* bind GUID and then query */
+		fu_metrics_add_counter ("engine.silo-query", 1);
 #if LIBXMLB_CHECK_VERSION(0,3,0)
 		xb_value_bindings_bind_str (xb_query_context_get_bindings (&context), 0, guid, NULL);
 		releases = xb_silo_query_with_context (self->silo, query, &context, &error_local);
@@ -1667,6 +1692,85 @@ fu_engine_get_boot_time (void)
 	return NULL;
 }
 
+#define FU_ENGINE_BOOT_CACHE_GROUP		"fwupd Boot"
+
+static gchar *
+fu_engine_get_boot_id (void)
+{
+	g_autofree gchar *buf = NULL;
+	if (!g_file_get_contents ("/proc/sys/kernel/random/boot_id", &buf, NULL, NULL))
+		return NULL;
+	return g_strdup (g_strstrip (buf));
+}
+
+/* values that cannot change until the next reboot */
+static void
+fu_engine_boot_cache_load (FuEngine *self)
+{
+	g_autofree gchar *boot_id = fu_engine_get_boot_id ();
+	g_autofree gchar *boot_id_old = NULL;
+	g_autofree gchar *cachedirpkg = fu_common_get_path (FU_PATH_KIND_CACHEDIR_PKG);
+	g_autofree gchar *fn = g_build_filename (cachedirpkg, "boot.ini", NULL);
+	g_autoptr(GKeyFile) kf = g_key_file_new ();
+
+	/* no way to detect a reboot */
+	if (boot_id == NULL)
+		return;
+	if (g_key_file_load_from_file (kf, fn, G_KEY_FILE_NONE, NULL)) {
+		boot_id_old = g_key_file_get_string (kf, FU_ENGINE_BOOT_CACHE_GROUP,
+						     "BootId", NULL);
+	}
+	if (g_strcmp0 (boot_id, boot_id_old) != 0) {
+		g_debug ("ignoring boot cache from boot %s", boot_id_old);
+		g_key_file_unref (kf);
+		kf = g_key_file_new ();
+		g_key_file_set_string (kf, FU_ENGINE_BOOT_CACHE_GROUP, "BootId", boot_id);
+		self->boot_cache_changed = TRUE;
+	}
+	self->boot_cache = g_steal_pointer (&kf);
+}
+
+static void
+fu_engine_boot_cache_save (FuEngine *self)
+{
+	g_autofree gchar *cachedirpkg = NULL;
+	g_autofree gchar *fn = NULL;
+	g_autoptr(GError) error_local = NULL;
+
+	if (self->boot_cache == NULL || !self->boot_cache_changed)
+		return;
+	cachedirpkg = fu_common_get_path (FU_PATH_KIND_CACHEDIR_PKG);
+	fn = g_build_filename (cachedirpkg, "boot.ini", NULL);
+	if (!fu_common_mkdir_parent (fn, &error_local) ||
+	    !g_key_file_save_to_file (self->boot_cache, fn, &error_local)) {
+		g_debug ("failed to save boot cache: %s", error_local->message);
+		return;
+	}
+	self->boot_cache_changed = FALSE;
+}
+
+static gchar *
+fu_engine_build_machine_id (FuEngine *self, GError **error)
+{
+	gchar *machine_id;
+
+	/* hashing the machine-id is only done once per boot */
+	if (self->boot_cache != NULL) {
+		machine_id = g_key_file_get_string (self->boot_cache,
+						    FU_ENGINE_BOOT_CACHE_GROUP,
+						    "MachineId", NULL);
+		if (machine_id != NULL)
+			return machine_id;
+	}
+	machine_id = fwupd_build_machine_id ("fwupd", error);
+	if (machine_id != NULL && self->boot_cache != NULL) {
+		g_key_file_set_string (self->boot_cache, FU_ENGINE_BOOT_CACHE_GROUP,
+				       "MachineId", machine_id);
+		self->boot_cache_changed = TRUE;
+	}
+	return machine_id;
+}
+
 static gboolean
 fu_engine_get_report_metadata_os_release (GHashTable *hash, GError **error)
 {
@@ -1790,14 +1894,81 @@ fu_engine_get_report_metadata_kernel_cmdline (GHashTable *hash, GError **error)
 	return TRUE;
 }
 
-GHashTable *
-fu_engine_get_report_metadata (FuEngine *self, GError **error)
+/* the distro, kernel and boot time are only read once per boot */
+static gboolean
+fu_engine_get_report_metadata_boot (FuEngine *self, GHashTable *hash, GError **error)
 {
-	const gchar *tmp;
+	GHashTableIter iter;
 	gchar *btime;
+	gpointer key, value;
 #ifdef HAVE_UTSNAME_H
 	struct utsname name_tmp;
 #endif
+	g_autoptr(GHashTable) hash_boot = NULL;
+
+	/* already read this boot */
+	if (self->boot_cache != NULL &&
+	    g_key_file_has_group (self->boot_cache, "ReportMetadata")) {
+		g_auto(GStrv) keys = g_key_file_get_keys (self->boot_cache,
+							  "ReportMetadata",
+							  NULL, error);
+		if (keys == NULL)
+			return FALSE;
+		for (guint i = 0; keys[i] != NULL; i++) {
+			gchar *tmp = g_key_file_get_string (self->boot_cache,
+							    "ReportMetadata",
+							    keys[i], error);
+			if (tmp == NULL)
+				return FALSE;
+			g_hash_table_insert (hash, g_strdup (keys[i]), tmp);
+		}
+		return TRUE;
+	}
+
+	hash_boot = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+	if (!fu_engine_get_report_metadata_os_release (hash_boot, error))
+		return FALSE;
+	if (!fu_engine_get_report_metadata_kernel_cmdline (hash_boot, error))
+		return FALSE;
+
+	/* kernel version is often important for debugging failures */
+#ifdef HAVE_UTSNAME_H
+	memset (&name_tmp, 0, sizeof (struct utsname));
+	if (uname (&name_tmp) >= 0) {
+		g_hash_table_insert (hash_boot,
+				     g_strdup ("CpuArchitecture"),
+				     g_strdup (name_tmp.machine));
+		g_hash_table_insert (hash_boot,
+				     g_strdup ("KernelVersion"),
+				     g_strdup (name_tmp.release));
+	}
+#endif
+
+	/* add the kernel boot time so we can detect a reboot */
+	btime = fu_engine_get_boot_time ();
+	if (btime != NULL)
+		g_hash_table_insert (hash_boot, g_strdup ("BootTime"), btime);
+
+	/* save for next time */
+	g_hash_table_iter_init (&iter, hash_boot);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		if (self->boot_cache != NULL) {
+			g_key_file_set_string (self->boot_cache, "ReportMetadata",
+					       key, value);
+		}
+		g_hash_table_insert (hash, g_strdup (key), g_strdup (value));
+	}
+	if (self->boot_cache != NULL) {
+		self->boot_cache_changed = TRUE;
+		fu_engine_boot_cache_save (self);
+	}
+	return TRUE;
+}
+
+GHashTable *
+fu_engine_get_report_metadata (FuEngine *self, GError **error)
+{
+	const gchar *tmp;
 	g_autoptr(GHashTable) hash = NULL;
 	g_autoptr(GList) compile_keys = g_hash_table_get_keys (self->compile_versions);
 	g_autoptr(GList) runtime_keys = g_hash_table_get_keys (self->runtime_versions);
@@ -1818,9 +1989,7 @@ fu_engine_get_report_metadata (FuEngine *self, GError **error)
 				     g_strdup_printf ("RuntimeVersion(%s)", id),
 				     g_strdup (version));
 	}
-	if (!fu_engine_get_report_metadata_os_release (hash, error))
-		return NULL;
-	if (!fu_engine_get_report_metadata_kernel_cmdline (hash, error))
+	if (!fu_engine_get_report_metadata_boot (self, hash, error))
 		return NULL;
 
 	/* DMI data */
@@ -1837,24 +2006,6 @@ fu_engine_get_report_metadata (FuEngine *self, GError **error)
 	if (tmp != NULL)
 		g_hash_table_insert (hash, g_strdup ("HostVendor"), g_strdup (tmp));
 
-	/* kernel version is often important for debugging failures */
-#ifdef HAVE_UTSNAME_H
-	memset (&name_tmp, 0, sizeof (struct utsname));
-	if (uname (&name_tmp) >= 0) {
-		g_hash_table_insert (hash,
-				     g_strdup ("CpuArchitecture"),
-				     g_strdup (name_tmp.machine));
-		g_hash_table_insert (hash,
-				     g_strdup ("KernelVersion"),
-				     g_strdup (name_tmp.release));
-	}
-#endif
-
-	/* add the kernel boot time so we can detect a reboot */
-	btime = fu_engine_get_boot_time ();
-	if (btime != NULL)
-		g_hash_table_insert (hash, g_strdup ("BootTime"), btime);
-
 	return g_steal_pointer (&hash);
 }
 
@@ -1904,6 +2055,14 @@ fu_engine_composite_cleanup (FuEngine *self, GPtrArray *devices, GError **error)
 	return TRUE;
 }
 
+static void
+fu_engine_save_retry_settle (void)
+{
+	g_autoptr(GError) error_local = NULL;
+	if (!fu_retry_policy_save_settle (&error_local))
+		g_debug ("failed to save learned settle times: %s", error_local->message);
+}
+
 /**
  * fu_engine_install_tasks:
  * @self: A #FuEngine
@@ -1955,6 +2114,7 @@ fu_engine_install_tasks (FuEngine *self,
 		FuInstallTask *task = g_ptr_array_index (install_tasks, i);
 		if (!fu_engine_install (self, task, blob_cab, flags, error)) {
 			g_autoptr(GError) error_local = NULL;
+			fu_engine_save_retry_settle ();
 			if (!fu_engine_composite_cleanup (self, devices, &error_local)) {
 				g_warning ("failed to cleanup failed composite action: %s",
 					   error_local->message);
@@ -1970,6 +2130,9 @@ fu_engine_install_tasks (FuEngine *self,
 		fu_device_set_status (device, FWUPD_STATUS_UNKNOWN);
 	}
 
+	/* remember how long the devices took to settle */
+	fu_engine_save_retry_settle ();
+
 	/* get a new list of devices in case they replugged */
 	devices_new = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
 	for (guint i = 0; i < devices->len; i++) {
@@ -3407,20 +3570,13 @@ fu_engine_md_refresh_devices (FuEngine *self)
 	}
 }
 
-static gboolean
-fu_engine_load_metadata_store (FuEngine *self, FuEngineLoadFlags flags, GError **error)
+/* only collects the sources, so this is quick */
+static XbBuilder *
+fu_engine_load_metadata_builder (FuEngine *self)
 {
 	GPtrArray *remotes;
-	XbBuilderCompileFlags compile_flags = XB_BUILDER_COMPILE_FLAG_IGNORE_INVALID;
-	g_autofree gchar *cachedirpkg = NULL;
-	g_autofree gchar *xmlbfn = NULL;
-	g_autoptr(GFile) xmlb = NULL;
-	g_autoptr(GPtrArray) components = NULL;
 	g_autoptr(XbBuilder) builder = xb_builder_new ();
 
-	/* clear existing silo */
-	g_clear_object (&self->silo);
-
 	/* verbose profiling */
 	if (g_getenv ("FWUPD_XMLB_VERBOSE") != NULL) {
 		xb_builder_set_profile_flags (builder,
@@ -3490,60 +3646,129 @@ fu_engine_load_metadata_store (FuEngine *self, FuEngineLoadFlags flags, GError *
 		/* we need to watch for changes? */
 		xb_builder_import_source (builder, source);
 	}
+	return g_steal_pointer (&builder);
+}
+
+/* this is slow, and is called from a thread so must not use the engine */
+static XbSilo *
+fu_engine_compile_metadata_silo (XbBuilder *builder,
+				 FuEngineLoadFlags flags,
+				 GCancellable *cancellable,
+				 GError **error)
+{
+	XbBuilderCompileFlags compile_flags = XB_BUILDER_COMPILE_FLAG_IGNORE_INVALID;
+	g_autoptr(GPtrArray) components = NULL;
+	g_autoptr(XbSilo) silo = NULL;
 
 	/* on a read-only filesystem don't care about the cache GUID */
 	if (flags & FU_ENGINE_LOAD_FLAG_READONLY)
 		compile_flags |= XB_BUILDER_COMPILE_FLAG_IGNORE_GUID;
 
-	/* ensure silo is up to date */
-	cachedirpkg = fu_common_get_path (FU_PATH_KIND_CACHEDIR_PKG);
-	xmlbfn = g_build_filename (cachedirpkg, "metadata.xmlb", NULL);
-	xmlb = g_file_new_for_path (xmlbfn);
-	self->silo = xb_builder_ensure (builder, xmlb, compile_flags, NULL, error);
-	if (self->silo == NULL)
-		return FALSE;
+	/* ensure silo is up to date, shared with other fwupd processes */
+	silo = fu_silo_cache_ensure (builder, "metadata.xmlb", compile_flags,
+				     cancellable, error);
+	if (silo == NULL)
+		return NULL;
 
 	/* print what we've got */
-	components = xb_silo_query (self->silo,
+	components = xb_silo_query (silo,
 				    "components/component[@type='firmware']",
 				    0, NULL);
 	if (components != NULL)
 		g_debug ("%u components now in silo", components->len);
 
 	/* build the index */
-	if (!xb_silo_query_build_index (self->silo,
+	if (!xb_silo_query_build_index (silo,
 					"components/component",
 					"type", error))
-		return FALSE;
-	if (!xb_silo_query_build_index (self->silo,
+		return NULL;
+	if (!xb_silo_query_build_index (silo,
 					"components/component[@type='firmware']/provides/firmware",
 					"type", error))
-		return FALSE;
-	if (!xb_silo_query_build_index (self->silo,
+		return NULL;
+	if (!xb_silo_query_build_index (silo,
 					"components/component[@type='firmware']/provides/firmware",
 					NULL, error))
-		return FALSE;
+		return NULL;
 
 	/* success */
+	return g_steal_pointer (&silo);
+}
+
+/* returns %FALSE if a silo from a newer request has already been swapped in */
+static gboolean
+fu_engine_swap_metadata_silo (FuEngine *self, XbSilo *silo, guint64 request)
+{
+	if (request < self->silo_request_loaded) {
+		g_debug ("ignoring metadata silo from stale request %" G_GUINT64_FORMAT,
+			 request);
+		return FALSE;
+	}
+	self->silo_request_loaded = request;
+	self->silo_generation++;
+	g_set_object (&self->silo, silo);
+	g_debug ("metadata silo is now generation %" G_GUINT64_FORMAT,
+		 self->silo_generation);
 	return TRUE;
 }
 
-static void
-fu_engine_config_changed_cb (FuConfig *config, FuEngine *self)
+static gboolean
+fu_engine_load_metadata_store (FuEngine *self, FuEngineLoadFlags flags, GError **error)
 {
-	fu_idle_set_timeout (self->idle, fu_config_get_idle_timeout (config));
+	guint64 request = ++self->silo_request;
+	g_autoptr(GMutexLocker) locker = NULL;
+	g_autoptr(XbBuilder) builder = fu_engine_load_metadata_builder (self);
+	g_autoptr(XbSilo) silo = NULL;
+
+	locker = g_mutex_locker_new (&silo_mutex);
+	silo = fu_engine_compile_metadata_silo (builder, flags, NULL, error);
+	if (silo == NULL)
+		return FALSE;
+	fu_engine_swap_metadata_silo (self, silo, request);
+	return TRUE;
 }
 
+typedef struct {
+	XbBuilder		*builder;
+	FuEngineLoadFlags	 flags;
+	guint64			 request;
+	gint64			 blocked;	/* us */
+} FuEngineLoadMetadataHelper;
+
 static void
-fu_engine_remote_list_changed_cb (FuRemoteList *remote_list, FuEngine *self)
+fu_engine_load_metadata_helper_free (FuEngineLoadMetadataHelper *helper)
 {
-	g_autoptr(GError) error_local = NULL;
-	if (!fu_engine_load_metadata_store (self, FU_ENGINE_LOAD_FLAG_NONE,
-					    &error_local))
-		g_warning ("Failed to reload metadata store: %s",
-			   error_local->message);
+	g_object_unref (helper->builder);
+	g_free (helper);
+}
 
-	/* set device properties from the metadata */
+static void
+fu_engine_load_metadata_store_thread_cb (GTask *task,
+					 gpointer source_object,
+					 gpointer task_data,
+					 GCancellable *cancellable)
+{
+	FuEngineLoadMetadataHelper *helper = (FuEngineLoadMetadataHelper *) task_data;
+	gint64 start = g_get_monotonic_time ();
+	GError *error = NULL;
+	XbSilo *silo;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&silo_mutex);
+
+	silo = fu_engine_compile_metadata_silo (helper->builder, helper->flags,
+						cancellable, &error);
+	if (silo == NULL) {
+		g_task_return_error (task, error);
+		return;
+	}
+	fu_metrics_add_duration ("engine.metadata-compile", g_get_monotonic_time () - start);
+	g_task_return_pointer (task, silo, (GDestroyNotify) g_object_unref);
+}
+
+/* set device properties from the metadata and make the UI update */
+static void
+fu_engine_metadata_changed (FuEngine *self)
+{
+	/* refresh SUPPORTED flag on devices */
 	fu_engine_md_refresh_devices (self);
 
 	/* invalidate host security attributes */
@@ -3553,105 +3778,195 @@ fu_engine_remote_list_changed_cb (FuRemoteList *remote_list, FuEngine *self)
 	fu_engine_emit_changed (self);
 }
 
-static gint
-fu_engine_sort_jcat_results_timestamp_cb (gconstpointer a, gconstpointer b)
+static void
+fu_engine_load_metadata_store_compile_cb (GObject *source,
+					  GAsyncResult *res,
+					  gpointer user_data)
 {
-	JcatResult *ra = *((JcatResult **) a);
-	JcatResult *rb = *((JcatResult **) b);
-	if (jcat_result_get_timestamp (ra) < jcat_result_get_timestamp (rb))
-		return 1;
-	if (jcat_result_get_timestamp (ra) > jcat_result_get_timestamp (rb))
-		return -1;
-	return 0;
+	FuEngine *self = FU_ENGINE (source);
+	FuEngineLoadMetadataHelper *helper = g_task_get_task_data (G_TASK (res));
+	gint64 start = g_get_monotonic_time ();
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GTask) task = G_TASK (user_data);
+	g_autoptr(XbSilo) silo = NULL;
+
+	silo = g_task_propagate_pointer (G_TASK (res), &error);
+	if (silo == NULL) {
+		g_task_return_error (task, g_steal_pointer (&error));
+		return;
+	}
+	if (fu_engine_swap_metadata_silo (self, silo, helper->request))
+		fu_engine_metadata_changed (self);
+
+	/* the only time the daemon was not answering requests */
+	fu_metrics_add_duration ("engine.metadata-blocked",
+				 helper->blocked + g_get_monotonic_time () - start);
+	g_task_return_boolean (task, TRUE);
 }
 
-static JcatResult *
-fu_engine_get_newest_signature_jcat_result (GPtrArray *results, GError **error)
+/* @blocked is how long the caller already blocked the main thread for */
+static void
+fu_engine_load_metadata_store_async (FuEngine *self,
+				     gint64 blocked,
+				     GCancellable *cancellable,
+				     GAsyncReadyCallback callback,
+				     gpointer callback_data)
+{
+	FuEngineLoadMetadataHelper *helper = g_new0 (FuEngineLoadMetadataHelper, 1);
+	gint64 start = g_get_monotonic_time ();
+	g_autoptr(GTask) task = g_task_new (self, cancellable, callback, callback_data);
+	g_autoptr(GTask) task_thread = NULL;
+
+	/* the old silo is used for queries until the new one is ready */
+	helper->builder = fu_engine_load_metadata_builder (self);
+	helper->flags = FU_ENGINE_LOAD_FLAG_NONE;
+	helper->request = ++self->silo_request;
+	helper->blocked = blocked + g_get_monotonic_time () - start;
+	task_thread = g_task_new (self, cancellable,
+				  fu_engine_load_metadata_store_compile_cb,
+				  g_steal_pointer (&task));
+	g_task_set_task_data (task_thread, helper,
+			      (GDestroyNotify) fu_engine_load_metadata_helper_free);
+	g_task_run_in_thread (task_thread, fu_engine_load_metadata_store_thread_cb);
+}
+
+static gboolean
+fu_engine_load_metadata_store_finish (FuEngine *self, GAsyncResult *res, GError **error)
 {
-	/* sort by timestamp, newest first */
-	g_ptr_array_sort (results, fu_engine_sort_jcat_results_timestamp_cb);
+	return g_task_propagate_boolean (G_TASK (res), error);
+}
 
-	/* get the first signature, ignoring the checksums */
-	for (guint i = 0; i < results->len; i++) {
-		JcatResult *result = g_ptr_array_index (results, i);
-#if LIBJCAT_CHECK_VERSION(0, 1, 3)
-		if (jcat_result_get_method (result) == JCAT_BLOB_METHOD_SIGNATURE)
-			return g_object_ref (result);
-#else
-		guint verify_kind = 0;
-		g_autoptr(JcatEngine) engine = NULL;
-		g_object_get (result, "engine", &engine, NULL);
-		g_object_get (engine, "verify-kind", &verify_kind, NULL);
-		if (verify_kind == 2) /* SIGNATURE */
-			return g_object_ref (result);
-#endif
-	}
+/**
+ * fu_engine_get_silo_generation:
+ * @self: A #FuEngine
+ *
+ * Gets the generation of the metadata silo, which is incremented each time
+ * new metadata is loaded.
+ *
+ * Returns: integer
+ **/
+guint64
+fu_engine_get_silo_generation (FuEngine *self)
+{
+	g_return_val_if_fail (FU_IS_ENGINE (self), G_MAXUINT64);
+	return self->silo_generation;
+}
 
-	/* should never happen due to %JCAT_VERIFY_FLAG_REQUIRE_SIGNATURE */
-	g_set_error_literal (error,
-			     FWUPD_ERROR,
-			     FWUPD_ERROR_INVALID_FILE,
-			     "no signature method in results");
-	return NULL;
+/**
+ * fu_engine_reload_metadata_async:
+ * @self: A #FuEngine
+ * @cancellable: A #GCancellable, or %NULL
+ * @callback: the function to run on completion
+ * @callback_data: the data to pass to @callback
+ *
+ * Recompiles the metadata silo in a thread, and swaps it in when ready.
+ * Until then the old metadata is used.
+ **/
+void
+fu_engine_reload_metadata_async (FuEngine *self,
+				 GCancellable *cancellable,
+				 GAsyncReadyCallback callback,
+				 gpointer callback_data)
+{
+	g_return_if_fail (FU_IS_ENGINE (self));
+	g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+	fu_engine_load_metadata_store_async (self, 0, cancellable, callback, callback_data);
+}
+
+/**
+ * fu_engine_reload_metadata_finish:
+ * @self: A #FuEngine
+ * @res: A #GAsyncResult
+ * @error: A #GError, or %NULL
+ *
+ * Gets the result of fu_engine_reload_metadata_async().
+ *
+ * Returns: %TRUE for success
+ **/
+gboolean
+fu_engine_reload_metadata_finish (FuEngine *self, GAsyncResult *res, GError **error)
+{
+	g_return_val_if_fail (FU_IS_ENGINE (self), FALSE);
+	g_return_val_if_fail (g_task_is_valid (res, self), FALSE);
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+	return fu_engine_load_metadata_store_finish (self, res, error);
+}
+
+static void
+fu_engine_config_changed_cb (FuConfig *config, FuEngine *self)
+{
+	fu_idle_set_timeout (self->idle, fu_config_get_idle_timeout (config));
+}
+
+static void
+fu_engine_remote_list_reload_cb (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+	g_autoptr(GError) error_local = NULL;
+	if (!fu_engine_load_metadata_store_finish (FU_ENGINE (source), res, &error_local))
+		g_warning ("Failed to reload metadata store: %s",
+			   error_local->message);
+}
+
+static void
+fu_engine_remote_list_changed_cb (FuRemoteList *remote_list, FuEngine *self)
+{
+	fu_engine_load_metadata_store_async (self, 0, NULL,
+					     fu_engine_remote_list_reload_cb,
+					     NULL);
 }
 
-static JcatResult *
-fu_engine_get_system_jcat_result (FuEngine *self, FwupdRemote *remote, GError **error)
+/* this uses the saved verification result for the existing metadata if
+ * possible, so no signatures have to be verified again */
+static gboolean
+fu_engine_get_system_jcat_timestamp (FuEngine *self,
+				     FwupdRemote *remote,
+				     gint64 *timestamp,
+				     GError **error)
 {
 	g_autoptr(GBytes) blob = NULL;
 	g_autoptr(GBytes) blob_sig = NULL;
 	g_autoptr(GInputStream) istream = NULL;
-	g_autoptr(GPtrArray) results = NULL;
 	g_autoptr(JcatItem) jcat_item = NULL;
 	g_autoptr(JcatFile) jcat_file = jcat_file_new ();
 
 	blob = fu_common_get_contents_bytes (fwupd_remote_get_filename_cache (remote), error);
 	if (blob == NULL)
-		return NULL;
+		return FALSE;
 	blob_sig = fu_common_get_contents_bytes (fwupd_remote_get_filename_cache_sig (remote), error);
 	if (blob_sig == NULL)
-		return NULL;
+		return FALSE;
 	istream = g_memory_input_stream_new_from_bytes (blob_sig);
 	if (!jcat_file_import_stream (jcat_file, istream,
 				      JCAT_IMPORT_FLAG_NONE,
 				      NULL, error))
-		return NULL;
+		return FALSE;
 	jcat_item = jcat_file_get_item_default (jcat_file, error);
 	if (jcat_item == NULL)
-		return NULL;
-	results = jcat_context_verify_item (self->jcat_context,
-					    blob, jcat_item,
-					    JCAT_VERIFY_FLAG_REQUIRE_CHECKSUM |
-					    JCAT_VERIFY_FLAG_REQUIRE_SIGNATURE,
-					    error);
-	if (results == NULL)
-		return NULL;
-
-	/* return the newest signature */
-	return fu_engine_get_newest_signature_jcat_result (results, error);
+		return FALSE;
+	return fu_jcat_cache_verify_item (self->jcat_context,
+					  blob, jcat_item,
+					  JCAT_VERIFY_FLAG_REQUIRE_CHECKSUM |
+					  JCAT_VERIFY_FLAG_REQUIRE_SIGNATURE,
+					  timestamp, NULL,
+					  error);
 }
 
 static gboolean
-fu_engine_validate_result_timestamp (JcatResult *jcat_result,
-				     JcatResult *jcat_result_old,
+fu_engine_validate_result_timestamp (gint64 timestamp,
+				     gint64 timestamp_old,
 				     GError **error)
 {
 	gint64 delta = 0;
 
-	g_return_val_if_fail (JCAT_IS_RESULT (jcat_result), FALSE);
-	g_return_val_if_fail (JCAT_IS_RESULT (jcat_result_old), FALSE);
-
-	if (jcat_result_get_timestamp (jcat_result) == 0) {
+	if (timestamp == 0) {
 		g_set_error (error,
 			     FWUPD_ERROR,
 			     FWUPD_ERROR_INVALID_FILE,
 			     "no signing timestamp");
 		return FALSE;
 	}
-	if (jcat_result_get_timestamp (jcat_result_old) > 0) {
-		delta = jcat_result_get_timestamp (jcat_result) -
-			jcat_result_get_timestamp (jcat_result_old);
-	}
+	if (timestamp_old > 0)
+		delta = timestamp - timestamp_old;
 	if (delta < 0) {
 		g_set_error (error,
 			     FWUPD_ERROR,
@@ -3666,33 +3981,16 @@ fu_engine_validate_result_timestamp (JcatResult *jcat_result,
 	return TRUE;
 }
 
-/**
- * fu_engine_update_metadata_bytes:
- * @self: A #FuEngine
- * @remote_id: A remote ID, e.g. `lvfs`
- * @bytes_raw: Blob of metadata
- * @bytes_sig: Blob of metadata signature, typically Jcat binary format
- * @error: A #GError, or %NULL
- *
- * Updates the metadata for a specific remote.
- *
- * Returns: %TRUE for success
- **/
-gboolean
-fu_engine_update_metadata_bytes (FuEngine *self, const gchar *remote_id,
-			        GBytes *bytes_raw, GBytes *bytes_sig, GError **error)
+/* verifies the metadata and saves it to remotes.d */
+static gboolean
+fu_engine_save_metadata_bytes (FuEngine *self, const gchar *remote_id,
+			       GBytes *bytes_raw, GBytes *bytes_sig, GError **error)
 {
 	FwupdKeyringKind keyring_kind;
 	FwupdRemote *remote;
 	JcatVerifyFlags jcat_flags = JCAT_VERIFY_FLAG_REQUIRE_SIGNATURE;
 	g_autoptr(JcatFile) jcat_file = jcat_file_new ();
 
-	g_return_val_if_fail (FU_IS_ENGINE (self), FALSE);
-	g_return_val_if_fail (remote_id != NULL, FALSE);
-	g_return_val_if_fail (bytes_raw != NULL, FALSE);
-	g_return_val_if_fail (bytes_sig != NULL, FALSE);
-	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
-
 	/* check remote is valid */
 	remote = fu_remote_list_get_by_id (self->remote_list, remote_id);
 	if (remote == NULL) {
@@ -3736,31 +4034,27 @@ fu_engine_update_metadata_bytes (FuEngine *self, const gchar *remote_id,
 
 	/* verify file */
 	if (keyring_kind != FWUPD_KEYRING_KIND_NONE) {
+		gint64 timestamp = 0;
+		gint64 timestamp_old = 0;
 		g_autoptr(GError) error_local = NULL;
-		g_autoptr(GPtrArray) results = NULL;
 		g_autoptr(JcatItem) jcat_item = NULL;
-		g_autoptr(JcatResult) jcat_result = NULL;
-		g_autoptr(JcatResult) jcat_result_old = NULL;
 
-		/* this should only be signing one thing */
+		/* this should only be signing one thing, and the result is saved
+		 * so it does not need verifying again on the next refresh */
 		jcat_item = jcat_file_get_item_default (jcat_file, error);
 		if (jcat_item == NULL)
 			return FALSE;
-		results = jcat_context_verify_item (self->jcat_context,
-						    bytes_raw, jcat_item,
-						    jcat_flags, error);
-		if (results == NULL)
-			return FALSE;
-
-		/* return the newest signature */
-		jcat_result = fu_engine_get_newest_signature_jcat_result (results, error);
-		if (jcat_result == NULL)
+		if (!fu_jcat_cache_verify_item (self->jcat_context,
+						bytes_raw, jcat_item,
+						jcat_flags, &timestamp, NULL,
+						error))
 			return FALSE;
 
 		/* verify the metadata was signed later than the existing
 		 * metadata for this remote to mitigate a rollback attack */
-		jcat_result_old = fu_engine_get_system_jcat_result (self, remote, &error_local);
-		if (jcat_result_old == NULL) {
+		if (!fu_engine_get_system_jcat_timestamp (self, remote,
+							  &timestamp_old,
+							  &error_local)) {
 			if (g_error_matches (error_local,
 					     G_FILE_ERROR,
 					     G_FILE_ERROR_NOENT)) {
@@ -3771,8 +4065,8 @@ fu_engine_update_metadata_bytes (FuEngine *self, const gchar *remote_id,
 					   error_local->message);
 			}
 		} else {
-			if (!fu_engine_validate_result_timestamp (jcat_result,
-								  jcat_result_old,
+			if (!fu_engine_validate_result_timestamp (timestamp,
+								  timestamp_old,
 								  error))
 				return FALSE;
 		}
@@ -3787,18 +4081,133 @@ fu_engine_update_metadata_bytes (FuEngine *self, const gchar *remote_id,
 						   bytes_sig, error))
 			return FALSE;
 	}
+	return TRUE;
+}
+
+/**
+ * fu_engine_update_metadata_bytes:
+ * @self: A #FuEngine
+ * @remote_id: A remote ID, e.g. `lvfs`
+ * @bytes_raw: Blob of metadata
+ * @bytes_sig: Blob of metadata signature, typically Jcat binary format
+ * @error: A #GError, or %NULL
+ *
+ * Updates the metadata for a specific remote.
+ *
+ * Returns: %TRUE for success
+ **/
+gboolean
+fu_engine_update_metadata_bytes (FuEngine *self, const gchar *remote_id,
+			        GBytes *bytes_raw, GBytes *bytes_sig, GError **error)
+{
+	g_return_val_if_fail (FU_IS_ENGINE (self), FALSE);
+	g_return_val_if_fail (remote_id != NULL, FALSE);
+	g_return_val_if_fail (bytes_raw != NULL, FALSE);
+	g_return_val_if_fail (bytes_sig != NULL, FALSE);
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+	if (!fu_engine_save_metadata_bytes (self, remote_id, bytes_raw, bytes_sig, error))
+		return FALSE;
 	if (!fu_engine_load_metadata_store (self, FU_ENGINE_LOAD_FLAG_NONE, error))
 		return FALSE;
+	fu_engine_metadata_changed (self);
+	return TRUE;
+}
 
-	/* refresh SUPPORTED flag on devices */
-	fu_engine_md_refresh_devices (self);
+/**
+ * fu_engine_update_metadata_bytes_async:
+ * @self: A #FuEngine
+ * @remote_id: A remote ID, e.g. `lvfs`
+ * @bytes_raw: Blob of metadata
+ * @bytes_sig: Blob of metadata signature, typically Jcat binary format
+ * @cancellable: A #GCancellable, or %NULL
+ * @callback: the function to run on completion
+ * @callback_data: the data to pass to @callback
+ *
+ * Updates the metadata for a specific remote, compiling the new metadata in
+ * a thread so that queries can use the old metadata until it is ready.
+ **/
+void
+fu_engine_update_metadata_bytes_async (FuEngine *self,
+				       const gchar *remote_id,
+				       GBytes *bytes_raw,
+				       GBytes *bytes_sig,
+				       GCancellable *cancellable,
+				       GAsyncReadyCallback callback,
+				       gpointer callback_data)
+{
+	gint64 start = g_get_monotonic_time ();
+	g_autoptr(GError) error = NULL;
 
-	/* invalidate host security attributes */
-	g_clear_pointer (&self->host_security_id, g_free);
+	g_return_if_fail (FU_IS_ENGINE (self));
+	g_return_if_fail (remote_id != NULL);
+	g_return_if_fail (bytes_raw != NULL);
+	g_return_if_fail (bytes_sig != NULL);
+	g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+	if (!fu_engine_save_metadata_bytes (self, remote_id, bytes_raw, bytes_sig, &error)) {
+		g_task_report_error (self, callback, callback_data,
+				     fu_engine_update_metadata_bytes_async,
+				     g_steal_pointer (&error));
+		return;
+	}
+	fu_engine_load_metadata_store_async (self,
+					     g_get_monotonic_time () - start,
+					     cancellable,
+					     callback,
+					     callback_data);
+}
 
-	/* make the UI update */
-	fu_engine_emit_changed (self);
+/**
+ * fu_engine_update_metadata_bytes_finish:
+ * @self: A #FuEngine
+ * @res: A #GAsyncResult
+ * @error: A #GError, or %NULL
+ *
+ * Gets the result of fu_engine_update_metadata_bytes_async().
+ *
+ * Returns: %TRUE for success
+ **/
+gboolean
+fu_engine_update_metadata_bytes_finish (FuEngine *self, GAsyncResult *res, GError **error)
+{
+	g_return_val_if_fail (FU_IS_ENGINE (self), FALSE);
+	g_return_val_if_fail (g_task_is_valid (res, self), FALSE);
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+	return g_task_propagate_boolean (G_TASK (res), error);
+}
+
+/* reads the entire files into memory, closing the fds */
+static gboolean
+fu_engine_read_metadata_fds (gint fd, gint fd_sig,
+			     GBytes **bytes_raw, GBytes **bytes_sig,
+			     GError **error)
+{
+#ifdef HAVE_GIO_UNIX
+	g_autoptr(GInputStream) stream_fd = NULL;
+	g_autoptr(GInputStream) stream_sig = NULL;
+
+	/* ensures the fd's are closed on error */
+	stream_fd = g_unix_input_stream_new (fd, TRUE);
+	stream_sig = g_unix_input_stream_new (fd_sig, TRUE);
+
+	/* read the entire file into memory */
+	*bytes_raw = g_input_stream_read_bytes (stream_fd, 0x100000, NULL, error);
+	if (*bytes_raw == NULL)
+		return FALSE;
+
+	/* read signature */
+	*bytes_sig = g_input_stream_read_bytes (stream_sig, 0x100000, NULL, error);
+	if (*bytes_sig == NULL)
+		return FALSE;
 	return TRUE;
+#else
+	g_set_error (error,
+		     FWUPD_ERROR,
+		     FWUPD_ERROR_NOT_SUPPORTED,
+		     "Not supported as <glib-unix.h> is unavailable");
+	return FALSE;
+#endif
 }
 
 /**
@@ -3819,11 +4228,8 @@ gboolean
 fu_engine_update_metadata (FuEngine *self, const gchar *remote_id,
 			   gint fd, gint fd_sig, GError **error)
 {
-#ifdef HAVE_GIO_UNIX
 	g_autoptr(GBytes) bytes_raw = NULL;
 	g_autoptr(GBytes) bytes_sig = NULL;
-	g_autoptr(GInputStream) stream_fd = NULL;
-	g_autoptr(GInputStream) stream_sig = NULL;
 
 	g_return_val_if_fail (FU_IS_ENGINE (self), FALSE);
 	g_return_val_if_fail (remote_id != NULL, FALSE);
@@ -3831,31 +4237,89 @@ fu_engine_update_metadata (FuEngine *self, const gchar *remote_id,
 	g_return_val_if_fail (fd_sig > 0, FALSE);
 	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 
-	/* ensures the fd's are closed on error */
-	stream_fd = g_unix_input_stream_new (fd, TRUE);
-	stream_sig = g_unix_input_stream_new (fd_sig, TRUE);
-
-	/* read the entire file into memory */
-	bytes_raw = g_input_stream_read_bytes (stream_fd, 0x100000, NULL, error);
-	if (bytes_raw == NULL)
-		return FALSE;
-
-	/* read signature */
-	bytes_sig = g_input_stream_read_bytes (stream_sig, 0x100000, NULL, error);
-	if (bytes_sig == NULL)
+	if (!fu_engine_read_metadata_fds (fd, fd_sig, &bytes_raw, &bytes_sig, error))
 		return FALSE;
 
 	/* update with blobs */
 	return fu_engine_update_metadata_bytes (self, remote_id,
 						bytes_raw, bytes_sig,
 						error);
-#else
-	g_set_error (error,
-		     FWUPD_ERROR,
-		     FWUPD_ERROR_NOT_SUPPORTED,
-		     "Not supported as <glib-unix.h> is unavailable");
-	return FALSE;
-#endif
+}
+
+/**
+ * fu_engine_update_metadata_async:
+ * @self: A #FuEngine
+ * @remote_id: A remote ID, e.g. `lvfs`
+ * @fd: file descriptor of the metadata
+ * @fd_sig: file descriptor of the metadata signature
+ * @cancellable: A #GCancellable, or %NULL
+ * @callback: the function to run on completion
+ * @callback_data: the data to pass to @callback
+ *
+ * Updates the metadata for a specific remote without blocking queries while
+ * the new metadata is compiled.
+ *
+ * Note: this will close the fds when done
+ **/
+void
+fu_engine_update_metadata_async (FuEngine *self,
+				 const gchar *remote_id,
+				 gint fd,
+				 gint fd_sig,
+				 GCancellable *cancellable,
+				 GAsyncReadyCallback callback,
+				 gpointer callback_data)
+{
+	g_autoptr(GBytes) bytes_raw = NULL;
+	g_autoptr(GBytes) bytes_sig = NULL;
+	g_autoptr(GError) error = NULL;
+
+	g_return_if_fail (FU_IS_ENGINE (self));
+	g_return_if_fail (remote_id != NULL);
+	g_return_if_fail (fd > 0);
+	g_return_if_fail (fd_sig > 0);
+
+	if (!fu_engine_read_metadata_fds (fd, fd_sig, &bytes_raw, &bytes_sig, &error)) {
+		g_task_report_error (self, callback, callback_data,
+				     fu_engine_update_metadata_async,
+				     g_steal_pointer (&error));
+		return;
+	}
+	fu_engine_update_metadata_bytes_async (self, remote_id,
+					       bytes_raw, bytes_sig,
+					       cancellable,
+					       callback, callback_data);
+}
+
+/**
+ * fu_engine_update_metadata_finish:
+ * @self: A #FuEngine
+ * @res: A #GAsyncResult
+ * @error: A #GError, or %NULL
+ *
+ * Gets the result of fu_engine_update_metadata_async().
+ *
+ * Returns: %TRUE for success
+ **/
+gboolean
+fu_engine_update_metadata_finish (FuEngine *self, GAsyncResult *res, GError **error)
+{
+	return fu_engine_update_metadata_bytes_finish (self, res, error);
+}
+
+/* this is called from a thread so must not use the engine */
+static XbSilo *
+fu_engine_parse_cabinet (GBytes *blob_cab,
+			 guint64 size_max,
+			 JcatContext *jcat_context,
+			 GError **error)
+{
+	g_autoptr(FuCabinet) cabinet = fu_cabinet_new ();
+	fu_cabinet_set_size_max (cabinet, size_max);
+	fu_cabinet_set_jcat_context (cabinet, jcat_context);
+	if (!fu_cabinet_parse (cabinet, blob_cab, FU_CABINET_PARSE_FLAG_NONE, error))
+		return NULL;
+	return fu_cabinet_get_silo (cabinet);
 }
 
 /**
@@ -3871,7 +4335,6 @@ fu_engine_update_metadata (FuEngine *self, const gchar *remote_id,
 XbSilo *
 fu_engine_get_silo_from_blob (FuEngine *self, GBytes *blob_cab, GError **error)
 {
-	g_autoptr(FuCabinet) cabinet = fu_cabinet_new ();
 	g_autoptr(XbSilo) silo = NULL;
 
 	g_return_val_if_fail (FU_IS_ENGINE (self), NULL);
@@ -3880,15 +4343,195 @@ fu_engine_get_silo_from_blob (FuEngine *self, GBytes *blob_cab, GError **error)
 
 	/* load file */
 	fu_engine_set_status (self, FWUPD_STATUS_DECOMPRESSING);
-	fu_cabinet_set_size_max (cabinet, fu_engine_get_archive_size_max (self));
-	fu_cabinet_set_jcat_context (cabinet, self->jcat_context);
-	if (!fu_cabinet_parse (cabinet, blob_cab, FU_CABINET_PARSE_FLAG_NONE, error))
+	silo = fu_engine_parse_cabinet (blob_cab,
+					fu_engine_get_archive_size_max (self),
+					self->jcat_context,
+					error);
+	if (silo == NULL)
 		return NULL;
-	silo = fu_cabinet_get_silo (cabinet);
 	fu_engine_set_status (self, FWUPD_STATUS_IDLE);
 	return g_steal_pointer (&silo);
 }
 
+static JcatContext *
+fu_engine_jcat_context_new (void)
+{
+	JcatContext *jcat_context = jcat_context_new ();
+	g_autofree gchar *keyring_path = NULL;
+	g_autofree gchar *pkidir_fw = NULL;
+	g_autofree gchar *pkidir_md = NULL;
+	g_autofree gchar *sysconfdir = NULL;
+
+	keyring_path = fu_common_get_path (FU_PATH_KIND_LOCALSTATEDIR_PKG);
+	jcat_context_set_keyring_path (jcat_context, keyring_path);
+	sysconfdir = fu_common_get_path (FU_PATH_KIND_SYSCONFDIR);
+	pkidir_fw = g_build_filename (sysconfdir, "pki", "fwupd", NULL);
+	fu_jcat_cache_add_public_keys (jcat_context, pkidir_fw);
+	pkidir_md = g_build_filename (sysconfdir, "pki", "fwupd-metadata", NULL);
+	fu_jcat_cache_add_public_keys (jcat_context, pkidir_md);
+	return jcat_context;
+}
+
+typedef struct {
+	FuEngineRequest		*request;
+	GBytes			*blob;
+	gint			 fd;
+	guint64			 size_max;
+	JcatContext		*jcat_context;
+} FuEngineParseCabinetHelper;
+
+static void
+fu_engine_parse_cabinet_helper_free (FuEngineParseCabinetHelper *helper)
+{
+	if (helper->request != NULL)
+		g_object_unref (helper->request);
+	if (helper->blob != NULL)
+		g_bytes_unref (helper->blob);
+	if (helper->fd >= 0)
+		g_close (helper->fd, NULL);
+	g_object_unref (helper->jcat_context);
+	g_free (helper);
+}
+
+/* clients show the status while any archive is being parsed */
+static void
+fu_engine_parse_cabinet_started (FuEngine *self)
+{
+	self->parse_cabinet_cnt++;
+	fu_engine_set_status (self, FWUPD_STATUS_DECOMPRESSING);
+}
+
+static void
+fu_engine_parse_cabinet_finished (FuEngine *self)
+{
+	g_return_if_fail (self->parse_cabinet_cnt > 0);
+	self->parse_cabinet_cnt--;
+	if (self->parse_cabinet_cnt == 0 &&
+	    self->status == FWUPD_STATUS_DECOMPRESSING)
+		fu_engine_set_status (self, FWUPD_STATUS_IDLE);
+}
+
+/* the archive size is copied as the config may change, and each job gets
+ * its own context with the same keys as a JcatContext is not thread-safe */
+static FuEngineParseCabinetHelper *
+fu_engine_parse_cabinet_helper_new (FuEngine *self)
+{
+	FuEngineParseCabinetHelper *helper = g_new0 (FuEngineParseCabinetHelper, 1);
+	helper->fd = -1;
+	helper->size_max = fu_engine_get_archive_size_max (self);
+	helper->jcat_context = fu_engine_jcat_context_new ();
+	return helper;
+}
+
+/* this is slow, and is called from a thread so must not use the engine */
+static void
+fu_engine_parse_cabinet_thread_cb (GTask *task,
+				   gpointer source_object,
+				   gpointer task_data,
+				   GCancellable *cancellable)
+{
+	FuEngineParseCabinetHelper *helper = (FuEngineParseCabinetHelper *) task_data;
+	GError *error = NULL;
+	XbSilo *silo;
+
+	/* this closes the fd */
+	if (helper->blob == NULL) {
+		helper->blob = fu_common_get_contents_fd (helper->fd,
+							  helper->size_max,
+							  &error);
+		helper->fd = -1;
+		if (helper->blob == NULL) {
+			g_task_return_error (task, error);
+			return;
+		}
+	}
+	if (g_task_return_error_if_cancelled (task))
+		return;
+	silo = fu_engine_parse_cabinet (helper->blob,
+					helper->size_max,
+					helper->jcat_context,
+					&error);
+	if (silo == NULL) {
+		g_task_return_error (task, error);
+		return;
+	}
+	g_task_return_pointer (task, silo, (GDestroyNotify) g_object_unref);
+}
+
+static void
+fu_engine_get_silo_from_blob_cb (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+	FuEngine *self = FU_ENGINE (source);
+	g_autoptr(GTask) task = G_TASK (user_data);
+	GError *error = NULL;
+	XbSilo *silo;
+
+	fu_engine_parse_cabinet_finished (self);
+	silo = g_task_propagate_pointer (G_TASK (res), &error);
+	if (silo == NULL) {
+		g_task_return_error (task, error);
+		return;
+	}
+	g_task_return_pointer (task, silo, (GDestroyNotify) g_object_unref);
+}
+
+/**
+ * fu_engine_get_silo_from_blob_async:
+ * @self: A #FuEngine
+ * @blob_cab: A #GBytes
+ * @cancellable: A #GCancellable, or %NULL
+ * @callback: the function to run on completion
+ * @callback_data: the data to pass to @callback
+ *
+ * Creates a silo from a .cab file blob in a thread.
+ **/
+void
+fu_engine_get_silo_from_blob_async (FuEngine *self,
+				    GBytes *blob_cab,
+				    GCancellable *cancellable,
+				    GAsyncReadyCallback callback,
+				    gpointer callback_data)
+{
+	FuEngineParseCabinetHelper *helper;
+	g_autoptr(GTask) task = NULL;
+	g_autoptr(GTask) task_thread = NULL;
+
+	g_return_if_fail (FU_IS_ENGINE (self));
+	g_return_if_fail (blob_cab != NULL);
+	g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+	helper = fu_engine_parse_cabinet_helper_new (self);
+	helper->blob = g_bytes_ref (blob_cab);
+	task = g_task_new (self, cancellable, callback, callback_data);
+	g_task_set_task_data (task, helper,
+			      (GDestroyNotify) fu_engine_parse_cabinet_helper_free);
+	task_thread = g_task_new (self, cancellable,
+				  fu_engine_get_silo_from_blob_cb,
+				  g_steal_pointer (&task));
+	g_task_set_task_data (task_thread, helper, NULL);
+	fu_engine_parse_cabinet_started (self);
+	g_task_run_in_thread (task_thread, fu_engine_parse_cabinet_thread_cb);
+}
+
+/**
+ * fu_engine_get_silo_from_blob_finish:
+ * @self: A #FuEngine
+ * @res: A #GAsyncResult
+ * @error: A #GError, or %NULL
+ *
+ * Gets the result of fu_engine_get_silo_from_blob_async().
+ *
+ * Returns: (transfer full): a #XbSilo, or %NULL
+ **/
+XbSilo *
+fu_engine_get_silo_from_blob_finish (FuEngine *self, GAsyncResult *res, GError **error)
+{
+	g_return_val_if_fail (FU_IS_ENGINE (self), NULL);
+	g_return_val_if_fail (g_task_is_valid (res, self), NULL);
+	g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+	return g_task_propagate_pointer (G_TASK (res), error);
+}
+
 static FuDevice *
 fu_engine_get_result_from_component (FuEngine *self,
 				     FuEngineRequest *request,
@@ -4024,43 +4667,21 @@ fu_engine_get_details_sort_cb (gconstpointer a, gconstpointer b)
 	return 0;
 }
 
-/**
- * fu_engine_get_details:
- * @self: A #FuEngine
- * @request: A #FuEngineRequest
- * @fd: A file descriptor
- * @error: A #GError, or %NULL
- *
- * Gets the details about a local file.
- *
- * Note: this will close the fd when done
- *
- * Returns: (transfer container) (element-type FuDevice): results
- **/
-GPtrArray *
-fu_engine_get_details (FuEngine *self, FuEngineRequest *request, gint fd, GError **error)
+/* this must be called from the main thread */
+static GPtrArray *
+fu_engine_get_details_for_silo (FuEngine *self,
+				FuEngineRequest *request,
+				GBytes *blob,
+				XbSilo *silo,
+				GError **error)
 {
 	const gchar *remote_id;
 	g_autofree gchar *csum = NULL;
-	g_autoptr(GBytes) blob = NULL;
 	g_autoptr(GError) error_local = NULL;
 	g_autoptr(GPtrArray) components = NULL;
 	g_autoptr(GPtrArray) details = NULL;
-	g_autoptr(XbSilo) silo = NULL;
-
-	g_return_val_if_fail (FU_IS_ENGINE (self), NULL);
-	g_return_val_if_fail (fd > 0, NULL);
-	g_return_val_if_fail (error == NULL || *error == NULL, NULL);
 
 	/* get all components */
-	blob = fu_common_get_contents_fd (fd,
-					  fu_engine_get_archive_size_max (self),
-					  error);
-	if (blob == NULL)
-		return NULL;
-	silo = fu_engine_get_silo_from_blob (self, blob, error);
-	if (silo == NULL)
-		return NULL;
 	components = xb_silo_query (silo,
 				    "components/component[@type='firmware']",
 				    0, &error_local);
@@ -4126,11 +4747,137 @@ fu_engine_get_details (FuEngine *self, FuEngineRequest *request, gint fd, GError
 		g_ptr_array_add (details, dev);
 	}
 
-	/* order multiple devices so that the one that passes the requirement
-	 * is listed first */
-	g_ptr_array_sort (details, fu_engine_get_details_sort_cb);
+	/* order multiple devices so that the one that passes the requirement
+	 * is listed first */
+	g_ptr_array_sort (details, fu_engine_get_details_sort_cb);
+
+	return g_steal_pointer (&details);
+}
+
+/**
+ * fu_engine_get_details:
+ * @self: A #FuEngine
+ * @request: A #FuEngineRequest
+ * @fd: A file descriptor
+ * @error: A #GError, or %NULL
+ *
+ * Gets the details about a local file.
+ *
+ * Note: this will close the fd when done
+ *
+ * Returns: (transfer container) (element-type FuDevice): results
+ **/
+GPtrArray *
+fu_engine_get_details (FuEngine *self, FuEngineRequest *request, gint fd, GError **error)
+{
+	g_autoptr(GBytes) blob = NULL;
+	g_autoptr(XbSilo) silo = NULL;
+
+	g_return_val_if_fail (FU_IS_ENGINE (self), NULL);
+	g_return_val_if_fail (fd > 0, NULL);
+	g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+	/* get all components */
+	blob = fu_common_get_contents_fd (fd,
+					  fu_engine_get_archive_size_max (self),
+					  error);
+	if (blob == NULL)
+		return NULL;
+	silo = fu_engine_get_silo_from_blob (self, blob, error);
+	if (silo == NULL)
+		return NULL;
+	return fu_engine_get_details_for_silo (self, request, blob, silo, error);
+}
+
+static void
+fu_engine_get_details_parse_cb (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+	FuEngine *self = FU_ENGINE (source);
+	g_autoptr(GTask) task = G_TASK (user_data);
+	FuEngineParseCabinetHelper *helper = g_task_get_task_data (task);
+	GError *error = NULL;
+	GPtrArray *details;
+	g_autoptr(XbSilo) silo = NULL;
+
+	fu_engine_parse_cabinet_finished (self);
+	silo = g_task_propagate_pointer (G_TASK (res), &error);
+	if (silo == NULL) {
+		g_task_return_error (task, error);
+		return;
+	}
+	if (g_task_return_error_if_cancelled (task))
+		return;
+	details = fu_engine_get_details_for_silo (self, helper->request,
+						  helper->blob, silo, &error);
+	if (details == NULL) {
+		g_task_return_error (task, error);
+		return;
+	}
+	g_task_return_pointer (task, details, (GDestroyNotify) g_ptr_array_unref);
+}
+
+/**
+ * fu_engine_get_details_async:
+ * @self: A #FuEngine
+ * @request: A #FuEngineRequest
+ * @fd: A file descriptor
+ * @cancellable: A #GCancellable, or %NULL
+ * @callback: the function to run on completion
+ * @callback_data: the data to pass to @callback
+ *
+ * Gets the details about a local file. The file is read and the archive
+ * parsed in a thread, and the results are matched to devices when done.
+ *
+ * Note: this will close the fd when done
+ **/
+void
+fu_engine_get_details_async (FuEngine *self,
+			     FuEngineRequest *request,
+			     gint fd,
+			     GCancellable *cancellable,
+			     GAsyncReadyCallback callback,
+			     gpointer callback_data)
+{
+	FuEngineParseCabinetHelper *helper;
+	g_autoptr(GTask) task = NULL;
+	g_autoptr(GTask) task_thread = NULL;
 
-	return g_steal_pointer (&details);
+	g_return_if_fail (FU_IS_ENGINE (self));
+	g_return_if_fail (fd > 0);
+	g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+	/* the blob is shared between both tasks */
+	helper = fu_engine_parse_cabinet_helper_new (self);
+	helper->request = g_object_ref (request);
+	helper->fd = fd;
+	task = g_task_new (self, cancellable, callback, callback_data);
+	g_task_set_task_data (task, helper,
+			      (GDestroyNotify) fu_engine_parse_cabinet_helper_free);
+	task_thread = g_task_new (self, cancellable,
+				  fu_engine_get_details_parse_cb,
+				  g_steal_pointer (&task));
+	g_task_set_task_data (task_thread, helper, NULL);
+	fu_engine_parse_cabinet_started (self);
+	g_task_run_in_thread (task_thread, fu_engine_parse_cabinet_thread_cb);
+}
+
+/**
+ * fu_engine_get_details_finish:
+ * @self: A #FuEngine
+ * @res: A #GAsyncResult
+ * @error: A #GError, or %NULL
+ *
+ * Gets the result of fu_engine_get_details_async().
+ *
+ * Returns: (transfer container) (element-type FuDevice): results
+ **/
+GPtrArray *
+fu_engine_get_details_finish (FuEngine *self, GAsyncResult *res, GError **error)
+{
+	g_return_val_if_fail (FU_IS_ENGINE (self), NULL);
+	g_return_val_if_fail (g_task_is_valid (res, self), NULL);
+	g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+	return g_task_propagate_pointer (G_TASK (res), error);
 }
 
 static gint
@@ -4610,6 +5357,7 @@ fu_engine_get_releases_for_device (FuEngine *self,
 					"provides/firmware[@type=$'flashed'][text()=$'%s']/"
 					"../..", guid);
 	}
+	fu_metrics_add_counter ("engine.silo-query", 1);
 	components = xb_silo_query (self->silo, xpath->str, 0, &error_local);
 	if (components == NULL) {
 		if (g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_NOT_FOUND) ||
@@ -4678,35 +5426,14 @@ fu_engine_get_releases_for_device (FuEngine *self,
 	return releases;
 }
 
-/**
- * fu_engine_get_releases:
- * @self: A #FuEngine
- * @request: A #FuEngineRequest
- * @device_id: A device ID
- * @error: A #GError, or %NULL
- *
- * Gets the releases available for a specific device.
- *
- * Returns: (transfer container) (element-type FwupdDevice): results
- **/
-GPtrArray *
-fu_engine_get_releases (FuEngine *self,
-			FuEngineRequest *request,
-			const gchar *device_id,
-			GError **error)
+static GPtrArray *
+fu_engine_get_releases_sorted_for_device (FuEngine *self,
+					  FuEngineRequest *request,
+					  FuDevice *device,
+					  GError **error)
 {
-	g_autoptr(FuDevice) device = NULL;
 	g_autoptr(GPtrArray) releases = NULL;
 
-	g_return_val_if_fail (FU_IS_ENGINE (self), NULL);
-	g_return_val_if_fail (device_id != NULL, NULL);
-	g_return_val_if_fail (error == NULL || *error == NULL, NULL);
-
-	/* find the device */
-	device = fu_device_list_get_by_id (self->device_list, device_id, error);
-	if (device == NULL)
-		return NULL;
-
 	/* get all the releases for the device */
 	releases = fu_engine_get_releases_for_device (self, request, device, error);
 	if (releases == NULL)
@@ -4723,26 +5450,23 @@ fu_engine_get_releases (FuEngine *self,
 }
 
 /**
- * fu_engine_get_downgrades:
+ * fu_engine_get_releases:
  * @self: A #FuEngine
  * @request: A #FuEngineRequest
  * @device_id: A device ID
  * @error: A #GError, or %NULL
  *
- * Gets the downgrades available for a specific device.
+ * Gets the releases available for a specific device.
  *
  * Returns: (transfer container) (element-type FwupdDevice): results
  **/
 GPtrArray *
-fu_engine_get_downgrades (FuEngine *self,
-			  FuEngineRequest *request,
-			  const gchar *device_id,
-			  GError **error)
+fu_engine_get_releases (FuEngine *self,
+			FuEngineRequest *request,
+			const gchar *device_id,
+			GError **error)
 {
 	g_autoptr(FuDevice) device = NULL;
-	g_autoptr(GPtrArray) releases = NULL;
-	g_autoptr(GPtrArray) releases_tmp = NULL;
-	g_autoptr(GString) error_str = g_string_new (NULL);
 
 	g_return_val_if_fail (FU_IS_ENGINE (self), NULL);
 	g_return_val_if_fail (device_id != NULL, NULL);
@@ -4753,6 +5477,19 @@ fu_engine_get_downgrades (FuEngine *self,
 	if (device == NULL)
 		return NULL;
 
+	return fu_engine_get_releases_sorted_for_device (self, request, device, error);
+}
+
+static GPtrArray *
+fu_engine_get_downgrades_for_device (FuEngine *self,
+				     FuEngineRequest *request,
+				     FuDevice *device,
+				     GError **error)
+{
+	g_autoptr(GPtrArray) releases = NULL;
+	g_autoptr(GPtrArray) releases_tmp = NULL;
+	g_autoptr(GString) error_str = g_string_new (NULL);
+
 	/* get all the releases for the device */
 	releases_tmp = fu_engine_get_releases_for_device (self, request, device, error);
 	if (releases_tmp == NULL)
@@ -4826,6 +5563,37 @@ fu_engine_get_downgrades (FuEngine *self,
 	return g_steal_pointer (&releases);
 }
 
+/**
+ * fu_engine_get_downgrades:
+ * @self: A #FuEngine
+ * @request: A #FuEngineRequest
+ * @device_id: A device ID
+ * @error: A #GError, or %NULL
+ *
+ * Gets the downgrades available for a specific device.
+ *
+ * Returns: (transfer container) (element-type FwupdDevice): results
+ **/
+GPtrArray *
+fu_engine_get_downgrades (FuEngine *self,
+			  FuEngineRequest *request,
+			  const gchar *device_id,
+			  GError **error)
+{
+	g_autoptr(FuDevice) device = NULL;
+
+	g_return_val_if_fail (FU_IS_ENGINE (self), NULL);
+	g_return_val_if_fail (device_id != NULL, NULL);
+	g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+	/* find the device */
+	device = fu_device_list_get_by_id (self->device_list, device_id, error);
+	if (device == NULL)
+		return NULL;
+
+	return fu_engine_get_downgrades_for_device (self, request, device, error);
+}
+
 GPtrArray *
 fu_engine_get_approved_firmware (FuEngine *self)
 {
@@ -4931,37 +5699,16 @@ fu_engine_self_sign (FuEngine *self,
 	return jcat_blob_get_data_as_string (jcat_signature);
 }
 
-/**
- * fu_engine_get_upgrades:
- * @self: A #FuEngine
- * @request: A #FuEngineRequest
- * @device_id: A device ID
- * @error: A #GError, or %NULL
- *
- * Gets the upgrades available for a specific device.
- *
- * Returns: (transfer container) (element-type FwupdDevice): results
- **/
-GPtrArray *
-fu_engine_get_upgrades (FuEngine *self,
-			FuEngineRequest *request,
-			const gchar *device_id,
-			GError **error)
+static GPtrArray *
+fu_engine_get_upgrades_for_device (FuEngine *self,
+				   FuEngineRequest *request,
+				   FuDevice *device,
+				   GError **error)
 {
-	g_autoptr(FuDevice) device = NULL;
 	g_autoptr(GPtrArray) releases = NULL;
 	g_autoptr(GPtrArray) releases_tmp = NULL;
 	g_autoptr(GString) error_str = g_string_new (NULL);
 
-	g_return_val_if_fail (FU_IS_ENGINE (self), NULL);
-	g_return_val_if_fail (device_id != NULL, NULL);
-	g_return_val_if_fail (error == NULL || *error == NULL, NULL);
-
-	/* find the device */
-	device = fu_device_list_get_by_id (self->device_list, device_id, error);
-	if (device == NULL)
-		return NULL;
-
 	/* don't show upgrades again until we reboot */
 	if (fu_device_get_update_state (device) == FWUPD_UPDATE_STATE_NEEDS_REBOOT) {
 		g_set_error_literal (error,
@@ -5044,6 +5791,105 @@ fu_engine_get_upgrades (FuEngine *self,
 	return g_steal_pointer (&releases);
 }
 
+/**
+ * fu_engine_get_upgrades:
+ * @self: A #FuEngine
+ * @request: A #FuEngineRequest
+ * @device_id: A device ID
+ * @error: A #GError, or %NULL
+ *
+ * Gets the upgrades available for a specific device.
+ *
+ * Returns: (transfer container) (element-type FwupdDevice): results
+ **/
+GPtrArray *
+fu_engine_get_upgrades (FuEngine *self,
+			FuEngineRequest *request,
+			const gchar *device_id,
+			GError **error)
+{
+	g_autoptr(FuDevice) device = NULL;
+
+	g_return_val_if_fail (FU_IS_ENGINE (self), NULL);
+	g_return_val_if_fail (device_id != NULL, NULL);
+	g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+	/* find the device */
+	device = fu_device_list_get_by_id (self->device_list, device_id, error);
+	if (device == NULL)
+		return NULL;
+
+	return fu_engine_get_upgrades_for_device (self, request, device, error);
+}
+
+/**
+ * fu_engine_get_devices_with_releases:
+ * @self: A #FuEngine
+ * @request: A #FuEngineRequest
+ * @kind: A #FwupdReleaseKind, e.g. %FWUPD_RELEASE_KIND_UPGRADES
+ * @error: A #GError, or %NULL
+ *
+ * Gets all the devices, each with the releases of the requested kind attached.
+ * Devices without any matching releases are still included.
+ *
+ * Returns: (transfer container) (element-type FwupdDevice): results
+ **/
+GPtrArray *
+fu_engine_get_devices_with_releases (FuEngine *self,
+				     FuEngineRequest *request,
+				     FwupdReleaseKind kind,
+				     GError **error)
+{
+	g_autoptr(GPtrArray) devices = NULL;
+	g_autoptr(GPtrArray) results = NULL;
+
+	g_return_val_if_fail (FU_IS_ENGINE (self), NULL);
+	g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+	devices = fu_engine_get_devices (self, error);
+	if (devices == NULL)
+		return NULL;
+	results = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+	for (guint i = 0; i < devices->len; i++) {
+		FuDevice *device = g_ptr_array_index (devices, i);
+		g_autoptr(FwupdDevice) dev = NULL;
+		g_autoptr(GError) error_local = NULL;
+		g_autoptr(GPtrArray) releases = NULL;
+		g_autoptr(GVariant) val = NULL;
+
+		if (kind == FWUPD_RELEASE_KIND_UPGRADES) {
+			releases = fu_engine_get_upgrades_for_device (self, request,
+								      device,
+								      &error_local);
+		} else if (kind == FWUPD_RELEASE_KIND_DOWNGRADES) {
+			releases = fu_engine_get_downgrades_for_device (self, request,
+									device,
+									&error_local);
+		} else {
+			releases = fu_engine_get_releases_sorted_for_device (self, request,
+									     device,
+									     &error_local);
+		}
+		if (releases == NULL) {
+			g_debug ("no releases for %s: %s",
+				 fu_device_get_id (device),
+				 error_local->message);
+		}
+
+		/* copy the device as the client would see it, as getting the
+		 * releases may have changed the flags */
+		val = g_variant_ref_sink (fwupd_device_to_variant_full (FWUPD_DEVICE (device),
+								       fu_engine_request_get_device_flags (request)));
+		dev = fwupd_device_from_variant (val);
+		for (guint j = 0; releases != NULL && j < releases->len; j++) {
+			FwupdRelease *rel = g_ptr_array_index (releases, j);
+			fwupd_device_add_release (dev, rel);
+		}
+		g_ptr_array_add (results, g_steal_pointer (&dev));
+	}
+	return g_steal_pointer (&results);
+}
+
 /**
  * fu_engine_clear_results:
  * @self: A #FuEngine
@@ -5131,28 +5977,34 @@ fu_engine_get_results (FuEngine *self, const gchar *device_id, GError **error)
 	return g_object_ref (FWUPD_DEVICE (device));
 }
 
+static void
+fu_engine_plugin_setup (FuEngine *self, FuPlugin *plugin)
+{
+	g_autoptr(GError) error = NULL;
+	if (fu_plugin_has_flag (plugin, FWUPD_PLUGIN_FLAG_REQUIRE_HWID)) {
+		fu_plugin_add_flag (plugin, FWUPD_PLUGIN_FLAG_DISABLED);
+		g_message ("disabling plugin %s because no HwId",
+			   fu_plugin_get_name (plugin));
+		return;
+	}
+	if (!fu_plugin_runner_startup (plugin, &error)) {
+		fu_plugin_add_flag (plugin, FWUPD_PLUGIN_FLAG_DISABLED);
+		if (g_error_matches (error,
+				     FWUPD_ERROR,
+				     FWUPD_ERROR_NOT_SUPPORTED)) {
+			fu_plugin_add_flag (plugin, FWUPD_PLUGIN_FLAG_NO_HARDWARE);
+		}
+		g_message ("disabling plugin because: %s", error->message);
+	}
+}
+
 static void
 fu_engine_plugins_setup (FuEngine *self)
 {
 	GPtrArray *plugins = fu_plugin_list_get_all (self->plugin_list);
 	for (guint i = 0; i < plugins->len; i++) {
-		g_autoptr(GError) error = NULL;
 		FuPlugin *plugin = g_ptr_array_index (plugins, i);
-		if (fu_plugin_has_flag (plugin, FWUPD_PLUGIN_FLAG_REQUIRE_HWID)) {
-			fu_plugin_add_flag (plugin, FWUPD_PLUGIN_FLAG_DISABLED);
-			g_message ("disabling plugin %s because no HwId",
-				   fu_plugin_get_name (plugin));
-			continue;
-		}
-		if (!fu_plugin_runner_startup (plugin, &error)) {
-			fu_plugin_add_flag (plugin, FWUPD_PLUGIN_FLAG_DISABLED);
-			if (g_error_matches (error,
-					     FWUPD_ERROR,
-					     FWUPD_ERROR_NOT_SUPPORTED)) {
-				fu_plugin_add_flag (plugin, FWUPD_PLUGIN_FLAG_NO_HARDWARE);
-			}
-			g_message ("disabling plugin because: %s", error->message);
-		}
+		fu_engine_plugin_setup (self, plugin);
 	}
 }
 
@@ -5641,26 +6493,37 @@ fu_engine_plugin_set_coldplug_delay_cb (FuPlugin *plugin, guint duration, FuEngi
 		 duration, self->coldplug_delay);
 }
 
+static void
+fu_engine_check_plugin_build_hash (FuEngine *self, FuPlugin *plugin)
+{
+	/* plugin does not match built version */
+	if (fu_plugin_get_build_hash (plugin) == NULL) {
+		const gchar *name = fu_plugin_get_name (plugin);
+		g_warning ("%s should call fu_plugin_set_build_hash()",
+			   name);
+		self->tainted = TRUE;
+	} else if (g_strcmp0 (fu_plugin_get_build_hash (plugin),
+			      FU_BUILD_HASH) != 0) {
+		const gchar *name = fu_plugin_get_name (plugin);
+		g_warning ("%s has incorrect built version %s",
+			   name, fu_plugin_get_build_hash (plugin));
+		self->tainted = TRUE;
+	}
+}
+
+/* this is only called by the self tests, and must be before fu_engine_load() */
+void
+fu_engine_add_backend (FuEngine *self, FuBackend *backend)
+{
+	g_ptr_array_add (self->backends, g_object_ref (backend));
+}
+
 /* this is called by the self tests as well */
 void
 fu_engine_add_plugin (FuEngine *self, FuPlugin *plugin)
 {
-	if (fu_plugin_is_open (plugin)) {
-		/* plugin does not match built version */
-		if (fu_plugin_get_build_hash (plugin) == NULL) {
-			const gchar *name = fu_plugin_get_name (plugin);
-			g_warning ("%s should call fu_plugin_set_build_hash()",
-				   name);
-			self->tainted = TRUE;
-		} else if (g_strcmp0 (fu_plugin_get_build_hash (plugin),
-				      FU_BUILD_HASH) != 0) {
-			const gchar *name = fu_plugin_get_name (plugin);
-			g_warning ("%s has incorrect built version %s",
-				   name, fu_plugin_get_build_hash (plugin));
-			self->tainted = TRUE;
-		}
-	}
-
+	if (fu_plugin_is_open (plugin))
+		fu_engine_check_plugin_build_hash (self, plugin);
 	fu_plugin_list_add (self->plugin_list, plugin);
 }
 
@@ -5712,6 +6575,7 @@ fu_engine_plugin_check_supported_cb (FuPlugin *plugin, const gchar *guid, FuEngi
 	xpath = g_strdup_printf ("components/component[@type='firmware']/"
 				 "provides/firmware[@type='flashed'][text()='%s']",
 				 guid);
+	fu_metrics_add_counter ("engine.silo-query", 1);
 	n = xb_silo_query_first (self->silo, xpath, NULL);
 	return n != NULL;
 }
@@ -5738,6 +6602,78 @@ fu_engine_get_host_machine_id (FuEngine *self)
 	return self->host_machine_id;
 }
 
+typedef struct {
+	FuPlugin		*plugin;
+	FuSecurityAttrs		*attrs;
+} FuEngineSecurityAttrsJob;
+
+static void
+fu_engine_security_attrs_job_free (FuEngineSecurityAttrsJob *job)
+{
+	g_object_unref (job->plugin);
+	g_object_unref (job->attrs);
+	g_free (job);
+}
+
+static void
+fu_engine_security_attrs_worker_cb (gpointer data, gpointer user_data)
+{
+	FuEngineSecurityAttrsJob *job = (FuEngineSecurityAttrsJob *) data;
+	fu_plugin_runner_add_security_attrs (job->plugin, job->attrs);
+}
+
+/* plugins that set FU_PLUGIN_INTERNAL_FLAG_THREADSAFE_SECURITY_ATTRS are run
+ * in a thread pool, and all others are run in this thread at the same time */
+static void
+fu_engine_ensure_security_attrs_plugins (FuEngine *self)
+{
+	GPtrArray *plugins = fu_plugin_list_get_all (self->plugin_list);
+	GThreadPool *pool;
+	g_autoptr(GError) error_pool = NULL;
+	g_autoptr(GPtrArray) jobs = NULL;
+
+	/* each plugin gets its own buffer */
+	jobs = g_ptr_array_new_with_free_func ((GDestroyNotify) fu_engine_security_attrs_job_free);
+	for (guint i = 0; i < plugins->len; i++) {
+		FuPlugin *plugin_tmp = g_ptr_array_index (plugins, i);
+		FuEngineSecurityAttrsJob *job = g_new0 (FuEngineSecurityAttrsJob, 1);
+		job->plugin = g_object_ref (plugin_tmp);
+		job->attrs = fu_security_attrs_new ();
+		g_ptr_array_add (jobs, job);
+	}
+
+	pool = g_thread_pool_new (fu_engine_security_attrs_worker_cb, NULL,
+				  g_get_num_processors (), FALSE, &error_pool);
+	if (pool == NULL)
+		g_warning ("failed to create thread pool: %s", error_pool->message);
+	for (guint i = 0; i < jobs->len; i++) {
+		FuEngineSecurityAttrsJob *job = g_ptr_array_index (jobs, i);
+		if (pool != NULL &&
+		    fu_plugin_has_internal_flag (job->plugin,
+						 FU_PLUGIN_INTERNAL_FLAG_THREADSAFE_SECURITY_ATTRS)) {
+			g_autoptr(GError) error_local = NULL;
+			if (g_thread_pool_push (pool, job, &error_local))
+				continue;
+			g_warning ("failed to push %s: %s",
+				   fu_plugin_get_name (job->plugin),
+				   error_local->message);
+		}
+		fu_plugin_runner_add_security_attrs (job->plugin, job->attrs);
+	}
+	if (pool != NULL)
+		g_thread_pool_free (pool, FALSE, TRUE);
+
+	/* merge in plugin order so the result does not depend on timing */
+	for (guint i = 0; i < jobs->len; i++) {
+		FuEngineSecurityAttrsJob *job = g_ptr_array_index (jobs, i);
+		g_autoptr(GPtrArray) items = fu_security_attrs_get_all (job->attrs);
+		for (guint j = 0; j < items->len; j++) {
+			FwupdSecurityAttr *attr = g_ptr_array_index (items, j);
+			fu_security_attrs_append (self->host_security_attrs, attr);
+		}
+	}
+}
+
 static void
 fu_engine_ensure_security_attrs_tainted (FuEngine *self)
 {
@@ -5819,7 +6755,7 @@ fu_engine_attrs_calculate_hsi_for_chassis (FuEngine *self)
 static void
 fu_engine_ensure_security_attrs (FuEngine *self)
 {
-	GPtrArray *plugins = fu_plugin_list_get_all (self->plugin_list);
+	gint64 start;
 	g_autoptr(GPtrArray) items = NULL;
 
 	/* already valid */
@@ -5833,10 +6769,9 @@ fu_engine_ensure_security_attrs (FuEngine *self)
 	fu_engine_ensure_security_attrs_tainted (self);
 
 	/* call into plugins */
-	for (guint j = 0; j < plugins->len; j++) {
-		FuPlugin *plugin_tmp = g_ptr_array_index (plugins, j);
-		fu_plugin_runner_add_security_attrs (plugin_tmp, self->host_security_attrs);
-	}
+	start = g_get_monotonic_time ();
+	fu_engine_ensure_security_attrs_plugins (self);
+	fu_metrics_add_duration ("engine.security-attrs", g_get_monotonic_time () - start);
 
 	/* set the fallback names for clients without native translations */
 	items = fu_security_attrs_get_all (self->host_security_attrs);
@@ -5877,6 +6812,378 @@ fu_engine_get_host_security_attrs (FuEngine *self)
 	return g_object_ref (self->host_security_attrs);
 }
 
+static void
+fu_engine_watch_plugin (FuEngine *self, FuPlugin *plugin)
+{
+	g_signal_connect (plugin, "device-added",
+			  G_CALLBACK (fu_engine_plugin_device_added_cb),
+			  self);
+	g_signal_connect (plugin, "device-removed",
+			  G_CALLBACK (fu_engine_plugin_device_removed_cb),
+			  self);
+	g_signal_connect (plugin, "device-register",
+			  G_CALLBACK (fu_engine_plugin_device_register_cb),
+			  self);
+	g_signal_connect (plugin, "recoldplug",
+			  G_CALLBACK (fu_engine_plugin_recoldplug_cb),
+			  self);
+	g_signal_connect (plugin, "set-coldplug-delay",
+			  G_CALLBACK (fu_engine_plugin_set_coldplug_delay_cb),
+			  self);
+	g_signal_connect (plugin, "check-supported",
+			  G_CALLBACK (fu_engine_plugin_check_supported_cb),
+			  self);
+	g_signal_connect (plugin, "rules-changed",
+			  G_CALLBACK (fu_engine_plugin_rules_changed_cb),
+			  self);
+	g_signal_connect (plugin, "security-changed",
+			  G_CALLBACK (fu_engine_plugin_security_changed_cb),
+			  self);
+}
+
+#define FU_ENGINE_PLUGIN_MANIFEST_GROUP		"fwupd Plugin"
+
+/* any class or bus device in sysfs, e.g. /sys/class/thunderbolt/domain0 */
+static gboolean
+fu_engine_sysfs_has_subsystem (const gchar *subsystem)
+{
+	g_autofree gchar *fn_class = g_build_filename ("/sys/class", subsystem, NULL);
+	g_autofree gchar *fn_bus = g_build_filename ("/sys/bus", subsystem, "devices", NULL);
+	const gchar *fns[] = { fn_class, fn_bus, NULL };
+	for (guint i = 0; fns[i] != NULL; i++) {
+		g_autoptr(GDir) dir = g_dir_open (fns[i], 0, NULL);
+		if (dir != NULL && g_dir_read_name (dir) != NULL)
+			return TRUE;
+	}
+	return FALSE;
+}
+
+/* returns the instance IDs of all connected USB devices, e.g. USB\VID_0BDA&PID_8153 */
+static GHashTable *
+fu_engine_get_usb_instance_ids (void)
+{
+	const gchar *fn;
+	const gchar *sysfs_usb = "/sys/bus/usb/devices";
+	GHashTable *usb_ids = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	g_autoptr(GDir) dir = NULL;
+
+	dir = g_dir_open (sysfs_usb, 0, NULL);
+	if (dir == NULL)
+		return usb_ids;
+	while ((fn = g_dir_read_name (dir)) != NULL) {
+		g_autofree gchar *fn_vid = g_build_filename (sysfs_usb, fn, "idVendor", NULL);
+		g_autofree gchar *fn_pid = g_build_filename (sysfs_usb, fn, "idProduct", NULL);
+		g_autofree gchar *vid = NULL;
+		g_autofree gchar *pid = NULL;
+		g_autofree gchar *devid1 = NULL;
+		g_autofree gchar *devid2 = NULL;
+
+		/* interfaces do not have IDs */
+		if (!g_file_get_contents (fn_vid, &vid, NULL, NULL))
+			continue;
+		if (!g_file_get_contents (fn_pid, &pid, NULL, NULL))
+			continue;
+		devid1 = g_strdup_printf ("USB\\VID_%s", g_strstrip (vid));
+		devid2 = g_strdup_printf ("USB\\VID_%s&PID_%s", vid, g_strstrip (pid));
+		g_hash_table_add (usb_ids, g_ascii_strup (devid1, -1));
+		g_hash_table_add (usb_ids, g_ascii_strup (devid2, -1));
+	}
+	return usb_ids;
+}
+
+/* any one of the triggers in the manifest is enough to load the plugin */
+static gboolean
+fu_engine_plugin_manifest_matches (FuEngine *self,
+				   FuPlugin *plugin,
+				   GKeyFile *kf,
+				   GHashTable *usb_ids)
+{
+	g_auto(GStrv) config_keys = NULL;
+	g_auto(GStrv) efivars = NULL;
+	g_auto(GStrv) hwids = NULL;
+	g_auto(GStrv) smbios_types = NULL;
+	g_auto(GStrv) subsystems = NULL;
+	g_auto(GStrv) usb_ids_tmp = NULL;
+
+	/* either a GUID or a key=value pair, e.g. Manufacturer=Dell Inc. */
+	hwids = g_key_file_get_string_list (kf, FU_ENGINE_PLUGIN_MANIFEST_GROUP,
+					    "HwIds", NULL, NULL);
+	for (guint i = 0; hwids != NULL && hwids[i] != NULL; i++) {
+		g_auto(GStrv) split = NULL;
+		if (fwupd_guid_is_valid (hwids[i])) {
+			if (fu_hwids_has_guid (self->hwids, hwids[i]))
+				return TRUE;
+			continue;
+		}
+		split = g_strsplit (hwids[i], "=", 2);
+		if (g_strv_length (split) == 2 &&
+		    g_strcmp0 (fu_hwids_get_value (self->hwids, split[0]), split[1]) == 0)
+			return TRUE;
+	}
+
+	/* SMBIOS structure types, e.g. 42 for the Redfish host interface */
+	smbios_types = g_key_file_get_string_list (kf, FU_ENGINE_PLUGIN_MANIFEST_GROUP,
+						   "SmbiosTypes", NULL, NULL);
+	for (guint i = 0; smbios_types != NULL && smbios_types[i] != NULL; i++) {
+		guint64 type = g_ascii_strtoull (smbios_types[i], NULL, 0);
+		g_autoptr(GBytes) blob = NULL;
+		if (type > G_MAXUINT8)
+			continue;
+		blob = fu_smbios_get_data (self->smbios, (guint8) type, NULL);
+		if (blob != NULL)
+			return TRUE;
+	}
+
+	/* in the efivarfs format of Name-GUID, e.g. SecureBoot-8be4df61-93ca-11d2-aa0d-00e098032b8c */
+	efivars = g_key_file_get_string_list (kf, FU_ENGINE_PLUGIN_MANIFEST_GROUP,
+					      "EfiVars", NULL, NULL);
+	for (guint i = 0; efivars != NULL && efivars[i] != NULL; i++) {
+		gsize len = strlen (efivars[i]);
+		g_autofree gchar *name = NULL;
+		if (len < 38 || efivars[i][len - 37] != '-')
+			continue;
+		name = g_strndup (efivars[i], len - 37);
+		if (fu_efivar_exists (efivars[i] + len - 36, name))
+			return TRUE;
+	}
+
+	/* any device of the subsystem */
+	subsystems = g_key_file_get_string_list (kf, FU_ENGINE_PLUGIN_MANIFEST_GROUP,
+						 "UdevSubsystems", NULL, NULL);
+	for (guint i = 0; subsystems != NULL && subsystems[i] != NULL; i++) {
+		if (fu_engine_sysfs_has_subsystem (subsystems[i]))
+			return TRUE;
+	}
+
+	/* connected USB device */
+	usb_ids_tmp = g_key_file_get_string_list (kf, FU_ENGINE_PLUGIN_MANIFEST_GROUP,
+						  "UsbIds", NULL, NULL);
+	for (guint i = 0; usb_ids_tmp != NULL && usb_ids_tmp[i] != NULL; i++) {
+		if (g_hash_table_contains (usb_ids, usb_ids_tmp[i]))
+			return TRUE;
+	}
+
+	/* plugin has been configured by the user, e.g. with a remote URI */
+	config_keys = g_key_file_get_string_list (kf, FU_ENGINE_PLUGIN_MANIFEST_GROUP,
+						  "ConfigKeys", NULL, NULL);
+	for (guint i = 0; config_keys != NULL && config_keys[i] != NULL; i++) {
+		g_autofree gchar *value = fu_plugin_get_config_value (plugin, config_keys[i]);
+		if (value != NULL && value[0] != '\0')
+			return TRUE;
+	}
+
+	/* nothing matched */
+	return FALSE;
+}
+
+/* returns TRUE if the plugin should not be opened until the hardware appears */
+static gboolean
+fu_engine_plugin_maybe_defer (FuEngine *self,
+			      FuPlugin *plugin,
+			      const gchar *filename,
+			      GHashTable **usb_ids)
+{
+	g_autofree gchar *dirname = NULL;
+	g_autofree gchar *manifest_basename = NULL;
+	g_autofree gchar *manifest_fn = NULL;
+	g_autoptr(GError) error_local = NULL;
+	g_autoptr(GKeyFile) kf = g_key_file_new ();
+	g_auto(GStrv) subsystems = NULL;
+
+	/* only when enumerating, and never when the user asked for specific plugins */
+	if ((self->load_flags & FU_ENGINE_LOAD_FLAG_COLDPLUG) == 0)
+		return FALSE;
+	if (self->plugin_filter->len > 0)
+		return FALSE;
+
+	/* plugins without a manifest are always loaded */
+	dirname = g_path_get_dirname (filename);
+	manifest_basename = g_strdup_printf ("%s.manifest", fu_plugin_get_name (plugin));
+	manifest_fn = g_build_filename (dirname, manifest_basename, NULL);
+	if (!g_file_test (manifest_fn, G_FILE_TEST_EXISTS))
+		return FALSE;
+	if (!g_key_file_load_from_file (kf, manifest_fn, G_KEY_FILE_NONE, &error_local)) {
+		g_warning ("failed to load %s: %s", manifest_fn, error_local->message);
+		return FALSE;
+	}
+
+	/* the hardware is already present */
+	if (*usb_ids == NULL)
+		*usb_ids = fu_engine_get_usb_instance_ids ();
+	if (fu_engine_plugin_manifest_matches (self, plugin, kf, *usb_ids))
+		return FALSE;
+
+	/* udev watches can only be set up before the backend coldplug */
+	subsystems = g_key_file_get_string_list (kf, FU_ENGINE_PLUGIN_MANIFEST_GROUP,
+						 "UdevSubsystems", NULL, NULL);
+	for (guint i = 0; subsystems != NULL && subsystems[i] != NULL; i++)
+		fu_plugin_add_udev_subsystem (plugin, subsystems[i]);
+
+	/* wait for a hotplugged device to match */
+	fu_plugin_add_flag (plugin, FWUPD_PLUGIN_FLAG_DISABLED);
+	fu_plugin_add_flag (plugin, FWUPD_PLUGIN_FLAG_NO_HARDWARE);
+	g_object_set_data_full (G_OBJECT (plugin), "fwupd::Filename",
+				g_strdup (filename), g_free);
+	g_object_set_data_full (G_OBJECT (plugin), "fwupd::Manifest",
+				g_steal_pointer (&kf),
+				(GDestroyNotify) g_key_file_unref);
+	g_ptr_array_add (self->plugins_deferred, g_object_ref (plugin));
+	return TRUE;
+}
+
+static gboolean
+fu_engine_plugin_manifest_matches_device (FuPlugin *plugin,
+					  FuDevice *device,
+					  GPtrArray *possible_plugins)
+{
+	GKeyFile *kf = g_object_get_data (G_OBJECT (plugin), "fwupd::Manifest");
+	g_auto(GStrv) subsystems = NULL;
+	g_auto(GStrv) usb_ids = NULL;
+
+	/* set from a quirk Plugin= key */
+	for (guint i = 0; i < possible_plugins->len; i++) {
+		const gchar *plugin_name = g_ptr_array_index (possible_plugins, i);
+		if (g_strcmp0 (plugin_name, fu_plugin_get_name (plugin)) == 0)
+			return TRUE;
+	}
+
+	/* any device of the subsystem */
+	if (FU_IS_UDEV_DEVICE (device)) {
+		const gchar *subsystem = fu_udev_device_get_subsystem (FU_UDEV_DEVICE (device));
+		subsystems = g_key_file_get_string_list (kf, FU_ENGINE_PLUGIN_MANIFEST_GROUP,
+							 "UdevSubsystems", NULL, NULL);
+		if (subsystems != NULL && subsystem != NULL &&
+		    g_strv_contains ((const gchar * const *) subsystems, subsystem))
+			return TRUE;
+	}
+
+	/* USB VID or VID&PID */
+	usb_ids = g_key_file_get_string_list (kf, FU_ENGINE_PLUGIN_MANIFEST_GROUP,
+					      "UsbIds", NULL, NULL);
+	for (guint i = 0; usb_ids != NULL && usb_ids[i] != NULL; i++) {
+		if (fu_device_has_instance_id (device, usb_ids[i]))
+			return TRUE;
+	}
+	return FALSE;
+}
+
+/* the priority of each enabled plugin, before the rules of a newly opened
+ * plugin are depsolved */
+static GHashTable *
+fu_engine_plugins_get_priorities (FuEngine *self)
+{
+	GPtrArray *plugins = fu_plugin_list_get_all (self->plugin_list);
+	GHashTable *priorities = g_hash_table_new (g_str_hash, g_str_equal);
+	for (guint i = 0; i < plugins->len; i++) {
+		FuPlugin *plugin = g_ptr_array_index (plugins, i);
+		if (fu_plugin_has_flag (plugin, FWUPD_PLUGIN_FLAG_DISABLED))
+			continue;
+		g_hash_table_insert (priorities,
+				     (gpointer) fu_plugin_get_name (plugin),
+				     GUINT_TO_POINTER (fu_plugin_get_priority (plugin)));
+	}
+	return priorities;
+}
+
+/* a late plugin can be BETTER_THAN or CONFLICT with a plugin that has
+ * already added devices */
+static void
+fu_engine_plugins_refresh_devices (FuEngine *self, GHashTable *priorities)
+{
+	GPtrArray *plugins = fu_plugin_list_get_all (self->plugin_list);
+	g_autoptr(GPtrArray) devices = fu_device_list_get_all (self->device_list);
+
+	for (guint i = 0; i < plugins->len; i++) {
+		FuPlugin *plugin = g_ptr_array_index (plugins, i);
+		gpointer tmp = NULL;
+		guint priority_old;
+
+		if (!g_hash_table_lookup_extended (priorities,
+						   fu_plugin_get_name (plugin),
+						   NULL, &tmp))
+			continue;
+		priority_old = GPOINTER_TO_UINT (tmp);
+		for (guint j = 0; j < devices->len; j++) {
+			FuDevice *device = g_ptr_array_index (devices, j);
+			if (g_strcmp0 (fu_device_get_plugin (device),
+				       fu_plugin_get_name (plugin)) != 0)
+				continue;
+			if (fu_plugin_has_flag (plugin, FWUPD_PLUGIN_FLAG_DISABLED)) {
+				g_debug ("removing %s as %s is now disabled",
+					 fu_device_get_id (device),
+					 fu_plugin_get_name (plugin));
+				fu_device_list_remove (self->device_list, device);
+				continue;
+			}
+
+			/* only if auto-set from the plugin, not from a quirk */
+			if (fu_plugin_get_priority (plugin) != priority_old &&
+			    fu_device_get_priority (device) == priority_old) {
+				g_debug ("auto-setting %s priority to %u",
+					 fu_device_get_id (device),
+					 fu_plugin_get_priority (plugin));
+				fu_device_set_priority (device, fu_plugin_get_priority (plugin));
+			}
+		}
+	}
+}
+
+static gboolean
+fu_engine_plugin_open_deferred (FuEngine *self, FuPlugin *plugin, GError **error)
+{
+	const gchar *filename = g_object_get_data (G_OBJECT (plugin), "fwupd::Filename");
+	g_autoptr(FuPlugin) plugin_ref = g_object_ref (plugin);
+	g_autoptr(GError) error_local = NULL;
+	g_autoptr(GHashTable) priorities = NULL;
+	g_autoptr(GPtrArray) devices = NULL;
+
+	/* only ever try once */
+	g_ptr_array_remove (self->plugins_deferred, plugin);
+	g_debug ("loading deferred plugin %s", fu_plugin_get_name (plugin));
+	fu_plugin_remove_flag (plugin, FWUPD_PLUGIN_FLAG_DISABLED);
+	fu_plugin_remove_flag (plugin, FWUPD_PLUGIN_FLAG_NO_HARDWARE);
+	if (!fu_plugin_open (plugin, filename, error))
+		return FALSE;
+	if (fu_plugin_has_flag (plugin, FWUPD_PLUGIN_FLAG_DISABLED)) {
+		g_set_error (error,
+			     FWUPD_ERROR,
+			     FWUPD_ERROR_NOT_SUPPORTED,
+			     "%s is runtime-disabled",
+			     fu_plugin_get_name (plugin));
+		return FALSE;
+	}
+	fu_engine_check_plugin_build_hash (self, plugin);
+	fu_engine_watch_plugin (self, plugin);
+
+	/* the rules from fu_plugin_init() only exist now */
+	fu_engine_plugin_rules_changed_cb (plugin, self);
+	priorities = fu_engine_plugins_get_priorities (self);
+	if (!fu_plugin_list_depsolve (self->plugin_list, error))
+		return FALSE;
+	fu_engine_plugins_refresh_devices (self, priorities);
+
+	/* startup */
+	fu_engine_plugin_setup (self, plugin);
+	if (fu_plugin_has_flag (plugin, FWUPD_PLUGIN_FLAG_DISABLED))
+		return TRUE;
+
+	/* devices that were added before the plugin was loaded */
+	devices = fu_device_list_get_all (self->device_list);
+	for (guint i = 0; i < devices->len; i++) {
+		FuDevice *device = g_ptr_array_index (devices, i);
+		fu_plugin_runner_device_register (plugin, device);
+	}
+
+	/* coldplug */
+	if (!fu_plugin_runner_coldplug_prepare (plugin, error))
+		return FALSE;
+	if (!fu_plugin_runner_coldplug (plugin, &error_local)) {
+		fu_plugin_add_flag (plugin, FWUPD_PLUGIN_FLAG_DISABLED);
+		g_message ("disabling plugin because: %s", error_local->message);
+	}
+	return fu_plugin_runner_coldplug_cleanup (plugin, error);
+}
+
 gboolean
 fu_engine_load_plugins (FuEngine *self, GError **error)
 {
@@ -5886,6 +7193,8 @@ fu_engine_load_plugins (FuEngine *self, GError **error)
 	g_autofree gchar *suffix = g_strdup_printf (".%s", G_MODULE_SUFFIX);
 	g_autoptr(GPtrArray) plugins_disabled = g_ptr_array_new_with_free_func (g_free);
 	g_autoptr(GPtrArray) plugins_disabled_rt = g_ptr_array_new_with_free_func (g_free);
+	g_autoptr(GPtrArray) plugins_deferred = g_ptr_array_new_with_free_func (g_free);
+	g_autoptr(GHashTable) usb_ids = NULL;
 
 	/* search */
 	plugin_path = fu_common_get_path (FU_PATH_KIND_PLUGINDIR_PKG);
@@ -5928,6 +7237,11 @@ fu_engine_load_plugins (FuEngine *self, GError **error)
 
 		/* if loaded from fu_engine_load() open the plugin */
 		if (g_hash_table_size (self->firmware_gtypes) > 0) {
+			if (fu_engine_plugin_maybe_defer (self, plugin, filename, &usb_ids)) {
+				g_ptr_array_add (plugins_deferred, g_steal_pointer (&name));
+				fu_engine_add_plugin (self, plugin);
+				continue;
+			}
 			if (!fu_plugin_open (plugin, filename, &error_local)) {
 				g_warning ("cannot load: %s", error_local->message);
 				fu_engine_add_plugin (self, plugin);
@@ -5942,30 +7256,7 @@ fu_engine_load_plugins (FuEngine *self, GError **error)
 		}
 
 		/* watch for changes */
-		g_signal_connect (plugin, "device-added",
-				  G_CALLBACK (fu_engine_plugin_device_added_cb),
-				  self);
-		g_signal_connect (plugin, "device-removed",
-				  G_CALLBACK (fu_engine_plugin_device_removed_cb),
-				  self);
-		g_signal_connect (plugin, "device-register",
-				  G_CALLBACK (fu_engine_plugin_device_register_cb),
-				  self);
-		g_signal_connect (plugin, "recoldplug",
-				  G_CALLBACK (fu_engine_plugin_recoldplug_cb),
-				  self);
-		g_signal_connect (plugin, "set-coldplug-delay",
-				  G_CALLBACK (fu_engine_plugin_set_coldplug_delay_cb),
-				  self);
-		g_signal_connect (plugin, "check-supported",
-				  G_CALLBACK (fu_engine_plugin_check_supported_cb),
-				  self);
-		g_signal_connect (plugin, "rules-changed",
-				  G_CALLBACK (fu_engine_plugin_rules_changed_cb),
-				  self);
-		g_signal_connect (plugin, "security-changed",
-				  G_CALLBACK (fu_engine_plugin_security_changed_cb),
-				  self);
+		fu_engine_watch_plugin (self, plugin);
 
 		/* add */
 		fu_engine_add_plugin (self, plugin);
@@ -5984,6 +7275,12 @@ fu_engine_load_plugins (FuEngine *self, GError **error)
 		str = g_strjoinv (", ", (gchar **) plugins_disabled_rt->pdata);
 		g_debug ("plugins runtime-disabled: %s", str);
 	}
+	if (plugins_deferred->len > 0) {
+		g_autofree gchar *str = NULL;
+		g_ptr_array_add (plugins_deferred, NULL);
+		str = g_strjoinv (", ", (gchar **) plugins_deferred->pdata);
+		g_debug ("plugins deferred until hardware is found: %s", str);
+	}
 
 	/* depsolve into the correct order */
 	if (!fu_plugin_list_depsolve (self->plugin_list, error))
@@ -6028,6 +7325,21 @@ fu_engine_backend_device_removed_cb (FuBackend *backend, FuDevice *device, FuEng
 			 fu_device_get_backend_id (device));
 	}
 
+	/* not yet given to a deferred plugin */
+	for (guint i = 0; i < self->plugins_deferred->len; i++) {
+		FuPlugin *plugin = g_ptr_array_index (self->plugins_deferred, i);
+		GPtrArray *devices_pending;
+		devices_pending = g_object_get_data (G_OBJECT (plugin), "fwupd::PendingDevices");
+		if (devices_pending == NULL)
+			continue;
+		for (guint j = devices_pending->len; j > 0; j--) {
+			FuDevice *device_tmp = g_ptr_array_index (devices_pending, j - 1);
+			if (g_strcmp0 (fu_device_get_backend_id (device_tmp),
+				       fu_device_get_backend_id (device)) == 0)
+				g_ptr_array_remove_index (devices_pending, j - 1);
+		}
+	}
+
 	/* go through each device and remove any that match */
 	devices = fu_device_list_get_all (self->device_list);
 	for (guint i = 0; i < devices->len; i++) {
@@ -6040,6 +7352,106 @@ fu_engine_backend_device_removed_cb (FuBackend *backend, FuDevice *device, FuEng
 	}
 }
 
+static void
+fu_engine_backend_device_added_plugin (FuEngine *self, FuPlugin *plugin, FuDevice *device)
+{
+	g_autoptr(GError) error = NULL;
+	if (!fu_plugin_runner_backend_device_added (plugin, device, &error)) {
+		if (g_error_matches (error, FWUPD_ERROR, FWUPD_ERROR_NOT_SUPPORTED)) {
+			if (g_getenv ("FWUPD_PROBE_VERBOSE") != NULL) {
+				g_debug ("%s ignoring: %s",
+					 fu_plugin_get_name (plugin),
+					 error->message);
+			}
+			return;
+		}
+		g_warning ("failed to add device %s: %s",
+			   fu_device_get_backend_id (device),
+			   error->message);
+	}
+}
+
+/* opens the deferred plugins matched by a backend device, which is not done
+ * from the backend signal as other plugins have not yet seen the device */
+static void
+fu_engine_plugins_open_pending (FuEngine *self)
+{
+	g_autoptr(GPtrArray) plugins = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+
+	if (self->plugins_deferred_id != 0) {
+		g_source_remove (self->plugins_deferred_id);
+		self->plugins_deferred_id = 0;
+	}
+
+	/* opening removes the plugin from the deferred list */
+	for (guint i = 0; i < self->plugins_deferred->len; i++) {
+		FuPlugin *plugin = g_ptr_array_index (self->plugins_deferred, i);
+		if (g_object_get_data (G_OBJECT (plugin), "fwupd::PendingDevices") != NULL)
+			g_ptr_array_add (plugins, g_object_ref (plugin));
+	}
+	for (guint i = 0; i < plugins->len; i++) {
+		FuPlugin *plugin = g_ptr_array_index (plugins, i);
+		g_autoptr(GError) error = NULL;
+		g_autoptr(GPtrArray) devices = NULL;
+
+		devices = g_object_steal_data (G_OBJECT (plugin), "fwupd::PendingDevices");
+		if (!fu_engine_plugin_open_deferred (self, plugin, &error)) {
+			g_warning ("failed to load deferred plugin %s: %s",
+				   fu_plugin_get_name (plugin),
+				   error->message);
+			continue;
+		}
+
+		/* the devices the plugin missed while it was not loaded */
+		for (guint j = 0; j < devices->len; j++) {
+			FuDevice *device = g_ptr_array_index (devices, j);
+			fu_engine_backend_device_added_plugin (self, plugin, device);
+		}
+	}
+}
+
+static gboolean
+fu_engine_plugins_open_pending_cb (gpointer user_data)
+{
+	FuEngine *self = FU_ENGINE (user_data);
+	self->plugins_deferred_id = 0;
+	fu_engine_plugins_open_pending (self);
+	return G_SOURCE_REMOVE;
+}
+
+static void
+fu_engine_backend_device_load_deferred (FuEngine *self,
+					FuDevice *device,
+					GPtrArray *possible_plugins)
+{
+	for (guint i = 0; i < self->plugins_deferred->len; i++) {
+		FuPlugin *plugin = g_ptr_array_index (self->plugins_deferred, i);
+		GPtrArray *devices;
+
+		if (!fu_engine_plugin_manifest_matches_device (plugin, device, possible_plugins))
+			continue;
+		devices = g_object_get_data (G_OBJECT (plugin), "fwupd::PendingDevices");
+		if (devices == NULL) {
+			devices = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+			g_object_set_data_full (G_OBJECT (plugin), "fwupd::PendingDevices",
+						devices, (GDestroyNotify) g_ptr_array_unref);
+		}
+
+		/* only replayed if the plugin would have been given it */
+		for (guint j = 0; j < possible_plugins->len; j++) {
+			const gchar *plugin_name = g_ptr_array_index (possible_plugins, j);
+			if (g_strcmp0 (plugin_name, fu_plugin_get_name (plugin)) == 0) {
+				g_ptr_array_add (devices, g_object_ref (device));
+				break;
+			}
+		}
+		if (self->plugins_deferred_id == 0) {
+			self->plugins_deferred_id = g_idle_add (fu_engine_plugins_open_pending_cb,
+								self);
+		}
+	}
+}
+
 static void
 fu_engine_backend_device_added_cb (FuBackend *backend, FuDevice *device, FuEngine *self)
 {
@@ -6067,30 +7479,22 @@ fu_engine_backend_device_added_cb (FuBackend *backend, FuDevice *device, FuEngin
 		g_debug ("%s added %s", fu_backend_get_name (backend), str);
 	}
 
+	/* save so that the device can be created when replaying */
+	fu_io_trace_record_device (device);
+
 	/* can be specified using a quirk */
 	possible_plugins = fu_device_get_possible_plugins (device);
+
+	/* load any plugin that was waiting for this hardware */
+	fu_engine_backend_device_load_deferred (self, device, possible_plugins);
 	for (guint i = 0; i < possible_plugins->len; i++) {
 		FuPlugin *plugin;
 		const gchar *plugin_name = g_ptr_array_index (possible_plugins, i);
-		g_autoptr(GError) error = NULL;
 
 		plugin = fu_plugin_list_find_by_name (self->plugin_list, plugin_name, NULL);
 		if (plugin == NULL)
 			continue;
-		if (!fu_plugin_runner_backend_device_added (plugin, device, &error)) {
-			if (g_error_matches (error, FWUPD_ERROR, FWUPD_ERROR_NOT_SUPPORTED)) {
-				if (g_getenv ("FWUPD_PROBE_VERBOSE") != NULL) {
-					g_debug ("%s ignoring: %s",
-						 fu_plugin_get_name (plugin),
-						 error->message);
-				}
-				continue;
-			}
-			g_warning ("failed to add device %s: %s",
-				   fu_device_get_backend_id (device),
-				   error->message);
-			continue;
-		}
+		fu_engine_backend_device_added_plugin (self, plugin, device);
 	}
 }
 
@@ -6194,9 +7598,40 @@ fu_engine_load_smbios (FuEngine *self)
 static void
 fu_engine_load_hwids (FuEngine *self)
 {
+	g_autofree gchar *dmi_checksum = NULL;
 	g_autoptr(GError) error = NULL;
-	if (!fu_hwids_setup (self->hwids, self->smbios, &error))
+
+	/* the DMI tables cannot change without a reboot, but check anyway;
+	 * without them the HWIDs come from sources we cannot checksum */
+	if (self->boot_cache != NULL) {
+		dmi_checksum = fu_firmware_get_checksum (FU_FIRMWARE (self->smbios),
+							 G_CHECKSUM_SHA1, NULL);
+	}
+	if (dmi_checksum != NULL) {
+		g_autofree gchar *dmi_checksum_old = NULL;
+		dmi_checksum_old = g_key_file_get_string (self->boot_cache,
+							  FU_ENGINE_BOOT_CACHE_GROUP,
+							  "DmiChecksum", NULL);
+		if (g_strcmp0 (dmi_checksum, dmi_checksum_old) == 0) {
+			g_autoptr(GError) error_cache = NULL;
+			if (fu_hwids_setup_from_keyfile (self->hwids,
+							 self->boot_cache,
+							 &error_cache))
+				return;
+			g_debug ("ignoring cached HWIDs: %s", error_cache->message);
+		}
+	}
+
+	if (!fu_hwids_setup (self->hwids, self->smbios, &error)) {
 		g_warning ("Failed to load HWIDs: %s", error->message);
+		return;
+	}
+	if (dmi_checksum != NULL) {
+		fu_hwids_to_keyfile (self->hwids, self->boot_cache);
+		g_key_file_set_string (self->boot_cache, FU_ENGINE_BOOT_CACHE_GROUP,
+				       "DmiChecksum", dmi_checksum);
+		self->boot_cache_changed = TRUE;
+	}
 }
 
 static gboolean
@@ -6380,11 +7815,15 @@ fu_engine_load (FuEngine *self, FuEngineLoadFlags flags, GError **error)
 	/* avoid re-loading a second time if fu-tool or fu-util request to */
 	if (self->loaded)
 		return TRUE;
+	self->load_flags = flags;
+
+	/* values that cannot change until the next reboot */
+	fu_engine_boot_cache_load (self);
 
 /* TODO: Read registry key [HKEY_LOCAL_MACHINE\SOFTWARE\Microsoft\Cryptography] "MachineGuid" */
 #ifndef _WIN32
 	/* cache machine ID so we can use it from a sandboxed app */
-	self->host_machine_id = fwupd_build_machine_id ("fwupd", &error_local);
+	self->host_machine_id = fu_engine_build_machine_id (self, &error_local);
 	if (self->host_machine_id == NULL)
 		g_debug ("failed to build machine-id: %s", error_local->message);
 #endif
@@ -6445,6 +7884,7 @@ fu_engine_load (FuEngine *self, FuEngineLoadFlags flags, GError **error)
 		fu_engine_load_smbios (self);
 		fu_engine_load_hwids (self);
 	}
+	fu_engine_boot_cache_save (self);
 
 	/* load AppStream metadata */
 	if (!fu_engine_load_metadata_store (self, flags, error)) {
@@ -6465,6 +7905,13 @@ fu_engine_load (FuEngine *self, FuEngineLoadFlags flags, GError **error)
 	for (guint i = 0; i < self->backends->len; i++) {
 		FuBackend *backend = g_ptr_array_index (self->backends, i);
 		g_autoptr(GError) error_backend = NULL;
+
+		/* only the recorded devices exist when replaying */
+		if (fu_io_trace_get_mode () == FU_IO_TRACE_MODE_REPLAY &&
+		    !FU_IS_REPLAY_BACKEND (backend)) {
+			fu_backend_set_enabled (backend, FALSE);
+			continue;
+		}
 		if (!fu_backend_setup (backend, &error_backend)) {
 			g_debug ("failed to setup backend %s: %s",
 				 fu_backend_get_name (backend),
@@ -6540,6 +7987,12 @@ fu_engine_load (FuEngine *self, FuEngineLoadFlags flags, GError **error)
 		}
 	}
 
+	/* plugins for hardware found by the backends */
+	fu_engine_plugins_open_pending (self);
+
+	/* write the register snapshot once for all the coldplugged devices */
+	fu_udev_device_snapshot_save ();
+
 	/* set device properties from the metadata */
 	fu_engine_md_refresh_devices (self);
 
@@ -6626,10 +8079,6 @@ fu_engine_init (FuEngine *self)
 #ifdef HAVE_UTSNAME_H
 	struct utsname uname_tmp;
 #endif
-	g_autofree gchar *keyring_path = NULL;
-	g_autofree gchar *pkidir_fw = NULL;
-	g_autofree gchar *pkidir_md = NULL;
-	g_autofree gchar *sysconfdir = NULL;
 	self->percentage = 0;
 	self->status = FWUPD_STATUS_IDLE;
 	self->config = fu_config_new ();
@@ -6642,6 +8091,7 @@ fu_engine_init (FuEngine *self)
 	self->history = fu_history_new ();
 	self->plugin_list = fu_plugin_list_new ();
 	self->plugin_filter = g_ptr_array_new_with_free_func (g_free);
+	self->plugins_deferred = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
 	self->host_security_attrs = fu_security_attrs_new ();
 	self->udev_subsystems = g_ptr_array_new_with_free_func (g_free);
 	self->backends = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
@@ -6669,16 +8119,10 @@ fu_engine_init (FuEngine *self)
 #ifdef HAVE_BLUEZ
 	g_ptr_array_add (self->backends, fu_bluez_backend_new ());
 #endif
+	g_ptr_array_add (self->backends, fu_replay_backend_new ());
 
 	/* setup Jcat context */
-	self->jcat_context = jcat_context_new ();
-	keyring_path = fu_common_get_path (FU_PATH_KIND_LOCALSTATEDIR_PKG);
-	jcat_context_set_keyring_path (self->jcat_context, keyring_path);
-	sysconfdir = fu_common_get_path (FU_PATH_KIND_SYSCONFDIR);
-	pkidir_fw = g_build_filename (sysconfdir, "pki", "fwupd", NULL);
-	jcat_context_add_public_keys (self->jcat_context, pkidir_fw);
-	pkidir_md = g_build_filename (sysconfdir, "pki", "fwupd-metadata", NULL);
-	jcat_context_add_public_keys (self->jcat_context, pkidir_md);
+	self->jcat_context = fu_engine_jcat_context_new ();
 
 	/* add some runtime versions of things the daemon depends on */
 	fu_engine_add_runtime_version (self, "org.freedesktop.fwupd", VERSION);
@@ -6716,15 +8160,22 @@ fu_engine_finalize (GObject *obj)
 {
 	FuEngine *self = FU_ENGINE (obj);
 
+	/* settle times learned outside of an update, e.g. when replugging */
+	fu_engine_save_retry_settle ();
+
 	if (self->silo != NULL)
 		g_object_unref (self->silo);
 	if (self->coldplug_id != 0)
 		g_source_remove (self->coldplug_id);
+	if (self->plugins_deferred_id != 0)
+		g_source_remove (self->plugins_deferred_id);
 	if (self->approved_firmware != NULL)
 		g_hash_table_unref (self->approved_firmware);
 	if (self->blocked_firmware != NULL)
 		g_hash_table_unref (self->blocked_firmware);
 
+	if (self->boot_cache != NULL)
+		g_key_file_unref (self->boot_cache);
 	g_free (self->host_machine_id);
 	g_free (self->host_security_id);
 	g_object_unref (self->host_security_attrs);
@@ -6738,6 +8189,7 @@ fu_engine_finalize (GObject *obj)
 	g_object_unref (self->device_list);
 	g_object_unref (self->jcat_context);
 	g_ptr_array_unref (self->plugin_filter);
+	g_ptr_array_unref (self->plugins_deferred);
 	g_ptr_array_unref (self->udev_subsystems);
 	g_ptr_array_unref (self->backends);
 	g_hash_table_unref (self->runtime_versions);
@@ -13,6 +13,7 @@
 #include "fwupd-device.h"
 #include "fwupd-enums.h"
 
+#include "fu-backend.h"
 #include "fu-common.h"
 #include "fu-engine-request.h"
 #include "fu-install-task.h"
@@ -61,6 +62,14 @@ FwupdStatus	 fu_engine_get_status			(FuEngine	*self);
 XbSilo		*fu_engine_get_silo_from_blob		(FuEngine	*self,
 							 GBytes		*blob_cab,
 							 GError		**error);
+void		 fu_engine_get_silo_from_blob_async	(FuEngine	*self,
+							 GBytes		*blob_cab,
+							 GCancellable	*cancellable,
+							 GAsyncReadyCallback callback,
+							 gpointer	 callback_data);
+XbSilo		*fu_engine_get_silo_from_blob_finish	(FuEngine	*self,
+							 GAsyncResult	*res,
+							 GError		**error);
 guint64		 fu_engine_get_archive_size_max		(FuEngine	*self);
 GPtrArray	*fu_engine_get_plugins			(FuEngine	*self);
 GPtrArray	*fu_engine_get_devices			(FuEngine	*self,
@@ -90,6 +99,10 @@ GPtrArray	*fu_engine_get_upgrades			(FuEngine	*self,
 							 FuEngineRequest *request,
 							 const gchar	*device_id,
 							 GError		**error);
+GPtrArray	*fu_engine_get_devices_with_releases	(FuEngine	*self,
+							 FuEngineRequest *request,
+							 FwupdReleaseKind kind,
+							 GError		**error);
 FwupdDevice	*fu_engine_get_results			(FuEngine	*self,
 							 const gchar	*device_id,
 							 GError		**error);
@@ -104,11 +117,39 @@ gboolean	 fu_engine_update_metadata		(FuEngine	*self,
 							 gint		 fd,
 							 gint		 fd_sig,
 							 GError		**error);
+void		 fu_engine_update_metadata_async	(FuEngine	*self,
+							 const gchar	*remote_id,
+							 gint		 fd,
+							 gint		 fd_sig,
+							 GCancellable	*cancellable,
+							 GAsyncReadyCallback callback,
+							 gpointer	 callback_data);
+gboolean	 fu_engine_update_metadata_finish	(FuEngine	*self,
+							 GAsyncResult	*res,
+							 GError		**error);
 gboolean	 fu_engine_update_metadata_bytes	(FuEngine	*self,
 							 const gchar	*remote_id,
 							 GBytes		*bytes_raw,
 							 GBytes		*bytes_sig,
 							 GError		**error);
+void		 fu_engine_update_metadata_bytes_async	(FuEngine	*self,
+							 const gchar	*remote_id,
+							 GBytes		*bytes_raw,
+							 GBytes		*bytes_sig,
+							 GCancellable	*cancellable,
+							 GAsyncReadyCallback callback,
+							 gpointer	 callback_data);
+gboolean	 fu_engine_update_metadata_bytes_finish	(FuEngine	*self,
+							 GAsyncResult	*res,
+							 GError		**error);
+void		 fu_engine_reload_metadata_async	(FuEngine	*self,
+							 GCancellable	*cancellable,
+							 GAsyncReadyCallback callback,
+							 gpointer	 callback_data);
+gboolean	 fu_engine_reload_metadata_finish	(FuEngine	*self,
+							 GAsyncResult	*res,
+							 GError		**error);
+guint64		 fu_engine_get_silo_generation		(FuEngine	*self);
 gboolean	 fu_engine_unlock			(FuEngine	*self,
 							 const gchar	*device_id,
 							 GError		**error);
@@ -158,6 +199,15 @@ GPtrArray	*fu_engine_get_details			(FuEngine	*self,
 							 FuEngineRequest *request,
 							 gint		 fd,
 							 GError		**error);
+void		 fu_engine_get_details_async		(FuEngine	*self,
+							 FuEngineRequest *request,
+							 gint		 fd,
+							 GCancellable	*cancellable,
+							 GAsyncReadyCallback callback,
+							 gpointer	 callback_data);
+GPtrArray	*fu_engine_get_details_finish		(FuEngine	*self,
+							 GAsyncResult	*res,
+							 GError		**error);
 gboolean	 fu_engine_activate			(FuEngine	*self,
 							 const gchar	*device_id,
 							 GError		**error);
@@ -192,6 +242,8 @@ GPtrArray	*fu_engine_get_releases_for_device 	(FuEngine	*self,
 							 GError		**error);
 
 /* for the self tests */
+void		 fu_engine_add_backend			(FuEngine	*self,
+							 FuBackend	*backend);
 void		 fu_engine_add_device			(FuEngine	*self,
 							 FuDevice	*device);
 void		 fu_engine_add_plugin			(FuEngine	*self,
@@ -37,6 +37,8 @@
 #include "fu-device-private.h"
 #include "fu-engine.h"
 #include "fu-install-task.h"
+#include "fu-metrics.h"
+#include "fu-poll-scheduler-private.h"
 #include "fu-security-attrs-private.h"
 
 #ifdef HAVE_POLKIT
@@ -62,6 +64,8 @@ typedef struct {
 	GMainLoop		*loop;
 	GFileMonitor		*argv0_monitor;
 	GHashTable		*sender_features;	/* sender:FwupdFeatureFlags */
+	GHashTable		*clients;		/* sender:watch-id */
+	GHashTable		*client_cancellables;	/* sender:GCancellable */
 #if GLIB_CHECK_VERSION(2,63,3)
 	GMemoryMonitor		*memory_monitor;
 #endif
@@ -692,6 +696,23 @@ fu_main_authorize_modify_remote_cb (GObject *source, GAsyncResult *res, gpointer
 	g_dbus_method_invocation_return_value (helper->invocation, NULL);
 }
 
+static void
+fu_main_update_metadata_cb (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+	g_autoptr(FuMainAuthHelper) helper = (FuMainAuthHelper *) user_data;
+	g_autoptr(GError) error = NULL;
+
+	if (!fu_engine_update_metadata_finish (FU_ENGINE (source), res, &error)) {
+		g_prefix_error (&error, "Failed to update metadata for %s: ",
+				helper->remote_id);
+		g_dbus_method_invocation_return_gerror (helper->invocation, error);
+		return;
+	}
+
+	/* success */
+	g_dbus_method_invocation_return_value (helper->invocation, NULL);
+}
+
 static void fu_main_authorize_install_queue (FuMainAuthHelper *helper);
 
 #ifdef HAVE_POLKIT
@@ -846,12 +867,14 @@ fu_main_install_with_helper (FuMainAuthHelper *helper_ref, GError **error)
 			return FALSE;
 	}
 
-	/* parse silo */
-	helper->silo = fu_engine_get_silo_from_blob (priv->engine,
-						     helper->blob_cab,
-						     error);
-	if (helper->silo == NULL)
-		return FALSE;
+	/* parse silo, unless already done in a thread */
+	if (helper->silo == NULL) {
+		helper->silo = fu_engine_get_silo_from_blob (priv->engine,
+							     helper->blob_cab,
+							     error);
+		if (helper->silo == NULL)
+			return FALSE;
+	}
 
 	/* for each component in the silo */
 	components = xb_silo_query (helper->silo,
@@ -937,6 +960,25 @@ fu_main_install_with_helper (FuMainAuthHelper *helper_ref, GError **error)
 	return TRUE;
 }
 
+/* the installs themselves are still run one at a time in the main thread */
+static void
+fu_main_install_silo_cb (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+	g_autoptr(FuMainAuthHelper) helper = (FuMainAuthHelper *) user_data;
+	GDBusMethodInvocation *invocation = helper->invocation;
+	g_autoptr(GError) error = NULL;
+
+	helper->silo = fu_engine_get_silo_from_blob_finish (FU_ENGINE (source), res, &error);
+	if (helper->silo == NULL) {
+		g_dbus_method_invocation_return_gerror (invocation, error);
+		return;
+	}
+	if (!fu_main_install_with_helper (g_steal_pointer (&helper), &error)) {
+		g_dbus_method_invocation_return_gerror (invocation, error);
+		return;
+	}
+}
+
 static gboolean
 fu_main_device_id_valid (const gchar *device_id, GError **error)
 {
@@ -952,6 +994,128 @@ fu_main_device_id_valid (const gchar *device_id, GError **error)
 	return FALSE;
 }
 
+static void
+fu_main_client_unwatch (gpointer data)
+{
+	g_bus_unwatch_name (GPOINTER_TO_UINT (data));
+}
+
+static void
+fu_main_client_vanished_cb (GDBusConnection *connection,
+			    const gchar *name,
+			    gpointer user_data)
+{
+	FuMainPrivate *priv = (FuMainPrivate *) user_data;
+	GCancellable *cancellable;
+
+	g_debug ("client %s disconnected", name);
+	g_hash_table_remove (priv->clients, name);
+
+	/* nobody is waiting for the result of any threaded method */
+	cancellable = g_hash_table_lookup (priv->client_cancellables, name);
+	if (cancellable != NULL) {
+		g_cancellable_cancel (cancellable);
+		g_hash_table_remove (priv->client_cancellables, name);
+	}
+
+	/* nothing can use the results */
+	if (g_hash_table_size (priv->clients) == 0)
+		fu_poll_scheduler_set_suspended (TRUE);
+}
+
+/* device polling is only useful when a client is connected */
+static void
+fu_main_client_add (FuMainPrivate *priv, const gchar *sender)
+{
+	guint watch_id;
+	if (g_hash_table_contains (priv->clients, sender))
+		return;
+	watch_id = g_bus_watch_name_on_connection (priv->connection, sender,
+						   G_BUS_NAME_WATCHER_FLAGS_NONE,
+						   NULL,
+						   fu_main_client_vanished_cb,
+						   priv, NULL);
+	g_hash_table_insert (priv->clients, g_strdup (sender), GUINT_TO_POINTER (watch_id));
+	g_hash_table_insert (priv->client_cancellables, g_strdup (sender), g_cancellable_new ());
+	fu_poll_scheduler_set_suspended (FALSE);
+}
+
+/* cancelled when the client disconnects */
+static GCancellable *
+fu_main_client_get_cancellable (FuMainPrivate *priv, const gchar *sender)
+{
+	return g_hash_table_lookup (priv->client_cancellables, sender);
+}
+
+typedef struct {
+	gchar			*method_name;
+	gint64			 start;
+} FuMainMethodTiming;
+
+/* the invocation is freed when the reply is sent, whichever thread that is */
+static void
+fu_main_method_invocation_finalized_cb (gpointer data, GObject *where_the_object_was)
+{
+	FuMainMethodTiming *timing = (FuMainMethodTiming *) data;
+	g_autofree gchar *id = g_strdup_printf ("daemon.method.%s", timing->method_name);
+	fu_metrics_add_duration (id, g_get_monotonic_time () - timing->start);
+	g_free (timing->method_name);
+	g_free (timing);
+}
+
+static void
+fu_main_method_invocation_add_timing (GDBusMethodInvocation *invocation)
+{
+	FuMainMethodTiming *timing = g_new0 (FuMainMethodTiming, 1);
+	timing->method_name = g_strdup (g_dbus_method_invocation_get_method_name (invocation));
+	timing->start = g_get_monotonic_time ();
+	g_object_weak_ref (G_OBJECT (invocation),
+			   fu_main_method_invocation_finalized_cb,
+			   timing);
+}
+
+typedef struct {
+	FuMainPrivate		*priv;
+	GDBusMethodInvocation	*invocation;
+} FuMainMethodHelper;
+
+static void
+fu_main_method_helper_free (FuMainMethodHelper *helper)
+{
+	g_object_unref (helper->invocation);
+	g_free (helper);
+}
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunused-function"
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(FuMainMethodHelper, fu_main_method_helper_free)
+#pragma clang diagnostic pop
+
+static FuMainMethodHelper *
+fu_main_method_helper_new (FuMainPrivate *priv, GDBusMethodInvocation *invocation)
+{
+	FuMainMethodHelper *helper = g_new0 (FuMainMethodHelper, 1);
+	helper->priv = priv;
+	helper->invocation = g_object_ref (invocation);
+	return helper;
+}
+
+static void
+fu_main_get_details_cb (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+	g_autoptr(FuMainMethodHelper) helper = (FuMainMethodHelper *) user_data;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GPtrArray) results = NULL;
+
+	results = fu_engine_get_details_finish (FU_ENGINE (source), res, &error);
+	if (results == NULL) {
+		g_dbus_method_invocation_return_gerror (helper->invocation, error);
+		return;
+	}
+	g_dbus_method_invocation_return_value (helper->invocation,
+					       fu_main_result_array_to_variant (results));
+}
+
 static void
 fu_main_daemon_method_call (GDBusConnection *connection, const gchar *sender,
 			    const gchar *object_path, const gchar *interface_name,
@@ -972,6 +1136,8 @@ fu_main_daemon_method_call (GDBusConnection *connection, const gchar *sender,
 
 	/* activity */
 	fu_engine_idle_reset (priv->engine);
+	fu_main_client_add (priv, sender);
+	fu_main_method_invocation_add_timing (invocation);
 
 	if (g_strcmp0 (method_name, "GetDevices") == 0) {
 		g_autoptr(GPtrArray) devices = NULL;
@@ -1039,6 +1205,27 @@ fu_main_daemon_method_call (GDBusConnection *connection, const gchar *sender,
 						       g_variant_new_tuple (&val, 1));
 		return;
 	}
+	if (g_strcmp0 (method_name, "GetMetrics") == 0) {
+		GHashTableIter iter;
+		GVariantBuilder builder;
+		const gchar *key;
+		const gchar *value;
+		g_autoptr(GHashTable) metrics = fu_metrics_get_all ();
+
+		g_debug ("Called %s()", method_name);
+		g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{ss}"));
+		g_hash_table_iter_init (&iter, metrics);
+		while (g_hash_table_iter_next (&iter,
+					       (gpointer *) &key,
+					       (gpointer *) &value)) {
+			g_variant_builder_add_value (&builder,
+						     g_variant_new ("{ss}", key, value));
+		}
+		val = g_variant_builder_end (&builder);
+		g_dbus_method_invocation_return_value (invocation,
+						       g_variant_new_tuple (&val, 1));
+		return;
+	}
 	if (g_strcmp0 (method_name, "GetReportMetadata") == 0) {
 		GHashTableIter iter;
 		GVariantBuilder builder;
@@ -1215,6 +1402,34 @@ fu_main_daemon_method_call (GDBusConnection *connection, const gchar *sender,
 		g_dbus_method_invocation_return_value (invocation, val);
 		return;
 	}
+	if (g_strcmp0 (method_name, "GetDevicesWithReleases") == 0) {
+		guint32 kind = 0;
+		g_autoptr(GPtrArray) devices = NULL;
+		g_variant_get (parameters, "(u)", &kind);
+		g_debug ("Called %s(%u)", method_name, kind);
+		if (kind >= FWUPD_RELEASE_KIND_LAST) {
+			g_set_error (&error,
+				     FWUPD_ERROR,
+				     FWUPD_ERROR_INVALID_ARGS,
+				     "invalid release kind %u",
+				     kind);
+			g_dbus_method_invocation_return_gerror (invocation, error);
+			return;
+		}
+		devices = fu_engine_get_devices_with_releases (priv->engine, request,
+							       kind, &error);
+		if (devices == NULL) {
+			g_dbus_method_invocation_return_gerror (invocation, error);
+			return;
+		}
+		val = fu_main_device_array_to_variant (priv, request, devices, &error);
+		if (val == NULL) {
+			g_dbus_method_invocation_return_gerror (invocation, error);
+			return;
+		}
+		g_dbus_method_invocation_return_value (invocation, val);
+		return;
+	}
 	if (g_strcmp0 (method_name, "GetRemotes") == 0) {
 		g_autoptr(GPtrArray) remotes = NULL;
 		g_debug ("Called %s()", method_name);
@@ -1309,6 +1524,7 @@ fu_main_daemon_method_call (GDBusConnection *connection, const gchar *sender,
 		const gchar *remote_id = NULL;
 		gint fd_data;
 		gint fd_sig;
+		g_autoptr(FuMainAuthHelper) helper = NULL;
 
 		g_variant_get (parameters, "(&shh)", &remote_id, &fd_data, &fd_sig);
 		g_debug ("Called %s(%s,%i,%i)", method_name, remote_id, fd_data, fd_sig);
@@ -1335,14 +1551,15 @@ fu_main_daemon_method_call (GDBusConnection *connection, const gchar *sender,
 			return;
 		}
 
-		/* store new metadata (will close the fds when done) */
-		if (!fu_engine_update_metadata (priv->engine, remote_id,
-						fd_data, fd_sig, &error)) {
-			g_prefix_error (&error, "Failed to update metadata for %s: ", remote_id);
-			g_dbus_method_invocation_return_gerror (invocation, error);
-			return;
-		}
-		g_dbus_method_invocation_return_value (invocation, NULL);
+		/* store new metadata (will close the fds when done), and keep
+		 * answering other requests while the silo is rebuilt */
+		helper = g_new0 (FuMainAuthHelper, 1);
+		helper->invocation = g_object_ref (invocation);
+		helper->remote_id = g_strdup (remote_id);
+		fu_engine_update_metadata_async (priv->engine, remote_id,
+						 fd_data, fd_sig, NULL,
+						 fu_main_update_metadata_cb,
+						 g_steal_pointer (&helper));
 		return;
 	}
 	if (g_strcmp0 (method_name, "Unlock") == 0) {
@@ -1636,14 +1853,16 @@ fu_main_daemon_method_call (GDBusConnection *connection, const gchar *sender,
 			return;
 		}
 
-		/* install all the things in the store */
+		/* install all the things in the store once the archive has
+		 * been parsed in a thread */
 #ifdef HAVE_POLKIT
 		helper->subject = polkit_system_bus_name_new (sender);
 #endif /* HAVE_POLKIT */
-		if (!fu_main_install_with_helper (g_steal_pointer (&helper), &error)) {
-			g_dbus_method_invocation_return_gerror (invocation, error);
-			return;
-		}
+		fu_engine_get_silo_from_blob_async (priv->engine,
+						    helper->blob_cab,
+						    fu_main_client_get_cancellable (priv, sender),
+						    fu_main_install_silo_cb,
+						    g_steal_pointer (&helper));
 
 		/* async return */
 		return;
@@ -1653,7 +1872,6 @@ fu_main_daemon_method_call (GDBusConnection *connection, const gchar *sender,
 		GUnixFDList *fd_list;
 		gint32 fd_handle = 0;
 		gint fd;
-		g_autoptr(GPtrArray) results = NULL;
 
 		/* get parameters */
 		g_variant_get (parameters, "(h)", &fd_handle);
@@ -1677,13 +1895,10 @@ fu_main_daemon_method_call (GDBusConnection *connection, const gchar *sender,
 		}
 
 		/* get details about the file (will close the fd when done) */
-		results = fu_engine_get_details (priv->engine, request, fd, &error);
-		if (results == NULL) {
-			g_dbus_method_invocation_return_gerror (invocation, error);
-			return;
-		}
-		val = fu_main_result_array_to_variant (results);
-		g_dbus_method_invocation_return_value (invocation, val);
+		fu_engine_get_details_async (priv->engine, request, fd,
+					     fu_main_client_get_cancellable (priv, sender),
+					     fu_main_get_details_cb,
+					     fu_main_method_helper_new (priv, invocation));
 		return;
 	}
 	g_set_error (&error,
@@ -1749,6 +1964,10 @@ fu_main_on_bus_acquired_cb (GDBusConnection *connection,
 	};
 
 	priv->connection = g_object_ref (connection);
+
+	/* no clients are connected yet */
+	fu_poll_scheduler_set_suspended (TRUE);
+
 	registration_id = g_dbus_connection_register_object (connection,
 							     FWUPD_DBUS_PATH,
 							     priv->introspection_daemon->interfaces[0],
@@ -1880,6 +2099,8 @@ static void
 fu_main_private_free (FuMainPrivate *priv)
 {
 	g_hash_table_unref (priv->sender_features);
+	g_hash_table_unref (priv->clients);
+	g_hash_table_unref (priv->client_cancellables);
 	if (priv->loop != NULL)
 		g_main_loop_unref (priv->loop);
 	if (priv->owner_id > 0)
@@ -1952,6 +2173,10 @@ main (int argc, char *argv[])
 	/* create new objects */
 	priv = g_new0 (FuMainPrivate, 1);
 	priv->sender_features = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+	priv->clients = g_hash_table_new_full (g_str_hash, g_str_equal,
+					       g_free, fu_main_client_unwatch);
+	priv->client_cancellables = g_hash_table_new_full (g_str_hash, g_str_equal,
+							   g_free, g_object_unref);
 	priv->loop = g_main_loop_new (NULL, FALSE);
 
 	/* load engine */
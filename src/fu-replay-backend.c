@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2021 Richard Hughes <richard@hughsie.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1+
+ */
+
+#define G_LOG_DOMAIN				"FuBackend"
+
+#include "config.h"
+
+#include "fwupd-error.h"
+
+#include "fu-io-trace.h"
+#include "fu-replay-backend.h"
+#include "fu-udev-device.h"
+
+struct _FuReplayBackend {
+	FuBackend		 parent_instance;
+	guint			 poll_id;
+};
+
+G_DEFINE_TYPE (FuReplayBackend, fu_replay_backend, FU_TYPE_BACKEND)
+
+/* how often to check for devices that were hotplugged while recording */
+#define FU_REPLAY_BACKEND_POLL_INTERVAL		50 /* ms */
+
+static void
+fu_replay_backend_add_devices (FuReplayBackend *self)
+{
+	while (TRUE) {
+		g_autoptr(FuDevice) device = NULL;
+		g_autoptr(GError) error_local = NULL;
+
+		device = fu_io_trace_replay_next_device (&error_local);
+		if (device == NULL) {
+			if (error_local == NULL)
+				break;
+			g_warning ("failed to replay device: %s", error_local->message);
+			continue;
+		}
+		fu_backend_device_added (FU_BACKEND (self), device);
+	}
+}
+
+static gboolean
+fu_replay_backend_poll_cb (gpointer user_data)
+{
+	FuReplayBackend *self = FU_REPLAY_BACKEND (user_data);
+	if (fu_io_trace_get_mode () != FU_IO_TRACE_MODE_REPLAY) {
+		self->poll_id = 0;
+		return G_SOURCE_REMOVE;
+	}
+	fu_replay_backend_add_devices (self);
+	return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+fu_replay_backend_setup (FuBackend *backend, GError **error)
+{
+	if (fu_io_trace_get_mode () != FU_IO_TRACE_MODE_REPLAY) {
+		g_set_error_literal (error,
+				     FWUPD_ERROR,
+				     FWUPD_ERROR_NOT_SUPPORTED,
+				     "not replaying an I/O trace");
+		return FALSE;
+	}
+
+	/* the recorded devices are created by GType name */
+	g_type_ensure (FU_TYPE_UDEV_DEVICE);
+	return TRUE;
+}
+
+static gboolean
+fu_replay_backend_coldplug (FuBackend *backend, GError **error)
+{
+	FuReplayBackend *self = FU_REPLAY_BACKEND (backend);
+
+	/* each device is set up by the plugin before the next is added, which
+	 * consumes the transactions in the order they were recorded */
+	fu_replay_backend_add_devices (self);
+
+	/* devices that were replugged during the update */
+	if (self->poll_id == 0) {
+		self->poll_id = g_timeout_add (FU_REPLAY_BACKEND_POLL_INTERVAL,
+					       fu_replay_backend_poll_cb, self);
+	}
+	return TRUE;
+}
+
+static void
+fu_replay_backend_finalize (GObject *object)
+{
+	FuReplayBackend *self = FU_REPLAY_BACKEND (object);
+	if (self->poll_id != 0)
+		g_source_remove (self->poll_id);
+	G_OBJECT_CLASS (fu_replay_backend_parent_class)->finalize (object);
+}
+
+static void
+fu_replay_backend_init (FuReplayBackend *self)
+{
+}
+
+static void
+fu_replay_backend_class_init (FuReplayBackendClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+	FuBackendClass *klass_backend = FU_BACKEND_CLASS (klass);
+	object_class->finalize = fu_replay_backend_finalize;
+	klass_backend->setup = fu_replay_backend_setup;
+	klass_backend->coldplug = fu_replay_backend_coldplug;
+}
+
+FuBackend *
+fu_replay_backend_new (void)
+{
+	return FU_BACKEND (g_object_new (FU_TYPE_REPLAY_BACKEND, "name", "replay", NULL));
+}
@@ -0,0 +1,14 @@
+/*
+ * Copyright (C) 2021 Richard Hughes <richard@hughsie.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1+
+ */
+
+#pragma once
+
+#include "fu-backend.h"
+
+#define FU_TYPE_REPLAY_BACKEND (fu_replay_backend_get_type ())
+G_DECLARE_FINAL_TYPE (FuReplayBackend, fu_replay_backend, FU, REPLAY_BACKEND, FuBackend)
+
+FuBackend	*fu_replay_backend_new		(void);
@@ -10,6 +10,7 @@
 #include <fwupd.h>
 #include <fwupdplugin.h>
 #include <glib-object.h>
+#include <fcntl.h>
 #include <glib/gstdio.h>
 #include <libgcab.h>
 #include <stdlib.h>
@@ -153,6 +154,248 @@ fu_engine_generate_md_func (gconstpointer user_data)
 	g_assert_cmpstr (tmp, ==, NULL);
 }
 
+static void
+fu_engine_reload_metadata_cb (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+	gboolean *ret = (gboolean *) user_data;
+	g_autoptr(GError) error = NULL;
+	*ret = fu_engine_reload_metadata_finish (FU_ENGINE (source), res, &error);
+	g_assert_no_error (error);
+	fu_test_loop_quit ();
+}
+
+static void
+fu_engine_reload_metadata_func (gconstpointer user_data)
+{
+	gboolean ret;
+	guint64 generation;
+	g_autofree gchar *filename = NULL;
+	g_autoptr(FuDevice) device = fu_device_new ();
+	g_autoptr(FuEngine) engine = fu_engine_new (FU_APP_FLAGS_NONE);
+	g_autoptr(GBytes) data = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GHashTable) metrics = NULL;
+	g_autoptr(XbNode) component = NULL;
+
+	/* put cab file somewhere we can parse it */
+	filename = g_build_filename (TESTDATADIR_DST, "colorhug", "colorhug-als-3.0.2.cab", NULL);
+	data = fu_common_get_contents_bytes (filename, &error);
+	g_assert_no_error (error);
+	g_assert_nonnull (data);
+	ret = fu_common_set_contents_bytes ("/tmp/fwupd-self-test/var/cache/fwupd/foo.cab",
+					    data, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	ret = fu_engine_load (engine, FU_ENGINE_LOAD_FLAG_REMOTES, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	generation = fu_engine_get_silo_generation (engine);
+	g_assert_cmpint (generation, >, 0);
+	fu_device_add_guid (device, "12345678-1234-1234-1234-123456789012");
+
+	/* the old silo is still used while compiling */
+	fu_metrics_reset ();
+	ret = FALSE;
+	fu_engine_reload_metadata_async (engine, NULL, fu_engine_reload_metadata_cb, &ret);
+	g_assert_cmpint (fu_engine_get_silo_generation (engine), ==, generation);
+	component = fu_engine_get_component_by_guids (engine, device);
+	g_assert_nonnull (component);
+	g_clear_object (&component);
+	fu_test_loop_run_with_timeout (5000);
+	g_assert_true (ret);
+
+	/* swapped in */
+	g_assert_cmpint (fu_engine_get_silo_generation (engine), ==, generation + 1);
+	component = fu_engine_get_component_by_guids (engine, device);
+	g_assert_nonnull (component);
+	metrics = fu_metrics_get_all ();
+	g_assert_cmpstr (g_hash_table_lookup (metrics, "engine.metadata-compile.count"), ==, "1");
+	g_assert_cmpstr (g_hash_table_lookup (metrics, "engine.metadata-blocked.count"), ==, "1");
+	g_debug ("main thread blocked for %sus of %sus",
+		 (const gchar *) g_hash_table_lookup (metrics, "engine.metadata-blocked.total-us"),
+		 (const gchar *) g_hash_table_lookup (metrics, "engine.metadata-compile.total-us"));
+}
+
+static void
+fu_engine_get_details_cb (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+	GPtrArray **results = (GPtrArray **) user_data;
+	g_autoptr(GError) error = NULL;
+	*results = fu_engine_get_details_finish (FU_ENGINE (source), res, &error);
+	g_assert_no_error (error);
+	fu_test_loop_quit ();
+}
+
+static void
+fu_engine_get_details_async_func (gconstpointer user_data)
+{
+	gboolean ret;
+	gint fd;
+	FuDevice *device_tmp;
+	g_autofree gchar *filename = NULL;
+	g_autoptr(FuEngine) engine = fu_engine_new (FU_APP_FLAGS_NONE);
+	g_autoptr(FuEngineRequest) request = fu_engine_request_new ();
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GPtrArray) results = NULL;
+
+	ret = fu_engine_load (engine, FU_ENGINE_LOAD_FLAG_NONE, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+
+	/* the archive is parsed in a thread */
+	filename = g_build_filename (TESTDATADIR_DST, "colorhug", "colorhug-als-3.0.2.cab", NULL);
+	fd = g_open (filename, O_RDONLY, 0);
+	g_assert_cmpint (fd, >, 0);
+	fu_engine_get_details_async (engine, request, fd, NULL,
+				     fu_engine_get_details_cb, &results);
+	fu_test_loop_run_with_timeout (5000);
+	g_assert_nonnull (results);
+	g_assert_cmpint (results->len, ==, 1);
+	device_tmp = g_ptr_array_index (results, 0);
+	g_assert_cmpstr (fwupd_release_get_version (fu_device_get_release_default (device_tmp)), ==, "3.0.2");
+	g_assert_cmpint (fu_engine_get_status (engine), ==, FWUPD_STATUS_IDLE);
+}
+
+static void
+fu_engine_get_details_cancelled_cb (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+	GError **error = (GError **) user_data;
+	g_autoptr(GPtrArray) results = NULL;
+	results = fu_engine_get_details_finish (FU_ENGINE (source), res, error);
+	g_assert_null (results);
+	fu_test_loop_quit ();
+}
+
+static void
+fu_engine_get_details_cancelled_func (gconstpointer user_data)
+{
+	gboolean ret;
+	gint fd;
+	g_autofree gchar *filename = NULL;
+	g_autoptr(FuEngine) engine = fu_engine_new (FU_APP_FLAGS_NONE);
+	g_autoptr(FuEngineRequest) request = fu_engine_request_new ();
+	g_autoptr(GCancellable) cancellable = g_cancellable_new ();
+	g_autoptr(GError) error = NULL;
+
+	ret = fu_engine_load (engine, FU_ENGINE_LOAD_FLAG_NONE, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+
+	/* the client disconnects before the archive has been matched to devices */
+	filename = g_build_filename (TESTDATADIR_DST, "colorhug", "colorhug-als-3.0.2.cab", NULL);
+	fd = g_open (filename, O_RDONLY, 0);
+	g_assert_cmpint (fd, >, 0);
+	fu_engine_get_details_async (engine, request, fd, cancellable,
+				     fu_engine_get_details_cancelled_cb, &error);
+	g_assert_cmpint (fu_engine_get_status (engine), ==, FWUPD_STATUS_DECOMPRESSING);
+	g_cancellable_cancel (cancellable);
+	fu_test_loop_run_with_timeout (5000);
+	g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+	g_assert_cmpint (fu_engine_get_status (engine), ==, FWUPD_STATUS_IDLE);
+}
+
+static FuPlugin *
+fu_test_engine_get_plugin (FuEngine *engine, const gchar *name)
+{
+	GPtrArray *plugins = fu_engine_get_plugins (engine);
+	for (guint i = 0; i < plugins->len; i++) {
+		FuPlugin *plugin = g_ptr_array_index (plugins, i);
+		if (g_strcmp0 (fu_plugin_get_name (plugin), name) == 0)
+			return plugin;
+	}
+	return NULL;
+}
+
+static void
+fu_engine_plugin_deferred_func (gconstpointer user_data)
+{
+	FuPlugin *plugin;
+	gboolean ret;
+	const gchar *plugindir = "/tmp/fwupd-self-test/plugins";
+	g_autofree gchar *fn_manifest = NULL;
+	g_autofree gchar *fn_plugin = NULL;
+	g_autofree gchar *pluginfn = NULL;
+	g_autoptr(FuBackend) backend = g_object_new (FU_TYPE_BACKEND, "name", "test", NULL);
+	g_autoptr(FuDevice) device1 = fu_device_new ();
+	g_autoptr(FuDevice) device2 = fu_device_new ();
+	g_autoptr(FuDevice) device_fake = fu_device_new ();
+	g_autoptr(FuDevice) device_tmp = NULL;
+	g_autoptr(FuEngine) engine = fu_engine_new (FU_APP_FLAGS_NONE);
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GFile) file_plugin = NULL;
+	g_autoptr(GPtrArray) devices = NULL;
+
+	/* only load the test plugin when a specific USB device is present */
+	fu_self_test_mkroot ();
+	g_assert_cmpint (g_mkdir_with_parents (plugindir, 0755), ==, 0);
+	pluginfn = g_build_filename (PLUGINBUILDDIR,
+				     "libfu_plugin_test." G_MODULE_SUFFIX,
+				     NULL);
+	fn_plugin = g_build_filename (plugindir,
+				      "libfu_plugin_test." G_MODULE_SUFFIX,
+				      NULL);
+	file_plugin = g_file_new_for_path (fn_plugin);
+	ret = g_file_make_symbolic_link (file_plugin, pluginfn, NULL, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	fn_manifest = g_build_filename (plugindir, "test.manifest", NULL);
+	ret = g_file_set_contents (fn_manifest,
+				   "[fwupd Plugin]\n"
+				   "UsbIds=USB\\VID_FFFF&PID_FFFF\n",
+				   -1, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+
+	/* the hardware is not present */
+	g_setenv ("FWUPD_PLUGINDIR", plugindir, TRUE);
+	fu_engine_add_backend (engine, backend);
+	ret = fu_engine_load (engine, FU_ENGINE_LOAD_FLAG_COLDPLUG, &error);
+	g_setenv ("FWUPD_PLUGINDIR", TESTDATADIR_SRC, TRUE);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	plugin = fu_test_engine_get_plugin (engine, "test");
+	g_assert_nonnull (plugin);
+	g_assert_false (fu_plugin_is_open (plugin));
+	g_assert_true (fu_plugin_has_flag (plugin, FWUPD_PLUGIN_FLAG_DISABLED));
+	g_assert_true (fu_plugin_has_flag (plugin, FWUPD_PLUGIN_FLAG_NO_HARDWARE));
+	devices = fu_engine_get_devices (engine, &error);
+	g_assert_error (error, FWUPD_ERROR, FWUPD_ERROR_NOTHING_TO_DO);
+	g_assert_null (devices);
+	g_clear_error (&error);
+
+	/* a device that does not match */
+	fu_device_set_id (device1, "device1");
+	fu_device_set_backend_id (device1, "/dev/test1");
+	fu_device_add_instance_id (device1, "USB\\VID_FFFF&PID_0000");
+	fu_backend_device_added (backend, device1);
+	while (g_main_context_iteration (NULL, FALSE));
+	g_assert_false (fu_plugin_is_open (plugin));
+
+	/* the USB ID matches, but the plugin is not opened from the signal */
+	fu_device_set_id (device2, "device2");
+	fu_device_set_backend_id (device2, "/dev/test2");
+	fu_device_add_instance_id (device2, "USB\\VID_FFFF&PID_FFFF");
+	fu_device_add_guid (device2, "2082b5e0-7a64-478a-b1b2-e3404fab6dad");
+	fu_device_add_possible_plugin (device2, "test");
+	fu_backend_device_added (backend, device2);
+	g_assert_false (fu_plugin_is_open (plugin));
+
+	/* opened, coldplugged and then given the device it missed */
+	while (g_main_context_iteration (NULL, FALSE));
+	g_assert_true (fu_plugin_is_open (plugin));
+	g_assert_false (fu_plugin_has_flag (plugin, FWUPD_PLUGIN_FLAG_DISABLED));
+	g_assert_false (fu_plugin_has_flag (plugin, FWUPD_PLUGIN_FLAG_NO_HARDWARE));
+	fu_device_set_id (device_fake, "FakeDevice");
+	device_tmp = fu_engine_get_device (engine, fu_device_get_id (device_fake), &error);
+	g_assert_no_error (error);
+	g_assert_nonnull (device_tmp);
+	g_clear_object (&device_tmp);
+	device_tmp = fu_engine_get_device (engine, fu_device_get_id (device2), &error);
+	g_assert_no_error (error);
+	g_assert_nonnull (device_tmp);
+	g_assert_cmpstr (fu_device_get_plugin (device_tmp), ==, "test");
+}
+
 static void
 fu_plugin_hash_func (gconstpointer user_data)
 {
@@ -1178,6 +1421,7 @@ static void
 fu_engine_downgrade_func (gconstpointer user_data)
 {
 	FwupdRelease *rel;
+	FwupdDevice *dev;
 	gboolean ret;
 	g_autoptr(FuDevice) device = fu_device_new ();
 	g_autoptr(FuEngine) engine = fu_engine_new (FU_APP_FLAGS_NONE);
@@ -1185,6 +1429,7 @@ fu_engine_downgrade_func (gconstpointer user_data)
 	g_autoptr(GError) error = NULL;
 	g_autoptr(GPtrArray) devices = NULL;
 	g_autoptr(GPtrArray) devices_pre = NULL;
+	g_autoptr(GPtrArray) devices_rel = NULL;
 	g_autoptr(GPtrArray) releases_dg = NULL;
 	g_autoptr(GPtrArray) releases = NULL;
 	g_autoptr(GPtrArray) releases_up = NULL;
@@ -1351,6 +1596,32 @@ fu_engine_downgrade_func (gconstpointer user_data)
 	g_assert_cmpint (releases_dg->len, ==, 1);
 	rel = FWUPD_RELEASE (g_ptr_array_index (releases_dg, 0));
 	g_assert_cmpstr (fwupd_release_get_version (rel), ==, "1.2.2");
+
+	/* all devices with the same upgrades in one call */
+	devices_rel = fu_engine_get_devices_with_releases (engine,
+							   request,
+							   FWUPD_RELEASE_KIND_UPGRADES,
+							   &error);
+	g_assert_no_error (error);
+	g_assert_nonnull (devices_rel);
+	g_assert_cmpint (devices_rel->len, ==, 1);
+	dev = g_ptr_array_index (devices_rel, 0);
+	g_assert_cmpstr (fwupd_device_get_id (dev), ==, fu_device_get_id (device));
+	g_assert_cmpint (fwupd_device_get_releases (dev)->len, ==, 2);
+	rel = fwupd_device_get_release_default (dev);
+	g_assert_cmpstr (fwupd_release_get_version (rel), ==, "1.2.5");
+	g_ptr_array_unref (devices_rel);
+	devices_rel = fu_engine_get_devices_with_releases (engine,
+							   request,
+							   FWUPD_RELEASE_KIND_DOWNGRADES,
+							   &error);
+	g_assert_no_error (error);
+	g_assert_nonnull (devices_rel);
+	dev = g_ptr_array_index (devices_rel, 0);
+	g_assert_cmpint (fwupd_device_get_releases (dev)->len, ==, 1);
+
+	/* the releases were not added to the daemon device */
+	g_assert_cmpint (fwupd_device_get_releases (FWUPD_DEVICE (device))->len, ==, 0);
 }
 
 static void
@@ -3131,6 +3402,14 @@ main (int argc, char **argv)
 			      fu_engine_install_duration_func);
 	g_test_add_data_func ("/fwupd/engine{generate-md}", self,
 			      fu_engine_generate_md_func);
+	g_test_add_data_func ("/fwupd/engine{reload-metadata}", self,
+			      fu_engine_reload_metadata_func);
+	g_test_add_data_func ("/fwupd/engine{get-details-async}", self,
+			      fu_engine_get_details_async_func);
+	g_test_add_data_func ("/fwupd/engine{get-details-cancelled}", self,
+			      fu_engine_get_details_cancelled_func);
+	g_test_add_data_func ("/fwupd/engine{plugin-deferred}", self,
+			      fu_engine_plugin_deferred_func);
 	g_test_add_data_func ("/fwupd/engine{requirements-other-device}", self,
 			      fu_engine_requirements_other_device_func);
 	g_test_add_data_func ("/fwupd/plugin{composite}", self,
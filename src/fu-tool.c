@@ -2039,11 +2039,15 @@ fu_util_firmware_extract (FuUtilPrivate *priv, gchar **values, GError **error)
 		return FALSE;
 	}
 	firmware = g_object_new (gtype, NULL);
-	if (!fu_firmware_parse (firmware, blob, priv->flags, error))
+	if (!fu_firmware_parse (firmware, blob,
+				priv->flags | FWUPD_INSTALL_FLAG_LAZY_PARSE,
+				error))
 		return FALSE;
 	str = fu_firmware_to_string (firmware);
 	g_print ("%s", str);
-	images = fu_firmware_get_images (firmware);
+	images = fu_firmware_get_images_full (firmware, error);
+	if (images == NULL)
+		return FALSE;
 	for (guint i = 0; i < images->len; i++) {
 		FuFirmware *img = g_ptr_array_index (images, i);
 		g_autofree gchar *fn = NULL;
@@ -2790,12 +2794,15 @@ main (int argc, char *argv[])
 	gboolean ignore_power = FALSE;
 	gboolean ignore_vid_pid = FALSE;
 	gboolean interactive = isatty (fileno (stdout)) != 0;
+	gdouble replay_speed = 1.f;
 	g_auto(GStrv) plugin_glob = NULL;
 	g_autoptr(FuUtilPrivate) priv = g_new0 (FuUtilPrivate, 1);
 	g_autoptr(GError) error = NULL;
 	g_autoptr(GPtrArray) cmd_array = fu_util_cmd_array_new ();
 	g_autofree gchar *cmd_descriptions = NULL;
 	g_autofree gchar *filter = NULL;
+	g_autofree gchar *record_io = NULL;
+	g_autofree gchar *replay_io = NULL;
 	const GOptionEntry options[] = {
 		{ "version", '\0', 0, G_OPTION_ARG_NONE, &version,
 			/* TRANSLATORS: command line option */
@@ -2855,6 +2862,15 @@ main (int argc, char *argv[])
 			/* TRANSLATORS: command line option */
 			_("Filter with a set of device flags using a ~ prefix to "
 			  "exclude, e.g. 'internal,~needs-reboot'"), NULL },
+		{ "record-io", '\0', 0, G_OPTION_ARG_FILENAME, &record_io,
+			/* TRANSLATORS: command line option */
+			_("Save all device transactions to a trace file"), NULL },
+		{ "replay-io", '\0', 0, G_OPTION_ARG_FILENAME, &replay_io,
+			/* TRANSLATORS: command line option */
+			_("Answer device transactions from a trace file rather than the hardware"), NULL },
+		{ "replay-speed", '\0', 0, G_OPTION_ARG_DOUBLE, &replay_speed,
+			/* TRANSLATORS: command line option */
+			_("Speed to replay the trace file, or 0 for no delays"), NULL },
 		{ NULL}
 	};
 
@@ -3247,8 +3263,32 @@ main (int argc, char *argv[])
 	for (guint i = 0; plugin_glob != NULL && plugin_glob[i] != NULL; i++)
 		fu_engine_add_plugin_filter (priv->engine, plugin_glob[i]);
 
+	/* record or replay device I/O */
+	if (record_io != NULL && replay_io != NULL) {
+		/* TRANSLATORS: the user didn't read the man page */
+		g_print ("%s\n", _("--record-io and --replay-io cannot be used together"));
+		return EXIT_FAILURE;
+	}
+	if (record_io != NULL) {
+		if (!fu_io_trace_record_start (record_io, &error)) {
+			g_printerr ("%s\n", error->message);
+			return EXIT_FAILURE;
+		}
+	}
+	if (replay_io != NULL) {
+		if (!fu_io_trace_replay_start (replay_io, replay_speed, &error)) {
+			g_printerr ("%s\n", error->message);
+			return EXIT_FAILURE;
+		}
+	}
+
 	/* run the specified command */
 	ret = fu_util_cmd_array_run (cmd_array, priv, argv[1], (gchar**) &argv[2], &error);
+	if (record_io != NULL || replay_io != NULL) {
+		g_autoptr(GError) error_local = NULL;
+		if (!fu_io_trace_stop (&error_local))
+			g_warning ("failed to stop I/O trace: %s", error_local->message);
+	}
 	if (!ret) {
 		g_printerr ("%s\n", error->message);
 		if (g_error_matches (error, FWUPD_ERROR, FWUPD_ERROR_INVALID_ARGS)) {
@@ -1411,15 +1411,35 @@ fu_util_get_updates (FuUtilPrivate *priv, gchar **values, GError **error)
 
 	/* handle both forms */
 	if (g_strv_length (values) == 0) {
-		devices = fwupd_client_get_devices (priv->client, NULL, error);
+		devices = fwupd_client_get_devices_with_releases (priv->client,
+								  FWUPD_RELEASE_KIND_UPGRADES,
+								  NULL, error);
 		if (devices == NULL)
 			return FALSE;
 	} else if (g_strv_length (values) == 1) {
 		FwupdDevice *device = fu_util_get_device_by_id (priv, values[0], error);
+		g_autoptr(GPtrArray) rels = NULL;
+		g_autoptr(GError) error_local = NULL;
 		if (device == NULL)
 			return FALSE;
 		devices = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
 		g_ptr_array_add (devices, device);
+
+		/* get the releases for this device and filter for validity */
+		if (fwupd_device_has_flag (device, FWUPD_DEVICE_FLAG_UPDATABLE) &&
+		    fwupd_device_has_flag (device, FWUPD_DEVICE_FLAG_SUPPORTED)) {
+			rels = fwupd_client_get_upgrades (priv->client,
+							  fwupd_device_get_id (device),
+							  NULL, &error_local);
+			if (rels == NULL) {
+				g_debug ("%s", error_local->message);
+			} else {
+				for (guint j = 0; j < rels->len; j++) {
+					FwupdRelease *rel = g_ptr_array_index (rels, j);
+					fwupd_device_add_release (device, rel);
+				}
+			}
+		}
 	} else {
 		g_set_error_literal (error,
 				     FWUPD_ERROR,
@@ -1430,8 +1450,7 @@ fu_util_get_updates (FuUtilPrivate *priv, gchar **values, GError **error)
 	g_ptr_array_sort (devices, fu_util_sort_devices_by_flags_cb);
 	for (guint i = 0; i < devices->len; i++) {
 		FwupdDevice *dev = g_ptr_array_index (devices, i);
-		g_autoptr(GPtrArray) rels = NULL;
-		g_autoptr(GError) error_local = NULL;
+		GPtrArray *rels = fwupd_device_get_releases (dev);
 		GNode *child;
 
 		/* not going to have results, so save a D-Bus round-trip */
@@ -1450,19 +1469,14 @@ fu_util_get_updates (FuUtilPrivate *priv, gchar **values, GError **error)
 			continue;
 		supported = TRUE;
 
-		/* get the releases for this device and filter for validity */
-		rels = fwupd_client_get_upgrades (priv->client,
-						  fwupd_device_get_id (dev),
-						  NULL, &error_local);
-		if (rels == NULL) {
+		/* the daemon has already filtered the releases for validity */
+		if (rels->len == 0) {
 			if (!latest_header) {
 				/* TRANSLATORS: message letting the user know no device upgrade available */
 				g_printerr ("%s\n", _("Devices with the latest available firmware version:"));
 				latest_header = TRUE;
 			}
 			g_printerr (" • %s\n", fwupd_device_get_name (dev));
-			/* discard the actual reason from user, but leave for debugging */
-			g_debug ("%s", error_local->message);
 			continue;
 		}
 		child = g_node_append_data (root, dev);
@@ -1579,8 +1593,10 @@ fu_util_update_all (FuUtilPrivate *priv, GError **error)
 	gboolean no_updates_header = FALSE;
 	gboolean latest_header = FALSE;
 
-	/* get devices from daemon */
-	devices = fwupd_client_get_devices (priv->client, NULL, error);
+	/* get devices from daemon, with the releases filtered for validity */
+	devices = fwupd_client_get_devices_with_releases (priv->client,
+							  FWUPD_RELEASE_KIND_UPGRADES,
+							  NULL, error);
 	if (devices == NULL)
 		return FALSE;
 	priv->current_operation = FU_UTIL_OPERATION_UPDATE;
@@ -1590,10 +1606,9 @@ fu_util_update_all (FuUtilPrivate *priv, GError **error)
 	for (guint i = 0; i < devices->len; i++) {
 		FwupdDevice *dev = g_ptr_array_index (devices, i);
 		FwupdRelease *rel;
+		GPtrArray *rels = fwupd_device_get_releases (dev);
 		const gchar *remote_id;
 		g_autofree gchar *upgrade_str = NULL;
-		g_autoptr(GPtrArray) rels = NULL;
-		g_autoptr(GError) error_local = NULL;
 
 		/* not going to have results, so save a D-Bus round-trip */
 		if (!fwupd_device_has_flag (dev, FWUPD_DEVICE_FLAG_UPDATABLE))
@@ -1611,19 +1626,14 @@ fu_util_update_all (FuUtilPrivate *priv, GError **error)
 			continue;
 		supported = TRUE;
 
-		/* get the releases for this device and filter for validity */
-		rels = fwupd_client_get_upgrades (priv->client,
-						  fwupd_device_get_id (dev),
-						  NULL, &error_local);
-		if (rels == NULL) {
+		/* the daemon has already filtered the releases for validity */
+		if (rels->len == 0) {
 			if (!latest_header) {
 				/* TRANSLATORS: message letting the user know no device upgrade available */
 				g_printerr ("%s\n", _("Devices with the latest available firmware version:"));
 				latest_header = TRUE;
 			}
 			g_printerr (" • %s\n", fwupd_device_get_name (dev));
-			/* discard the actual reason from user, but leave for debugging */
-			g_debug ("%s", error_local->message);
 			continue;
 		}
 		rel = g_ptr_array_index (rels, 0);
@@ -2661,6 +2671,36 @@ fu_util_get_blocked_firmware (FuUtilPrivate *priv, gchar **values, GError **erro
 	return TRUE;
 }
 
+static gboolean
+fu_util_get_metrics (FuUtilPrivate *priv, gchar **values, GError **error)
+{
+	g_autoptr(GHashTable) metrics = NULL;
+	g_autoptr(GList) keys = NULL;
+
+	/* get metrics from daemon */
+	metrics = fwupd_client_get_metrics (priv->client, priv->cancellable, error);
+	if (metrics == NULL)
+		return FALSE;
+
+	/* empty list */
+	if (g_hash_table_size (metrics) == 0) {
+		/* TRANSLATORS: nothing to show */
+		g_print ("%s\n", _("No metrics have been recorded"));
+		return TRUE;
+	}
+
+	/* print in a predictable order */
+	keys = g_hash_table_get_keys (metrics);
+	keys = g_list_sort (keys, (GCompareFunc) g_strcmp0);
+	for (GList *l = keys; l != NULL; l = l->next) {
+		const gchar *key = l->data;
+		g_print ("%s: %s\n", key, (const gchar *) g_hash_table_lookup (metrics, key));
+	}
+
+	/* success */
+	return TRUE;
+}
+
 static void
 fu_util_show_plugin_warnings (FuUtilPrivate *priv)
 {
@@ -3023,6 +3063,12 @@ main (int argc, char *argv[])
 		     /* TRANSLATORS: command description */
 		     _("Gets the list of blocked firmware"),
 		     fu_util_get_blocked_firmware);
+	fu_util_cmd_array_add (cmd_array,
+		     "get-metrics",
+		     NULL,
+		     /* TRANSLATORS: command description */
+		     _("Gets the time spent in each plugin and device method"),
+		     fu_util_get_metrics);
 	fu_util_cmd_array_add (cmd_array,
 		     "get-plugins",
 		     NULL,